@@ -0,0 +1,253 @@
+#!/usr/bin/env python3
+"""
+Convert the PNG assets to LZ compressed native images (.lzi)
+
+The pixels are converted to the color format LVGL draws from and
+compressed as an LZ4 block, the format decoded by src/lib/lz_image.c.
+With --bin the uncompressed LVGL binary image (.bin) is written as well,
+the dash_bench image-decode benchmark compares the three files of each
+asset.
+
+With --format a8 the single color images, e.g. the telltales, are written
+as A8 masks and their color is printed, LVGL draws them with the recolor
+of the image. The other images are converted as with --format auto.
+
+usage: convert_lzi.py --input assets [--output out] [--format auto] [--bin]
+"""
+
+import argparse
+import os
+import struct
+import sys
+
+from PIL import Image
+
+try:
+    import lz4.block
+except ImportError:
+    lz4 = None
+
+# lv_color_format_t
+COLOR_FORMATS = {
+    "a8": 0x0E,
+    "rgb565": 0x12,
+    "rgb565a8": 0x14,
+    "argb8888": 0x10,
+}
+
+LZI_MAGIC = b"LZI1"
+LV_IMAGE_HEADER_MAGIC = 0x19
+
+# Same limits as src/lib/lz_codec.c
+MIN_MATCH = 4
+LAST_LITERALS = 5
+MF_LIMIT = 12
+MAX_OFFSET = 65535
+
+# Mean error per channel of the tinted mask, above it the image is not single color
+MASK_MAX_ERROR = 3.0
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description="Convert PNGs to LZ compressed LVGL images")
+    parser.add_argument("--input", required=True, help="directory of the PNG files, walked recursively")
+    parser.add_argument("--output", help="output directory, the input directory by default")
+    parser.add_argument("--format", default="auto", choices=["auto"] + sorted(COLOR_FORMATS),
+                        help="color format, auto: RGB565 when opaque, RGB565A8 otherwise, "
+                             "a8: A8 mask of the single color images, auto for the others")
+    parser.add_argument("--bin", action="store_true", help="also write the uncompressed LVGL .bin image")
+    return parser.parse_args()
+
+
+# ------------------------------------------------------------
+# Pixels
+# ------------------------------------------------------------
+
+def to_mask(rgba):
+    """(tint, A8 mask, mean error) of an image, the tint is the color of mask 255.
+
+    The premultiplied pixels are projected on their mean color, the error is
+    the difference between the pixels and the tinted mask.
+    """
+    pixels = [[rgba[i + c] * rgba[i + 3] / 255 for c in range(3)] for i in range(0, len(rgba), 4)]
+    total = [sum(p[c] for p in pixels) for c in range(3)]
+    norm = sum(v * v for v in total) ** 0.5
+    if norm == 0:
+        return (0, 0, 0), bytes(len(pixels)), 0.0
+
+    axis = [v / norm for v in total]
+    proj = [sum(p[c] * axis[c] for c in range(3)) for p in pixels]
+    top = max(proj)
+
+    # Keep the tint in range, the mask saturates instead
+    scale = min(1.0, 255 / (max(axis) * top))
+    tint = [axis[c] * top * scale for c in range(3)]
+    mask = bytes(min(255, max(0, round(255 * v / (top * scale)))) for v in proj)
+
+    error = sum(abs(p[c] - tint[c] * m / 255) for p, m in zip(pixels, mask) for c in range(3))
+    return tuple(round(v) for v in tint), mask, error / (3 * len(pixels))
+
+
+def to_native(img, fmt):
+    """(color format, stride, planes, tint) of an image, little endian."""
+    img = img.convert("RGBA")
+    w, h = img.size
+    rgba = img.tobytes()
+
+    if fmt == "a8":
+        tint, mask, error = to_mask(rgba)
+        if error <= MASK_MAX_ERROR:
+            return fmt, w, mask, tint
+        fmt = "auto"
+
+    if fmt == "auto":
+        fmt = "rgb565" if all(a == 255 for a in rgba[3::4]) else "rgb565a8"
+
+    if fmt == "argb8888":
+        out = bytearray(len(rgba))
+        out[0::4] = rgba[2::4]
+        out[1::4] = rgba[1::4]
+        out[2::4] = rgba[0::4]
+        out[3::4] = rgba[3::4]
+        return fmt, w * 4, bytes(out), None
+
+    out = bytearray(w * h * 2)
+    for i in range(w * h):
+        r, g, b = rgba[i * 4], rgba[i * 4 + 1], rgba[i * 4 + 2]
+        v = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3)
+        out[i * 2] = v & 0xFF
+        out[i * 2 + 1] = v >> 8
+
+    if fmt == "rgb565a8":
+        out += rgba[3::4]
+
+    return fmt, w * 2, bytes(out), None
+
+
+# ------------------------------------------------------------
+# LZ4 block
+# ------------------------------------------------------------
+
+def put_length(out, n):
+    while n >= 255:
+        out.append(255)
+        n -= 255
+    out.append(n)
+
+
+def put_sequence(out, lit, offset, match_len):
+    ml = match_len - MIN_MATCH if match_len else 0
+    token = (min(len(lit), 15) << 4) | (min(ml, 15) if match_len else 0)
+    out.append(token)
+    if len(lit) >= 15:
+        put_length(out, len(lit) - 15)
+    out += lit
+    if match_len:
+        out += struct.pack("<H", offset)
+        if ml >= 15:
+            put_length(out, ml - 15)
+
+
+def compress(data):
+    """Greedy compressor, the same as lz_compress(), used without the lz4 module."""
+    out = bytearray()
+    table = {}
+    anchor = 0
+    ip = 0
+    n = len(data)
+
+    while ip < n - MF_LIMIT:
+        seq = data[ip:ip + 4]
+        ref = table.get(seq)
+        table[seq] = ip
+
+        if ref is None or ip - ref > MAX_OFFSET:
+            ip += 1
+            continue
+
+        match_len = MIN_MATCH
+        while ip + match_len < n - LAST_LITERALS and data[ref + match_len] == data[ip + match_len]:
+            match_len += 1
+
+        put_sequence(out, data[anchor:ip], ip - ref, match_len)
+        ip += match_len
+        anchor = ip
+
+    put_sequence(out, data[anchor:], 0, 0)
+    return bytes(out)
+
+
+def compress_block(data):
+    if lz4 is not None:
+        return lz4.block.compress(data, mode="high_compression", compression=12, store_size=False)
+    return compress(data)
+
+
+# ------------------------------------------------------------
+# Files
+# ------------------------------------------------------------
+
+def write_lzi(path, cf, w, h, stride, raw):
+    comp = compress_block(raw)
+    with open(path, "wb") as f:
+        f.write(LZI_MAGIC)
+        f.write(struct.pack("<B3xHHIII", cf, w, h, stride, len(raw), len(comp)))
+        f.write(comp)
+    return 24 + len(comp)
+
+
+def write_bin(path, cf, w, h, stride, raw):
+    with open(path, "wb") as f:
+        f.write(struct.pack("<BBHHHHH", LV_IMAGE_HEADER_MAGIC, cf, 0, w, h, stride, 0))
+        f.write(raw)
+    return 12 + len(raw)
+
+
+def main():
+    args = parse_args()
+
+    in_root = os.path.abspath(args.input)
+    out_root = os.path.abspath(args.output or args.input)
+
+    if not os.path.isdir(in_root):
+        sys.exit("Input directory not found: %s" % in_root)
+
+    if lz4 is None:
+        print("lz4 module not found, using the greedy compressor", file=sys.stderr)
+
+    totals = [0, 0, 0, 0]
+    for root, _, files in os.walk(in_root):
+        out_dir = os.path.join(out_root, os.path.relpath(root, in_root))
+
+        for file in sorted(files):
+            if not file.lower().endswith(".png"):
+                continue
+
+            os.makedirs(out_dir, exist_ok=True)
+            in_png = os.path.join(root, file)
+            base = os.path.join(out_dir, os.path.splitext(file)[0])
+
+            img = Image.open(in_png)
+            w, h = img.size
+            fmt, stride, raw, tint = to_native(img, args.format)
+            cf = COLOR_FORMATS[fmt]
+
+            png_size = os.path.getsize(in_png)
+            lzi_size = write_lzi(base + ".lzi", cf, w, h, stride, raw)
+            bin_size = write_bin(base + ".bin", cf, w, h, stride, raw) if args.bin else 0
+
+            totals[0] += 1
+            totals[1] += png_size
+            totals[2] += lzi_size
+            totals[3] += bin_size
+            print("%s: %dx%d %s%s, png %d B, lzi %d B%s" % (os.path.relpath(in_png, in_root), w, h, fmt,
+                                                           " tint 0x%02x%02x%02x" % tint if tint else "", png_size,
+                                                           lzi_size, ", bin %d B" % bin_size if args.bin else ""))
+
+    print("%d images, png %d B, lzi %d B%s" % (totals[0], totals[1], totals[2],
+                                              ", bin %d B" % totals[3] if args.bin else ""))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,1010 @@
+/**
+ * @file dash_bench.c
+ *
+ * Dashboard micro benchmarks
+ *
+ * Each benchmark updates part of the dashboard from a timer and reports
+ * the cost of the update calls, the refresh time and the number of
+ * invalidated pixels per frame.
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#include "lvgl/lvgl.h"
+
+#include "src/lib/simulator_util.h"
+#include "src/lib/perf_stats.h"
+#include "src/lib/glyph_cache.h"
+#include "src/lib/frame_trace.h"
+#include "dash_readout.h"
+#include "dash_telltales.h"
+#include "dash_timeline.h"
+#include "dash_sched.h"
+#include "dash_bench.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/* Update period of the 60 Hz benchmarks */
+#define BENCH_PERIOD_MS 16
+
+/* Position of the speed readout */
+#define SPEED_POS_X 344
+#define SPEED_POS_Y 220
+#define SPEED_DIGITS 3
+#define SPEED_MAX 180
+
+/* Telltale changes */
+#define TELLTALE_PERIOD_MS 250
+
+/* Random delays injected while the startup sequence runs */
+#define JITTER_PERIOD_MS 16
+#define JITTER_RESTART_MS 500
+
+/* Values posted by the simulated DAQ and CPU load stealing the frame budget */
+#define DAQ_PERIOD_MS 5
+#define LOAD_PERIOD_MS 16
+#define LOAD_PHASE_MS 5000
+#define DAQ_RPM_LEDS 90
+#define DAQ_TEMP_LEDS 8
+#define DAQ_FUEL_LEDS 20
+
+/* Size of the TTF text */
+#define TTF_TEXT_SIZE 32
+
+/* Image files decoded, the first pass only warms up the page cache */
+#define DECODE_MAX_ASSETS 256
+#define DECODE_PASSES 5
+
+/* Each telltale is drawn this many times per measure, on a canvas of this size */
+#define TELLTALE_DRAWS 200
+#define TELLTALE_CANVAS_SIZE 64
+
+/* Color of the A8 masks */
+#define TELLTALE_TINT 0xff6c18
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+typedef struct {
+    const char *name;
+    void (*start)(const void *bg_src);
+} bench_t;
+
+typedef struct {
+    uint64_t refr_start_ns;
+    uint64_t flush_start_ns;
+    uint64_t flush_ns;
+    uint64_t inv_px;
+    uint32_t frames;
+    perf_hist_t refr_us;
+    perf_hist_t flush_us;
+    perf_hist_t update_ns;
+} bench_stats_t;
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static void bench_speed_readout(const void *bg_src);
+static void bench_speed_label(const void *bg_src);
+static void speed_readout_cb(lv_timer_t *t);
+static void speed_label_cb(lv_timer_t *t);
+static void bench_telltales(const void *bg_src);
+static void telltales_cb(lv_timer_t *t);
+static void bench_startup_jitter(const void *bg_src);
+static void jitter_cb(lv_timer_t *t);
+static void restart_cb(lv_timer_t *t);
+static void bench_sched_load(const void *bg_src);
+static void speed_apply_cb(int32_t value, void *user_data);
+static void daq_cb(lv_timer_t *t);
+static void load_cb(lv_timer_t *t);
+static void bench_gauge_sweep(const void *bg_src);
+static void gauge_sweep_cb(lv_timer_t *t);
+#if LV_USE_TINY_TTF
+static void bench_ttf_text(const void *bg_src);
+static void first_text_cb(lv_event_t *e);
+#endif
+static void bench_image_decode(const void *bg_src);
+static uint32_t find_assets(const char *dir, char **paths, uint32_t count);
+static bool decode_format(char *const *paths, uint32_t count, const char *ext);
+static void bench_telltale_draw(const void *bg_src);
+static void draw_format(char *const *paths, uint32_t count, const char *ext, lv_obj_t *canvas);
+static void get_assets_dir(const void *bg_src, char *dir, size_t size);
+static int32_t next_speed(void);
+static void stats_attach(const char *name);
+static void display_event_cb(lv_event_t *e);
+static void report_timer_cb(lv_timer_t *t);
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+static const bench_t benches[] = {
+    { "speed-readout", bench_speed_readout },
+    { "speed-label", bench_speed_label },
+    { "telltales", bench_telltales },
+    { "startup-jitter", bench_startup_jitter },
+    { "sched-load", bench_sched_load },
+    { "gauge-sweep", bench_gauge_sweep },
+#if LV_USE_TINY_TTF
+    { "ttf-text", bench_ttf_text },
+#endif
+    { "image-decode", bench_image_decode },
+    { "telltale-draw", bench_telltale_draw },
+};
+
+static const char *bench_name;
+static bench_stats_t stats;
+static int32_t speed;
+static int32_t speed_dir = 1;
+static uint64_t first_text_start_ns;
+static const lv_font_t *ttf_font;
+static lv_obj_t *telltales;
+static uint32_t left_turn_mask;
+static uint32_t right_turn_mask;
+static uint32_t telltale_step;
+static dash_timeline_t *startup;
+static uint32_t jitter_max_ms;
+static dash_sched_t *sched;
+static const char *const daq_names[] = { "telltales", "rpm", "speed", "temp", "fuel" };
+static dash_sched_item_t *daq_items[sizeof(daq_names) / sizeof(daq_names[0])];
+static uint32_t daq_step;
+static uint32_t load_ms;
+static uint64_t load_start_ns;
+static bool full_frame;
+
+LV_FONT_DECLARE(font_speed_32);
+
+/**********************
+ *      MACROS
+ **********************/
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+bool dash_bench_start(const void *bg_src)
+{
+    const char *name = getenv("LV_DASH_BENCH");
+    size_t i;
+
+    if (name == NULL) {
+        return false;
+    }
+
+    for (i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        if (strcmp(benches[i].name, name) == 0) {
+            stats_attach(benches[i].name);
+            benches[i].start(bg_src);
+            return true;
+        }
+    }
+
+    fprintf(stderr, "Unknown benchmark: %s, available: ", name);
+    for (i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        fprintf(stderr, "%s ", benches[i].name);
+    }
+    fprintf(stderr, "\n");
+
+    return false;
+}
+
+void dash_bench_set_telltales(lv_obj_t *obj, uint32_t left_turn, uint32_t right_turn)
+{
+    telltales = obj;
+    left_turn_mask = left_turn;
+    right_turn_mask = right_turn;
+}
+
+void dash_bench_set_startup(dash_timeline_t *timeline)
+{
+    startup = timeline;
+}
+
+void dash_bench_set_sched(dash_sched_t *s)
+{
+    sched = s;
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+/**
+ * 3 digit speed drawn with the pre-rendered readout
+ *
+ * @param bg_src the background
+ */
+static void bench_speed_readout(const void *bg_src)
+{
+    lv_obj_t *readout;
+
+    readout = dash_readout_create(lv_screen_active(), &font_speed_32, SPEED_DIGITS,
+                                  lv_color_hex(0xffffff), bg_src, SPEED_POS_X, SPEED_POS_Y);
+    dash_readout_set_value(readout, 0);
+
+    lv_timer_create(speed_readout_cb, BENCH_PERIOD_MS, readout);
+}
+
+/**
+ * 3 digit speed drawn with a label
+ *
+ * @param bg_src the background
+ */
+static void bench_speed_label(const void *bg_src)
+{
+    lv_obj_t *label;
+
+    LV_UNUSED(bg_src);
+
+    label = lv_label_create(lv_screen_active());
+    lv_obj_set_style_text_font(label, &font_speed_32, 0);
+    lv_obj_set_style_text_color(label, lv_color_hex(0xffffff), 0);
+    lv_obj_set_pos(label, SPEED_POS_X, SPEED_POS_Y);
+    lv_label_set_text(label, "0");
+
+    lv_timer_create(speed_label_cb, BENCH_PERIOD_MS, label);
+}
+
+/**
+ * Telltales switched on and off with the turn signals blinking
+ *
+ * @param bg_src the background
+ */
+static void bench_telltales(const void *bg_src)
+{
+    LV_UNUSED(bg_src);
+
+    if (telltales == NULL) {
+        fprintf(stderr, "telltales: no telltale layer\n");
+        return;
+    }
+
+    lv_timer_create(telltales_cb, TELLTALE_PERIOD_MS, NULL);
+}
+
+/**
+ * Change the static telltales, cycle left, right, hazard and no turn signal
+ *
+ * @param t the update timer
+ */
+static void telltales_cb(lv_timer_t *t)
+{
+    const uint32_t turn[] = { left_turn_mask, right_turn_mask, left_turn_mask | right_turn_mask, 0 };
+    uint32_t on_mask;
+    uint32_t blink_mask;
+    uint64_t start;
+
+    LV_UNUSED(t);
+
+    telltale_step++;
+
+    /* A different set of static telltales on every update */
+    on_mask = ((telltale_step * 2654435761u) >> 22) & ~(left_turn_mask | right_turn_mask);
+    blink_mask = turn[(telltale_step / 8) % 4];
+
+    start = perf_time_ns();
+    dash_telltales_set_mask(telltales, on_mask | blink_mask, blink_mask);
+    perf_hist_add(&stats.update_ns, (uint32_t)(perf_time_ns() - start));
+}
+
+/**
+ * Startup sequence run over and over with random frame delays
+ *
+ * Each run prints the declared and the measured duration of the sequence,
+ * it must end on time whatever the delays.
+ *
+ * @param bg_src the background
+ */
+static void bench_startup_jitter(const void *bg_src)
+{
+    LV_UNUSED(bg_src);
+
+    if (startup == NULL) {
+        fprintf(stderr, "startup-jitter: no startup sequence\n");
+        return;
+    }
+
+    jitter_max_ms = (uint32_t)LV_MAX(atoi(getenv_default("LV_DASH_BENCH_JITTER_MS", "50")), 1);
+
+    dash_timeline_set_report(startup, true);
+    dash_timeline_start(startup, lv_display_get_default());
+
+    lv_timer_create(jitter_cb, JITTER_PERIOD_MS, NULL);
+    lv_timer_create(restart_cb, JITTER_RESTART_MS, NULL);
+}
+
+/**
+ * Block the UI thread for a random time
+ *
+ * @param t the jitter timer
+ */
+static void jitter_cb(lv_timer_t *t)
+{
+    LV_UNUSED(t);
+
+    usleep((useconds_t)(rand() % jitter_max_ms) * 1000);
+}
+
+/**
+ * Start the sequence again once it ended
+ *
+ * @param t the restart timer
+ */
+static void restart_cb(lv_timer_t *t)
+{
+    LV_UNUSED(t);
+
+    if (!dash_timeline_is_running(startup)) {
+        dash_timeline_start(startup, lv_display_get_default());
+    }
+}
+
+/**
+ * Gauges fed by a simulated DAQ while the CPU is overloaded half of the time
+ *
+ * The DAQ posts every value each DAQ_PERIOD_MS. Every other LOAD_PHASE_MS
+ * the UI thread spins LV_DASH_BENCH_LOAD_MS (default 30) every 16 ms: the
+ * low priority classes must be decimated while the safety class is never
+ * late, then restored once the load is gone.
+ *
+ * @param bg_src the background
+ */
+static void bench_sched_load(const void *bg_src)
+{
+    lv_obj_t *readout;
+    uint32_t i;
+
+    if (sched == NULL) {
+        fprintf(stderr, "sched-load: no scheduler\n");
+        return;
+    }
+
+    readout = dash_readout_create(lv_screen_active(), &font_speed_32, SPEED_DIGITS,
+                                  lv_color_hex(0xffffff), bg_src, SPEED_POS_X, SPEED_POS_Y);
+    dash_sched_add(sched, "speed", DASH_SCHED_20HZ, speed_apply_cb, readout);
+
+    for (i = 0; i < sizeof(daq_names) / sizeof(daq_names[0]); i++) {
+        daq_items[i] = dash_sched_find(sched, daq_names[i]);
+        if (daq_items[i] == NULL) {
+            fprintf(stderr, "sched-load: no %s item\n", daq_names[i]);
+            return;
+        }
+    }
+
+    load_ms = (uint32_t)atoi(getenv_default("LV_DASH_BENCH_LOAD_MS", "30"));
+    load_start_ns = perf_time_ns();
+
+    lv_timer_create(daq_cb, DAQ_PERIOD_MS, NULL);
+    lv_timer_create(load_cb, LOAD_PERIOD_MS, NULL);
+}
+
+/**
+ * Apply the speed to the readout
+ *
+ * @param value the speed
+ * @param user_data the readout
+ */
+static void speed_apply_cb(int32_t value, void *user_data)
+{
+    dash_readout_set_value(user_data, value);
+}
+
+/**
+ * Post a new value of every gauge
+ *
+ * @param t the DAQ timer
+ */
+static void daq_cb(lv_timer_t *t)
+{
+    int32_t values[sizeof(daq_names) / sizeof(daq_names[0])];
+    uint64_t start;
+    uint32_t i;
+
+    LV_UNUSED(t);
+
+    daq_step++;
+
+    /* The telltales change every 50 samples, the turn signals are bits 3 and 8 */
+    values[0] = (int32_t)((((daq_step / 50) * 2654435761u) >> 22) & 0x3ff);
+    values[1] = (int32_t)(daq_step % (2 * DAQ_RPM_LEDS));
+    values[1] = values[1] < DAQ_RPM_LEDS ? values[1] : 2 * DAQ_RPM_LEDS - 1 - values[1];
+    values[2] = next_speed();
+    values[3] = (int32_t)((daq_step / 200) % DAQ_TEMP_LEDS);
+    values[4] = (int32_t)(DAQ_FUEL_LEDS - 1 - (daq_step / 100) % DAQ_FUEL_LEDS);
+
+    start = perf_time_ns();
+    FRAME_TRACE_BEGIN("daq_post");
+    for (i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        dash_sched_post(daq_items[i], values[i]);
+    }
+    FRAME_TRACE_END("daq_post");
+    perf_hist_add(&stats.update_ns, (uint32_t)(perf_time_ns() - start));
+}
+
+/**
+ * Spin the UI thread during the load phases
+ *
+ * @param t the load timer
+ */
+static void load_cb(lv_timer_t *t)
+{
+    uint64_t start = perf_time_ns();
+
+    LV_UNUSED(t);
+
+    if (((start - load_start_ns) / ((uint64_t)LOAD_PHASE_MS * 1000000)) % 2 == 0) {
+        return;
+    }
+
+    while (perf_time_ns() - start < (uint64_t)load_ms * 1000000) {
+    }
+}
+
+/**
+ * All the gauges sweeping at 60 Hz
+ *
+ * Compares the cost of the frames with the software rotation of the flush
+ * (LV_DASH_SW_ROTATION) and with a build rendering in the orientation of
+ * the panel (DASH_ROTATION). LV_DASH_BENCH_FULL=1 redraws the whole screen
+ * on every update, the cost of rotating a full frame.
+ *
+ * @param bg_src the background
+ */
+static void bench_gauge_sweep(const void *bg_src)
+{
+    static const char *const names[] = { "rpm", "temp", "fuel" };
+    uint32_t i;
+
+    LV_UNUSED(bg_src);
+
+    if (sched == NULL) {
+        fprintf(stderr, "gauge-sweep: no scheduler\n");
+        return;
+    }
+
+    for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        daq_items[i] = dash_sched_find(sched, names[i]);
+        if (daq_items[i] == NULL) {
+            fprintf(stderr, "gauge-sweep: no %s item\n", names[i]);
+            return;
+        }
+    }
+
+    full_frame = atoi(getenv_default("LV_DASH_BENCH_FULL", "0")) != 0;
+
+    lv_timer_create(gauge_sweep_cb, BENCH_PERIOD_MS, NULL);
+}
+
+/**
+ * Move the gauges one LED
+ *
+ * @param t the update timer
+ */
+static void gauge_sweep_cb(lv_timer_t *t)
+{
+    int32_t rpm;
+    uint64_t start;
+
+    LV_UNUSED(t);
+
+    daq_step++;
+    rpm = (int32_t)(daq_step % (2 * DAQ_RPM_LEDS));
+    rpm = rpm < DAQ_RPM_LEDS ? rpm : 2 * DAQ_RPM_LEDS - 1 - rpm;
+
+    start = perf_time_ns();
+    dash_sched_post(daq_items[0], rpm);
+    dash_sched_post(daq_items[1], (rpm * DAQ_TEMP_LEDS) / DAQ_RPM_LEDS);
+    dash_sched_post(daq_items[2], (rpm * DAQ_FUEL_LEDS) / DAQ_RPM_LEDS);
+    if (full_frame) {
+        lv_obj_invalidate(lv_screen_active());
+    }
+    perf_hist_add(&stats.update_ns, (uint32_t)(perf_time_ns() - start));
+}
+
+#if LV_USE_TINY_TTF
+/**
+ * Text drawn with a TTF font through the persistent glyph cache
+ *
+ * Reports the time from loading the font to the end of the first frame,
+ * run it twice to compare a cold and a warm cache.
+ *
+ * @param bg_src the background
+ */
+static void bench_ttf_text(const void *bg_src)
+{
+    const char *path = getenv("LV_DASH_BENCH_TTF");
+    const char *text = getenv_default("LV_DASH_BENCH_TEXT", "0123456789 km/h rpm ABCDEFGHIJKLMNOPQRSTUVWXYZ");
+    const lv_font_t *font;
+    lv_obj_t *label;
+    lv_obj_t *speed_label;
+
+    LV_UNUSED(bg_src);
+
+    if (path == NULL) {
+        fprintf(stderr, "ttf-text needs the path of a TTF file in LV_DASH_BENCH_TTF\n");
+        return;
+    }
+
+    first_text_start_ns = perf_time_ns();
+
+    font = glyph_cache_font_create(path, TTF_TEXT_SIZE);
+    if (font == NULL) {
+        return;
+    }
+
+    label = lv_label_create(lv_screen_active());
+    lv_obj_set_style_text_font(label, font, 0);
+    lv_obj_set_style_text_color(label, lv_color_hex(0xffffff), 0);
+    lv_obj_set_width(label, lv_pct(90));
+    lv_obj_align(label, LV_ALIGN_TOP_MID, 0, 40);
+    lv_label_set_text(label, text);
+
+    speed_label = lv_label_create(lv_screen_active());
+    lv_obj_set_style_text_font(speed_label, font, 0);
+    lv_obj_set_style_text_color(speed_label, lv_color_hex(0xffffff), 0);
+    lv_obj_set_pos(speed_label, SPEED_POS_X, SPEED_POS_Y);
+    lv_label_set_text(speed_label, "0");
+
+    ttf_font = font;
+    lv_display_add_event_cb(lv_display_get_default(), first_text_cb, LV_EVENT_REFR_READY, (void *)font);
+    lv_timer_create(speed_label_cb, BENCH_PERIOD_MS, speed_label);
+}
+
+/**
+ * Report the time to the first frame with text and the cache counters
+ *
+ * @param e the refresh ready event
+ */
+static void first_text_cb(lv_event_t *e)
+{
+    const lv_font_t *font = lv_event_get_user_data(e);
+    glyph_cache_stats_t cache;
+
+    glyph_cache_get_stats(font, &cache);
+
+    fprintf(stdout, "bench ttf-text: time to first text %llu us (%s cache: loaded=%u hits=%u misses=%u)\n",
+            (unsigned long long)((perf_time_ns() - first_text_start_ns) / 1000),
+            cache.loaded > 0 ? "warm" : "cold", cache.loaded, cache.hits, cache.misses);
+
+    lv_display_remove_event_cb_with_user_data(lv_display_get_default(), first_text_cb, (void *)font);
+}
+#endif
+
+/**
+ * Decode time and size of the assets as PNG, LZ compressed and raw images
+ *
+ * Every PNG file in the directory of the background is decoded, then the
+ * .lzi and .bin files written next to it by assets/convert_lzi.py. The
+ * images are decoded without the image cache.
+ *
+ * @param bg_src the background
+ */
+static void bench_image_decode(const void *bg_src)
+{
+    static const char *const exts[] = { "png", "lzi", "bin" };
+    char *paths[DECODE_MAX_ASSETS];
+    char dir[PATH_MAX];
+    bool complete = true;
+    uint32_t count;
+    uint32_t i;
+
+    get_assets_dir(bg_src, dir, sizeof(dir));
+    count = find_assets(dir, paths, 0);
+    fprintf(stdout, "bench image-decode: %u PNG files in %s, %d passes\n", count, dir, DECODE_PASSES - 1);
+
+    for (i = 0; i < sizeof(exts) / sizeof(exts[0]); i++) {
+        complete &= decode_format(paths, count, exts[i]);
+    }
+
+    if (!complete) {
+        fprintf(stdout, "bench image-decode: write the missing files with "
+                "assets/convert_lzi.py --input %s --bin\n", dir);
+    }
+
+    for (i = 0; i < count; i++) {
+        free(paths[i]);
+    }
+}
+
+/**
+ * Memory and draw time of the telltales as full color images and as A8 masks
+ *
+ * The PNG files of the icons directory next to the background and the .lzi
+ * masks written by assets/convert_lzi.py --format a8 are decoded, then
+ * each one is drawn on a canvas in the color format of the display, the
+ * masks with a recolor.
+ *
+ * @param bg_src the background
+ */
+static void bench_telltale_draw(const void *bg_src)
+{
+    char *paths[DECODE_MAX_ASSETS];
+    char dir[PATH_MAX];
+    char icons[PATH_MAX];
+    lv_draw_buf_t *canvas_buf;
+    lv_obj_t *canvas;
+    uint32_t count;
+    uint32_t i;
+
+    get_assets_dir(bg_src, dir, sizeof(dir));
+    snprintf(icons, sizeof(icons), "%s/icons", dir);
+
+    count = find_assets(icons, paths, 0);
+    fprintf(stdout, "bench telltale-draw: %u telltales in %s, %d draws each\n", count, icons, TELLTALE_DRAWS);
+
+    canvas_buf = lv_draw_buf_create(TELLTALE_CANVAS_SIZE, TELLTALE_CANVAS_SIZE,
+                                    lv_display_get_color_format(NULL), 0);
+    if (canvas_buf == NULL) {
+        fprintf(stderr, "bench telltale-draw: no memory for the canvas\n");
+    } else {
+        /* A canvas without a parent is never shown */
+        canvas = lv_canvas_create(NULL);
+        lv_canvas_set_draw_buf(canvas, canvas_buf);
+        draw_format(paths, count, "png", canvas);
+        draw_format(paths, count, "lzi", canvas);
+        lv_obj_delete(canvas);
+        lv_draw_buf_destroy(canvas_buf);
+    }
+
+    for (i = 0; i < count; i++) {
+        free(paths[i]);
+    }
+}
+
+/**
+ * Decode the telltales in one format, draw them and print their size and draw time
+ *
+ * @param paths the PNG files
+ * @param count the number of files
+ * @param ext the extension of the format, replaces the one of the PNG files
+ * @param canvas the canvas drawn on
+ */
+static void draw_format(char *const *paths, uint32_t count, const char *ext, lv_obj_t *canvas)
+{
+    lv_image_decoder_args_t args;
+    lv_image_decoder_dsc_t dsc;
+    lv_draw_image_dsc_t draw_dsc;
+    lv_layer_t layer;
+    lv_area_t area;
+    char path[PATH_MAX];
+    perf_hist_t draw_ns;
+    uint64_t decoded_bytes = 0;
+    uint64_t total_ns = 0;
+    uint64_t start;
+    uint32_t decoded = 0;
+    uint32_t a8 = 0;
+    uint32_t i;
+    int n;
+
+    memset(&args, 0, sizeof(args));
+    args.no_cache = 1;
+    perf_hist_reset(&draw_ns);
+
+    for (i = 0; i < count; i++) {
+        snprintf(path, sizeof(path), "%.*s.%s", (int)(strrchr(paths[i], '.') - paths[i]), paths[i], ext);
+        if (lv_image_decoder_open(&dsc, path, &args) != LV_RESULT_OK) {
+            continue;
+        }
+
+        if (dsc.decoded == NULL) {
+            lv_image_decoder_close(&dsc);
+            continue;
+        }
+
+        decoded_bytes += dsc.decoded->data_size;
+        decoded++;
+        if (dsc.decoded->header.cf == LV_COLOR_FORMAT_A8) {
+            a8++;
+        }
+
+        lv_draw_image_dsc_init(&draw_dsc);
+        draw_dsc.src = dsc.decoded;
+        draw_dsc.recolor = lv_color_hex(TELLTALE_TINT);
+        lv_area_set(&area, 0, 0, dsc.decoded->header.w - 1, dsc.decoded->header.h - 1);
+
+        start = perf_time_ns();
+        lv_canvas_init_layer(canvas, &layer);
+        for (n = 0; n < TELLTALE_DRAWS; n++) {
+            lv_draw_image(&layer, &draw_dsc, &area);
+        }
+        lv_canvas_finish_layer(canvas, &layer);
+        start = perf_time_ns() - start;
+
+        total_ns += start / TELLTALE_DRAWS;
+        perf_hist_add(&draw_ns, (uint32_t)(start / TELLTALE_DRAWS));
+
+        lv_image_decoder_close(&dsc);
+    }
+
+    fprintf(stdout, "bench telltale-draw %s: %u/%u decoded, %u A8, decoded %llu B, %.2f us per telltale\n",
+            ext, decoded, count, a8, (unsigned long long)decoded_bytes,
+            decoded > 0 ? (double)total_ns / 1e3 / decoded : 0.0);
+    perf_hist_print(&draw_ns, "draw", "ns");
+}
+
+/**
+ * Get the directory of the assets from the path of the background
+ *
+ * @param bg_src the background
+ * @param dir the directory
+ * @param size the size of dir
+ */
+static void get_assets_dir(const void *bg_src, char *dir, size_t size)
+{
+    char *slash;
+
+    snprintf(dir, size, "%s", (const char *)bg_src);
+    slash = strrchr(dir, '/');
+    if (slash != NULL) {
+        *slash = '\0';
+    } else {
+        snprintf(dir, size, ".");
+    }
+}
+
+/**
+ * Collect the PNG files of a directory and of its subdirectories
+ *
+ * @param dir the directory
+ * @param paths the paths found, allocated with malloc
+ * @param count the number of paths already found
+ * @return the number of paths found, at most DECODE_MAX_ASSETS
+ */
+static uint32_t find_assets(const char *dir, char **paths, uint32_t count)
+{
+    char path[PATH_MAX];
+    struct dirent *entry;
+    struct stat st;
+    const char *ext;
+    DIR *d;
+
+    d = opendir(dir);
+    if (d == NULL) {
+        return count;
+    }
+
+    while ((entry = readdir(d)) != NULL && count < DECODE_MAX_ASSETS) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        if (stat(path, &st) != 0) {
+            continue;
+        }
+
+        ext = strrchr(entry->d_name, '.');
+        if (S_ISDIR(st.st_mode)) {
+            count = find_assets(path, paths, count);
+        } else if (ext != NULL && strcmp(ext, ".png") == 0) {
+            paths[count++] = strdup(path);
+        }
+    }
+
+    closedir(d);
+    return count;
+}
+
+/**
+ * Decode the assets in one format and print the sizes and the decode time
+ *
+ * @param paths the PNG files
+ * @param count the number of files
+ * @param ext the extension of the format, replaces the one of the PNG files
+ * @return true if every file was found and decoded
+ */
+static bool decode_format(char *const *paths, uint32_t count, const char *ext)
+{
+    lv_image_decoder_args_t args;
+    lv_image_decoder_dsc_t dsc;
+    char path[PATH_MAX];
+    perf_hist_t decode_us;
+    uint64_t file_bytes = 0;
+    uint64_t decoded_bytes = 0;
+    uint64_t total_ns = 0;
+    uint64_t start;
+    uint32_t decoded = 0;
+    struct stat st;
+    uint32_t pass;
+    uint32_t i;
+
+    memset(&args, 0, sizeof(args));
+    args.no_cache = 1;
+    perf_hist_reset(&decode_us);
+
+    for (i = 0; i < count; i++) {
+        snprintf(path, sizeof(path), "%.*s.%s", (int)(strrchr(paths[i], '.') - paths[i]), paths[i], ext);
+        if (stat(path, &st) != 0) {
+            continue;
+        }
+
+        for (pass = 0; pass < DECODE_PASSES; pass++) {
+            start = perf_time_ns();
+            if (lv_image_decoder_open(&dsc, path, &args) != LV_RESULT_OK) {
+                break;
+            }
+            start = perf_time_ns() - start;
+
+            if (pass == 0) {
+                file_bytes += (uint64_t)st.st_size;
+                decoded_bytes += dsc.decoded != NULL ? dsc.decoded->data_size : 0;
+                decoded++;
+            } else {
+                total_ns += start;
+                perf_hist_add(&decode_us, (uint32_t)(start / 1000));
+            }
+
+            lv_image_decoder_close(&dsc);
+        }
+    }
+
+    fprintf(stdout, "bench image-decode %s: %u/%u decoded, files %llu B, decoded %llu B, %.2f ms per pass\n",
+            ext, decoded, count, (unsigned long long)file_bytes, (unsigned long long)decoded_bytes,
+            (double)total_ns / 1e6 / (DECODE_PASSES - 1));
+    perf_hist_print(&decode_us, "decode", "us");
+
+    return decoded == count;
+}
+
+/**
+ * Update the readout
+ *
+ * @param t the update timer
+ */
+static void speed_readout_cb(lv_timer_t *t)
+{
+    lv_obj_t *readout = lv_timer_get_user_data(t);
+    int32_t value = next_speed();
+    uint64_t start = perf_time_ns();
+
+    dash_readout_set_value(readout, value);
+    perf_hist_add(&stats.update_ns, (uint32_t)(perf_time_ns() - start));
+}
+
+/**
+ * Update the label
+ *
+ * @param t the update timer
+ */
+static void speed_label_cb(lv_timer_t *t)
+{
+    lv_obj_t *label = lv_timer_get_user_data(t);
+    int32_t value = next_speed();
+    uint64_t start = perf_time_ns();
+
+    lv_label_set_text_fmt(label, "%d", (int)value);
+    perf_hist_add(&stats.update_ns, (uint32_t)(perf_time_ns() - start));
+}
+
+/**
+ * Sweep the speed up and down, one unit per update
+ *
+ * @return the next speed
+ */
+static int32_t next_speed(void)
+{
+    speed += speed_dir;
+
+    if (speed >= SPEED_MAX || speed <= 0) {
+        speed_dir = -speed_dir;
+    }
+
+    return speed;
+}
+
+/**
+ * Start collecting the frame statistics of the default display
+ *
+ * @param name the name of the benchmark
+ */
+static void stats_attach(const char *name)
+{
+    lv_display_t *disp = lv_display_get_default();
+    int report_sec = atoi(getenv_default("LV_DASH_BENCH_REPORT", "5"));
+
+    bench_name = name;
+    perf_hist_reset(&stats.refr_us);
+    perf_hist_reset(&stats.flush_us);
+    perf_hist_reset(&stats.update_ns);
+
+    lv_display_add_event_cb(disp, display_event_cb, LV_EVENT_REFR_START, NULL);
+    lv_display_add_event_cb(disp, display_event_cb, LV_EVENT_REFR_READY, NULL);
+    lv_display_add_event_cb(disp, display_event_cb, LV_EVENT_INVALIDATE_AREA, NULL);
+    lv_display_add_event_cb(disp, display_event_cb, LV_EVENT_FLUSH_START, NULL);
+    lv_display_add_event_cb(disp, display_event_cb, LV_EVENT_FLUSH_FINISH, NULL);
+
+    fprintf(stdout, "bench %s: %dx%d, software rotation %d\n", name,
+            (int)lv_display_get_horizontal_resolution(disp), (int)lv_display_get_vertical_resolution(disp),
+            (int)lv_display_get_rotation(disp) * 90);
+
+    lv_timer_create(report_timer_cb, (uint32_t)LV_MAX(report_sec, 1) * 1000, NULL);
+}
+
+/**
+ * Measure the refreshes and the invalidated areas
+ *
+ * @param e the display event
+ */
+static void display_event_cb(lv_event_t *e)
+{
+    const lv_area_t *area;
+
+    switch (lv_event_get_code(e)) {
+    case LV_EVENT_REFR_START:
+        stats.refr_start_ns = perf_time_ns();
+        break;
+    case LV_EVENT_REFR_READY:
+        if (stats.refr_start_ns != 0) {
+            perf_hist_add(&stats.refr_us, (uint32_t)((perf_time_ns() - stats.refr_start_ns) / 1000));
+            perf_hist_add(&stats.flush_us, (uint32_t)(stats.flush_ns / 1000));
+            stats.frames++;
+        }
+        stats.flush_ns = 0;
+        break;
+    case LV_EVENT_FLUSH_START:
+        stats.flush_start_ns = perf_time_ns();
+        break;
+    case LV_EVENT_FLUSH_FINISH:
+        /* Includes the rotation done by the flush callback */
+        stats.flush_ns += perf_time_ns() - stats.flush_start_ns;
+        break;
+    case LV_EVENT_INVALIDATE_AREA:
+        area = lv_event_get_param(e);
+        stats.inv_px += lv_area_get_size(area);
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * Print and reset the statistics
+ *
+ * @param t the report timer
+ */
+static void report_timer_cb(lv_timer_t *t)
+{
+    LV_UNUSED(t);
+
+    fprintf(stdout, "bench %s: frames=%u invalidated px/frame=%llu\n", bench_name, stats.frames,
+            (unsigned long long)(stats.frames > 0 ? stats.inv_px / stats.frames : 0));
+    perf_hist_print(&stats.update_ns, "update", "ns");
+    perf_hist_print(&stats.refr_us, "refresh", "us");
+    perf_hist_print(&stats.flush_us, "flush", "us");
+
+    if (daq_items[0] != NULL) {
+        dash_sched_report(sched);
+    }
+
+#if LV_USE_TINY_TTF
+    if (ttf_font != NULL) {
+        glyph_cache_stats_t cache;
+
+        glyph_cache_get_stats(ttf_font, &cache);
+        fprintf(stdout, "glyph cache: loaded=%u hits=%u misses=%u written=%u\n",
+                cache.loaded, cache.hits, cache.misses, cache.written);
+    }
+#endif
+
+    stats.inv_px = 0;
+    stats.frames = 0;
+    perf_hist_reset(&stats.refr_us);
+    perf_hist_reset(&stats.flush_us);
+    perf_hist_reset(&stats.update_ns);
+}
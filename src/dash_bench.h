@@ -0,0 +1,75 @@
+/**
+ * @file dash_bench.h
+ *
+ * Dashboard micro benchmarks
+ *
+ * Select a benchmark with the LV_DASH_BENCH environment variable,
+ * results are printed on stdout every LV_DASH_BENCH_REPORT seconds.
+ *
+ */
+
+#ifndef DASH_BENCH_H
+#define DASH_BENCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stdbool.h>
+
+#include "lvgl/lvgl.h"
+
+#include "dash_timeline.h"
+#include "dash_sched.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+/**
+ * @description Start the benchmark selected by LV_DASH_BENCH
+ * @param bg_src the source of the dashboard background
+ * @return true if a benchmark was started
+ */
+bool dash_bench_start(const void *bg_src);
+
+/**
+ * @description Give the telltale layer of the dashboard to the telltales benchmark
+ * @param obj the layer created by dash_telltales_create
+ * @param left_turn the mask of the left turn signal in the layer
+ * @param right_turn the mask of the right turn signal in the layer
+ */
+void dash_bench_set_telltales(lv_obj_t *obj, uint32_t left_turn, uint32_t right_turn);
+
+/**
+ * @description Give the startup sequence of the dashboard to the startup-jitter benchmark
+ * @param timeline the startup timeline, not started
+ */
+void dash_bench_set_startup(dash_timeline_t *timeline);
+
+/**
+ * @description Give the update scheduler of the dashboard to the sched-load benchmark
+ * @param sched the scheduler with the telltales, rpm, temp and fuel items
+ */
+void dash_bench_set_sched(dash_sched_t *sched);
+
+/**********************
+ *      MACROS
+ **********************/
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif /*DASH_BENCH_H*/
@@ -0,0 +1,179 @@
+/**
+ * @file dash_layout.h
+ *
+ * Layout of the dashboard in landscape orientation
+ *
+ * The sprites are given by their file and the position of their top left
+ * corner. tools/rotate_assets.py reads this file to generate the layout
+ * and the sprites of a panel mounted at 90, 180 or 270 degrees, only the
+ * strings and the numbers of the tables and of the defines are changed.
+ *
+ */
+
+#ifndef DASH_LAYOUT_H
+#define DASH_LAYOUT_H
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define DASH_LAYOUT_WIDTH 800
+#define DASH_LAYOUT_HEIGHT 480
+#define DASH_LAYOUT_ROTATION 0
+#define DASH_BG_SRC "assets/bg.png"
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+typedef struct {
+    const char *src;
+    int x;
+    int y;
+} dash_sprite_t;
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+static const dash_sprite_t rpm_sprites[] = {
+    {"assets/rpm/rpm1.png", 122, 211},
+    {"assets/rpm/rpm2.png", 128, 206},
+    {"assets/rpm/rpm3.png", 131, 204},
+    {"assets/rpm/rpm4.png", 134, 202},
+    {"assets/rpm/rpm5.png", 138, 200},
+    {"assets/rpm/rpm6.png", 142, 197},
+    {"assets/rpm/rpm7.png", 146, 196},
+    {"assets/rpm/rpm8.png", 150, 194},
+    {"assets/rpm/rpm9.png", 153, 192},
+    {"assets/rpm/rpm10.png", 157, 190},
+    {"assets/rpm/rpm11.png", 161, 188},
+    {"assets/rpm/rpm12.png", 165, 186},
+    {"assets/rpm/rpm13.png", 169, 184},
+    {"assets/rpm/rpm14.png", 173, 182},
+    {"assets/rpm/rpm15.png", 177, 180},
+    {"assets/rpm/rpm16.png", 181, 179},
+    {"assets/rpm/rpm17.png", 185, 177},
+    {"assets/rpm/rpm18.png", 190, 175},
+    {"assets/rpm/rpm19.png", 194, 173},
+    {"assets/rpm/rpm20.png", 198, 172},
+    {"assets/rpm/rpm21.png", 202, 170},
+    {"assets/rpm/rpm22.png", 207, 168},
+    {"assets/rpm/rpm23.png", 211, 166},
+    {"assets/rpm/rpm24.png", 216, 165},
+    {"assets/rpm/rpm25.png", 221, 164},
+    {"assets/rpm/rpm26.png", 226, 162},
+    {"assets/rpm/rpm27.png", 230, 160},
+    {"assets/rpm/rpm28.png", 235, 159},
+    {"assets/rpm/rpm29.png", 240, 157},
+    {"assets/rpm/rpm30.png", 244, 156},
+    {"assets/rpm/rpm31.png", 250, 155},
+    {"assets/rpm/rpm32.png", 254, 153},
+    {"assets/rpm/rpm33.png", 259, 152},
+    {"assets/rpm/rpm34.png", 265, 151},
+    {"assets/rpm/rpm35.png", 269, 150},
+    {"assets/rpm/rpm36.png", 275, 149},
+    {"assets/rpm/rpm37.png", 280, 148},
+    {"assets/rpm/rpm38.png", 285, 147},
+    {"assets/rpm/rpm39.png", 290, 146},
+    {"assets/rpm/rpm40.png", 295, 144},
+    {"assets/rpm/rpm41.png", 301, 144},
+    {"assets/rpm/rpm42.png", 306, 143},
+    {"assets/rpm/rpm43.png", 311, 142},
+    {"assets/rpm/rpm44.png", 316, 142},
+    {"assets/rpm/rpm45.png", 322, 141},
+    {"assets/rpm/rpm46.png", 328, 141},
+    {"assets/rpm/rpm47.png", 333, 140},
+    {"assets/rpm/rpm48.png", 338, 139},
+    {"assets/rpm/rpm49.png", 344, 139},
+    {"assets/rpm/rpm50.png", 350, 138},
+    {"assets/rpm/rpm51.png", 356, 138},
+    {"assets/rpm/rpm52.png", 361, 138},
+    {"assets/rpm/rpm53.png", 368, 137},
+    {"assets/rpm/rpm54.png", 373, 137},
+    {"assets/rpm/rpm55.png", 380, 137},
+    {"assets/rpm/rpm56.png", 386, 136},
+    {"assets/rpm/rpm57.png", 392, 136},
+    {"assets/rpm/rpm58.png", 398, 136},
+    {"assets/rpm/rpm59.png", 404, 136},
+    {"assets/rpm/rpm60.png", 409, 137},
+    {"assets/rpm/rpm61.png", 416, 137},
+    {"assets/rpm/rpm62.png", 422, 137},
+    {"assets/rpm/rpm63.png", 429, 137},
+    {"assets/rpm/rpm64.png", 434, 138},
+    {"assets/rpm/rpm65.png", 442, 139},
+    {"assets/rpm/rpm66.png", 448, 139},
+    {"assets/rpm/rpm67.png", 456, 140},
+    {"assets/rpm/rpm68.png", 461, 141},
+    {"assets/rpm/rpm69.png", 468, 142},
+    {"assets/rpm/rpm70.png", 474, 143},
+    {"assets/rpm/rpm71.png", 481, 144},
+    {"assets/rpm/rpm72.png", 488, 146},
+    {"assets/rpm/rpm73.png", 496, 147},
+    {"assets/rpm/rpm74.png", 504, 149},
+    {"assets/rpm/rpm75.png", 511, 151},
+    {"assets/rpm/rpm76.png", 519, 153},
+    {"assets/rpm/rpm77.png", 527, 155},
+    {"assets/rpm/rpm78.png", 534, 157},
+    {"assets/rpm/rpm79.png", 541, 160},
+    {"assets/rpm/rpm80.png", 549, 162},
+    {"assets/rpm/rpm81.png", 557, 165},
+    {"assets/rpm/rpm82.png", 565, 168},
+    {"assets/rpm/rpm83.png", 573, 171},
+    {"assets/rpm/rpm84.png", 581, 175},
+    {"assets/rpm/rpm85.png", 590, 178},
+    {"assets/rpm/rpm86.png", 597, 182},
+    {"assets/rpm/rpm87.png", 605, 186},
+    {"assets/rpm/rpm88.png", 613, 189},
+    {"assets/rpm/rpm89.png", 621, 194},
+    {"assets/rpm/rpm90.png", 621, 199},
+};
+
+static const dash_sprite_t temp_sprites[] = {
+    {"assets/temp/temp91.png", 107, 259},
+    {"assets/temp/temp92.png", 109, 259},
+    {"assets/temp/temp93.png", 122, 259},
+    {"assets/temp/temp94.png", 136, 259},
+    {"assets/temp/temp95.png", 148, 259},
+    {"assets/temp/temp96.png", 162, 259},
+    {"assets/temp/temp97.png", 176, 259},
+    {"assets/temp/temp98.png", 193, 259},
+};
+
+static const dash_sprite_t fuel_sprites[] = {
+    {"assets/fuel/fuel99.png", 602, 260},
+    {"assets/fuel/fuel100.png", 609, 260},
+    {"assets/fuel/fuel101.png", 613, 260},
+    {"assets/fuel/fuel102.png", 617, 260},
+    {"assets/fuel/fuel103.png", 622, 260},
+    {"assets/fuel/fuel104.png", 627, 260},
+    {"assets/fuel/fuel105.png", 631, 260},
+    {"assets/fuel/fuel106.png", 635, 260},
+    {"assets/fuel/fuel107.png", 640, 260},
+    {"assets/fuel/fuel108.png", 644, 260},
+    {"assets/fuel/fuel109.png", 648, 260},
+    {"assets/fuel/fuel110.png", 653, 260},
+    {"assets/fuel/fuel111.png", 657, 260},
+    {"assets/fuel/fuel112.png", 661, 260},
+    {"assets/fuel/fuel113.png", 666, 260},
+    {"assets/fuel/fuel114.png", 670, 260},
+    {"assets/fuel/fuel115.png", 674, 260},
+    {"assets/fuel/fuel116.png", 679, 260},
+    {"assets/fuel/fuel117.png", 683, 260},
+    {"assets/fuel/fuel118.png", 696, 261},
+};
+
+static const dash_sprite_t icon_sprites[] = {
+    {"assets/icons/door_open.png", 611, 329},
+    {"assets/icons/hi_beam.png", 554, 229},
+    {"assets/icons/immo.png", 302, 332},
+    {"assets/icons/left_turn.png", 282, 211},
+    {"assets/icons/low_bat.png", 171, 330},
+    {"assets/icons/low_brake_fluid.png", 126, 329},
+    {"assets/icons/low_oil.png", 210, 331},
+    {"assets/icons/mil_on.png", 257, 329},
+    {"assets/icons/right_turn.png", 496, 211},
+    {"assets/icons/trunk_open.png", 563, 330},
+};
+
+#endif /*DASH_LAYOUT_H*/
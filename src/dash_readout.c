@@ -0,0 +1,374 @@
+/**
+ * @file dash_readout.c
+ *
+ * Numeric readout built from pre-rendered digits
+ *
+ * A label blends the 4 bpp glyphs on every redraw and lv_label_set_text()
+ * reallocates and lays out the text. Here each cell owns 11 opaque RGB565
+ * images (the digits and a blank) blended once at creation against the
+ * background pixels below the cell, a redraw is a plain copy and setting
+ * the value only invalidates the cells that changed.
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "lvgl/lvgl.h"
+
+#include "dash_readout.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define BLANK 10
+#define IMAGES_PER_CELL 11
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+typedef struct {
+    lv_draw_buf_t *images[IMAGES_PER_CELL];
+    uint8_t shown;
+} readout_cell_t;
+
+typedef struct {
+    readout_cell_t cells[DASH_READOUT_MAX_DIGITS];
+    uint32_t digit_count;
+    int32_t cell_w;
+    int32_t cell_h;
+    int32_t max_value;
+} readout_t;
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static void render_cells(readout_t *r, const lv_font_t *font, lv_color_t color,
+                         const void *bg_src, int32_t x, int32_t y);
+static lv_draw_buf_t *render_glyph(const lv_font_t *font, uint32_t letter, lv_font_glyph_dsc_t *g);
+static void bg_pixel(const lv_draw_buf_t *bg, int32_t x, int32_t y, uint8_t *r, uint8_t *g, uint8_t *b);
+static void draw_cb(lv_event_t *e);
+static void delete_cb(lv_event_t *e);
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+/**********************
+ *      MACROS
+ **********************/
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+lv_obj_t *dash_readout_create(lv_obj_t *parent, const lv_font_t *font, uint32_t digit_count,
+                              lv_color_t color, const void *bg_src, int32_t x, int32_t y)
+{
+    lv_font_glyph_dsc_t g;
+    readout_t *r;
+    lv_obj_t *obj;
+    uint32_t i;
+
+    LV_ASSERT(digit_count > 0 && digit_count <= DASH_READOUT_MAX_DIGITS);
+
+    r = lv_malloc_zeroed(sizeof(readout_t));
+    LV_ASSERT_NULL(r);
+
+    /* Fixed width cells, as wide as the widest digit, adv_w is in pixels */
+    r->digit_count = digit_count;
+    for (i = 0; i < 10; i++) {
+        memset(&g, 0, sizeof(g));
+        lv_font_get_glyph_dsc(font, &g, '0' + i, 0);
+        r->cell_w = LV_MAX(r->cell_w, (int32_t)g.adv_w);
+    }
+    r->cell_h = lv_font_get_line_height(font);
+    r->max_value = 1;
+    for (i = 0; i < digit_count; i++) {
+        r->max_value *= 10;
+    }
+    r->max_value--;
+
+    render_cells(r, font, color, bg_src, x, y);
+
+    obj = lv_obj_create(parent);
+    lv_obj_remove_style_all(obj);
+    lv_obj_remove_flag(obj, LV_OBJ_FLAG_CLICKABLE | LV_OBJ_FLAG_SCROLLABLE);
+    lv_obj_set_pos(obj, x, y);
+    lv_obj_set_size(obj, r->cell_w * (int32_t)digit_count, r->cell_h);
+    lv_obj_set_user_data(obj, r);
+
+    lv_obj_add_event_cb(obj, draw_cb, LV_EVENT_DRAW_MAIN, r);
+    lv_obj_add_event_cb(obj, delete_cb, LV_EVENT_DELETE, r);
+
+    return obj;
+}
+
+void dash_readout_set_value(lv_obj_t *obj, int32_t value)
+{
+    readout_t *r = lv_obj_get_user_data(obj);
+    readout_cell_t *cell;
+    lv_area_t coords;
+    lv_area_t area;
+    uint8_t digit;
+    int32_t i;
+
+    value = LV_MAX(0, LV_MIN(r->max_value, value));
+    lv_obj_get_coords(obj, &coords);
+
+    /* Walk the cells from the least significant digit */
+    for (i = (int32_t)r->digit_count - 1; i >= 0; i--) {
+
+        if (value == 0 && i != (int32_t)r->digit_count - 1) {
+            digit = BLANK;
+        } else {
+            digit = (uint8_t)(value % 10);
+            value /= 10;
+        }
+
+        cell = &r->cells[i];
+        if (cell->shown == digit) {
+            continue;
+        }
+
+        cell->shown = digit;
+
+        area.x1 = coords.x1 + i * r->cell_w;
+        area.y1 = coords.y1;
+        area.x2 = area.x1 + r->cell_w - 1;
+        area.y2 = coords.y2;
+        lv_obj_invalidate_area(obj, &area);
+    }
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+/**
+ * Blend every digit of every cell with the background
+ *
+ * @param r the readout
+ * @param font the font of the digits
+ * @param color the color of the digits
+ * @param bg_src the background image or NULL
+ * @param x the position of the readout on the background
+ * @param y the position of the readout on the background
+ */
+static void render_cells(readout_t *r, const lv_font_t *font, lv_color_t color,
+                         const void *bg_src, int32_t x, int32_t y)
+{
+    lv_image_decoder_dsc_t bg_dsc;
+    const lv_draw_buf_t *bg = NULL;
+    lv_draw_buf_t *glyphs[IMAGES_PER_CELL];
+    lv_font_glyph_dsc_t dscs[IMAGES_PER_CELL];
+    lv_font_glyph_dsc_t *g;
+    lv_draw_buf_t *img;
+    uint16_t *dst;
+    uint32_t c;
+    uint32_t d;
+    int32_t px;
+    int32_t py;
+    int32_t gx;
+    int32_t gy;
+    int32_t top;
+    uint8_t a;
+    uint8_t br;
+    uint8_t bgc;
+    uint8_t bb;
+    uint8_t rr;
+    uint8_t rg;
+    uint8_t rb;
+
+    if (bg_src != NULL && lv_image_decoder_open(&bg_dsc, bg_src, NULL) == LV_RESULT_OK) {
+        bg = bg_dsc.decoded;
+    }
+
+    for (d = 0; d < IMAGES_PER_CELL; d++) {
+        memset(&dscs[d], 0, sizeof(lv_font_glyph_dsc_t));
+        glyphs[d] = d == BLANK ? NULL : render_glyph(font, '0' + d, &dscs[d]);
+    }
+
+    for (c = 0; c < r->digit_count; c++) {
+
+        /* Force the first update to invalidate the cell */
+        r->cells[c].shown = 0xFF;
+
+        for (d = 0; d < IMAGES_PER_CELL; d++) {
+
+            img = lv_draw_buf_create(r->cell_w, r->cell_h, LV_COLOR_FORMAT_RGB565, 0);
+            LV_ASSERT_NULL(img);
+            r->cells[c].images[d] = img;
+
+            g = &dscs[d];
+            top = (lv_font_get_line_height(font) - font->base_line) - g->box_h - g->ofs_y;
+
+            for (py = 0; py < r->cell_h; py++) {
+                dst = (uint16_t *)(img->data + py * img->header.stride);
+
+                for (px = 0; px < r->cell_w; px++) {
+                    gx = px - g->ofs_x;
+                    gy = py - top;
+                    a = 0;
+
+                    if (glyphs[d] != NULL && gx >= 0 && gx < g->box_w && gy >= 0 && gy < g->box_h) {
+                        a = glyphs[d]->data[gy * glyphs[d]->header.stride + gx];
+                    }
+
+                    bg_pixel(bg, x + (int32_t)c * r->cell_w + px, y + py, &br, &bgc, &bb);
+
+                    rr = (uint8_t)((color.red * a + br * (255 - a)) / 255);
+                    rg = (uint8_t)((color.green * a + bgc * (255 - a)) / 255);
+                    rb = (uint8_t)((color.blue * a + bb * (255 - a)) / 255);
+
+                    dst[px] = (uint16_t)(((rr & 0xF8) << 8) | ((rg & 0xFC) << 3) | (rb >> 3));
+                }
+            }
+        }
+    }
+
+    for (d = 0; d < IMAGES_PER_CELL; d++) {
+        if (glyphs[d] != NULL) {
+            lv_draw_buf_destroy(glyphs[d]);
+        }
+    }
+
+    if (bg != NULL) {
+        lv_image_decoder_close(&bg_dsc);
+    }
+}
+
+/**
+ * Unpack a glyph to an A8 buffer
+ *
+ * @param font the font
+ * @param letter the letter to render
+ * @param g filled with the glyph descriptor
+ * @return the A8 buffer or NULL if the glyph is missing
+ */
+static lv_draw_buf_t *render_glyph(const lv_font_t *font, uint32_t letter, lv_font_glyph_dsc_t *g)
+{
+    lv_draw_buf_t *buf;
+
+    if (!lv_font_get_glyph_dsc(font, g, letter, 0) || g->box_w == 0 || g->box_h == 0) {
+        return NULL;
+    }
+
+    buf = lv_draw_buf_create(g->box_w, g->box_h, LV_COLOR_FORMAT_A8, 0);
+    LV_ASSERT_NULL(buf);
+
+    if (lv_font_get_glyph_bitmap(g, buf) == NULL) {
+        lv_draw_buf_destroy(buf);
+        return NULL;
+    }
+
+    return buf;
+}
+
+/**
+ * Read a pixel of the background
+ *
+ * @param bg the decoded background or NULL
+ * @param x the x coordinate
+ * @param y the y coordinate
+ * @param r the red component
+ * @param g the green component
+ * @param b the blue component
+ */
+static void bg_pixel(const lv_draw_buf_t *bg, int32_t x, int32_t y, uint8_t *r, uint8_t *g, uint8_t *b)
+{
+    const uint8_t *row;
+    uint16_t px;
+
+    *r = *g = *b = 0;
+
+    if (bg == NULL || x < 0 || y < 0 || x >= (int32_t)bg->header.w || y >= (int32_t)bg->header.h) {
+        return;
+    }
+
+    row = bg->data + y * bg->header.stride;
+
+    switch (bg->header.cf) {
+    case LV_COLOR_FORMAT_ARGB8888:
+    case LV_COLOR_FORMAT_XRGB8888:
+        *b = row[x * 4];
+        *g = row[x * 4 + 1];
+        *r = row[x * 4 + 2];
+        break;
+    case LV_COLOR_FORMAT_RGB888:
+        *b = row[x * 3];
+        *g = row[x * 3 + 1];
+        *r = row[x * 3 + 2];
+        break;
+    case LV_COLOR_FORMAT_RGB565:
+        px = ((const uint16_t *)row)[x];
+        *r = (uint8_t)((px >> 8) & 0xF8);
+        *g = (uint8_t)((px >> 3) & 0xFC);
+        *b = (uint8_t)((px << 3) & 0xF8);
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * Copy the pre-rendered cells
+ *
+ * @param e the draw event
+ */
+static void draw_cb(lv_event_t *e)
+{
+    readout_t *r = lv_event_get_user_data(e);
+    lv_obj_t *obj = lv_event_get_target_obj(e);
+    lv_layer_t *layer = lv_event_get_layer(e);
+    lv_draw_image_dsc_t dsc;
+    lv_area_t coords;
+    lv_area_t area;
+    uint32_t i;
+
+    lv_obj_get_coords(obj, &coords);
+
+    for (i = 0; i < r->digit_count; i++) {
+
+        if (r->cells[i].shown >= IMAGES_PER_CELL) {
+            continue;
+        }
+
+        area.x1 = coords.x1 + (int32_t)i * r->cell_w;
+        area.y1 = coords.y1;
+        area.x2 = area.x1 + r->cell_w - 1;
+        area.y2 = area.y1 + r->cell_h - 1;
+
+        /* Cells outside of the area being redrawn are skipped by the draw unit */
+        lv_draw_image_dsc_init(&dsc);
+        dsc.src = r->cells[i].images[r->cells[i].shown];
+        lv_draw_image(layer, &dsc, &area);
+    }
+}
+
+/**
+ * Release the images
+ *
+ * @param e the delete event
+ */
+static void delete_cb(lv_event_t *e)
+{
+    readout_t *r = lv_event_get_user_data(e);
+    uint32_t c;
+    uint32_t d;
+
+    for (c = 0; c < r->digit_count; c++) {
+        for (d = 0; d < IMAGES_PER_CELL; d++) {
+            lv_draw_buf_destroy(r->cells[c].images[d]);
+        }
+    }
+
+    lv_free(r);
+}
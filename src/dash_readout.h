@@ -0,0 +1,67 @@
+/**
+ * @file dash_readout.h
+ *
+ * Numeric readout built from pre-rendered digits
+ *
+ * Each digit of the font is rendered once per cell into an opaque RGB565
+ * image already blended with the background the cell sits on, updating
+ * the value only copies the cells whose digit changed.
+ *
+ */
+
+#ifndef DASH_READOUT_H
+#define DASH_READOUT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include "lvgl/lvgl.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define DASH_READOUT_MAX_DIGITS 8
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+/**
+ * @description Create a numeric readout
+ * @param parent the parent object, its top left corner is the one of the background
+ * @param font a font containing the digits 0 - 9
+ * @param digit_count the number of fixed width cells
+ * @param color the color of the digits
+ * @param bg_src the image the readout sits on, NULL for a black background
+ * @param x the position of the readout on the background
+ * @param y the position of the readout on the background
+ * @return the readout object
+ */
+lv_obj_t *dash_readout_create(lv_obj_t *parent, const lv_font_t *font, uint32_t digit_count,
+                              lv_color_t color, const void *bg_src, int32_t x, int32_t y);
+
+/**
+ * @description Display a value, the leading zeros are blank
+ * @param obj the readout
+ * @param value the value, clamped to the number of digits
+ */
+void dash_readout_set_value(lv_obj_t *obj, int32_t value);
+
+/**********************
+ *      MACROS
+ **********************/
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif /*DASH_READOUT_H*/
@@ -0,0 +1,400 @@
+/**
+ * @file dash_sched.c
+ *
+ * Update scheduler of the dashboard elements
+ *
+ * The pending values are applied at LV_EVENT_REFR_START, so all the items
+ * of a class due in a frame change together and are drawn by that frame.
+ *
+ * The load is measured on the interval between the frames: a frame
+ * starting more than FRAME_BUDGET_MS after the previous one overran. Each
+ * window of SHED_WINDOW frames with SHED_OVERRUNS overruns or more raises
+ * the shedding level, each window without overrun lowers it. Every level
+ * doubles the period of one class, starting from the lowest priority.
+ * The first frame after an idle display resumes is not measured.
+ *
+ * With LV_TICKLESS a pending value keeps the display refreshing until
+ * its class is due and it is applied.
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lvgl/lvgl.h"
+
+#include "src/lib/simulator_util.h"
+#include "src/lib/perf_stats.h"
+#include "src/lib/frame_trace.h"
+#include "src/lib/tickless.h"
+#include "dash_sched.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/* A frame later than 1.5 refresh periods overran */
+#define FRAME_BUDGET_MS (LV_DEF_REFR_PERIOD * 3 / 2)
+
+#define SHED_WINDOW 30
+#define SHED_OVERRUNS 3
+
+/* Each decimated class is slowed down at most 4 times */
+#define SHED_MAX_SHIFT 2
+
+/* A value is late when applied later than the class period plus 2 frames */
+#define DEADLINE_SLACK_MS (2 * LV_DEF_REFR_PERIOD)
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+typedef struct {
+    const char *name;
+    uint32_t period_ms;     /* 0: every frame */
+    bool decimated;         /* Can be slowed down under load */
+} sched_class_t;
+
+struct _dash_sched_item_t {
+    dash_sched_t *sched;
+    const char *name;
+    dash_sched_class_t cls;
+    dash_sched_apply_cb_t cb;
+    void *user_data;
+    int32_t value;
+    int32_t applied_value;
+    uint64_t pending_ns;    /* When the oldest value not applied was posted, 0 if none */
+    bool applied_once;
+};
+
+struct _dash_sched_t {
+    lv_display_t *display;
+    dash_sched_item_t items[DASH_SCHED_MAX_ITEMS];
+    uint32_t item_count;
+
+    uint64_t last_apply_ns[DASH_SCHED_CLASS_COUNT];
+    bool held[DASH_SCHED_CLASS_COUNT];
+    dash_sched_class_stats_t stats[DASH_SCHED_CLASS_COUNT];
+
+    uint64_t last_frame_ns;
+    uint32_t window_frames;
+    uint32_t window_overruns;
+    uint32_t shed_level;
+    uint32_t overruns;
+    uint32_t max_shed_level;
+};
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static uint32_t class_shift(const dash_sched_t *sched, dash_sched_class_t cls);
+static bool class_due(dash_sched_t *sched, dash_sched_class_t cls, uint64_t now);
+static void measure_load(dash_sched_t *sched, uint64_t now);
+static void refr_start_cb(lv_event_t *e);
+static void report_timer_cb(lv_timer_t *timer);
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+static const sched_class_t classes[DASH_SCHED_CLASS_COUNT] = {
+    [DASH_SCHED_SAFETY] = { "safety", 0, false },
+    [DASH_SCHED_FRAME] = { "frame", 0, true },
+    [DASH_SCHED_20HZ] = { "20Hz", 50, true },
+    [DASH_SCHED_2HZ] = { "2Hz", 500, true },
+};
+
+/**********************
+ *      MACROS
+ **********************/
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+dash_sched_t *dash_sched_create(lv_display_t *display)
+{
+    dash_sched_t *sched;
+    int report_sec;
+
+    sched = lv_malloc_zeroed(sizeof(dash_sched_t));
+    LV_ASSERT_NULL(sched);
+
+    sched->display = display;
+    lv_display_add_event_cb(display, refr_start_cb, LV_EVENT_REFR_START, sched);
+
+    report_sec = atoi(getenv_default("LV_DASH_SCHED_REPORT", "0"));
+    if (report_sec > 0) {
+        lv_timer_create(report_timer_cb, (uint32_t)report_sec * 1000, sched);
+    }
+
+    return sched;
+}
+
+dash_sched_item_t *dash_sched_add(dash_sched_t *sched, const char *name, dash_sched_class_t cls,
+                                  dash_sched_apply_cb_t cb, void *user_data)
+{
+    dash_sched_item_t *item;
+
+    LV_ASSERT(cls < DASH_SCHED_CLASS_COUNT);
+
+    if (sched->item_count == DASH_SCHED_MAX_ITEMS) {
+        LV_LOG_WARN("Too many scheduled items, %s not added", name);
+        return NULL;
+    }
+
+    item = &sched->items[sched->item_count++];
+    item->sched = sched;
+    item->name = name;
+    item->cls = cls;
+    item->cb = cb;
+    item->user_data = user_data;
+
+    return item;
+}
+
+dash_sched_item_t *dash_sched_find(dash_sched_t *sched, const char *name)
+{
+    uint32_t i;
+
+    for (i = 0; i < sched->item_count; i++) {
+        if (strcmp(sched->items[i].name, name) == 0) {
+            return &sched->items[i];
+        }
+    }
+
+    return NULL;
+}
+
+void dash_sched_post(dash_sched_item_t *item, int32_t value)
+{
+    dash_sched_t *sched = item->sched;
+    bool changed;
+
+    /* Compared to the value pending, or to the value shown when none is */
+    if (item->pending_ns != 0) {
+        changed = value != item->value;
+    } else {
+        changed = !item->applied_once || value != item->applied_value;
+    }
+
+    sched->stats[item->cls].posted++;
+
+    if (item->pending_ns != 0) {
+        sched->stats[item->cls].coalesced++;
+    } else {
+        item->pending_ns = perf_time_ns();
+    }
+
+    item->value = value;
+    tickless_request_frame(sched->display);
+
+    /* Do not wait for the refresh period, unless the value shown does not change */
+    if (item->cls == DASH_SCHED_SAFETY && changed) {
+        lv_timer_ready(lv_display_get_refr_timer(sched->display));
+    }
+}
+
+uint32_t dash_sched_get_shed_level(const dash_sched_t *sched)
+{
+    return sched->shed_level;
+}
+
+void dash_sched_get_stats(const dash_sched_t *sched, dash_sched_class_t cls, dash_sched_class_stats_t *stats)
+{
+    LV_ASSERT(cls < DASH_SCHED_CLASS_COUNT);
+
+    *stats = sched->stats[cls];
+}
+
+void dash_sched_report(dash_sched_t *sched)
+{
+    const dash_sched_class_stats_t *s;
+    uint32_t i;
+
+    fprintf(stdout, "sched: %u overrun frames, shedding level %u (max %u)\n",
+            sched->overruns, sched->shed_level, sched->max_shed_level);
+
+    for (i = 0; i < DASH_SCHED_CLASS_COUNT; i++) {
+        s = &sched->stats[i];
+        fprintf(stdout, "sched %-6s: posted=%u applied=%u coalesced=%u decimated=%u missed=%u (x%u)\n",
+                classes[i].name, s->posted, s->applied, s->coalesced, s->decimated, s->missed,
+                1u << class_shift(sched, (dash_sched_class_t)i));
+    }
+
+    memset(sched->stats, 0, sizeof(sched->stats));
+    sched->overruns = 0;
+    sched->max_shed_level = sched->shed_level;
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+/**
+ * Get how much a class is slowed down by the load shedding
+ *
+ * Level 1 and 2 slow down the last class 2 and 4 times, level 3 and 4 the
+ * class before and so on.
+ *
+ * @param sched the scheduler
+ * @param cls the class
+ * @return the period of the class is multiplied by 2^shift
+ */
+static uint32_t class_shift(const dash_sched_t *sched, dash_sched_class_t cls)
+{
+    uint32_t first_level;
+
+    if (!classes[cls].decimated) {
+        return 0;
+    }
+
+    first_level = (DASH_SCHED_CLASS_COUNT - 1 - cls) * SHED_MAX_SHIFT;
+    if (sched->shed_level <= first_level) {
+        return 0;
+    }
+
+    return LV_MIN(sched->shed_level - first_level, SHED_MAX_SHIFT);
+}
+
+/**
+ * Check if the pending values of a class must be applied in this frame
+ *
+ * @param sched the scheduler
+ * @param cls the class
+ * @param now the start of the frame
+ * @return true if the class is due
+ */
+static bool class_due(dash_sched_t *sched, dash_sched_class_t cls, uint64_t now)
+{
+    uint32_t shift = class_shift(sched, cls);
+    uint64_t period_ns = (uint64_t)(classes[cls].period_ms ? classes[cls].period_ms : LV_DEF_REFR_PERIOD) * 1000000;
+    uint64_t half_frame_ns = (uint64_t)LV_DEF_REFR_PERIOD * 1000000 / 2;
+    uint64_t elapsed = now - sched->last_apply_ns[cls];
+
+    if (classes[cls].period_ms == 0 && shift == 0) {
+        return true;
+    }
+
+    /* Due in the frame closest to the period */
+    if (elapsed + half_frame_ns >= (period_ns << shift)) {
+        return true;
+    }
+
+    if (!sched->held[cls] && shift > 0 && elapsed + half_frame_ns >= period_ns) {
+        sched->held[cls] = true;
+        sched->stats[cls].decimated++;
+    }
+
+    return false;
+}
+
+/**
+ * Raise or lower the shedding level from the interval between frames
+ *
+ * @param sched the scheduler
+ * @param now the start of the frame
+ */
+static void measure_load(dash_sched_t *sched, uint64_t now)
+{
+    uint32_t max_level = (DASH_SCHED_CLASS_COUNT - 1) * SHED_MAX_SHIFT;
+
+    if (sched->last_frame_ns != 0 && !tickless_frame_after_idle(sched->display) &&
+        now - sched->last_frame_ns > (uint64_t)FRAME_BUDGET_MS * 1000000) {
+        sched->window_overruns++;
+        sched->overruns++;
+    }
+    sched->last_frame_ns = now;
+
+    if (++sched->window_frames < SHED_WINDOW) {
+        return;
+    }
+
+    if (sched->window_overruns >= SHED_OVERRUNS && sched->shed_level < max_level) {
+        sched->shed_level++;
+    } else if (sched->window_overruns == 0 && sched->shed_level > 0) {
+        sched->shed_level--;
+    }
+
+    sched->max_shed_level = LV_MAX(sched->max_shed_level, sched->shed_level);
+    sched->window_frames = 0;
+    sched->window_overruns = 0;
+}
+
+/**
+ * Apply the pending values of the classes due in this frame
+ *
+ * @param e the refresh start event
+ */
+static void refr_start_cb(lv_event_t *e)
+{
+    dash_sched_t *sched = lv_event_get_user_data(e);
+    uint64_t now = perf_time_ns();
+    bool due[DASH_SCHED_CLASS_COUNT];
+    bool pending[DASH_SCHED_CLASS_COUNT] = { false };
+    dash_sched_item_t *item;
+    uint64_t deadline_ns;
+    uint32_t i;
+
+    measure_load(sched, now);
+
+    for (i = 0; i < sched->item_count; i++) {
+        if (sched->items[i].pending_ns != 0) {
+            pending[sched->items[i].cls] = true;
+        }
+    }
+
+    for (i = 0; i < DASH_SCHED_CLASS_COUNT; i++) {
+        due[i] = pending[i] && class_due(sched, (dash_sched_class_t)i, now);
+        if (due[i]) {
+            sched->last_apply_ns[i] = now;
+            sched->held[i] = false;
+        }
+    }
+
+    for (i = 0; i < sched->item_count; i++) {
+        item = &sched->items[i];
+        if (item->pending_ns == 0) {
+            continue;
+        }
+
+        if (!due[item->cls]) {
+            tickless_request_frame(sched->display);
+            continue;
+        }
+
+        deadline_ns = (uint64_t)(classes[item->cls].period_ms + DEADLINE_SLACK_MS) * 1000000;
+        if (now - item->pending_ns > deadline_ns) {
+            sched->stats[item->cls].missed++;
+        }
+        sched->stats[item->cls].applied++;
+        item->pending_ns = 0;
+
+        if (item->applied_once && item->value == item->applied_value) {
+            continue;
+        }
+
+        item->applied_value = item->value;
+        item->applied_once = true;
+        FRAME_TRACE_BEGIN(item->name);
+        item->cb(item->value, item->user_data);
+        FRAME_TRACE_END(item->name);
+    }
+}
+
+/**
+ * Print and reset the counters
+ *
+ * @param timer the report timer
+ */
+static void report_timer_cb(lv_timer_t *timer)
+{
+    dash_sched_report(lv_timer_get_user_data(timer));
+}
@@ -0,0 +1,133 @@
+/**
+ * @file dash_sched.h
+ *
+ * Update scheduler of the dashboard elements
+ *
+ * Every element declares an update class. The values posted by the data
+ * sources are coalesced and applied at the start of a frame when the
+ * class is due. When the frames overrun, the low priority classes are
+ * decimated first, the safety class is always applied on the next frame.
+ *
+ */
+
+#ifndef DASH_SCHED_H
+#define DASH_SCHED_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "lvgl/lvgl.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define DASH_SCHED_MAX_ITEMS 32
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/* Sorted by priority, the last classes are decimated first */
+typedef enum {
+    DASH_SCHED_SAFETY,  /* Every frame, never decimated: telltales */
+    DASH_SCHED_FRAME,   /* Every frame: RPM, shift light */
+    DASH_SCHED_20HZ,    /* Speed */
+    DASH_SCHED_2HZ,     /* Coolant temperature, fuel */
+    DASH_SCHED_CLASS_COUNT,
+} dash_sched_class_t;
+
+typedef struct {
+    uint32_t posted;        /* Values posted */
+    uint32_t applied;       /* Values applied to the elements */
+    uint32_t coalesced;     /* Values replaced by a newer one before being applied */
+    uint32_t decimated;     /* Updates held back by the load shedding */
+    uint32_t missed;        /* Values applied after their deadline */
+} dash_sched_class_stats_t;
+
+/**
+ * Apply a value to an element
+ * @param value the last value posted
+ * @param user_data the user data of the item
+ */
+typedef void (*dash_sched_apply_cb_t)(int32_t value, void *user_data);
+
+typedef struct _dash_sched_t dash_sched_t;
+typedef struct _dash_sched_item_t dash_sched_item_t;
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+/**
+ * @description Create a scheduler
+ * @param display the display whose frames apply the updates
+ * @return the scheduler
+ * @note LV_DASH_SCHED_REPORT=N prints the counters of each class every N seconds
+ */
+dash_sched_t *dash_sched_create(lv_display_t *display);
+
+/**
+ * @description Add an element to the scheduler
+ * @param sched the scheduler
+ * @param name the name of the element
+ * @param cls the update class of the element
+ * @param cb applies a value to the element
+ * @param user_data passed to cb
+ * @return the item, NULL if DASH_SCHED_MAX_ITEMS are already added
+ */
+dash_sched_item_t *dash_sched_add(dash_sched_t *sched, const char *name, dash_sched_class_t cls,
+                                  dash_sched_apply_cb_t cb, void *user_data);
+
+/**
+ * @description Find an element by name
+ * @param sched the scheduler
+ * @param name the name given to dash_sched_add
+ * @return the item, NULL if not found
+ */
+dash_sched_item_t *dash_sched_find(dash_sched_t *sched, const char *name);
+
+/**
+ * @description Post a new value, it replaces the value not applied yet
+ * @param item the item
+ * @param value the value
+ */
+void dash_sched_post(dash_sched_item_t *item, int32_t value);
+
+/**
+ * @description Get the current load shedding level
+ * @param sched the scheduler
+ * @return 0 when no class is decimated
+ */
+uint32_t dash_sched_get_shed_level(const dash_sched_t *sched);
+
+/**
+ * @description Get the counters of a class since the last report
+ * @param sched the scheduler
+ * @param cls the class
+ * @param stats the counters
+ */
+void dash_sched_get_stats(const dash_sched_t *sched, dash_sched_class_t cls, dash_sched_class_stats_t *stats);
+
+/**
+ * @description Print and reset the counters of each class
+ * @param sched the scheduler
+ */
+void dash_sched_report(dash_sched_t *sched);
+
+/**********************
+ *      MACROS
+ **********************/
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif /*DASH_SCHED_H*/
@@ -0,0 +1,536 @@
+/**
+ * @file dash_telltales.c
+ *
+ * Telltale layer driven by bit masks
+ *
+ * The telltale images are decoded once and packed into an atlas, each
+ * telltale is drawn from a draw buffer pointing inside the atlas with the
+ * atlas stride. The atlas is ARGB8888, or A8 when the telltales are A8
+ * masks: a quarter of the memory, and the mask is blended with the color
+ * of the telltale in one pass, so the color changes without a new image.
+ *
+ * The blink phase is derived from one clock started when the first
+ * telltale starts blinking, it is sampled at LV_EVENT_REFR_START so every
+ * blinking telltale toggles in the same frame.
+ *
+ * A mask change readies the refresh timer so that it is drawn by the next
+ * timer handler run. The time from a mask change, or from a blink edge, to
+ * the end of the flush of the frame showing it is recorded.
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lvgl/lvgl.h"
+
+#include "src/lib/simulator_util.h"
+#include "src/lib/perf_stats.h"
+#include "src/lib/tickless.h"
+#include "dash_telltales.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/* A change is drawn by the next refresh, the frame after at worst */
+#define LATENCY_BOUND_US (2 * LV_DEF_REFR_PERIOD * 1000)
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+typedef struct {
+    lv_draw_buf_t *atlas;
+    lv_draw_buf_t views[DASH_TELLTALES_MAX];    /* Telltales inside the atlas */
+    lv_area_t areas[DASH_TELLTALES_MAX];        /* Relative to the layer */
+    lv_color_t colors[DASH_TELLTALES_MAX];      /* Color of the A8 masks */
+    uint32_t count;
+
+    uint32_t on_mask;
+    uint32_t blink_mask;
+    uint32_t shown;
+
+    /* Shared blink phase */
+    uint32_t half_period_ms;
+    uint64_t blink_epoch_ns;
+    uint64_t blink_edge;
+
+    lv_display_t *display;
+    lv_timer_t *phase_timer;
+    lv_timer_t *report_timer;
+
+    /* Oldest change not presented yet */
+    uint64_t pending_ns;
+    perf_hist_t latency_us;
+    uint32_t late;
+} telltales_t;
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static bool build_atlas(telltales_t *t, const char *const *srcs, const lv_point_t *pos);
+static void print_atlas(const telltales_t *t);
+static void invalidate_telltale(lv_obj_t *obj, const telltales_t *t, uint32_t id);
+static bool update_shown(lv_obj_t *obj, telltales_t *t, uint64_t change_ns);
+static void refr_start_cb(lv_event_t *e);
+static void flush_finish_cb(lv_event_t *e);
+static void phase_timer_cb(lv_timer_t *timer);
+static void report_timer_cb(lv_timer_t *timer);
+static void draw_cb(lv_event_t *e);
+static void delete_cb(lv_event_t *e);
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+/**********************
+ *      MACROS
+ **********************/
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+lv_obj_t *dash_telltales_create(lv_obj_t *parent, const char *const *srcs, const lv_point_t *pos,
+                                uint32_t count)
+{
+    telltales_t *t;
+    lv_obj_t *obj;
+    lv_area_t bbox;
+    int report_sec;
+    uint32_t i;
+
+    LV_ASSERT(count > 0 && count <= DASH_TELLTALES_MAX);
+
+    t = lv_malloc_zeroed(sizeof(telltales_t));
+    LV_ASSERT_NULL(t);
+
+    t->count = count;
+    t->half_period_ms = DASH_TELLTALES_BLINK_PERIOD_MS / 2;
+    t->display = lv_obj_get_display(parent);
+    perf_hist_reset(&t->latency_us);
+    for (i = 0; i < count; i++) {
+        t->colors[i] = lv_color_white();
+    }
+
+    if (!build_atlas(t, srcs, pos)) {
+        LV_LOG_WARN("Failed to build the telltale atlas");
+    }
+
+    /* The layer covers the bounding box of the telltales */
+    bbox = t->areas[0];
+    for (i = 1; i < count; i++) {
+        bbox.x1 = LV_MIN(bbox.x1, t->areas[i].x1);
+        bbox.y1 = LV_MIN(bbox.y1, t->areas[i].y1);
+        bbox.x2 = LV_MAX(bbox.x2, t->areas[i].x2);
+        bbox.y2 = LV_MAX(bbox.y2, t->areas[i].y2);
+    }
+    for (i = 0; i < count; i++) {
+        lv_area_move(&t->areas[i], -bbox.x1, -bbox.y1);
+    }
+
+    obj = lv_obj_create(parent);
+    lv_obj_remove_style_all(obj);
+    lv_obj_remove_flag(obj, LV_OBJ_FLAG_CLICKABLE | LV_OBJ_FLAG_SCROLLABLE);
+    lv_obj_set_pos(obj, bbox.x1, bbox.y1);
+    lv_obj_set_size(obj, lv_area_get_width(&bbox), lv_area_get_height(&bbox));
+    lv_obj_set_user_data(obj, t);
+
+    lv_obj_add_event_cb(obj, draw_cb, LV_EVENT_DRAW_MAIN, t);
+    lv_obj_add_event_cb(obj, delete_cb, LV_EVENT_DELETE, t);
+
+    lv_display_add_event_cb(t->display, refr_start_cb, LV_EVENT_REFR_START, obj);
+    lv_display_add_event_cb(t->display, flush_finish_cb, LV_EVENT_FLUSH_FINISH, t);
+
+    t->phase_timer = lv_timer_create(phase_timer_cb, t->half_period_ms, t);
+    lv_timer_pause(t->phase_timer);
+
+    report_sec = atoi(getenv_default("LV_DASH_TELLTALE_REPORT", "0"));
+    if (report_sec > 0) {
+        t->report_timer = lv_timer_create(report_timer_cb, (uint32_t)report_sec * 1000, t);
+        print_atlas(t);
+    }
+
+    return obj;
+}
+
+void dash_telltales_set_mask(lv_obj_t *obj, uint32_t on_mask, uint32_t blink_mask)
+{
+    telltales_t *t = lv_obj_get_user_data(obj);
+    uint32_t mask = t->count == 32 ? UINT32_MAX : (1u << t->count) - 1;
+
+    on_mask &= mask;
+    blink_mask &= on_mask;
+
+    /* The first blinking telltale starts the phase in the on state */
+    if (t->blink_mask == 0 && blink_mask != 0) {
+        t->blink_epoch_ns = perf_time_ns();
+        t->blink_edge = 0;
+        lv_timer_set_period(t->phase_timer, t->half_period_ms);
+        lv_timer_reset(t->phase_timer);
+        lv_timer_resume(t->phase_timer);
+    } else if (blink_mask == 0) {
+        lv_timer_pause(t->phase_timer);
+    }
+
+    t->on_mask = on_mask;
+    t->blink_mask = blink_mask;
+
+    if (update_shown(obj, t, perf_time_ns())) {
+        lv_timer_ready(lv_display_get_refr_timer(t->display));
+    }
+}
+
+void dash_telltales_set_color(lv_obj_t *obj, uint32_t id, lv_color_t color)
+{
+    telltales_t *t = lv_obj_get_user_data(obj);
+
+    if (id >= t->count || lv_color_eq(t->colors[id], color)) {
+        return;
+    }
+
+    t->colors[id] = color;
+
+    if (t->atlas != NULL && t->atlas->header.cf == LV_COLOR_FORMAT_A8 && (t->shown & (1u << id))) {
+        invalidate_telltale(obj, t, id);
+        lv_timer_ready(lv_display_get_refr_timer(t->display));
+    }
+}
+
+void dash_telltales_set_blink_period(lv_obj_t *obj, uint32_t period_ms)
+{
+    telltales_t *t = lv_obj_get_user_data(obj);
+
+    t->half_period_ms = LV_MAX(period_ms / 2, 1);
+    t->blink_epoch_ns = perf_time_ns();
+    t->blink_edge = 0;
+    lv_timer_set_period(t->phase_timer, t->half_period_ms);
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+/**
+ * Decode the telltales and pack them into the atlas
+ *
+ * @param t the layer
+ * @param srcs the image of each telltale
+ * @param pos the position of each telltale
+ * @return true if every telltale was decoded
+ */
+static bool build_atlas(telltales_t *t, const char *const *srcs, const lv_point_t *pos)
+{
+    lv_image_decoder_dsc_t dsc;
+    lv_image_header_t headers[DASH_TELLTALES_MAX];
+    int32_t slot_x[DASH_TELLTALES_MAX];
+    int32_t slot_y[DASH_TELLTALES_MAX];
+    int32_t atlas_w = 0;
+    int32_t row_h = 0;
+    int32_t x = 0;
+    int32_t y = 0;
+    lv_color_format_t cf = LV_COLOR_FORMAT_UNKNOWN;
+    uint32_t px_size;
+    uint32_t flags = 0;
+    bool ok = true;
+    uint32_t i;
+    int32_t row;
+
+    /* Shelf packing: left to right, a new row when the atlas is full */
+    for (i = 0; i < t->count; i++) {
+        if (lv_image_decoder_get_info(srcs[i], &headers[i]) != LV_RESULT_OK) {
+            memset(&headers[i], 0, sizeof(lv_image_header_t));
+        }
+
+        /* The first telltale gives the format of the atlas */
+        if (cf == LV_COLOR_FORMAT_UNKNOWN && headers[i].w != 0) {
+            cf = headers[i].cf == LV_COLOR_FORMAT_A8 ? LV_COLOR_FORMAT_A8 : LV_COLOR_FORMAT_ARGB8888;
+        }
+
+        if (x > 0 && x + (int32_t)headers[i].w > DASH_TELLTALES_ATLAS_MAX_W) {
+            x = 0;
+            y += row_h;
+            row_h = 0;
+        }
+
+        slot_x[i] = x;
+        slot_y[i] = y;
+        x += headers[i].w;
+        row_h = LV_MAX(row_h, (int32_t)headers[i].h);
+        atlas_w = LV_MAX(atlas_w, x);
+
+        t->areas[i].x1 = pos[i].x;
+        t->areas[i].y1 = pos[i].y;
+        t->areas[i].x2 = pos[i].x + (int32_t)headers[i].w - 1;
+        t->areas[i].y2 = pos[i].y + (int32_t)headers[i].h - 1;
+    }
+
+    if (atlas_w == 0 || y + row_h == 0) {
+        return false;
+    }
+
+    px_size = lv_color_format_get_size(cf);
+    t->atlas = lv_draw_buf_create(atlas_w, y + row_h, cf, 0);
+    LV_ASSERT_NULL(t->atlas);
+    lv_draw_buf_clear(t->atlas, NULL);
+
+    for (i = 0; i < t->count; i++) {
+        if (headers[i].w == 0 || lv_image_decoder_open(&dsc, srcs[i], NULL) != LV_RESULT_OK) {
+            ok = false;
+            continue;
+        }
+
+        if (dsc.decoded == NULL || dsc.decoded->header.cf != cf) {
+            LV_LOG_WARN("%s: telltales must all decode to ARGB8888 or to A8", srcs[i]);
+            lv_image_decoder_close(&dsc);
+            headers[i].w = 0;
+            ok = false;
+            continue;
+        }
+
+        for (row = 0; row < (int32_t)headers[i].h; row++) {
+            memcpy(t->atlas->data + (slot_y[i] + row) * t->atlas->header.stride + slot_x[i] * px_size,
+                   dsc.decoded->data + row * dsc.decoded->header.stride, headers[i].w * px_size);
+        }
+
+        flags |= dsc.decoded->header.flags & LV_IMAGE_FLAGS_PREMULTIPLIED;
+        lv_image_decoder_close(&dsc);
+    }
+
+    for (i = 0; i < t->count; i++) {
+        if (headers[i].w == 0) {
+            continue;
+        }
+        lv_draw_buf_init(&t->views[i], headers[i].w, headers[i].h, cf,
+                         t->atlas->header.stride,
+                         t->atlas->data + slot_y[i] * t->atlas->header.stride + slot_x[i] * px_size,
+                         t->atlas->header.stride * headers[i].h);
+        t->views[i].header.flags |= flags;
+    }
+
+    return ok;
+}
+
+/**
+ * Print the size of the atlas, and its size in ARGB8888 for an A8 atlas
+ *
+ * @param t the layer
+ */
+static void print_atlas(const telltales_t *t)
+{
+    uint32_t argb_size;
+
+    if (t->atlas == NULL) {
+        return;
+    }
+
+    argb_size = t->atlas->header.w * t->atlas->header.h * 4;
+    fprintf(stdout, "telltale: %u telltales in a %ux%u %s atlas, %u B (%u B as ARGB8888)\n", t->count,
+            (unsigned)t->atlas->header.w, (unsigned)t->atlas->header.h,
+            t->atlas->header.cf == LV_COLOR_FORMAT_A8 ? "A8" : "ARGB8888", t->atlas->data_size, argb_size);
+}
+
+/**
+ * Invalidate the area of a telltale
+ *
+ * @param obj the layer
+ * @param t the layer data
+ * @param id the telltale
+ */
+static void invalidate_telltale(lv_obj_t *obj, const telltales_t *t, uint32_t id)
+{
+    lv_area_t coords;
+    lv_area_t area;
+
+    lv_obj_get_coords(obj, &coords);
+    lv_area_copy(&area, &t->areas[id]);
+    lv_area_move(&area, coords.x1, coords.y1);
+    lv_obj_invalidate_area(obj, &area);
+}
+
+/**
+ * Apply the masks and the blink phase, invalidate the telltales which changed
+ *
+ * @param obj the layer
+ * @param t the layer data
+ * @param change_ns when the change to present happened
+ * @return true if a telltale changed
+ */
+static bool update_shown(lv_obj_t *obj, telltales_t *t, uint64_t change_ns)
+{
+    uint32_t visible;
+    uint32_t changed;
+    uint32_t i;
+
+    visible = t->on_mask & ~t->blink_mask;
+    if ((t->blink_edge & 1) == 0) {
+        visible |= t->blink_mask;
+    }
+
+    changed = visible ^ t->shown;
+    if (changed == 0) {
+        return false;
+    }
+
+    t->shown = visible;
+
+    for (i = 0; i < t->count; i++) {
+        if (changed & (1u << i)) {
+            invalidate_telltale(obj, t, i);
+        }
+    }
+
+    if (t->pending_ns == 0 || change_ns < t->pending_ns) {
+        t->pending_ns = change_ns;
+    }
+
+    return true;
+}
+
+/**
+ * Sample the blink phase at the start of the frame
+ *
+ * @param e the refresh start event
+ */
+static void refr_start_cb(lv_event_t *e)
+{
+    lv_obj_t *obj = lv_event_get_user_data(e);
+    telltales_t *t = lv_obj_get_user_data(obj);
+    uint64_t half_ns = (uint64_t)t->half_period_ms * 1000000;
+    uint64_t edge;
+
+    if (t->blink_mask == 0) {
+        return;
+    }
+
+    edge = (perf_time_ns() - t->blink_epoch_ns) / half_ns;
+    if (edge == t->blink_edge) {
+        return;
+    }
+
+    t->blink_edge = edge;
+
+    /* The latency is counted from the ideal edge, not from this frame */
+    update_shown(obj, t, t->blink_epoch_ns + edge * half_ns);
+}
+
+/**
+ * Record the latency once the frame showing a change is flushed
+ *
+ * @param e the flush finish event
+ */
+static void flush_finish_cb(lv_event_t *e)
+{
+    telltales_t *t = lv_event_get_user_data(e);
+    uint32_t latency_us;
+
+    if (t->pending_ns == 0 || !lv_display_flush_is_last(t->display)) {
+        return;
+    }
+
+    latency_us = (uint32_t)((perf_time_ns() - t->pending_ns) / 1000);
+    perf_hist_add(&t->latency_us, latency_us);
+    if (latency_us > LATENCY_BOUND_US) {
+        t->late++;
+    }
+
+    t->pending_ns = 0;
+}
+
+/**
+ * Make sure a frame starts at the blink edges
+ *
+ * @param timer the phase timer
+ */
+static void phase_timer_cb(lv_timer_t *timer)
+{
+    telltales_t *t = lv_timer_get_user_data(timer);
+
+    tickless_request_frame(t->display);
+    lv_timer_ready(lv_display_get_refr_timer(t->display));
+}
+
+/**
+ * Print and reset the latency statistics
+ *
+ * @param timer the report timer
+ */
+static void report_timer_cb(lv_timer_t *timer)
+{
+    telltales_t *t = lv_timer_get_user_data(timer);
+
+    perf_hist_print(&t->latency_us, "telltale mask-to-present", "us");
+    fprintf(stdout, "telltale: %u presented later than %u us\n", t->late, (unsigned)LATENCY_BOUND_US);
+
+    perf_hist_reset(&t->latency_us);
+    t->late = 0;
+}
+
+/**
+ * Draw the telltales which are on
+ *
+ * @param e the draw event
+ */
+static void draw_cb(lv_event_t *e)
+{
+    telltales_t *t = lv_event_get_user_data(e);
+    lv_obj_t *obj = lv_event_get_target_obj(e);
+    lv_layer_t *layer = lv_event_get_layer(e);
+    lv_draw_image_dsc_t dsc;
+    lv_area_t coords;
+    lv_area_t area;
+    uint32_t i;
+
+    if (t->shown == 0 || t->atlas == NULL) {
+        return;
+    }
+
+    lv_obj_get_coords(obj, &coords);
+
+    for (i = 0; i < t->count; i++) {
+        if ((t->shown & (1u << i)) == 0 || t->views[i].data == NULL) {
+            continue;
+        }
+
+        lv_area_copy(&area, &t->areas[i]);
+        lv_area_move(&area, coords.x1, coords.y1);
+
+        /* An A8 view is a mask, LVGL fills it with the recolor */
+        lv_draw_image_dsc_init(&dsc);
+        dsc.src = &t->views[i];
+        dsc.recolor = t->colors[i];
+        lv_draw_image(layer, &dsc, &area);
+    }
+}
+
+/**
+ * Release the atlas
+ *
+ * @param e the delete event
+ */
+static void delete_cb(lv_event_t *e)
+{
+    telltales_t *t = lv_event_get_user_data(e);
+    lv_obj_t *obj = lv_event_get_target_obj(e);
+
+    lv_display_remove_event_cb_with_user_data(t->display, refr_start_cb, obj);
+    lv_display_remove_event_cb_with_user_data(t->display, flush_finish_cb, t);
+    lv_timer_delete(t->phase_timer);
+    if (t->report_timer != NULL) {
+        lv_timer_delete(t->report_timer);
+    }
+
+    if (t->atlas != NULL) {
+        lv_draw_buf_destroy(t->atlas);
+    }
+
+    lv_free(t);
+}
@@ -0,0 +1,91 @@
+/**
+ * @file dash_telltales.h
+ *
+ * Telltale layer driven by bit masks
+ *
+ * All the telltales are drawn by one object from one atlas. Bit i of the
+ * masks controls the telltale i, the blinking ones share a single phase
+ * evaluated at the start of each frame and only the telltales whose
+ * visible state changed are invalidated. The telltales given as A8 masks
+ * are drawn with their own color, which can be changed at any time.
+ *
+ */
+
+#ifndef DASH_TELLTALES_H
+#define DASH_TELLTALES_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include "lvgl/lvgl.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define DASH_TELLTALES_MAX 32
+
+/* 90 flashes per minute, the middle of the range allowed for turn signals */
+#define DASH_TELLTALES_BLINK_PERIOD_MS 666
+
+/* Width of the atlas, the telltales are packed in rows */
+#define DASH_TELLTALES_ATLAS_MAX_W 1024
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+/**
+ * @description Create the telltale layer
+ * @param parent the parent object, the positions are relative to it
+ * @param srcs the image of each telltale, all full color or all A8 masks
+ * @param pos the position of each telltale
+ * @param count the number of telltales, at most DASH_TELLTALES_MAX
+ * @return the layer, all telltales off
+ * @note LV_DASH_TELLTALE_REPORT=N prints the size of the atlas, then the mask-to-present
+ *       latency every N seconds
+ */
+lv_obj_t *dash_telltales_create(lv_obj_t *parent, const char *const *srcs, const lv_point_t *pos,
+                                uint32_t count);
+
+/**
+ * @description Set the telltales to show
+ * @param obj the layer
+ * @param on_mask the telltales switched on
+ * @param blink_mask the telltales of on_mask which blink
+ */
+void dash_telltales_set_mask(lv_obj_t *obj, uint32_t on_mask, uint32_t blink_mask);
+
+/**
+ * @description Change the color of a telltale given as an A8 mask
+ * @param obj the layer
+ * @param id the telltale
+ * @param color the new color, white by default
+ * @note the full color telltales are not recolored
+ */
+void dash_telltales_set_color(lv_obj_t *obj, uint32_t id, lv_color_t color);
+
+/**
+ * @description Change the blink period of all the telltales
+ * @param obj the layer
+ * @param period_ms the duration of an on and off cycle
+ */
+void dash_telltales_set_blink_period(lv_obj_t *obj, uint32_t period_ms);
+
+/**********************
+ *      MACROS
+ **********************/
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif /*DASH_TELLTALES_H*/
@@ -0,0 +1,266 @@
+/**
+ * @file dash_timeline.c
+ *
+ * Keyframe timeline for the dashboard sequences
+ *
+ * The timeline is evaluated at LV_EVENT_REFR_START, so every track sees
+ * the same time within a frame and the changes are drawn by that frame.
+ * The callbacks only run when the value of their track changes. A running
+ * timeline requests every frame, the display does not go idle between
+ * two keyframes with LV_TICKLESS.
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "lvgl/lvgl.h"
+
+#include "src/lib/simulator_util.h"
+#include "src/lib/perf_stats.h"
+#include "src/lib/tickless.h"
+#include "dash_timeline.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define DASH_TIMELINE_MAX_TRACKS 16
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+struct _dash_timeline_t {
+    const char *name;
+    const dash_track_t *tracks;
+    uint32_t track_count;
+    int32_t values[DASH_TIMELINE_MAX_TRACKS];
+    dash_timeline_done_cb_t done_cb;
+    uint32_t duration_ms;
+
+    lv_display_t *display;
+    uint64_t start_ns;
+    uint64_t last_eval_ns;
+    uint64_t max_gap_ns;
+    uint32_t frames;
+    bool running;
+    bool report;
+};
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static int32_t track_value(const dash_track_t *track, uint32_t time_ms);
+static void evaluate(dash_timeline_t *timeline, uint32_t time_ms);
+static void refr_start_cb(lv_event_t *e);
+static void print_report(dash_timeline_t *timeline, uint64_t end_ns);
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+/**********************
+ *      MACROS
+ **********************/
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+dash_timeline_t *dash_timeline_create(const char *name, const dash_track_t *tracks, uint32_t track_count,
+                                      dash_timeline_done_cb_t done_cb)
+{
+    dash_timeline_t *timeline;
+    uint32_t i;
+
+    LV_ASSERT(track_count > 0 && track_count <= DASH_TIMELINE_MAX_TRACKS);
+
+    timeline = lv_malloc_zeroed(sizeof(dash_timeline_t));
+    LV_ASSERT_NULL(timeline);
+
+    timeline->name = name;
+    timeline->tracks = tracks;
+    timeline->track_count = track_count;
+    timeline->done_cb = done_cb;
+    timeline->report = atoi(getenv_default("LV_DASH_TIMELINE_REPORT", "0")) != 0;
+
+    for (i = 0; i < track_count; i++) {
+        LV_ASSERT(tracks[i].key_count > 0);
+        timeline->duration_ms = LV_MAX(timeline->duration_ms, tracks[i].keys[tracks[i].key_count - 1].time_ms);
+    }
+
+    return timeline;
+}
+
+void dash_timeline_start(dash_timeline_t *timeline, lv_display_t *display)
+{
+    uint32_t i;
+
+    if (timeline->running) {
+        lv_display_remove_event_cb_with_user_data(timeline->display, refr_start_cb, timeline);
+    }
+
+    timeline->display = display;
+    timeline->start_ns = perf_time_ns();
+    timeline->last_eval_ns = timeline->start_ns;
+    timeline->max_gap_ns = 0;
+    timeline->frames = 0;
+    timeline->running = true;
+
+    /* Apply the first keyframes right away */
+    for (i = 0; i < timeline->track_count; i++) {
+        timeline->values[i] = track_value(&timeline->tracks[i], 0);
+        if (timeline->tracks[i].cb != NULL) {
+            timeline->tracks[i].cb(timeline->values[i], timeline->tracks[i].user_data);
+        }
+    }
+
+    lv_display_add_event_cb(display, refr_start_cb, LV_EVENT_REFR_START, timeline);
+    tickless_request_frame(display);
+}
+
+void dash_timeline_set_report(dash_timeline_t *timeline, bool enable)
+{
+    timeline->report = enable;
+}
+
+uint32_t dash_timeline_get_duration(const dash_timeline_t *timeline)
+{
+    return timeline->duration_ms;
+}
+
+bool dash_timeline_is_running(const dash_timeline_t *timeline)
+{
+    return timeline->running;
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+/**
+ * Compute the value of a track
+ *
+ * @param track the track
+ * @param time_ms the time since the start of the timeline
+ * @return the value of the track at this time
+ */
+static int32_t track_value(const dash_track_t *track, uint32_t time_ms)
+{
+    const dash_keyframe_t *a;
+    const dash_keyframe_t *b;
+    uint32_t i;
+
+    if (time_ms <= track->keys[0].time_ms) {
+        return track->keys[0].value;
+    }
+
+    for (i = 1; i < track->key_count; i++) {
+        if (time_ms < track->keys[i].time_ms) {
+            break;
+        }
+    }
+
+    if (i == track->key_count) {
+        return track->keys[track->key_count - 1].value;
+    }
+
+    a = &track->keys[i - 1];
+    b = &track->keys[i];
+
+    if (track->type == DASH_TRACK_VISIBILITY) {
+        return a->value;
+    }
+
+    return a->value + (int32_t)(((int64_t)(b->value - a->value) * (time_ms - a->time_ms)) /
+                                (int64_t)(b->time_ms - a->time_ms));
+}
+
+/**
+ * Update the tracks whose value changed
+ *
+ * @param timeline the timeline
+ * @param time_ms the time since the start of the timeline
+ */
+static void evaluate(dash_timeline_t *timeline, uint32_t time_ms)
+{
+    const dash_track_t *track;
+    int32_t value;
+    uint32_t i;
+
+    for (i = 0; i < timeline->track_count; i++) {
+        track = &timeline->tracks[i];
+        value = track_value(track, time_ms);
+
+        if (value != timeline->values[i]) {
+            timeline->values[i] = value;
+            if (track->cb != NULL) {
+                track->cb(value, track->user_data);
+            }
+        }
+    }
+}
+
+/**
+ * Evaluate the timeline at the start of a frame
+ *
+ * @param e the refresh start event
+ */
+static void refr_start_cb(lv_event_t *e)
+{
+    dash_timeline_t *timeline = lv_event_get_user_data(e);
+    uint64_t now = perf_time_ns();
+    uint64_t elapsed_ms = (now - timeline->start_ns) / 1000000;
+
+    timeline->frames++;
+    timeline->max_gap_ns = LV_MAX(timeline->max_gap_ns, now - timeline->last_eval_ns);
+    timeline->last_eval_ns = now;
+
+    evaluate(timeline, (uint32_t)LV_MIN(elapsed_ms, timeline->duration_ms));
+
+    if (elapsed_ms < timeline->duration_ms) {
+        tickless_request_frame(timeline->display);
+        return;
+    }
+
+    timeline->running = false;
+    lv_display_remove_event_cb_with_user_data(timeline->display, refr_start_cb, timeline);
+
+    if (timeline->report) {
+        print_report(timeline, now);
+    }
+
+    if (timeline->done_cb != NULL) {
+        timeline->done_cb(timeline);
+    }
+}
+
+/**
+ * Compare the measured duration with the declared one
+ *
+ * The end is detected by the first frame after the last keyframe, so the
+ * timeline is on time when it is late by less than the longest frame gap.
+ * A sequence advanced per timer tick would be late by the sum of the delays.
+ *
+ * @param timeline the timeline
+ * @param end_ns when the end was detected
+ */
+static void print_report(dash_timeline_t *timeline, uint64_t end_ns)
+{
+    uint64_t took_us = (end_ns - timeline->start_ns) / 1000;
+    uint64_t late_us = took_us - (uint64_t)timeline->duration_ms * 1000;
+    uint64_t max_gap_us = timeline->max_gap_ns / 1000;
+
+    fprintf(stdout, "timeline %s: declared %u ms, took %llu.%03llu ms, %u frames, longest frame gap %llu us: %s\n",
+            timeline->name, timeline->duration_ms,
+            (unsigned long long)(took_us / 1000), (unsigned long long)(took_us % 1000),
+            timeline->frames, (unsigned long long)max_gap_us,
+            late_us <= max_gap_us ? "on time" : "LATE");
+}
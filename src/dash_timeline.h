@@ -0,0 +1,121 @@
+/**
+ * @file dash_timeline.h
+ *
+ * Keyframe timeline for the dashboard sequences
+ *
+ * A timeline is a set of tracks, each track is a list of keyframes over
+ * the time elapsed since the start of the timeline. The tracks are
+ * evaluated once per frame from the monotonic clock: a slow frame skips
+ * the intermediate values instead of stretching the sequence.
+ *
+ */
+
+#ifndef DASH_TIMELINE_H
+#define DASH_TIMELINE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "lvgl/lvgl.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+typedef struct {
+    uint32_t time_ms;
+    int32_t value;
+} dash_keyframe_t;
+
+typedef enum {
+    DASH_TRACK_LEVEL,       /* Linear between the keyframes */
+    DASH_TRACK_VISIBILITY,  /* Holds the value of the last keyframe reached */
+} dash_track_type_t;
+
+/**
+ * Called when the value of a track changes
+ * @param value the new value
+ * @param user_data the user data of the track
+ */
+typedef void (*dash_track_cb_t)(int32_t value, void *user_data);
+
+typedef struct {
+    dash_track_type_t type;
+    const dash_keyframe_t *keys;    /* Sorted by time */
+    uint32_t key_count;
+    dash_track_cb_t cb;
+    void *user_data;
+} dash_track_t;
+
+typedef struct _dash_timeline_t dash_timeline_t;
+
+/**
+ * Called once every track reached its last keyframe
+ * @param timeline the timeline
+ */
+typedef void (*dash_timeline_done_cb_t)(dash_timeline_t *timeline);
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+/**
+ * @description Create a timeline
+ * @param name the name used in the reports
+ * @param tracks the tracks, must stay valid while the timeline exists
+ * @param track_count the number of tracks
+ * @param done_cb called at the end of the timeline, can be NULL
+ * @return the timeline
+ */
+dash_timeline_t *dash_timeline_create(const char *name, const dash_track_t *tracks, uint32_t track_count,
+                                      dash_timeline_done_cb_t done_cb);
+
+/**
+ * @description Start the timeline, it is evaluated at the start of every frame of the display
+ * @param timeline the timeline
+ * @param display the display whose frames drive the timeline
+ */
+void dash_timeline_start(dash_timeline_t *timeline, lv_display_t *display);
+
+/**
+ * @description Print the declared and the measured duration when the timeline ends
+ * @param timeline the timeline
+ * @param enable true to print the report
+ * @note also enabled by LV_DASH_TIMELINE_REPORT=1
+ */
+void dash_timeline_set_report(dash_timeline_t *timeline, bool enable);
+
+/**
+ * @description Get the time of the last keyframe
+ * @param timeline the timeline
+ * @return the duration in milliseconds
+ */
+uint32_t dash_timeline_get_duration(const dash_timeline_t *timeline);
+
+/**
+ * @description Check if a timeline is running
+ * @param timeline the timeline
+ * @return true between dash_timeline_start() and the end of the timeline
+ */
+bool dash_timeline_is_running(const dash_timeline_t *timeline);
+
+/**********************
+ *      MACROS
+ **********************/
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif /*DASH_TIMELINE_H*/
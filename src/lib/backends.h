@@ -36,6 +36,8 @@ typedef void (*run_loop_t)(void);
 typedef struct {
     display_init_t init_display; /* The display creation/initialization function */
     run_loop_t run_loop;         /* The run loop of the driver handle */
+    bool shared_loop;            /* The run loop only runs the LVGL timers, it can drive other displays */
+    bool thread_flush;           /* The flush callback may run off the UI thread */
     lv_display_t *display;       /* The LVGL display that was created */
 } display_backend_t;
 
@@ -11,6 +11,10 @@
  *
  * Author: EDGEMTech Ltd, Erik Tagirov (erik.tagirov@edgemtech.ch)
  *
+ * The LVGL driver scans out the format of LV_COLOR_DEPTH, the formats of
+ * the planes are probed to tell when another depth would avoid a
+ * conversion or would be the only one supported.
+ *
  */
 
 /*********************
@@ -19,12 +23,18 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <fcntl.h>
 
 #include "lvgl/lvgl.h"
 #if LV_USE_LINUX_DRM
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+#include <drm_fourcc.h>
+
 #include "../simulator_util.h"
 #include "../simulator_settings.h"
 #include "../backends.h"
+#include "../event_loop.h"
 
 /*********************
  *      DEFINES
@@ -39,6 +49,7 @@
  **********************/
 static void run_loop_drm(void);
 static lv_display_t *init_drm(void);
+static void probe_formats(const char *device);
 
 
 /**********************
@@ -69,6 +80,8 @@ int backend_init_drm(backend_t *backend)
 
     backend->handle->display->init_display = init_drm;
     backend->handle->display->run_loop = run_loop_drm;
+    backend->handle->display->shared_loop = true;
+    backend->handle->display->thread_flush = true;
     backend->name = backend_name;
     backend->type = BACKEND_DISPLAY;
 
@@ -93,11 +106,65 @@ static lv_display_t *init_drm(void)
         return NULL;
     }
 
+    probe_formats(device);
     lv_linux_drm_set_file(disp, device, -1);
 
     return disp;
 }
 
+/**
+ * Check that a plane scans out the format rendered by LVGL
+ *
+ * @param device the DRM card
+ */
+static void probe_formats(const char *device)
+{
+    const uint32_t rendered = LV_COLOR_DEPTH == 32 ? DRM_FORMAT_XRGB8888 : DRM_FORMAT_RGB565;
+    drmModePlaneRes *res;
+    drmModePlane *plane;
+    bool has_rgb565 = false;
+    bool has_xrgb8888 = false;
+    uint32_t i;
+    uint32_t j;
+    int fd;
+
+    fd = open(device, O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+
+    drmSetClientCap(fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1);
+
+    res = drmModeGetPlaneResources(fd);
+    for (i = 0; res != NULL && i < res->count_planes; i++) {
+        plane = drmModeGetPlane(fd, res->planes[i]);
+        if (plane == NULL) {
+            continue;
+        }
+
+        for (j = 0; j < plane->count_formats; j++) {
+            has_rgb565 |= plane->formats[j] == DRM_FORMAT_RGB565;
+            has_xrgb8888 |= plane->formats[j] == DRM_FORMAT_XRGB8888;
+        }
+
+        drmModeFreePlane(plane);
+    }
+
+    if (res != NULL) {
+        drmModeFreePlaneResources(res);
+    }
+    close(fd);
+
+    LV_LOG_USER("%s planes: RGB565 %s, XRGB8888 %s, rendering %s", device,
+                has_rgb565 ? "yes" : "no", has_xrgb8888 ? "yes" : "no",
+                rendered == DRM_FORMAT_RGB565 ? "RGB565" : "XRGB8888");
+
+    if ((rendered == DRM_FORMAT_RGB565 && !has_rgb565) || (rendered == DRM_FORMAT_XRGB8888 && !has_xrgb8888)) {
+        LV_LOG_WARN("No plane scans out the format of LV_COLOR_DEPTH %d, build with LV_COLOR_DEPTH %d",
+                    LV_COLOR_DEPTH, LV_COLOR_DEPTH == 32 ? 16 : 32);
+    }
+}
+
 
 /**
  * The run loop of the DRM driver
@@ -110,7 +177,7 @@ static void run_loop_drm(void)
     while (true) {
         /* Returns the time to the next timer execution */
         idle_time = lv_timer_handler();
-        usleep(idle_time * 1000);
+        event_loop_wait(idle_time);
     }
 }
 
@@ -10,6 +10,11 @@
  *
  * Author: EDGEMTech Ltd, Erik Tagirov (erik.tagirov@edgemtech.ch)
  *
+ * The format of the framebuffer is probed before creating the display:
+ * LVGL renders in it when it can, otherwise it renders in a format of the
+ * same depth, or the one given by LV_LINUX_FBDEV_RENDER_FORMAT, and the
+ * flushed areas are converted while they are copied to the framebuffer.
+ *
  */
 
 /*********************
@@ -18,32 +23,70 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/fb.h>
 
 #include "lvgl/lvgl.h"
 #if LV_USE_LINUX_FBDEV
 #include "../simulator_util.h"
 #include "../backends.h"
+#include "../event_loop.h"
+#include "../perf_stats.h"
+#include "../px_convert.h"
 
 /*********************
  *      DEFINES
  *********************/
 
+/* Height of the draw buffers of the converting path, in screens */
+#define CONVERT_BUF_DIV 10
+
 /**********************
  *      TYPEDEFS
  **********************/
 
+typedef struct {
+    px_format_t format;
+    lv_color_format_t cf;
+    px_convert_fn_t convert;    /* NULL when LVGL renders in the format of the framebuffer */
+
+    /* Converting path */
+    int fd;
+    uint8_t *fbp;
+    size_t fb_size;
+    uint32_t line_length;
+    uint32_t xoffset;
+    uint32_t yoffset;
+
+    uint64_t flushed_bytes;
+    uint64_t converted_bytes;
+    perf_hist_t flushed_hist;
+    perf_hist_t converted_hist;
+} fbdev_format_t;
+
 /**********************
  *  STATIC PROTOTYPES
  **********************/
 
 static lv_display_t *init_fbdev(void);
 static void run_loop_fbdev(void);
+static px_format_t probe_format(const char *device);
+static void choose_render_format(fbdev_format_t *f);
+static lv_display_t *create_converting(const char *device, fbdev_format_t *f);
+static void convert_flush_cb(lv_display_t *disp, const lv_area_t *area, uint8_t *px_map);
+static void format_event_cb(lv_event_t *e);
+static void format_report_cb(lv_timer_t *timer);
 
 /**********************
  *  STATIC VARIABLES
  **********************/
 
 static char *backend_name = "FBDEV";
+static fbdev_format_t fb_format;
 
 /**********************
  *      MACROS
@@ -68,6 +111,8 @@ int backend_init_fbdev(backend_t *backend)
 
     backend->handle->display->init_display = init_fbdev;
     backend->handle->display->run_loop = run_loop_fbdev;
+    backend->handle->display->shared_loop = true;
+    backend->handle->display->thread_flush = true;
     backend->name = backend_name;
     backend->type = BACKEND_DISPLAY;
 
@@ -86,17 +131,264 @@ int backend_init_fbdev(backend_t *backend)
 static lv_display_t *init_fbdev(void)
 {
     const char *device = getenv_default("LV_LINUX_FBDEV_DEVICE", "/dev/fb0");
-    lv_display_t *disp = lv_linux_fbdev_create();
+    fbdev_format_t *f = &fb_format;
+    lv_display_t *disp;
+    int report_sec;
+
+    f->format = probe_format(device);
+    choose_render_format(f);
+
+    if (f->convert != NULL) {
+        disp = create_converting(device, f);
+    } else {
+        disp = lv_linux_fbdev_create();
+        if (disp != NULL) {
+            lv_linux_fbdev_set_file(disp, device);
+            if (f->cf != LV_COLOR_FORMAT_UNKNOWN && lv_display_get_color_format(disp) != f->cf) {
+                LV_LOG_WARN("fbdev renders in color format %d instead of %d",
+                            lv_display_get_color_format(disp), f->cf);
+            }
+        }
+    }
 
     if (disp == NULL) {
         return NULL;
     }
 
-    lv_linux_fbdev_set_file(disp, device);
+    LV_LOG_USER("%s: %s framebuffer, %s", device, px_format_name(f->format),
+                f->convert != NULL ? "converting the flushed areas" : "rendering natively");
+
+    perf_hist_reset(&f->flushed_hist);
+    perf_hist_reset(&f->converted_hist);
+    lv_display_add_event_cb(disp, format_event_cb, LV_EVENT_FLUSH_START, f);
+    lv_display_add_event_cb(disp, format_event_cb, LV_EVENT_REFR_READY, f);
+
+    report_sec = atoi(getenv_default("LV_LINUX_FBDEV_FORMAT_REPORT", "0"));
+    if (report_sec > 0) {
+        lv_timer_create(format_report_cb, (uint32_t)report_sec * 1000, f);
+    }
 
     return disp;
 }
 
+/**
+ * Read the pixel format of the framebuffer
+ *
+ * The byte order of RGB565 cannot be probed, LV_LINUX_FBDEV_SWAP=1 selects
+ * big endian pixels.
+ *
+ * @param device the framebuffer device
+ * @return the format, PX_FORMAT_UNKNOWN if not supported
+ */
+static px_format_t probe_format(const char *device)
+{
+    struct fb_var_screeninfo vinfo;
+    int fd;
+    int ret;
+
+    fd = open(device, O_RDONLY);
+    if (fd < 0) {
+        LV_LOG_WARN("Failed to open %s", device);
+        return PX_FORMAT_UNKNOWN;
+    }
+
+    ret = ioctl(fd, FBIOGET_VSCREENINFO, &vinfo);
+    close(fd);
+
+    if (ret < 0) {
+        return PX_FORMAT_UNKNOWN;
+    }
+
+    switch (vinfo.bits_per_pixel) {
+    case 16:
+        if (vinfo.red.offset == 0 && vinfo.blue.offset == 11) {
+            return PX_FORMAT_BGR565;
+        }
+        return atoi(getenv_default("LV_LINUX_FBDEV_SWAP", "0")) ? PX_FORMAT_RGB565_SWAPPED : PX_FORMAT_RGB565;
+    case 24:
+        return vinfo.red.offset == 16 ? PX_FORMAT_RGB888 : PX_FORMAT_UNKNOWN;
+    case 32:
+        if (vinfo.red.offset == 0 && vinfo.blue.offset == 16) {
+            return PX_FORMAT_XBGR8888;
+        }
+        return vinfo.red.offset == 16 ? PX_FORMAT_XRGB8888 : PX_FORMAT_UNKNOWN;
+    default:
+        return PX_FORMAT_UNKNOWN;
+    }
+}
+
+/**
+ * Choose the color format rendered by LVGL and the converter
+ *
+ * @param f the format of the framebuffer
+ */
+static void choose_render_format(fbdev_format_t *f)
+{
+    const char *request = getenv_default("LV_LINUX_FBDEV_RENDER_FORMAT", "native");
+
+    f->cf = px_format_to_color_format(f->format);
+    f->convert = NULL;
+
+    if (strcmp(request, "RGB565") == 0 || strcmp(request, "XRGB8888") == 0) {
+        lv_color_format_t cf = strcmp(request, "RGB565") == 0 ? LV_COLOR_FORMAT_RGB565 : LV_COLOR_FORMAT_XRGB8888;
+
+        if (cf == f->cf) {
+            return;
+        }
+
+        f->convert = px_convert_find(cf, f->format);
+        if (f->convert != NULL) {
+            f->cf = cf;
+            return;
+        }
+
+        LV_LOG_WARN("No conversion from %s to a %s framebuffer", request, px_format_name(f->format));
+    }
+
+    /* LVGL can not render in this format, render the same depth and convert */
+    if (f->cf == LV_COLOR_FORMAT_UNKNOWN) {
+        f->cf = px_format_get_render_format(f->format);
+        f->convert = px_convert_find(f->cf, f->format);
+    }
+}
+
+/**
+ * Create a display rendering in partial mode and converting the flushed
+ * areas into the framebuffer
+ *
+ * @param device the framebuffer device
+ * @param f the format of the framebuffer
+ * @return the display, NULL on error
+ */
+static lv_display_t *create_converting(const char *device, fbdev_format_t *f)
+{
+    struct fb_var_screeninfo vinfo;
+    struct fb_fix_screeninfo finfo;
+    lv_display_t *disp;
+    lv_draw_buf_t *buf1;
+    lv_draw_buf_t *buf2;
+    uint32_t buf_h;
+
+    f->fd = open(device, O_RDWR);
+    if (f->fd < 0) {
+        LV_LOG_ERROR("Failed to open %s", device);
+        return NULL;
+    }
+
+    if (ioctl(f->fd, FBIOGET_FSCREENINFO, &finfo) < 0 || ioctl(f->fd, FBIOGET_VSCREENINFO, &vinfo) < 0) {
+        LV_LOG_ERROR("Failed to read the screen info of %s", device);
+        close(f->fd);
+        return NULL;
+    }
+
+    f->fb_size = finfo.smem_len;
+    f->line_length = finfo.line_length;
+    f->xoffset = vinfo.xoffset;
+    f->yoffset = vinfo.yoffset;
+
+    f->fbp = mmap(NULL, f->fb_size, PROT_READ | PROT_WRITE, MAP_SHARED, f->fd, 0);
+    if (f->fbp == MAP_FAILED) {
+        LV_LOG_ERROR("Failed to map %s", device);
+        close(f->fd);
+        return NULL;
+    }
+
+    disp = lv_display_create((int32_t)vinfo.xres, (int32_t)vinfo.yres);
+    if (disp == NULL) {
+        munmap(f->fbp, f->fb_size);
+        close(f->fd);
+        return NULL;
+    }
+
+    buf_h = LV_MAX(vinfo.yres / CONVERT_BUF_DIV, 1);
+    buf1 = lv_draw_buf_create(vinfo.xres, buf_h, f->cf, LV_STRIDE_AUTO);
+    buf2 = lv_draw_buf_create(vinfo.xres, buf_h, f->cf, LV_STRIDE_AUTO);
+    LV_ASSERT_NULL(buf1);
+    LV_ASSERT_NULL(buf2);
+
+    lv_display_set_color_format(disp, f->cf);
+    lv_display_set_draw_buffers(disp, buf1, buf2);
+    lv_display_set_render_mode(disp, LV_DISPLAY_RENDER_MODE_PARTIAL);
+    lv_display_set_flush_cb(disp, convert_flush_cb);
+    lv_display_set_driver_data(disp, f);
+
+    return disp;
+}
+
+/**
+ * Convert a rendered area into the framebuffer
+ *
+ * @param disp the display
+ * @param area the area rendered
+ * @param px_map the pixels of the area
+ */
+static void convert_flush_cb(lv_display_t *disp, const lv_area_t *area, uint8_t *px_map)
+{
+    fbdev_format_t *f = lv_display_get_driver_data(disp);
+    uint32_t w = (uint32_t)lv_area_get_width(area);
+    uint32_t h = (uint32_t)lv_area_get_height(area);
+    uint32_t src_stride = lv_draw_buf_width_to_stride(w, f->cf);
+    uint32_t px_size = px_format_get_size(f->format);
+    uint8_t *dst;
+    uint32_t y;
+
+    dst = f->fbp + (size_t)(area->y1 + f->yoffset) * f->line_length + (size_t)(area->x1 + f->xoffset) * px_size;
+
+    for (y = 0; y < h; y++) {
+        f->convert(dst, px_map, w);
+        dst += f->line_length;
+        px_map += src_stride;
+    }
+
+    f->converted_bytes += (uint64_t)w * h * px_size;
+
+    lv_display_flush_ready(disp);
+}
+
+/**
+ * Count the bytes flushed and converted per frame
+ *
+ * @param e the flush start or refresh ready event
+ */
+static void format_event_cb(lv_event_t *e)
+{
+    fbdev_format_t *f = lv_event_get_user_data(e);
+    const lv_area_t *area;
+
+    if (lv_event_get_code(e) == LV_EVENT_FLUSH_START) {
+        area = lv_event_get_param(e);
+        f->flushed_bytes += (uint64_t)lv_area_get_size(area) * px_format_get_size(f->format);
+        return;
+    }
+
+    if (f->flushed_bytes == 0) {
+        return;
+    }
+
+    perf_hist_add(&f->flushed_hist, (uint32_t)f->flushed_bytes);
+    perf_hist_add(&f->converted_hist, (uint32_t)f->converted_bytes);
+    f->flushed_bytes = 0;
+    f->converted_bytes = 0;
+}
+
+/**
+ * Print and reset the bytes flushed and converted per frame
+ *
+ * @param timer the report timer
+ */
+static void format_report_cb(lv_timer_t *timer)
+{
+    fbdev_format_t *f = lv_timer_get_user_data(timer);
+
+    fprintf(stdout, "fbdev: %s framebuffer, rendering color format %d, %s\n", px_format_name(f->format), f->cf,
+            f->convert != NULL ? "converting" : "native");
+    perf_hist_print(&f->flushed_hist, "flushed per frame", "B");
+    perf_hist_print(&f->converted_hist, "converted per frame", "B");
+
+    perf_hist_reset(&f->flushed_hist);
+    perf_hist_reset(&f->converted_hist);
+}
+
 /**
  * The run loop of the fbdev driver
  */
@@ -109,7 +401,7 @@ static void run_loop_fbdev(void)
 
         /* Returns the time to the next timer execution */
         idle_time = lv_timer_handler();
-        usleep(idle_time * 1000);
+        event_loop_wait(idle_time);
     }
 }
 
@@ -10,6 +10,14 @@
  *
  * Author: EDGEMTech Ltd, Erik Tagirov (erik.tagirov@edgemtech.ch)
  *
+ * The texture display of LVGL uploads its whole frame buffer with
+ * glTexImage2D() after each frame, its flush callback is replaced to
+ * upload only the areas drawn. The areas are copied into a ring of
+ * persistently mapped pixel buffer objects and uploaded from there with
+ * glTexSubImage2D(), a fence per PBO makes sure the GPU is done reading a
+ * PBO before it is written again. Without ARB_buffer_storage the areas
+ * are uploaded from the frame buffer directly.
+ *
  */
 
 /*********************
@@ -17,33 +25,84 @@
  *********************/
 
 #include <unistd.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 
 #include "lvgl/lvgl.h"
 #if LV_USE_GLFW
+#include <GL/glew.h>
+
 #include "../simulator_util.h"
 #include "../simulator_settings.h"
 #include "../backends.h"
+#include "../event_loop.h"
+#include "../perf_stats.h"
 
 /*********************
  *      DEFINES
  *********************/
 
+/* PBOs in flight, the CPU writes one while the GPU reads the others */
+#define PBO_RING_SIZE 3
+
+/* Areas kept per frame, a frame flushing more uploads the whole texture */
+#define UPLOAD_MAX_AREAS 16
+
 /**********************
  *      TYPEDEFS
  **********************/
 
+typedef struct {
+    GLuint pbo;
+    uint8_t *map;                   /* Persistent mapping of the PBO */
+    GLsync fence;                   /* Signaled when the GPU is done reading it */
+} gl_pbo_t;
+
+typedef struct {
+    GLuint texture_id;
+    GLenum format;
+    GLenum type;
+    int32_t hor_res;
+    int32_t ver_res;
+    uint32_t px_size;
+    uint32_t stride;
+
+    bool use_pbo;
+    gl_pbo_t pbos[PBO_RING_SIZE];
+    uint32_t next_pbo;
+
+    lv_area_t areas[UPLOAD_MAX_AREAS];
+    uint32_t area_count;
+    bool full;
+
+    uint32_t frames;
+    uint32_t stalls;
+    uint64_t total_bytes;
+    perf_hist_t bytes_hist;
+    perf_hist_t upload_hist;
+    perf_hist_t stall_hist;
+} gl_upload_t;
+
 /**********************
  *  STATIC PROTOTYPES
  **********************/
 static void run_loop_glfw3(void);
 static lv_display_t *init_glfw3(void);
+static bool init_upload(gl_upload_t *u, lv_display_t *disp);
+static bool init_pbos(gl_upload_t *u);
+static void wait_pbo(gl_upload_t *u, gl_pbo_t *slot);
+static void upload_areas(gl_upload_t *u, const uint8_t *fb);
+static void upload_flush_cb(lv_display_t *disp, const lv_area_t *area, uint8_t *px_map);
+static void upload_report_cb(lv_timer_t *timer);
 
 /**********************
  *  STATIC VARIABLES
  **********************/
 static char *backend_name = "GLFW";
+static gl_upload_t gl_upload;
 
 /**********************
  *  EXTERNAL VARIABLES
@@ -74,6 +133,8 @@ int backend_init_glfw3(backend_t *backend)
 
     backend->handle->display->init_display = init_glfw3;
     backend->handle->display->run_loop = run_loop_glfw3;
+    backend->handle->display->shared_loop = true;
+    backend->handle->display->thread_flush = false;
     backend->name = backend_name;
     backend->type = BACKEND_DISPLAY;
 
@@ -122,9 +183,248 @@ static lv_display_t *init_glfw3(void)
     lv_image_set_src(cursor_obj, &mouse_cursor_icon);
     lv_indev_set_cursor(mouse, cursor_obj);
 
+    if (init_upload(&gl_upload, disp_texture)) {
+        lv_display_set_flush_cb(disp_texture, upload_flush_cb);
+    } else {
+        LV_LOG_WARN("Unsupported color format, uploading the whole texture");
+    }
+
     return disp_texture;
 }
 
+/**
+ * Prepare the upload of the areas drawn in a texture display
+ *
+ * @param u the upload state
+ * @param disp the texture display
+ * @return true on success, false if the color format is not handled
+ */
+static bool init_upload(gl_upload_t *u, lv_display_t *disp)
+{
+    lv_color_format_t cf = lv_display_get_color_format(disp);
+    GLint internal_format;
+    int report_sec;
+
+    switch (cf) {
+    case LV_COLOR_FORMAT_RGB565:
+        internal_format = GL_RGB565;
+        u->format = GL_RGB;
+        u->type = GL_UNSIGNED_SHORT_5_6_5;
+        break;
+    case LV_COLOR_FORMAT_RGB888:
+        internal_format = GL_RGB8;
+        u->format = GL_BGR;
+        u->type = GL_UNSIGNED_BYTE;
+        break;
+    case LV_COLOR_FORMAT_XRGB8888:
+    case LV_COLOR_FORMAT_ARGB8888:
+        internal_format = GL_RGBA8;
+        u->format = GL_BGRA;
+        u->type = GL_UNSIGNED_BYTE;
+        break;
+    default:
+        return false;
+    }
+
+    u->texture_id = lv_opengles_texture_get_texture_id(disp);
+    u->hor_res = lv_display_get_horizontal_resolution(disp);
+    u->ver_res = lv_display_get_vertical_resolution(disp);
+    u->px_size = lv_color_format_get_size(cf);
+    u->stride = lv_draw_buf_width_to_stride((uint32_t)u->hor_res, cf);
+
+    /* The areas are uploaded into a texture of the size of the display */
+    glBindTexture(GL_TEXTURE_2D, u->texture_id);
+    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, u->hor_res, u->ver_res, 0, u->format, u->type, NULL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    u->use_pbo = atoi(getenv_default("LV_GLFW_PBO", "1")) != 0 && init_pbos(u);
+
+    report_sec = atoi(getenv_default("LV_GLFW_UPLOAD_REPORT", "0"));
+    if (report_sec > 0) {
+        lv_timer_create(upload_report_cb, (uint32_t)report_sec * 1000, u);
+    }
+
+    return true;
+}
+
+/**
+ * Create the ring of persistently mapped PBOs
+ *
+ * @param u the upload state
+ * @return true on success, false if ARB_buffer_storage is not supported
+ */
+static bool init_pbos(gl_upload_t *u)
+{
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    GLsizeiptr size = (GLsizeiptr)u->stride * u->ver_res;
+    gl_pbo_t *slot;
+    int i;
+
+    if (!GLEW_ARB_buffer_storage) {
+        LV_LOG_WARN("ARB_buffer_storage is not supported, uploading without PBO");
+        return false;
+    }
+
+    for (i = 0; i < PBO_RING_SIZE; i++) {
+        slot = &u->pbos[i];
+        glGenBuffers(1, &slot->pbo);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot->pbo);
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, NULL, flags);
+        slot->map = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+        if (slot->map == NULL) {
+            LV_LOG_WARN("Failed to map the PBO, uploading without PBO");
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            return false;
+        }
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    return true;
+}
+
+/**
+ * Wait until the GPU is done reading a PBO
+ *
+ * @param u the upload state
+ * @param slot the PBO about to be written
+ */
+static void wait_pbo(gl_upload_t *u, gl_pbo_t *slot)
+{
+    uint64_t start;
+
+    if (slot->fence == NULL) {
+        return;
+    }
+
+    if (glClientWaitSync(slot->fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+        /* The ring is too short for the GPU */
+        start = perf_time_ns();
+        glClientWaitSync(slot->fence, GL_SYNC_FLUSH_COMMANDS_BIT, UINT64_MAX);
+        perf_hist_add(&u->stall_hist, (uint32_t)((perf_time_ns() - start) / 1000));
+        u->stalls++;
+    }
+
+    glDeleteSync(slot->fence);
+    slot->fence = NULL;
+}
+
+/**
+ * Upload the areas of the frame to the texture
+ *
+ * The PBOs have the layout of the frame buffer, each area is copied and
+ * uploaded at its offset in the frame.
+ *
+ * @param u the upload state
+ * @param fb the frame buffer of the display
+ */
+static void upload_areas(gl_upload_t *u, const uint8_t *fb)
+{
+    gl_pbo_t *slot = NULL;
+    const lv_area_t *area;
+    uint64_t start = perf_time_ns();
+    uint64_t bytes = 0;
+    size_t offset;
+    size_t row_len;
+    int32_t y;
+    uint32_t i;
+
+    if (u->use_pbo) {
+        slot = &u->pbos[u->next_pbo];
+        u->next_pbo = (u->next_pbo + 1) % PBO_RING_SIZE;
+        wait_pbo(u, slot);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot->pbo);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, u->texture_id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, (GLint)(u->stride / u->px_size));
+
+    for (i = 0; i < u->area_count; i++) {
+        area = &u->areas[i];
+        offset = (size_t)area->y1 * u->stride + (size_t)area->x1 * u->px_size;
+        row_len = (size_t)lv_area_get_width(area) * u->px_size;
+
+        if (slot != NULL) {
+            for (y = 0; y < lv_area_get_height(area); y++) {
+                memcpy(slot->map + offset + (size_t)y * u->stride, fb + offset + (size_t)y * u->stride, row_len);
+            }
+        }
+
+        glTexSubImage2D(GL_TEXTURE_2D, 0, area->x1, area->y1, lv_area_get_width(area), lv_area_get_height(area),
+                        u->format, u->type, slot != NULL ? (const void *)(uintptr_t)offset : fb + offset);
+        bytes += (uint64_t)row_len * (uint64_t)lv_area_get_height(area);
+    }
+
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    if (slot != NULL) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    perf_hist_add(&u->bytes_hist, (uint32_t)bytes);
+    perf_hist_add(&u->upload_hist, (uint32_t)((perf_time_ns() - start) / 1000));
+    u->total_bytes += bytes;
+    u->frames++;
+}
+
+/**
+ * Collect the areas drawn and upload them after the last one
+ *
+ * @param disp the texture display
+ * @param area the area rendered
+ * @param px_map the frame buffer in direct mode
+ */
+static void upload_flush_cb(lv_display_t *disp, const lv_area_t *area, uint8_t *px_map)
+{
+    gl_upload_t *u = &gl_upload;
+
+    if (u->area_count < UPLOAD_MAX_AREAS) {
+        u->areas[u->area_count++] = *area;
+    } else {
+        u->full = true;
+    }
+
+    if (lv_display_flush_is_last(disp)) {
+        if (u->full) {
+            u->area_count = 1;
+            lv_area_set(&u->areas[0], 0, 0, u->hor_res - 1, u->ver_res - 1);
+        }
+
+        upload_areas(u, px_map);
+        u->area_count = 0;
+        u->full = false;
+    }
+
+    lv_display_flush_ready(disp);
+}
+
+/**
+ * Print and reset the upload statistics
+ *
+ * @param timer the report timer
+ */
+static void upload_report_cb(lv_timer_t *timer)
+{
+    gl_upload_t *u = lv_timer_get_user_data(timer);
+
+    fprintf(stdout, "glfw: %u frames uploaded %s, %llu bytes, %u PBO stalls\n", u->frames,
+            u->use_pbo ? "through the PBO ring" : "from client memory",
+            (unsigned long long)u->total_bytes, u->stalls);
+    perf_hist_print(&u->bytes_hist, "uploaded per frame", "B");
+    perf_hist_print(&u->upload_hist, "upload per frame", "us");
+    perf_hist_print(&u->stall_hist, "PBO stall", "us");
+
+    u->frames = 0;
+    u->stalls = 0;
+    u->total_bytes = 0;
+    perf_hist_reset(&u->bytes_hist);
+    perf_hist_reset(&u->upload_hist);
+    perf_hist_reset(&u->stall_hist);
+}
+
 /**
  * The run loop of the GLFW3 driver
  */
@@ -137,7 +437,7 @@ void run_loop_glfw3(void)
 
         /* Returns the time to the next timer execution */
         idle_time = lv_timer_handler();
-        usleep(idle_time * 1000);
+        event_loop_wait(idle_time);
     }
 }
 
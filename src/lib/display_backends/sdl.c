@@ -10,29 +10,65 @@
  *
  * Author: EDGEMTech Ltd, Erik Tagirov (erik.tagirov@edgemtech.ch)
  *
+ * The window, its events and the inputs are handled by the SDL driver of
+ * LVGL, the frames are streamed by this file: each area flushed is copied
+ * into the same sub-rectangle of a streaming texture locked for that area
+ * only, and the renderer presents once per frame that drew something.
+ *
  */
 
 /*********************
  *      INCLUDES
  *********************/
 #include <unistd.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 
 #include "lvgl/lvgl.h"
 #if LV_USE_SDL
+#include LV_SDL_INCLUDE_PATH
+
 #include "../simulator_util.h"
 #include "../simulator_settings.h"
 #include "../backends.h"
+#include "../event_loop.h"
+#include "../perf_stats.h"
 
 /*********************
  *      DEFINES
  *********************/
 
+/* Period of the uploaded pixels overlay */
+#define OVERLAY_PERIOD_MS 500
+
 /**********************
  *      TYPEDEFS
  **********************/
 
+typedef struct {
+    SDL_Renderer *renderer;
+    SDL_Texture *texture;
+    lv_color_format_t cf;
+    uint32_t px_size;
+
+    /* Uploads of the current frame */
+    uint64_t upload_start_ns;
+    uint32_t frame_rects;
+    uint64_t frame_px;
+
+    uint32_t frames;
+    uint64_t total_px;
+    perf_hist_t px_hist;
+    perf_hist_t rects_hist;
+    perf_hist_t upload_hist;
+
+    lv_obj_t *overlay;
+    uint32_t overlay_frames;
+    uint64_t overlay_px;
+} sdl_stream_t;
+
 /**********************
  *  EXTERNAL VARIABLES
  **********************/
@@ -43,12 +79,19 @@ extern simulator_settings_t settings;
  **********************/
 static void run_loop_sdl(void);
 static lv_display_t *init_sdl(void);
+static void init_stream(lv_display_t *disp);
+static bool create_texture(sdl_stream_t *stream, int32_t w, int32_t h);
+static void stream_flush_cb(lv_display_t *disp, const lv_area_t *area, uint8_t *px_map);
+static void resolution_changed_cb(lv_event_t *e);
+static void overlay_timer_cb(lv_timer_t *timer);
+static void upload_report_cb(lv_timer_t *timer);
 
 /**********************
  *  STATIC VARIABLES
  **********************/
 
 static char *backend_name = "SDL";
+static sdl_stream_t sdl_stream;
 
 /**********************
  *      MACROS
@@ -72,6 +115,8 @@ int backend_init_sdl(backend_t *backend)
 
     backend->handle->display->init_display = init_sdl;
     backend->handle->display->run_loop = run_loop_sdl;
+    backend->handle->display->shared_loop = true;
+    backend->handle->display->thread_flush = false;
     backend->name = backend_name;
     backend->type = BACKEND_DISPLAY;
 
@@ -114,9 +159,213 @@ static lv_display_t *init_sdl(void)
     lv_indev_set_display(kb, disp);
     lv_indev_set_group(kb, lv_group_get_default());
 
+    init_stream(disp);
+
     return disp;
 }
 
+/**
+ * Replace the full window upload of the SDL driver by the streaming of the
+ * flushed areas
+ *
+ * @param disp the SDL display
+ */
+static void init_stream(lv_display_t *disp)
+{
+    sdl_stream_t *stream = &sdl_stream;
+    int report_sec;
+
+    stream->renderer = lv_sdl_window_get_renderer(disp);
+    stream->cf = lv_display_get_color_format(disp);
+    stream->px_size = lv_color_format_get_size(stream->cf);
+
+    if (!create_texture(stream, lv_display_get_horizontal_resolution(disp),
+                        lv_display_get_vertical_resolution(disp))) {
+        LV_LOG_WARN("Failed to create the streaming texture, uploading the whole window");
+        return;
+    }
+
+    /* The driver data stays the window of the SDL driver, which reads it for its events */
+    lv_display_set_flush_cb(disp, stream_flush_cb);
+    lv_display_add_event_cb(disp, resolution_changed_cb, LV_EVENT_RESOLUTION_CHANGED, stream);
+
+    if (atoi(getenv_default("LV_SDL_UPLOAD_OVERLAY", "0")) != 0) {
+        stream->overlay = lv_label_create(lv_display_get_layer_top(disp));
+        lv_obj_set_style_bg_color(stream->overlay, lv_color_black(), 0);
+        lv_obj_set_style_bg_opa(stream->overlay, LV_OPA_70, 0);
+        lv_obj_set_style_text_color(stream->overlay, lv_color_white(), 0);
+        lv_obj_align(stream->overlay, LV_ALIGN_TOP_RIGHT, 0, 0);
+        lv_label_set_text(stream->overlay, "");
+        lv_timer_create(overlay_timer_cb, OVERLAY_PERIOD_MS, stream);
+    }
+
+    report_sec = atoi(getenv_default("LV_SDL_UPLOAD_REPORT", "0"));
+    if (report_sec > 0) {
+        lv_timer_create(upload_report_cb, (uint32_t)report_sec * 1000, stream);
+    }
+}
+
+/**
+ * Create the streaming texture in the format rendered by LVGL
+ *
+ * @param stream the stream
+ * @param w the width of the window
+ * @param h the height of the window
+ * @return true on success
+ */
+static bool create_texture(sdl_stream_t *stream, int32_t w, int32_t h)
+{
+    Uint32 format;
+
+    switch (stream->cf) {
+    case LV_COLOR_FORMAT_RGB565:
+        format = SDL_PIXELFORMAT_RGB565;
+        break;
+    case LV_COLOR_FORMAT_RGB888:
+        format = SDL_PIXELFORMAT_BGR24;
+        break;
+    case LV_COLOR_FORMAT_XRGB8888:
+    case LV_COLOR_FORMAT_ARGB8888:
+        format = SDL_PIXELFORMAT_ARGB8888;
+        break;
+    default:
+        return false;
+    }
+
+    if (stream->texture != NULL) {
+        SDL_DestroyTexture(stream->texture);
+    }
+
+    stream->texture = SDL_CreateTexture(stream->renderer, format, SDL_TEXTUREACCESS_STREAMING, w, h);
+
+    return stream->texture != NULL;
+}
+
+/**
+ * Copy a flushed area into the texture and present after the last one
+ *
+ * Only the rectangle of the area is locked, so only its pixels are
+ * uploaded by the renderer.
+ *
+ * @param disp the display
+ * @param area the area rendered
+ * @param px_map the whole frame in direct and full mode, the area in partial mode
+ */
+static void stream_flush_cb(lv_display_t *disp, const lv_area_t *area, uint8_t *px_map)
+{
+    sdl_stream_t *stream = &sdl_stream;
+    int32_t w = lv_area_get_width(area);
+    int32_t h = lv_area_get_height(area);
+    uint32_t row_len = (uint32_t)w * stream->px_size;
+    SDL_Rect rect = { area->x1, area->y1, w, h };
+    uint32_t src_stride;
+    uint8_t *dst;
+    void *pixels;
+    int pitch;
+    int32_t y;
+
+    if (stream->frame_rects == 0) {
+        stream->upload_start_ns = perf_time_ns();
+    }
+
+#if LV_SDL_RENDER_MODE == LV_DISPLAY_RENDER_MODE_PARTIAL
+    src_stride = lv_draw_buf_width_to_stride((uint32_t)w, stream->cf);
+#else
+    src_stride = lv_draw_buf_width_to_stride((uint32_t)lv_display_get_horizontal_resolution(disp), stream->cf);
+    px_map += (size_t)area->y1 * src_stride + (size_t)area->x1 * stream->px_size;
+#endif
+
+    if (SDL_LockTexture(stream->texture, &rect, &pixels, &pitch) == 0) {
+        dst = pixels;
+        for (y = 0; y < h; y++) {
+            memcpy(dst, px_map, row_len);
+            dst += pitch;
+            px_map += src_stride;
+        }
+        SDL_UnlockTexture(stream->texture);
+    }
+
+    stream->frame_rects++;
+    stream->frame_px += (uint64_t)w * (uint64_t)h;
+
+    if (lv_display_flush_is_last(disp)) {
+        SDL_RenderCopy(stream->renderer, stream->texture, NULL, NULL);
+        SDL_RenderPresent(stream->renderer);
+
+        perf_hist_add(&stream->upload_hist, (uint32_t)((perf_time_ns() - stream->upload_start_ns) / 1000));
+        perf_hist_add(&stream->px_hist, (uint32_t)stream->frame_px);
+        perf_hist_add(&stream->rects_hist, stream->frame_rects);
+        stream->frames++;
+        stream->total_px += stream->frame_px;
+        stream->overlay_frames++;
+        stream->overlay_px += stream->frame_px;
+        stream->frame_rects = 0;
+        stream->frame_px = 0;
+    }
+
+    lv_display_flush_ready(disp);
+}
+
+/**
+ * Follow the size of the window
+ *
+ * @param e the resolution changed event
+ */
+static void resolution_changed_cb(lv_event_t *e)
+{
+    sdl_stream_t *stream = lv_event_get_user_data(e);
+    lv_display_t *disp = lv_event_get_target(e);
+
+    if (!create_texture(stream, lv_display_get_horizontal_resolution(disp),
+                        lv_display_get_vertical_resolution(disp))) {
+        LV_LOG_ERROR("Failed to resize the streaming texture");
+    }
+}
+
+/**
+ * Show the pixels uploaded per frame since the last update
+ *
+ * The overlay itself is uploaded when its text changes.
+ *
+ * @param timer the overlay timer
+ */
+static void overlay_timer_cb(lv_timer_t *timer)
+{
+    sdl_stream_t *stream = lv_timer_get_user_data(timer);
+
+    if (stream->overlay_frames == 0) {
+        return;
+    }
+
+    lv_label_set_text_fmt(stream->overlay, "%u fps, %llu px/frame",
+                          stream->overlay_frames * 1000 / OVERLAY_PERIOD_MS,
+                          (unsigned long long)(stream->overlay_px / stream->overlay_frames));
+    stream->overlay_frames = 0;
+    stream->overlay_px = 0;
+}
+
+/**
+ * Print and reset the upload statistics
+ *
+ * @param timer the report timer
+ */
+static void upload_report_cb(lv_timer_t *timer)
+{
+    sdl_stream_t *stream = lv_timer_get_user_data(timer);
+
+    fprintf(stdout, "sdl: %u frames presented, %llu px uploaded\n", stream->frames,
+            (unsigned long long)stream->total_px);
+    perf_hist_print(&stream->px_hist, "uploaded per frame", "px");
+    perf_hist_print(&stream->rects_hist, "rects per frame", "");
+    perf_hist_print(&stream->upload_hist, "upload and present", "us");
+
+    stream->frames = 0;
+    stream->total_px = 0;
+    perf_hist_reset(&stream->px_hist);
+    perf_hist_reset(&stream->rects_hist);
+    perf_hist_reset(&stream->upload_hist);
+}
+
 /**
  * The run loop of the SDL driver
  */
@@ -128,7 +377,7 @@ static void run_loop_sdl(void)
     while (true) {
         /* Returns the time to the next timer execution */
         idle_time = lv_timer_handler();
-        usleep(idle_time * 1000);
+        event_loop_wait(idle_time);
     }
 }
 #endif /*#if LV_USE_SDL*/
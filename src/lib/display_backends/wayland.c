@@ -10,39 +10,329 @@
  *
  * Author: EDGEMTech Ltd, Erik Tagirov (erik.tagirov@edgemtech.ch)
  *
+ * The window is an xdg_toplevel drawn in a pool of wl_shm buffers. A frame is
+ * rendered only when the compositor asked for one with a wl_surface.frame
+ * callback: the refresh timer of LVGL is paused from the commit of a frame
+ * to the frame callback and the release of a buffer. The display fd is
+ * polled by the event loop, and the wp_presentation feedback of each frame
+ * tells when it was actually shown.
+ *
+ * LVGL renders in direct mode into one draw buffer pointing to a released
+ * shm buffer. The areas flushed by each frame are kept, a reused buffer
+ * only gets the areas drawn since it was last committed (its age) copied
+ * from the latest buffer before LVGL draws the new frame over it, and only
+ * the areas flushed are damaged.
+ *
+ * The seat provides a pointer, a touchscreen, a keypad translated through
+ * xkbcommon, and an encoder driven by the scroll wheel and the middle
+ * button. The keypad and the encoder are in the default group.
+ *
+ * With LV_WAYLAND_WINDOW_DECORATIONS the compositor is asked to draw the
+ * decorations through xdg-decoration, there are no client side ones.
+ * LV_WAYLAND_USE_DMABUF is not supported, the buffers are wl_shm.
+ *
  */
 
 /*********************
  *      INCLUDES
  *********************/
+#define _GNU_SOURCE
 #include <unistd.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <linux/input-event-codes.h>
 
 #include "lvgl/lvgl.h"
 #if LV_USE_WAYLAND
+#include <wayland-client.h>
+#include <xkbcommon/xkbcommon.h>
+#include "wayland_xdg_shell.h"
+#include "wayland_presentation_time.h"
+#if LV_WAYLAND_WINDOW_DECORATIONS
+#include "wayland_xdg_decoration.h"
+#endif
+
 #include "../simulator_util.h"
 #include "../simulator_settings.h"
 #include "../backends.h"
+#include "../event_loop.h"
+#include "../perf_stats.h"
 
 /*********************
  *      DEFINES
  *********************/
 
+#ifdef LV_WAYLAND_BUF_COUNT
+#define WL_BUF_COUNT LV_WAYLAND_BUF_COUNT
+#else
+#define WL_BUF_COUNT 2
+#endif
+
+/* Frames whose damage is kept, an older buffer is copied entirely */
+#define WL_DAMAGE_HISTORY 8
+
+/* Areas kept per frame, a frame flushing more damages the whole window */
+#define WL_DAMAGE_MAX_AREAS 16
+
+/* Frames waiting for their presentation feedback */
+#define WL_FEEDBACK_COUNT 8
+
+/* Key events waiting to be read by the keypad */
+#define WL_KEY_QUEUE 16
+
 /**********************
  *      TYPEDEFS
  **********************/
 
+typedef struct {
+    struct wl_buffer *wl_buffer;
+    uint8_t *data;
+    uint32_t frame;                 /* Last frame committed from the buffer, 0 if never used */
+    bool busy;                      /* Attached, not released by the compositor yet */
+} wl_shm_buf_t;
+
+typedef struct {
+    lv_area_t areas[WL_DAMAGE_MAX_AREAS];
+    uint32_t count;
+    bool full;
+} wl_damage_t;
+
+typedef struct {
+    struct wp_presentation_feedback *feedback;
+    uint64_t render_ns;             /* Start of the refresh that drew the frame */
+    uint64_t commit_ns;
+} wl_frame_t;
+
+typedef struct {
+    uint32_t key;                   /* LV_KEY_* or the UTF-8 bytes of a character */
+    lv_indev_state_t state;
+} wl_key_t;
+
+typedef struct {
+    struct wl_display *display;
+    struct wl_registry *registry;
+    struct wl_compositor *compositor;
+    uint32_t compositor_version;
+    struct wl_shm *shm;
+    struct xdg_wm_base *wm_base;
+    struct wp_presentation *presentation;
+    struct wl_seat *seat;
+    struct wl_pointer *pointer;
+    struct wl_keyboard *keyboard;
+    struct wl_touch *touch;
+#if LV_WAYLAND_WINDOW_DECORATIONS
+    struct zxdg_decoration_manager_v1 *decoration_manager;
+    struct zxdg_toplevel_decoration_v1 *decoration;
+#endif
+
+    struct wl_surface *surface;
+    struct xdg_surface *xdg_surface;
+    struct xdg_toplevel *toplevel;
+    bool configured;
+    bool closed;
+
+    int32_t width;
+    int32_t height;
+    uint32_t stride;
+    uint8_t *pool_data;
+    size_t pool_size;
+    wl_shm_buf_t bufs[WL_BUF_COUNT];
+    wl_shm_buf_t *current;          /* Buffer LVGL draws in */
+    wl_shm_buf_t *latest;           /* Buffer of the last frame committed */
+    lv_draw_buf_t draw_buf;
+    uint32_t frame;                 /* Number of frames committed */
+    wl_damage_t damage[WL_DAMAGE_HISTORY];
+
+    lv_display_t *lv_disp;
+    lv_timer_t *refr_timer;
+    struct wl_callback *frame_cb;   /* Pending frame callback, NULL if none */
+
+    lv_indev_t *indev;
+    lv_point_t pointer_pos;
+    lv_indev_state_t pointer_state;
+
+    lv_indev_t *touch_indev;
+    lv_point_t touch_pos;
+    lv_indev_state_t touch_state;
+    int32_t touch_id;               /* The touch point followed, the first one down */
+
+    lv_indev_t *axis_indev;
+    int32_t axis_diff;              /* Wheel steps since the last read */
+    lv_indev_state_t axis_state;
+
+    lv_indev_t *keyboard_indev;
+    struct xkb_context *xkb_context;
+    struct xkb_keymap *xkb_keymap;
+    struct xkb_state *xkb_state;
+    wl_key_t keys[WL_KEY_QUEUE];
+    uint32_t key_head;
+    uint32_t key_count;
+    wl_key_t key_queued;            /* Last key queued */
+    wl_key_t key_read;              /* Last key read, repeated while the queue is empty */
+
+    /* Presentation statistics */
+    clockid_t clock_id;
+    uint64_t refr_start_ns;
+    wl_frame_t frames[WL_FEEDBACK_COUNT];
+    uint32_t refresh_ns;
+    uint32_t committed;
+    uint32_t presented;
+    uint32_t discarded;
+    uint32_t missed;
+    perf_hist_t render_present_hist;
+    perf_hist_t commit_present_hist;
+    uint64_t copied_bytes;
+    uint64_t damaged_bytes;
+    perf_hist_t copied_hist;
+    perf_hist_t damaged_hist;
+} wl_ctx_t;
+
 /**********************
  *  STATIC PROTOTYPES
  **********************/
 static lv_display_t *init_wayland(void);
 static void run_loop_wayland(void);
+static void registry_global(void *data, struct wl_registry *registry, uint32_t name,
+                            const char *interface, uint32_t version);
+static void registry_global_remove(void *data, struct wl_registry *registry, uint32_t name);
+static void wm_base_ping(void *data, struct xdg_wm_base *wm_base, uint32_t serial);
+static void xdg_surface_configure(void *data, struct xdg_surface *xdg_surface, uint32_t serial);
+static void toplevel_configure(void *data, struct xdg_toplevel *toplevel, int32_t width, int32_t height,
+                               struct wl_array *states);
+static void toplevel_close(void *data, struct xdg_toplevel *toplevel);
+static void buffer_release(void *data, struct wl_buffer *wl_buffer);
+static void frame_done(void *data, struct wl_callback *callback, uint32_t time);
+static void presentation_clock_id(void *data, struct wp_presentation *presentation, uint32_t clk_id);
+static void feedback_sync_output(void *data, struct wp_presentation_feedback *feedback, struct wl_output *output);
+static void feedback_presented(void *data, struct wp_presentation_feedback *feedback, uint32_t tv_sec_hi,
+                               uint32_t tv_sec_lo, uint32_t tv_nsec, uint32_t refresh, uint32_t seq_hi,
+                               uint32_t seq_lo, uint32_t flags);
+static void feedback_discarded(void *data, struct wp_presentation_feedback *feedback);
+static void seat_capabilities(void *data, struct wl_seat *seat, uint32_t caps);
+static void pointer_enter(void *data, struct wl_pointer *pointer, uint32_t serial, struct wl_surface *surface,
+                          wl_fixed_t x, wl_fixed_t y);
+static void pointer_leave(void *data, struct wl_pointer *pointer, uint32_t serial, struct wl_surface *surface);
+static void pointer_motion(void *data, struct wl_pointer *pointer, uint32_t time, wl_fixed_t x, wl_fixed_t y);
+static void pointer_button(void *data, struct wl_pointer *pointer, uint32_t serial, uint32_t time,
+                           uint32_t button, uint32_t state);
+static void pointer_axis(void *data, struct wl_pointer *pointer, uint32_t time, uint32_t axis, wl_fixed_t value);
+static void keyboard_keymap(void *data, struct wl_keyboard *keyboard, uint32_t format, int32_t fd, uint32_t size);
+static void keyboard_enter(void *data, struct wl_keyboard *keyboard, uint32_t serial, struct wl_surface *surface,
+                           struct wl_array *keys);
+static void keyboard_leave(void *data, struct wl_keyboard *keyboard, uint32_t serial, struct wl_surface *surface);
+static void keyboard_key(void *data, struct wl_keyboard *keyboard, uint32_t serial, uint32_t time, uint32_t key,
+                         uint32_t state);
+static void keyboard_modifiers(void *data, struct wl_keyboard *keyboard, uint32_t serial, uint32_t mods_depressed,
+                               uint32_t mods_latched, uint32_t mods_locked, uint32_t group);
+static void touch_down(void *data, struct wl_touch *touch, uint32_t serial, uint32_t time,
+                       struct wl_surface *surface, int32_t id, wl_fixed_t x, wl_fixed_t y);
+static void touch_up(void *data, struct wl_touch *touch, uint32_t serial, uint32_t time, int32_t id);
+static void touch_motion(void *data, struct wl_touch *touch, uint32_t time, int32_t id, wl_fixed_t x, wl_fixed_t y);
+static void touch_frame(void *data, struct wl_touch *touch);
+static void touch_cancel(void *data, struct wl_touch *touch);
+#if LV_WAYLAND_WINDOW_DECORATIONS
+static void decoration_configure(void *data, struct zxdg_toplevel_decoration_v1 *decoration, uint32_t mode);
+#endif
+static uint32_t keysym_to_lv_key(xkb_keysym_t sym);
+static void queue_key(wl_ctx_t *ctx, uint32_t key, lv_indev_state_t state);
+static int create_buffers(wl_ctx_t *ctx);
+static void flush_cb(lv_display_t *disp, const lv_area_t *area, uint8_t *px_map);
+static void request_feedback(wl_ctx_t *ctx, uint64_t now);
+static void resume_rendering(wl_ctx_t *ctx);
+static wl_shm_buf_t *find_free_buffer(wl_ctx_t *ctx);
+static void copy_area(wl_ctx_t *ctx, uint8_t *dst, const uint8_t *src, const lv_area_t *area);
+static void repair_buffer(wl_ctx_t *ctx, wl_shm_buf_t *buf);
+static void refr_start_cb(lv_event_t *e);
+static void render_start_cb(lv_event_t *e);
+static void pointer_read_cb(lv_indev_t *indev, lv_indev_data_t *data);
+static void touch_read_cb(lv_indev_t *indev, lv_indev_data_t *data);
+static void axis_read_cb(lv_indev_t *indev, lv_indev_data_t *data);
+static void keyboard_read_cb(lv_indev_t *indev, lv_indev_data_t *data);
+static void display_fd_cb(int fd, short revents, void *user_data);
+static void present_report_cb(lv_timer_t *timer);
 
 /**********************
  *  STATIC VARIABLES
  **********************/
 static char *backend_name = "WAYLAND";
+static wl_ctx_t wl_ctx;
+
+static const struct wl_registry_listener registry_listener = {
+    .global = registry_global,
+    .global_remove = registry_global_remove,
+};
+
+static const struct xdg_wm_base_listener wm_base_listener = {
+    .ping = wm_base_ping,
+};
+
+static const struct xdg_surface_listener xdg_surface_listener = {
+    .configure = xdg_surface_configure,
+};
+
+static const struct xdg_toplevel_listener toplevel_listener = {
+    .configure = toplevel_configure,
+    .close = toplevel_close,
+};
+
+static const struct wl_buffer_listener buffer_listener = {
+    .release = buffer_release,
+};
+
+static const struct wl_callback_listener frame_listener = {
+    .done = frame_done,
+};
+
+static const struct wp_presentation_listener presentation_listener = {
+    .clock_id = presentation_clock_id,
+};
+
+static const struct wp_presentation_feedback_listener feedback_listener = {
+    .sync_output = feedback_sync_output,
+    .presented = feedback_presented,
+    .discarded = feedback_discarded,
+};
+
+static const struct wl_seat_listener seat_listener = {
+    .capabilities = seat_capabilities,
+};
+
+static const struct wl_pointer_listener pointer_listener = {
+    .enter = pointer_enter,
+    .leave = pointer_leave,
+    .motion = pointer_motion,
+    .button = pointer_button,
+    .axis = pointer_axis,
+};
+
+/* The seat is bound at version 1, the later events are never sent */
+static const struct wl_keyboard_listener keyboard_listener = {
+    .keymap = keyboard_keymap,
+    .enter = keyboard_enter,
+    .leave = keyboard_leave,
+    .key = keyboard_key,
+    .modifiers = keyboard_modifiers,
+};
+
+static const struct wl_touch_listener touch_listener = {
+    .down = touch_down,
+    .up = touch_up,
+    .motion = touch_motion,
+    .frame = touch_frame,
+    .cancel = touch_cancel,
+};
+
+#if LV_WAYLAND_WINDOW_DECORATIONS
+static const struct zxdg_toplevel_decoration_v1_listener decoration_listener = {
+    .configure = decoration_configure,
+};
+#endif
 
 /**********************
  *  EXTERNAL VARIABLES
@@ -71,6 +361,8 @@ int backend_init_wayland(backend_t *backend)
 
     backend->handle->display->init_display = init_wayland;
     backend->handle->display->run_loop = run_loop_wayland;
+    backend->handle->display->shared_loop = false;
+    backend->handle->display->thread_flush = false;
     backend->name = backend_name;
     backend->type = BACKEND_DISPLAY;
 
@@ -88,56 +380,1347 @@ int backend_init_wayland(backend_t *backend)
  */
 static lv_display_t *init_wayland(void)
 {
-    lv_display_t *disp;
+    wl_ctx_t *ctx = &wl_ctx;
     lv_group_t *g;
+    int report_sec;
 
-    disp = lv_wayland_window_create(settings.window_width, settings.window_height,
-            "LVGL Simulator", NULL);
+    ctx->width = (int32_t)settings.window_width;
+    ctx->height = (int32_t)settings.window_height;
+    ctx->clock_id = CLOCK_MONOTONIC;
 
-    if (disp == NULL) {
-        die("Failed to initialize Wayland backend\n");
+#if LV_WAYLAND_USE_DMABUF
+    LV_LOG_WARN("LV_WAYLAND_USE_DMABUF is not supported, the Wayland backend draws in wl_shm buffers");
+#endif
+
+    ctx->xkb_context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+    if (ctx->xkb_context == NULL) {
+        die("Failed to create the xkbcommon context\n");
+    }
+
+    ctx->display = wl_display_connect(NULL);
+    if (ctx->display == NULL) {
+        die("Failed to connect to the Wayland compositor\n");
     }
 
+    ctx->registry = wl_display_get_registry(ctx->display);
+    wl_registry_add_listener(ctx->registry, &registry_listener, ctx);
+
+    /* The globals, then the events of the objects bound from them */
+    wl_display_roundtrip(ctx->display);
+    wl_display_roundtrip(ctx->display);
+
+    if (ctx->compositor == NULL || ctx->shm == NULL || ctx->wm_base == NULL) {
+        die("The Wayland compositor lacks wl_compositor, wl_shm or xdg_wm_base\n");
+    }
+
+    if (ctx->presentation == NULL) {
+        LV_LOG_WARN("wp_presentation is not supported, presentation times are not reported");
+    }
+
+    ctx->surface = wl_compositor_create_surface(ctx->compositor);
+    ctx->xdg_surface = xdg_wm_base_get_xdg_surface(ctx->wm_base, ctx->surface);
+    xdg_surface_add_listener(ctx->xdg_surface, &xdg_surface_listener, ctx);
+    ctx->toplevel = xdg_surface_get_toplevel(ctx->xdg_surface);
+    xdg_toplevel_add_listener(ctx->toplevel, &toplevel_listener, ctx);
+    xdg_toplevel_set_title(ctx->toplevel, "LVGL Simulator");
+    xdg_toplevel_set_app_id(ctx->toplevel, "lvglsim");
+    xdg_toplevel_set_min_size(ctx->toplevel, ctx->width, ctx->height);
+    xdg_toplevel_set_max_size(ctx->toplevel, ctx->width, ctx->height);
+
+#if LV_WAYLAND_WINDOW_DECORATIONS
+    if (ctx->decoration_manager != NULL) {
+        ctx->decoration = zxdg_decoration_manager_v1_get_toplevel_decoration(ctx->decoration_manager,
+                                                                             ctx->toplevel);
+        zxdg_toplevel_decoration_v1_add_listener(ctx->decoration, &decoration_listener, ctx);
+        zxdg_toplevel_decoration_v1_set_mode(ctx->decoration, ZXDG_TOPLEVEL_DECORATION_V1_MODE_SERVER_SIDE);
+    } else {
+        LV_LOG_WARN("xdg-decoration is not supported, the window has no decorations");
+    }
+#endif
+
     if (settings.fullscreen) {
-            lv_wayland_window_set_fullscreen(disp, true);
+        xdg_toplevel_set_fullscreen(ctx->toplevel, NULL);
     } else if (settings.maximize) {
-            lv_wayland_window_set_maximized(disp, true);
+        xdg_toplevel_set_maximized(ctx->toplevel);
+    }
+
+    /* A buffer can only be attached after the first configure */
+    wl_surface_commit(ctx->surface);
+    while (!ctx->configured && !ctx->closed) {
+        if (wl_display_dispatch(ctx->display) < 0) {
+            die("Lost the connection to the Wayland compositor\n");
+        }
     }
 
+    if (create_buffers(ctx) < 0) {
+        die("Failed to create the Wayland shm buffers\n");
+    }
+
+    ctx->lv_disp = lv_display_create(ctx->width, ctx->height);
+    if (ctx->lv_disp == NULL) {
+        die("Failed to initialize Wayland backend\n");
+    }
+
+    /* The draw buffer is pointed to a free shm buffer before each render */
+    ctx->current = &ctx->bufs[0];
+    lv_display_set_color_format(ctx->lv_disp, LV_COLOR_FORMAT_XRGB8888);
+    lv_display_set_draw_buffers(ctx->lv_disp, &ctx->draw_buf, NULL);
+    lv_display_set_render_mode(ctx->lv_disp, LV_DISPLAY_RENDER_MODE_DIRECT);
+    lv_display_set_flush_cb(ctx->lv_disp, flush_cb);
+    lv_display_set_driver_data(ctx->lv_disp, ctx);
+    lv_display_add_event_cb(ctx->lv_disp, refr_start_cb, LV_EVENT_REFR_START, ctx);
+    lv_display_add_event_cb(ctx->lv_disp, render_start_cb, LV_EVENT_RENDER_START, ctx);
+    ctx->refr_timer = lv_display_get_refr_timer(ctx->lv_disp);
+
+    ctx->indev = lv_indev_create();
+    lv_indev_set_type(ctx->indev, LV_INDEV_TYPE_POINTER);
+    lv_indev_set_read_cb(ctx->indev, pointer_read_cb);
+    lv_indev_set_display(ctx->indev, ctx->lv_disp);
+    lv_indev_set_driver_data(ctx->indev, ctx);
+
+    ctx->touch_id = -1;
+    ctx->touch_indev = lv_indev_create();
+    lv_indev_set_type(ctx->touch_indev, LV_INDEV_TYPE_POINTER);
+    lv_indev_set_read_cb(ctx->touch_indev, touch_read_cb);
+    lv_indev_set_display(ctx->touch_indev, ctx->lv_disp);
+    lv_indev_set_driver_data(ctx->touch_indev, ctx);
+
+    ctx->axis_indev = lv_indev_create();
+    lv_indev_set_type(ctx->axis_indev, LV_INDEV_TYPE_ENCODER);
+    lv_indev_set_read_cb(ctx->axis_indev, axis_read_cb);
+    lv_indev_set_display(ctx->axis_indev, ctx->lv_disp);
+    lv_indev_set_driver_data(ctx->axis_indev, ctx);
+
+    ctx->keyboard_indev = lv_indev_create();
+    lv_indev_set_type(ctx->keyboard_indev, LV_INDEV_TYPE_KEYPAD);
+    lv_indev_set_read_cb(ctx->keyboard_indev, keyboard_read_cb);
+    lv_indev_set_display(ctx->keyboard_indev, ctx->lv_disp);
+    lv_indev_set_driver_data(ctx->keyboard_indev, ctx);
+
     g = lv_group_create();
     lv_group_set_default(g);
-    lv_indev_set_group(lv_wayland_get_keyboard(disp), g);
-    lv_indev_set_group(lv_wayland_get_pointeraxis(disp), g);
+    lv_indev_set_group(ctx->keyboard_indev, g);
+    lv_indev_set_group(ctx->axis_indev, g);
 
-    return disp;
+    if (event_loop_add_fd(wl_display_get_fd(ctx->display), display_fd_cb, ctx) < 0) {
+        die("Failed to watch the Wayland display\n");
+    }
 
+    report_sec = atoi(getenv_default("LV_WAYLAND_PRESENT_REPORT", "0"));
+    if (report_sec > 0) {
+        lv_timer_create(present_report_cb, (uint32_t)report_sec * 1000, ctx);
+    }
+
+    return ctx->lv_disp;
 }
 
 /**
- * The run loop of the DRM driver
+ * Bind the globals used by the backend
  *
- * @note Currently, the wayland driver calls lv_timer_handler internaly
- * The wayland driver needs to be re-written to match the other backends
+ * @param data the context
+ * @param registry the registry
+ * @param name the name of the global
+ * @param interface the interface of the global
+ * @param version the version supported by the compositor
  */
-static void run_loop_wayland(void)
+static void registry_global(void *data, struct wl_registry *registry, uint32_t name,
+                            const char *interface, uint32_t version)
 {
+    wl_ctx_t *ctx = data;
 
-    uint32_t idle_time;
+    if (strcmp(interface, wl_compositor_interface.name) == 0) {
+        /* Version 4 adds wl_surface.damage_buffer */
+        ctx->compositor_version = LV_MIN(version, 4);
+        ctx->compositor = wl_registry_bind(registry, name, &wl_compositor_interface, ctx->compositor_version);
+    } else if (strcmp(interface, wl_shm_interface.name) == 0) {
+        ctx->shm = wl_registry_bind(registry, name, &wl_shm_interface, 1);
+    } else if (strcmp(interface, xdg_wm_base_interface.name) == 0) {
+        ctx->wm_base = wl_registry_bind(registry, name, &xdg_wm_base_interface, 1);
+        xdg_wm_base_add_listener(ctx->wm_base, &wm_base_listener, ctx);
+    } else if (strcmp(interface, wp_presentation_interface.name) == 0) {
+        ctx->presentation = wl_registry_bind(registry, name, &wp_presentation_interface, 1);
+        wp_presentation_add_listener(ctx->presentation, &presentation_listener, ctx);
+    } else if (strcmp(interface, wl_seat_interface.name) == 0 && ctx->seat == NULL) {
+        ctx->seat = wl_registry_bind(registry, name, &wl_seat_interface, 1);
+        wl_seat_add_listener(ctx->seat, &seat_listener, ctx);
+#if LV_WAYLAND_WINDOW_DECORATIONS
+    } else if (strcmp(interface, zxdg_decoration_manager_v1_interface.name) == 0) {
+        ctx->decoration_manager = wl_registry_bind(registry, name, &zxdg_decoration_manager_v1_interface, 1);
+#endif
+    }
+}
+
+/**
+ * Ignore the removal of a global, none of them can go away while running
+ *
+ * @param data the context
+ * @param registry the registry
+ * @param name the name of the global
+ */
+static void registry_global_remove(void *data, struct wl_registry *registry, uint32_t name)
+{
+    LV_UNUSED(data);
+    LV_UNUSED(registry);
+    LV_UNUSED(name);
+}
+
+/**
+ * Answer the liveness check of the compositor
+ *
+ * @param data the context
+ * @param wm_base the window manager
+ * @param serial the serial of the ping
+ */
+static void wm_base_ping(void *data, struct xdg_wm_base *wm_base, uint32_t serial)
+{
+    LV_UNUSED(data);
+    xdg_wm_base_pong(wm_base, serial);
+}
+
+/**
+ * Acknowledge a configure sequence
+ *
+ * @param data the context
+ * @param xdg_surface the xdg surface
+ * @param serial the serial of the configure
+ */
+static void xdg_surface_configure(void *data, struct xdg_surface *xdg_surface, uint32_t serial)
+{
+    wl_ctx_t *ctx = data;
+
+    xdg_surface_ack_configure(xdg_surface, serial);
+    ctx->configured = true;
+}
+
+/**
+ * Ignore the size suggested by the compositor, the window keeps the size
+ * of the simulator settings
+ *
+ * @param data the context
+ * @param toplevel the toplevel
+ * @param width the suggested width
+ * @param height the suggested height
+ * @param states the states of the window
+ */
+static void toplevel_configure(void *data, struct xdg_toplevel *toplevel, int32_t width, int32_t height,
+                               struct wl_array *states)
+{
+    LV_UNUSED(data);
+    LV_UNUSED(toplevel);
+    LV_UNUSED(width);
+    LV_UNUSED(height);
+    LV_UNUSED(states);
+}
+
+/**
+ * Stop the run loop when the window is closed
+ *
+ * @param data the context
+ * @param toplevel the toplevel
+ */
+static void toplevel_close(void *data, struct xdg_toplevel *toplevel)
+{
+    wl_ctx_t *ctx = data;
+
+    LV_UNUSED(toplevel);
+    ctx->closed = true;
+}
+
+/**
+ * Mark a buffer as free, rendering waits for one
+ *
+ * @param data the buffer
+ * @param wl_buffer the Wayland buffer
+ */
+static void buffer_release(void *data, struct wl_buffer *wl_buffer)
+{
+    wl_shm_buf_t *buf = data;
+
+    LV_UNUSED(wl_buffer);
+    buf->busy = false;
+    resume_rendering(&wl_ctx);
+}
+
+/**
+ * The compositor is ready for the next frame
+ *
+ * @param data the context
+ * @param callback the frame callback
+ * @param time the time of the callback in ms, unused
+ */
+static void frame_done(void *data, struct wl_callback *callback, uint32_t time)
+{
+    wl_ctx_t *ctx = data;
+
+    LV_UNUSED(time);
+    wl_callback_destroy(callback);
+    ctx->frame_cb = NULL;
+    resume_rendering(ctx);
+}
+
+/**
+ * Keep the clock of the presentation timestamps
+ *
+ * @param data the context
+ * @param presentation the presentation global
+ * @param clk_id the clock of the timestamps
+ */
+static void presentation_clock_id(void *data, struct wp_presentation *presentation, uint32_t clk_id)
+{
+    wl_ctx_t *ctx = data;
+
+    LV_UNUSED(presentation);
+    ctx->clock_id = (clockid_t)clk_id;
+}
+
+/**
+ * Ignore the output a frame was shown on
+ *
+ * @param data the frame
+ * @param feedback the feedback
+ * @param output the output
+ */
+static void feedback_sync_output(void *data, struct wp_presentation_feedback *feedback, struct wl_output *output)
+{
+    LV_UNUSED(data);
+    LV_UNUSED(feedback);
+    LV_UNUSED(output);
+}
+
+/**
+ * Measure the latency of a frame that was shown
+ *
+ * The first vblank after the commit is at most one refresh period later,
+ * each further refresh period to the presentation is a missed vblank.
+ *
+ * @param data the frame
+ * @param feedback the feedback
+ * @param tv_sec_hi the high 32 bits of the seconds of the presentation time
+ * @param tv_sec_lo the low 32 bits of the seconds
+ * @param tv_nsec the nanoseconds
+ * @param refresh the refresh period of the output in ns, 0 if unknown
+ * @param seq_hi the high 32 bits of the vblank counter, unused
+ * @param seq_lo the low 32 bits of the vblank counter, unused
+ * @param flags the kind of presentation, unused
+ */
+static void feedback_presented(void *data, struct wp_presentation_feedback *feedback, uint32_t tv_sec_hi,
+                               uint32_t tv_sec_lo, uint32_t tv_nsec, uint32_t refresh, uint32_t seq_hi,
+                               uint32_t seq_lo, uint32_t flags)
+{
+    wl_frame_t *frame = data;
+    wl_ctx_t *ctx = &wl_ctx;
+    struct timespec ts;
+    uint64_t present_ns;
+    uint64_t clock_ns;
+    uint64_t refresh_ns;
+
+    LV_UNUSED(seq_hi);
+    LV_UNUSED(seq_lo);
+    LV_UNUSED(flags);
+
+    present_ns = ((((uint64_t)tv_sec_hi << 32) | tv_sec_lo) * 1000000000ull) + tv_nsec;
+
+    /* Move the timestamp to CLOCK_MONOTONIC if the compositor uses another clock */
+    if (ctx->clock_id != CLOCK_MONOTONIC && clock_gettime(ctx->clock_id, &ts) == 0) {
+        clock_ns = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+        present_ns = present_ns - clock_ns + perf_time_ns();
+    }
+
+    if (refresh != 0) {
+        ctx->refresh_ns = refresh;
+    }
+    refresh_ns = ctx->refresh_ns != 0 ? ctx->refresh_ns : (uint64_t)LV_DEF_REFR_PERIOD * 1000000;
+
+    ctx->presented++;
+
+    if (present_ns > frame->commit_ns) {
+        perf_hist_add(&ctx->commit_present_hist, (uint32_t)((present_ns - frame->commit_ns) / 1000));
+        ctx->missed += (uint32_t)((present_ns - frame->commit_ns) / refresh_ns);
+    }
+
+    if (present_ns > frame->render_ns) {
+        perf_hist_add(&ctx->render_present_hist, (uint32_t)((present_ns - frame->render_ns) / 1000));
+    }
+
+    wp_presentation_feedback_destroy(feedback);
+    frame->feedback = NULL;
+}
+
+/**
+ * Count a frame that was never shown
+ *
+ * @param data the frame
+ * @param feedback the feedback
+ */
+static void feedback_discarded(void *data, struct wp_presentation_feedback *feedback)
+{
+    wl_frame_t *frame = data;
+
+    wl_ctx.discarded++;
+    wp_presentation_feedback_destroy(feedback);
+    frame->feedback = NULL;
+}
+
+/**
+ * Get the pointer, the keyboard and the touchscreen of the seat
+ *
+ * @param data the context
+ * @param seat the seat
+ * @param caps the capabilities of the seat
+ */
+static void seat_capabilities(void *data, struct wl_seat *seat, uint32_t caps)
+{
+    wl_ctx_t *ctx = data;
+
+    if ((caps & WL_SEAT_CAPABILITY_POINTER) && ctx->pointer == NULL) {
+        ctx->pointer = wl_seat_get_pointer(seat);
+        wl_pointer_add_listener(ctx->pointer, &pointer_listener, ctx);
+    } else if (!(caps & WL_SEAT_CAPABILITY_POINTER) && ctx->pointer != NULL) {
+        wl_pointer_destroy(ctx->pointer);
+        ctx->pointer = NULL;
+        ctx->pointer_state = LV_INDEV_STATE_RELEASED;
+        ctx->axis_state = LV_INDEV_STATE_RELEASED;
+    }
+
+    if ((caps & WL_SEAT_CAPABILITY_KEYBOARD) && ctx->keyboard == NULL) {
+        ctx->keyboard = wl_seat_get_keyboard(seat);
+        wl_keyboard_add_listener(ctx->keyboard, &keyboard_listener, ctx);
+    } else if (!(caps & WL_SEAT_CAPABILITY_KEYBOARD) && ctx->keyboard != NULL) {
+        keyboard_leave(ctx, ctx->keyboard, 0, NULL);
+        wl_keyboard_destroy(ctx->keyboard);
+        ctx->keyboard = NULL;
+    }
+
+    if ((caps & WL_SEAT_CAPABILITY_TOUCH) && ctx->touch == NULL) {
+        ctx->touch = wl_seat_get_touch(seat);
+        wl_touch_add_listener(ctx->touch, &touch_listener, ctx);
+    } else if (!(caps & WL_SEAT_CAPABILITY_TOUCH) && ctx->touch != NULL) {
+        touch_cancel(ctx, ctx->touch);
+        wl_touch_destroy(ctx->touch);
+        ctx->touch = NULL;
+    }
+}
+
+/**
+ * The pointer entered the window
+ *
+ * @param data the context
+ * @param pointer the pointer
+ * @param serial the serial of the event
+ * @param surface the surface entered
+ * @param x the position in the surface
+ * @param y the position in the surface
+ */
+static void pointer_enter(void *data, struct wl_pointer *pointer, uint32_t serial, struct wl_surface *surface,
+                          wl_fixed_t x, wl_fixed_t y)
+{
+    wl_ctx_t *ctx = data;
+
+    LV_UNUSED(pointer);
+    LV_UNUSED(serial);
+    LV_UNUSED(surface);
+    ctx->pointer_pos.x = wl_fixed_to_int(x);
+    ctx->pointer_pos.y = wl_fixed_to_int(y);
+}
+
+/**
+ * The pointer left the window, release the button
+ *
+ * @param data the context
+ * @param pointer the pointer
+ * @param serial the serial of the event
+ * @param surface the surface left
+ */
+static void pointer_leave(void *data, struct wl_pointer *pointer, uint32_t serial, struct wl_surface *surface)
+{
+    wl_ctx_t *ctx = data;
+
+    LV_UNUSED(pointer);
+    LV_UNUSED(serial);
+    LV_UNUSED(surface);
+    ctx->pointer_state = LV_INDEV_STATE_RELEASED;
+}
+
+/**
+ * The pointer moved in the window
+ *
+ * @param data the context
+ * @param pointer the pointer
+ * @param time the time of the event
+ * @param x the position in the surface
+ * @param y the position in the surface
+ */
+static void pointer_motion(void *data, struct wl_pointer *pointer, uint32_t time, wl_fixed_t x, wl_fixed_t y)
+{
+    wl_ctx_t *ctx = data;
+
+    LV_UNUSED(pointer);
+    LV_UNUSED(time);
+    ctx->pointer_pos.x = wl_fixed_to_int(x);
+    ctx->pointer_pos.y = wl_fixed_to_int(y);
+}
+
+/**
+ * A button was pressed or released, the middle one presses the encoder and
+ * the others act as the left one
+ *
+ * @param data the context
+ * @param pointer the pointer
+ * @param serial the serial of the event
+ * @param time the time of the event
+ * @param button the button code
+ * @param state the state of the button
+ */
+static void pointer_button(void *data, struct wl_pointer *pointer, uint32_t serial, uint32_t time,
+                           uint32_t button, uint32_t state)
+{
+    wl_ctx_t *ctx = data;
+
+    LV_UNUSED(pointer);
+    LV_UNUSED(serial);
+    LV_UNUSED(time);
+
+    if (button == BTN_MIDDLE) {
+        ctx->axis_state = state == WL_POINTER_BUTTON_STATE_PRESSED ? LV_INDEV_STATE_PRESSED : LV_INDEV_STATE_RELEASED;
+    } else {
+        ctx->pointer_state = state == WL_POINTER_BUTTON_STATE_PRESSED ? LV_INDEV_STATE_PRESSED : LV_INDEV_STATE_RELEASED;
+    }
+}
+
+/**
+ * The scroll wheel turns the encoder, one step per event
+ *
+ * @param data the context
+ * @param pointer the pointer
+ * @param time the time of the event
+ * @param axis the axis
+ * @param value the motion
+ */
+static void pointer_axis(void *data, struct wl_pointer *pointer, uint32_t time, uint32_t axis, wl_fixed_t value)
+{
+    wl_ctx_t *ctx = data;
+
+    LV_UNUSED(pointer);
+    LV_UNUSED(time);
+
+    if (axis != WL_POINTER_AXIS_VERTICAL_SCROLL || value == 0) {
+        return;
+    }
+    ctx->axis_diff += value > 0 ? 1 : -1;
+}
+
+/**
+ * Compile the keymap sent by the compositor
+ *
+ * @param data the context
+ * @param keyboard the keyboard
+ * @param format the format of the keymap
+ * @param fd the fd to map the keymap from
+ * @param size the size of the keymap
+ */
+static void keyboard_keymap(void *data, struct wl_keyboard *keyboard, uint32_t format, int32_t fd, uint32_t size)
+{
+    wl_ctx_t *ctx = data;
+    struct xkb_keymap *keymap;
+    char *map;
+
+    LV_UNUSED(keyboard);
+
+    if (format != WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1) {
+        LV_LOG_WARN("Unsupported keymap format %u, the keyboard is ignored", format);
+        close(fd);
+        return;
+    }
+
+    map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        LV_LOG_ERROR("Failed to map the keymap");
+        return;
+    }
+
+    keymap = xkb_keymap_new_from_string(ctx->xkb_context, map, XKB_KEYMAP_FORMAT_TEXT_V1,
+                                        XKB_KEYMAP_COMPILE_NO_FLAGS);
+    munmap(map, size);
+    if (keymap == NULL) {
+        LV_LOG_ERROR("Failed to compile the keymap");
+        return;
+    }
+
+    xkb_state_unref(ctx->xkb_state);
+    xkb_keymap_unref(ctx->xkb_keymap);
+    ctx->xkb_keymap = keymap;
+    ctx->xkb_state = xkb_state_new(keymap);
+}
+
+/**
+ * The keyboard focus entered the window, the keys already down are ignored
+ *
+ * @param data the context
+ * @param keyboard the keyboard
+ * @param serial the serial of the event
+ * @param surface the surface focused
+ * @param keys the keys already down
+ */
+static void keyboard_enter(void *data, struct wl_keyboard *keyboard, uint32_t serial, struct wl_surface *surface,
+                           struct wl_array *keys)
+{
+    LV_UNUSED(data);
+    LV_UNUSED(keyboard);
+    LV_UNUSED(serial);
+    LV_UNUSED(surface);
+    LV_UNUSED(keys);
+}
+
+/**
+ * The keyboard focus left the window, release the key down
+ *
+ * @param data the context
+ * @param keyboard the keyboard
+ * @param serial the serial of the event
+ * @param surface the surface left
+ */
+static void keyboard_leave(void *data, struct wl_keyboard *keyboard, uint32_t serial, struct wl_surface *surface)
+{
+    wl_ctx_t *ctx = data;
+
+    LV_UNUSED(keyboard);
+    LV_UNUSED(serial);
+    LV_UNUSED(surface);
+
+    if (ctx->key_queued.state == LV_INDEV_STATE_PRESSED) {
+        queue_key(ctx, ctx->key_queued.key, LV_INDEV_STATE_RELEASED);
+    }
+}
+
+/**
+ * A key was pressed or released, queue it for the keypad
+ *
+ * @param data the context
+ * @param keyboard the keyboard
+ * @param serial the serial of the event
+ * @param time the time of the event
+ * @param key the evdev code of the key
+ * @param state the state of the key
+ */
+static void keyboard_key(void *data, struct wl_keyboard *keyboard, uint32_t serial, uint32_t time, uint32_t key,
+                         uint32_t state)
+{
+    wl_ctx_t *ctx = data;
+    uint32_t lv_key;
+
+    LV_UNUSED(keyboard);
+    LV_UNUSED(serial);
+    LV_UNUSED(time);
+
+    if (ctx->xkb_state == NULL) {
+        return;
+    }
+
+    /* The xkb keycodes are the evdev ones shifted by 8 */
+    lv_key = keysym_to_lv_key(xkb_state_key_get_one_sym(ctx->xkb_state, key + 8));
+    if (lv_key == 0) {
+        return;
+    }
+
+    queue_key(ctx, lv_key, state == WL_KEYBOARD_KEY_STATE_PRESSED ? LV_INDEV_STATE_PRESSED : LV_INDEV_STATE_RELEASED);
+}
+
+/**
+ * Update the modifiers of the keymap state
+ *
+ * @param data the context
+ * @param keyboard the keyboard
+ * @param serial the serial of the event
+ * @param mods_depressed the modifiers down
+ * @param mods_latched the modifiers latched
+ * @param mods_locked the modifiers locked
+ * @param group the layout
+ */
+static void keyboard_modifiers(void *data, struct wl_keyboard *keyboard, uint32_t serial, uint32_t mods_depressed,
+                               uint32_t mods_latched, uint32_t mods_locked, uint32_t group)
+{
+    wl_ctx_t *ctx = data;
+
+    LV_UNUSED(keyboard);
+    LV_UNUSED(serial);
+
+    if (ctx->xkb_state != NULL) {
+        xkb_state_update_mask(ctx->xkb_state, mods_depressed, mods_latched, mods_locked, 0, 0, group);
+    }
+}
+
+/**
+ * A finger touched the window, the first one down is followed
+ *
+ * @param data the context
+ * @param touch the touchscreen
+ * @param serial the serial of the event
+ * @param time the time of the event
+ * @param surface the surface touched
+ * @param id the id of the touch point
+ * @param x the position in the surface
+ * @param y the position in the surface
+ */
+static void touch_down(void *data, struct wl_touch *touch, uint32_t serial, uint32_t time,
+                       struct wl_surface *surface, int32_t id, wl_fixed_t x, wl_fixed_t y)
+{
+    wl_ctx_t *ctx = data;
+
+    LV_UNUSED(touch);
+    LV_UNUSED(serial);
+    LV_UNUSED(time);
+    LV_UNUSED(surface);
+
+    if (ctx->touch_id >= 0) {
+        return;
+    }
+    ctx->touch_id = id;
+    ctx->touch_pos.x = wl_fixed_to_int(x);
+    ctx->touch_pos.y = wl_fixed_to_int(y);
+    ctx->touch_state = LV_INDEV_STATE_PRESSED;
+}
+
+/**
+ * A finger left the window
+ *
+ * @param data the context
+ * @param touch the touchscreen
+ * @param serial the serial of the event
+ * @param time the time of the event
+ * @param id the id of the touch point
+ */
+static void touch_up(void *data, struct wl_touch *touch, uint32_t serial, uint32_t time, int32_t id)
+{
+    wl_ctx_t *ctx = data;
+
+    LV_UNUSED(touch);
+    LV_UNUSED(serial);
+    LV_UNUSED(time);
+
+    if (id == ctx->touch_id) {
+        ctx->touch_id = -1;
+        ctx->touch_state = LV_INDEV_STATE_RELEASED;
+    }
+}
+
+/**
+ * A finger moved on the window
+ *
+ * @param data the context
+ * @param touch the touchscreen
+ * @param time the time of the event
+ * @param id the id of the touch point
+ * @param x the position in the surface
+ * @param y the position in the surface
+ */
+static void touch_motion(void *data, struct wl_touch *touch, uint32_t time, int32_t id, wl_fixed_t x, wl_fixed_t y)
+{
+    wl_ctx_t *ctx = data;
 
-    /* Handle LVGL tasks */
-    while (true) {
+    LV_UNUSED(touch);
+    LV_UNUSED(time);
 
-        idle_time = lv_wayland_timer_handler();
+    if (id == ctx->touch_id) {
+        ctx->touch_pos.x = wl_fixed_to_int(x);
+        ctx->touch_pos.y = wl_fixed_to_int(y);
+    }
+}
 
-        if(idle_time != 0) {
-            usleep(idle_time * 1000);
+/**
+ * End of a set of touch events, they were applied as they came
+ *
+ * @param data the context
+ * @param touch the touchscreen
+ */
+static void touch_frame(void *data, struct wl_touch *touch)
+{
+    LV_UNUSED(data);
+    LV_UNUSED(touch);
+}
+
+/**
+ * The compositor took the touch sequence over, release the touch point
+ *
+ * @param data the context
+ * @param touch the touchscreen
+ */
+static void touch_cancel(void *data, struct wl_touch *touch)
+{
+    wl_ctx_t *ctx = data;
+
+    LV_UNUSED(touch);
+    ctx->touch_id = -1;
+    ctx->touch_state = LV_INDEV_STATE_RELEASED;
+}
+
+#if LV_WAYLAND_WINDOW_DECORATIONS
+/**
+ * The compositor chose who draws the decorations
+ *
+ * @param data the context
+ * @param decoration the decoration of the toplevel
+ * @param mode the decoration mode
+ */
+static void decoration_configure(void *data, struct zxdg_toplevel_decoration_v1 *decoration, uint32_t mode)
+{
+    LV_UNUSED(data);
+    LV_UNUSED(decoration);
+
+    if (mode != ZXDG_TOPLEVEL_DECORATION_V1_MODE_SERVER_SIDE) {
+        LV_LOG_WARN("The compositor does not draw the decorations, the window has none");
+    }
+}
+#endif
+
+/**
+ * Translate a keysym to a key of LVGL
+ *
+ * @param sym the keysym
+ * @return the LV_KEY_* or the UTF-8 bytes of the character, 0 if the key is ignored
+ */
+static uint32_t keysym_to_lv_key(xkb_keysym_t sym)
+{
+    char utf8[8];
+    uint32_t key;
+    int len;
+
+    switch (sym) {
+    case XKB_KEY_Up:
+    case XKB_KEY_KP_Up:
+        return LV_KEY_UP;
+    case XKB_KEY_Down:
+    case XKB_KEY_KP_Down:
+        return LV_KEY_DOWN;
+    case XKB_KEY_Right:
+    case XKB_KEY_KP_Right:
+        return LV_KEY_RIGHT;
+    case XKB_KEY_Left:
+    case XKB_KEY_KP_Left:
+        return LV_KEY_LEFT;
+    case XKB_KEY_Escape:
+        return LV_KEY_ESC;
+    case XKB_KEY_Delete:
+    case XKB_KEY_KP_Delete:
+        return LV_KEY_DEL;
+    case XKB_KEY_BackSpace:
+        return LV_KEY_BACKSPACE;
+    case XKB_KEY_Return:
+    case XKB_KEY_KP_Enter:
+        return LV_KEY_ENTER;
+    case XKB_KEY_Tab:
+    case XKB_KEY_Next:
+        return LV_KEY_NEXT;
+    case XKB_KEY_ISO_Left_Tab:
+    case XKB_KEY_Prior:
+        return LV_KEY_PREV;
+    case XKB_KEY_Home:
+    case XKB_KEY_KP_Home:
+        return LV_KEY_HOME;
+    case XKB_KEY_End:
+    case XKB_KEY_KP_End:
+        return LV_KEY_END;
+    default:
+        break;
+    }
+
+    /* The length counts the terminating NUL, a character fits in the 4 bytes of the key */
+    len = xkb_keysym_to_utf8(sym, utf8, sizeof(utf8));
+    if (len < 2 || len > 5 || (uint8_t)utf8[0] < 0x20 || utf8[0] == 0x7f) {
+        return 0;
+    }
+
+    key = 0;
+    memcpy(&key, utf8, (size_t)len - 1);
+    return key;
+}
+
+/**
+ * Queue a key event for the keypad, dropped if the queue is full
+ *
+ * @param ctx the context
+ * @param key the key
+ * @param state the state of the key
+ */
+static void queue_key(wl_ctx_t *ctx, uint32_t key, lv_indev_state_t state)
+{
+    wl_key_t *slot;
+
+    if (ctx->key_count == WL_KEY_QUEUE) {
+        LV_LOG_WARN("The key queue is full, key dropped");
+        return;
+    }
+
+    slot = &ctx->keys[(ctx->key_head + ctx->key_count) % WL_KEY_QUEUE];
+    slot->key = key;
+    slot->state = state;
+    ctx->key_count++;
+    ctx->key_queued = *slot;
+}
+
+/**
+ * Allocate the shm pool and the buffers of the window
+ *
+ * @param ctx the context
+ * @return 0 on success, -1 on error
+ */
+static int create_buffers(wl_ctx_t *ctx)
+{
+    struct wl_shm_pool *pool;
+    size_t buf_size;
+    wl_shm_buf_t *buf;
+    int fd;
+    int i;
+
+    ctx->stride = (uint32_t)ctx->width * 4;
+    buf_size = (size_t)ctx->stride * (size_t)ctx->height;
+    ctx->pool_size = buf_size * WL_BUF_COUNT;
+
+    fd = memfd_create("lvgl-wayland", MFD_CLOEXEC);
+    if (fd < 0) {
+        LV_LOG_ERROR("memfd_create failed");
+        return -1;
+    }
+
+    if (ftruncate(fd, (off_t)ctx->pool_size) < 0) {
+        LV_LOG_ERROR("Failed to size the shm pool");
+        close(fd);
+        return -1;
+    }
+
+    ctx->pool_data = mmap(NULL, ctx->pool_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ctx->pool_data == MAP_FAILED) {
+        LV_LOG_ERROR("Failed to map the shm pool");
+        close(fd);
+        return -1;
+    }
+
+    pool = wl_shm_create_pool(ctx->shm, fd, (int32_t)ctx->pool_size);
+
+    for (i = 0; i < WL_BUF_COUNT; i++) {
+        buf = &ctx->bufs[i];
+        buf->data = ctx->pool_data + buf_size * i;
+        buf->wl_buffer = wl_shm_pool_create_buffer(pool, (int32_t)(buf_size * i), ctx->width, ctx->height,
+                                                   (int32_t)ctx->stride, WL_SHM_FORMAT_XRGB8888);
+        wl_buffer_add_listener(buf->wl_buffer, &buffer_listener, buf);
+    }
+
+    /* The buffers keep the pool alive */
+    wl_shm_pool_destroy(pool);
+    close(fd);
+
+    lv_draw_buf_init(&ctx->draw_buf, (uint32_t)ctx->width, (uint32_t)ctx->height, LV_COLOR_FORMAT_XRGB8888,
+                     ctx->stride, ctx->bufs[0].data, (uint32_t)buf_size);
+
+    return 0;
+}
+
+/**
+ * Damage the flushed areas and commit the buffer after the last one
+ *
+ * The refresh timer is paused until the compositor asks for the next frame.
+ *
+ * @param disp the display
+ * @param area the area rendered
+ * @param px_map the buffer, unused in direct mode
+ */
+static void flush_cb(lv_display_t *disp, const lv_area_t *area, uint8_t *px_map)
+{
+    wl_ctx_t *ctx = lv_display_get_driver_data(disp);
+    wl_damage_t *damage = &ctx->damage[(ctx->frame + 1) % WL_DAMAGE_HISTORY];
+    wl_shm_buf_t *buf = ctx->current;
+    uint64_t now;
+    uint32_t i;
+
+    LV_UNUSED(px_map);
+
+    if (damage->count < WL_DAMAGE_MAX_AREAS) {
+        damage->areas[damage->count++] = *area;
+    } else {
+        damage->full = true;
+    }
+
+    if (!lv_display_flush_is_last(disp)) {
+        lv_display_flush_ready(disp);
+        return;
+    }
+
+    if (damage->full) {
+        damage->count = 1;
+        lv_area_set(&damage->areas[0], 0, 0, ctx->width - 1, ctx->height - 1);
+    }
+
+    for (i = 0; i < damage->count; i++) {
+        area = &damage->areas[i];
+        ctx->damaged_bytes += (uint64_t)lv_area_get_size(area) * 4;
+        if (ctx->compositor_version >= 4) {
+            wl_surface_damage_buffer(ctx->surface, area->x1, area->y1, lv_area_get_width(area),
+                                     lv_area_get_height(area));
+        } else {
+            wl_surface_damage(ctx->surface, area->x1, area->y1, lv_area_get_width(area), lv_area_get_height(area));
         }
+    }
+
+    now = perf_time_ns();
+
+    ctx->frame++;
+    buf->frame = ctx->frame;
+    buf->busy = true;
+    ctx->latest = buf;
+    wl_surface_attach(ctx->surface, buf->wl_buffer, 0, 0);
+
+    if (ctx->frame_cb == NULL) {
+        ctx->frame_cb = wl_surface_frame(ctx->surface);
+        wl_callback_add_listener(ctx->frame_cb, &frame_listener, ctx);
+    }
+
+    request_feedback(ctx, now);
 
-        /* Run until the last window closes */
-        if (!lv_wayland_window_is_open(NULL)) {
+    wl_surface_commit(ctx->surface);
+    wl_display_flush(ctx->display);
+    ctx->committed++;
+
+    perf_hist_add(&ctx->copied_hist, (uint32_t)ctx->copied_bytes);
+    perf_hist_add(&ctx->damaged_hist, (uint32_t)ctx->damaged_bytes);
+    ctx->copied_bytes = 0;
+    ctx->damaged_bytes = 0;
+
+    lv_timer_pause(ctx->refr_timer);
+    lv_display_flush_ready(disp);
+}
+
+/**
+ * Ask for the presentation feedback of the frame about to be committed
+ *
+ * @param ctx the context
+ * @param now the time of the commit
+ */
+static void request_feedback(wl_ctx_t *ctx, uint64_t now)
+{
+    wl_frame_t *frame = NULL;
+    int i;
+
+    if (ctx->presentation == NULL) {
+        return;
+    }
+
+    for (i = 0; i < WL_FEEDBACK_COUNT; i++) {
+        if (ctx->frames[i].feedback == NULL) {
+            frame = &ctx->frames[i];
             break;
         }
     }
+
+    /* The compositor holds too many frames, this one is not measured */
+    if (frame == NULL) {
+        return;
+    }
+
+    frame->render_ns = ctx->refr_start_ns;
+    frame->commit_ns = now;
+    frame->feedback = wp_presentation_feedback(ctx->presentation, ctx->surface);
+    wp_presentation_feedback_add_listener(frame->feedback, &feedback_listener, frame);
+}
+
+/**
+ * Render again once the frame callback arrived and a buffer was released
+ *
+ * @param ctx the context
+ */
+static void resume_rendering(wl_ctx_t *ctx)
+{
+    if (ctx->lv_disp == NULL || ctx->frame_cb != NULL || find_free_buffer(ctx) == NULL) {
+        return;
+    }
+
+    lv_timer_resume(ctx->refr_timer);
+    lv_timer_ready(ctx->refr_timer);
+}
+
+/**
+ * Find the released buffer with the most recent content
+ *
+ * @param ctx the context
+ * @return the buffer, NULL if the compositor holds all of them
+ */
+static wl_shm_buf_t *find_free_buffer(wl_ctx_t *ctx)
+{
+    wl_shm_buf_t *best = NULL;
+    int i;
+
+    for (i = 0; i < WL_BUF_COUNT; i++) {
+        if (!ctx->bufs[i].busy && (best == NULL || ctx->bufs[i].frame > best->frame)) {
+            best = &ctx->bufs[i];
+        }
+    }
+
+    return best;
+}
+
+/**
+ * Copy an area between two buffers of the pool
+ *
+ * @param ctx the context
+ * @param dst the destination buffer
+ * @param src the source buffer
+ * @param area the area to copy
+ */
+static void copy_area(wl_ctx_t *ctx, uint8_t *dst, const uint8_t *src, const lv_area_t *area)
+{
+    size_t offset = (size_t)area->y1 * ctx->stride + (size_t)area->x1 * 4;
+    size_t len = (size_t)lv_area_get_width(area) * 4;
+    int32_t y;
+
+    for (y = area->y1; y <= area->y2; y++) {
+        memcpy(dst + offset, src + offset, len);
+        offset += ctx->stride;
+    }
+
+    ctx->copied_bytes += (uint64_t)len * (uint64_t)lv_area_get_height(area);
+}
+
+/**
+ * Bring a reused buffer up to the latest frame
+ *
+ * The areas flushed by the frames committed since the buffer was last
+ * committed are copied from the latest buffer, overlapping areas are
+ * joined first so that no pixel is copied twice.
+ *
+ * @param ctx the context
+ * @param buf the buffer LVGL is about to draw in
+ */
+static void repair_buffer(wl_ctx_t *ctx, wl_shm_buf_t *buf)
+{
+    lv_area_t areas[WL_DAMAGE_HISTORY * WL_DAMAGE_MAX_AREAS];
+    lv_area_t full;
+    const wl_damage_t *damage;
+    uint32_t count = 0;
+    uint32_t f;
+    uint32_t i;
+    uint32_t j;
+    bool joined;
+
+    if (ctx->latest == NULL || ctx->latest == buf) {
+        return;
+    }
+
+    lv_area_set(&full, 0, 0, ctx->width - 1, ctx->height - 1);
+
+    /* Never used or older than the damage history */
+    if (buf->frame == 0 || ctx->frame - buf->frame >= WL_DAMAGE_HISTORY) {
+        copy_area(ctx, buf->data, ctx->latest->data, &full);
+        return;
+    }
+
+    for (f = buf->frame + 1; f <= ctx->frame; f++) {
+        damage = &ctx->damage[f % WL_DAMAGE_HISTORY];
+        for (i = 0; i < damage->count; i++) {
+            areas[count++] = damage->areas[i];
+        }
+    }
+
+    /* Join the overlapping areas until none is left */
+    do {
+        joined = false;
+        for (i = 0; i < count; i++) {
+            for (j = i + 1; j < count; j++) {
+                if (areas[i].x1 <= areas[j].x2 && areas[j].x1 <= areas[i].x2 &&
+                    areas[i].y1 <= areas[j].y2 && areas[j].y1 <= areas[i].y2) {
+                    lv_area_set(&areas[i], LV_MIN(areas[i].x1, areas[j].x1), LV_MIN(areas[i].y1, areas[j].y1),
+                                LV_MAX(areas[i].x2, areas[j].x2), LV_MAX(areas[i].y2, areas[j].y2));
+                    areas[j] = areas[--count];
+                    joined = true;
+                    j--;
+                }
+            }
+        }
+    } while (joined);
+
+    for (i = 0; i < count; i++) {
+        copy_area(ctx, buf->data, ctx->latest->data, &areas[i]);
+    }
+}
+
+/**
+ * Remember when the refresh drawing the next frame started
+ *
+ * @param e the refresh start event
+ */
+static void refr_start_cb(lv_event_t *e)
+{
+    wl_ctx_t *ctx = lv_event_get_user_data(e);
+
+    ctx->refr_start_ns = perf_time_ns();
+}
+
+/**
+ * Point the draw buffer to the free buffer with the most recent content
+ * and repair it before LVGL draws the invalidated areas
+ *
+ * @param e the render start event
+ */
+static void render_start_cb(lv_event_t *e)
+{
+    wl_ctx_t *ctx = lv_event_get_user_data(e);
+    wl_damage_t *damage = &ctx->damage[(ctx->frame + 1) % WL_DAMAGE_HISTORY];
+    wl_shm_buf_t *buf = find_free_buffer(ctx);
+
+    /* The refresh timer only runs with a free buffer */
+    LV_ASSERT_NULL(buf);
+
+    repair_buffer(ctx, buf);
+
+    ctx->current = buf;
+    ctx->draw_buf.data = buf->data;
+    ctx->draw_buf.unaligned_data = buf->data;
+
+    damage->count = 0;
+    damage->full = false;
+}
+
+/**
+ * Report the state of the Wayland pointer
+ *
+ * @param indev the input device
+ * @param data the state to fill
+ */
+static void pointer_read_cb(lv_indev_t *indev, lv_indev_data_t *data)
+{
+    wl_ctx_t *ctx = lv_indev_get_driver_data(indev);
+
+    data->point = ctx->pointer_pos;
+    data->state = ctx->pointer_state;
+}
+
+/**
+ * Report the state of the Wayland touchscreen
+ *
+ * @param indev the input device
+ * @param data the state to fill
+ */
+static void touch_read_cb(lv_indev_t *indev, lv_indev_data_t *data)
+{
+    wl_ctx_t *ctx = lv_indev_get_driver_data(indev);
+
+    data->point = ctx->touch_pos;
+    data->state = ctx->touch_state;
+}
+
+/**
+ * Report the wheel steps and the middle button to the encoder
+ *
+ * @param indev the input device
+ * @param data the state to fill
+ */
+static void axis_read_cb(lv_indev_t *indev, lv_indev_data_t *data)
+{
+    wl_ctx_t *ctx = lv_indev_get_driver_data(indev);
+
+    data->enc_diff = (int16_t)LV_CLAMP(INT16_MIN, ctx->axis_diff, INT16_MAX);
+    data->state = ctx->axis_state;
+    ctx->axis_diff = 0;
+}
+
+/**
+ * Report the next queued key, or the last one read while the queue is empty
+ *
+ * @param indev the input device
+ * @param data the state to fill
+ */
+static void keyboard_read_cb(lv_indev_t *indev, lv_indev_data_t *data)
+{
+    wl_ctx_t *ctx = lv_indev_get_driver_data(indev);
+
+    if (ctx->key_count > 0) {
+        ctx->key_read = ctx->keys[ctx->key_head];
+        ctx->key_head = (ctx->key_head + 1) % WL_KEY_QUEUE;
+        ctx->key_count--;
+    }
+
+    data->key = ctx->key_read.key;
+    data->state = ctx->key_read.state;
+    data->continue_reading = ctx->key_count > 0;
+}
+
+/**
+ * Read the events of the display prepared before the wait and dispatch them
+ *
+ * @param fd the display fd
+ * @param revents the events of the fd, 0 if it was not readable
+ * @param user_data the context
+ */
+static void display_fd_cb(int fd, short revents, void *user_data)
+{
+    wl_ctx_t *ctx = user_data;
+
+    LV_UNUSED(fd);
+
+    if (revents & POLLIN) {
+        wl_display_read_events(ctx->display);
+    } else {
+        wl_display_cancel_read(ctx->display);
+    }
+
+    if ((revents & (POLLERR | POLLHUP)) || wl_display_dispatch_pending(ctx->display) < 0) {
+        LV_LOG_ERROR("Lost the connection to the Wayland compositor");
+        ctx->closed = true;
+    }
+}
+
+/**
+ * Print and reset the presentation statistics
+ *
+ * @param timer the report timer
+ */
+static void present_report_cb(lv_timer_t *timer)
+{
+    wl_ctx_t *ctx = lv_timer_get_user_data(timer);
+
+    fprintf(stdout, "wayland: %u frames committed, %u presented, %u discarded, %u missed vblanks, refresh %u us\n",
+            ctx->committed, ctx->presented, ctx->discarded, ctx->missed, ctx->refresh_ns / 1000);
+    perf_hist_print(&ctx->render_present_hist, "render to present", "us");
+    perf_hist_print(&ctx->commit_present_hist, "commit to present", "us");
+    fprintf(stdout, "wayland: %d shm buffers of %dx%d\n", WL_BUF_COUNT, ctx->width, ctx->height);
+    perf_hist_print(&ctx->copied_hist, "copied per frame", "B");
+    perf_hist_print(&ctx->damaged_hist, "committed per frame", "B");
+
+    ctx->committed = 0;
+    ctx->presented = 0;
+    ctx->discarded = 0;
+    ctx->missed = 0;
+    perf_hist_reset(&ctx->render_present_hist);
+    perf_hist_reset(&ctx->commit_present_hist);
+    perf_hist_reset(&ctx->copied_hist);
+    perf_hist_reset(&ctx->damaged_hist);
+}
+
+/**
+ * The run loop of the Wayland driver
+ *
+ * Sleeps in the event loop until the next LVGL timer or an event of the
+ * compositor, the frame callbacks resume the refresh timer.
+ */
+static void run_loop_wayland(void)
+{
+    wl_ctx_t *ctx = &wl_ctx;
+    uint32_t idle_time;
+
+    /* Run until the window closes */
+    while (!ctx->closed) {
+
+        /* Returns the time to the next timer execution */
+        idle_time = lv_timer_handler();
+
+        /* Events already read are dispatched before sleeping, they may resume the refresh */
+        while (wl_display_prepare_read(ctx->display) != 0) {
+            if (wl_display_dispatch_pending(ctx->display) > 0) {
+                idle_time = 0;
+            }
+        }
+        wl_display_flush(ctx->display);
+
+        event_loop_wait(idle_time);
+    }
 }
 
 #endif /*#if LV_USE_WAYLAND*/
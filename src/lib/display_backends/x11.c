@@ -10,6 +10,13 @@
  *
  * Author: EDGEMTech Ltd, Erik Tagirov (erik.tagirov@edgemtech.ch)
  *
+ * LVGL renders in direct mode into the XImage of the window, and each
+ * area flushed is pushed with XShmPutImage() when the server supports
+ * MIT-SHM on this connection, with XPutImage() through the socket
+ * otherwise. The frame ends with XSync() so that the server is done
+ * reading the image before LVGL draws in it again, the time from the
+ * first area pushed to the end of the XSync() is the blit time.
+ *
  */
 
 /*********************
@@ -17,14 +24,25 @@
  *********************/
 
 #include <unistd.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
 
 #include "lvgl/lvgl.h"
 #if LV_USE_X11
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/keysym.h>
+#include <X11/extensions/XShm.h>
+
 #include "../simulator_util.h"
 #include "../simulator_settings.h"
 #include "../backends.h"
+#include "../event_loop.h"
+#include "../perf_stats.h"
 
 /*********************
  *      DEFINES
@@ -34,6 +52,36 @@
  *      TYPEDEFS
  **********************/
 
+typedef struct {
+    Display *dpy;
+    Window win;
+    GC gc;
+    Atom wm_delete;
+    XImage *img;
+    XShmSegmentInfo shminfo;
+    bool use_shm;
+    bool closed;
+    int32_t width;
+    int32_t height;
+
+    lv_display_t *lv_disp;
+    lv_draw_buf_t draw_buf;
+
+    lv_point_t pointer_pos;
+    lv_indev_state_t pointer_state;
+    uint32_t key;
+    lv_indev_state_t key_state;
+
+    /* Blit statistics of the current frame */
+    uint64_t blit_start_ns;
+    uint32_t blit_rects;
+    uint64_t blit_bytes;
+    uint32_t frames;
+    perf_hist_t blit_hist;
+    perf_hist_t rects_hist;
+    perf_hist_t bytes_hist;
+} x11_ctx_t;
+
 /**********************
  *  EXTERNAL VARIABLES
  **********************/
@@ -44,11 +92,25 @@ extern simulator_settings_t settings;
  **********************/
 static lv_display_t *init_x11(void);
 static void run_loop_x11(void);
+static lv_color_format_t get_color_format(x11_ctx_t *ctx);
+static int shm_error_handler(Display *dpy, XErrorEvent *ev);
+static bool create_shm_image(x11_ctx_t *ctx, Visual *visual, int depth);
+static bool create_image(x11_ctx_t *ctx, Visual *visual, int depth);
+static void put_image(x11_ctx_t *ctx, int32_t x, int32_t y, int32_t w, int32_t h);
+static void flush_cb(lv_display_t *disp, const lv_area_t *area, uint8_t *px_map);
+static uint32_t translate_key(KeySym sym, const char *text, int len);
+static void process_events(x11_ctx_t *ctx);
+static void pointer_read_cb(lv_indev_t *indev, lv_indev_data_t *data);
+static void keypad_read_cb(lv_indev_t *indev, lv_indev_data_t *data);
+static void display_fd_cb(int fd, short revents, void *user_data);
+static void blit_report_cb(lv_timer_t *timer);
 
 /**********************
  *  STATIC VARIABLES
  **********************/
 static char *backend_name = "X11";
+static x11_ctx_t x11_ctx;
+static bool shm_attach_failed;
 
 /**********************
  *      MACROS
@@ -73,6 +135,8 @@ int backend_init_x11(backend_t *backend)
     backend->name = backend_name;
     backend->handle->display->init_display = init_x11;
     backend->handle->display->run_loop = run_loop_x11;
+    backend->handle->display->shared_loop = false;
+    backend->handle->display->thread_flush = false;
     backend->type = BACKEND_DISPLAY;
 
     return 0;
@@ -89,35 +153,465 @@ int backend_init_x11(backend_t *backend)
  */
 static lv_display_t *init_x11(void)
 {
-    lv_display_t *disp;
-    LV_IMG_DECLARE(mouse_cursor_icon);
+    x11_ctx_t *ctx = &x11_ctx;
+    XSizeHints hints;
+    Visual *visual;
+    lv_color_format_t cf;
+    lv_indev_t *indev;
+    lv_group_t *g;
+    int screen;
+    int depth;
+    int report_sec;
+
+    ctx->width = (int32_t)settings.window_width;
+    ctx->height = (int32_t)settings.window_height;
+
+    ctx->dpy = XOpenDisplay(NULL);
+    if (ctx->dpy == NULL) {
+        die("Failed to open the X display\n");
+    }
+
+    screen = DefaultScreen(ctx->dpy);
+    visual = DefaultVisual(ctx->dpy, screen);
+    depth = DefaultDepth(ctx->dpy, screen);
 
-    disp = lv_x11_window_create("LVGL simulator",
-           settings.window_width , settings.window_height);
+    ctx->win = XCreateSimpleWindow(ctx->dpy, RootWindow(ctx->dpy, screen), 0, 0, (unsigned int)ctx->width,
+                                   (unsigned int)ctx->height, 0, BlackPixel(ctx->dpy, screen),
+                                   BlackPixel(ctx->dpy, screen));
+    XSelectInput(ctx->dpy, ctx->win, ExposureMask | ButtonPressMask | ButtonReleaseMask | PointerMotionMask |
+                 KeyPressMask | KeyReleaseMask | LeaveWindowMask);
+    XStoreName(ctx->dpy, ctx->win, "LVGL simulator");
 
-    disp = lv_display_get_default();
+    hints.flags = PMinSize | PMaxSize;
+    hints.min_width = hints.max_width = ctx->width;
+    hints.min_height = hints.max_height = ctx->height;
+    XSetWMNormalHints(ctx->dpy, ctx->win, &hints);
 
-    if (disp == NULL) {
+    ctx->wm_delete = XInternAtom(ctx->dpy, "WM_DELETE_WINDOW", False);
+    XSetWMProtocols(ctx->dpy, ctx->win, &ctx->wm_delete, 1);
+
+    ctx->gc = XCreateGC(ctx->dpy, ctx->win, 0, NULL);
+
+    ctx->use_shm = atoi(getenv_default("LV_X11_SHM", "1")) != 0 && create_shm_image(ctx, visual, depth);
+    if (!ctx->use_shm && !create_image(ctx, visual, depth)) {
+        die("Failed to create the X11 image\n");
+    }
+
+    cf = get_color_format(ctx);
+    if (cf == LV_COLOR_FORMAT_UNKNOWN) {
+        die("Unsupported X11 visual, depth %d\n", depth);
+    }
+
+    LV_LOG_USER("X11 %dx%d, %d bpp, %s", ctx->width, ctx->height, ctx->img->bits_per_pixel,
+                ctx->use_shm ? "MIT-SHM" : "XPutImage");
+
+    XMapWindow(ctx->dpy, ctx->win);
+    XFlush(ctx->dpy);
+
+    ctx->lv_disp = lv_display_create(ctx->width, ctx->height);
+    if (ctx->lv_disp == NULL) {
         return NULL;
     }
 
-    lv_x11_inputs_create(disp, &mouse_cursor_icon);
+    lv_draw_buf_init(&ctx->draw_buf, (uint32_t)ctx->width, (uint32_t)ctx->height, cf,
+                     (uint32_t)ctx->img->bytes_per_line, ctx->img->data,
+                     (uint32_t)(ctx->img->bytes_per_line * ctx->height));
+
+    lv_display_set_color_format(ctx->lv_disp, cf);
+    lv_display_set_draw_buffers(ctx->lv_disp, &ctx->draw_buf, NULL);
+    lv_display_set_render_mode(ctx->lv_disp, LV_DISPLAY_RENDER_MODE_DIRECT);
+    lv_display_set_flush_cb(ctx->lv_disp, flush_cb);
+    lv_display_set_driver_data(ctx->lv_disp, ctx);
 
-    return disp;
+    g = lv_group_create();
+    lv_group_set_default(g);
+
+    indev = lv_indev_create();
+    lv_indev_set_type(indev, LV_INDEV_TYPE_POINTER);
+    lv_indev_set_read_cb(indev, pointer_read_cb);
+    lv_indev_set_display(indev, ctx->lv_disp);
+    lv_indev_set_driver_data(indev, ctx);
+
+    indev = lv_indev_create();
+    lv_indev_set_type(indev, LV_INDEV_TYPE_KEYPAD);
+    lv_indev_set_read_cb(indev, keypad_read_cb);
+    lv_indev_set_display(indev, ctx->lv_disp);
+    lv_indev_set_driver_data(indev, ctx);
+    lv_indev_set_group(indev, g);
+
+    if (event_loop_add_fd(ConnectionNumber(ctx->dpy), display_fd_cb, ctx) < 0) {
+        die("Failed to watch the X11 connection\n");
+    }
+
+    report_sec = atoi(getenv_default("LV_X11_BLIT_REPORT", "0"));
+    if (report_sec > 0) {
+        lv_timer_create(blit_report_cb, (uint32_t)report_sec * 1000, ctx);
+    }
+
+    return ctx->lv_disp;
+}
+
+/**
+ * Get the LVGL color format matching the image of the window
+ *
+ * @param ctx the context
+ * @return the color format, LV_COLOR_FORMAT_UNKNOWN if LVGL cannot render it
+ */
+static lv_color_format_t get_color_format(x11_ctx_t *ctx)
+{
+    XImage *img = ctx->img;
+
+    if (img->byte_order != LSBFirst) {
+        return LV_COLOR_FORMAT_UNKNOWN;
+    }
+
+    if (img->bits_per_pixel == 32 && img->red_mask == 0xff0000 && img->blue_mask == 0xff) {
+        return LV_COLOR_FORMAT_XRGB8888;
+    }
+
+    if (img->bits_per_pixel == 16 && img->red_mask == 0xf800 && img->blue_mask == 0x1f) {
+        return LV_COLOR_FORMAT_RGB565;
+    }
+
+    return LV_COLOR_FORMAT_UNKNOWN;
+}
+
+/**
+ * Record the failure of XShmAttach(), e.g. on a remote display
+ *
+ * @param dpy the display
+ * @param ev the error
+ * @return ignored
+ */
+static int shm_error_handler(Display *dpy, XErrorEvent *ev)
+{
+    LV_UNUSED(dpy);
+    LV_UNUSED(ev);
+    shm_attach_failed = true;
+    return 0;
+}
+
+/**
+ * Create the image of the window in a shared memory segment
+ *
+ * @param ctx the context
+ * @param visual the visual of the window
+ * @param depth the depth of the window
+ * @return true on success, false if MIT-SHM cannot be used
+ */
+static bool create_shm_image(x11_ctx_t *ctx, Visual *visual, int depth)
+{
+    XErrorHandler old_handler;
+    XImage *img;
+
+    if (!XShmQueryExtension(ctx->dpy)) {
+        LV_LOG_WARN("MIT-SHM is not available, using XPutImage");
+        return false;
+    }
+
+    img = XShmCreateImage(ctx->dpy, visual, (unsigned int)depth, ZPixmap, NULL, &ctx->shminfo,
+                          (unsigned int)ctx->width, (unsigned int)ctx->height);
+    if (img == NULL) {
+        return false;
+    }
+
+    ctx->shminfo.shmid = shmget(IPC_PRIVATE, (size_t)img->bytes_per_line * (size_t)img->height, IPC_CREAT | 0600);
+    if (ctx->shminfo.shmid < 0) {
+        XDestroyImage(img);
+        return false;
+    }
+
+    ctx->shminfo.shmaddr = img->data = shmat(ctx->shminfo.shmid, NULL, 0);
+    ctx->shminfo.readOnly = False;
+
+    if (ctx->shminfo.shmaddr == (char *)-1) {
+        shmctl(ctx->shminfo.shmid, IPC_RMID, NULL);
+        img->data = NULL;
+        XDestroyImage(img);
+        return false;
+    }
+
+    shm_attach_failed = false;
+    old_handler = XSetErrorHandler(shm_error_handler);
+    XShmAttach(ctx->dpy, &ctx->shminfo);
+    XSync(ctx->dpy, False);
+    XSetErrorHandler(old_handler);
+
+    /* The segment goes away with the last detach, even on a crash */
+    shmctl(ctx->shminfo.shmid, IPC_RMID, NULL);
+
+    if (shm_attach_failed) {
+        LV_LOG_WARN("XShmAttach failed, using XPutImage");
+        shmdt(ctx->shminfo.shmaddr);
+        img->data = NULL;
+        XDestroyImage(img);
+        return false;
+    }
+
+    ctx->img = img;
+
+    return true;
+}
+
+/**
+ * Create the image of the window in client memory, sent through the socket
+ *
+ * @param ctx the context
+ * @param visual the visual of the window
+ * @param depth the depth of the window
+ * @return true on success
+ */
+static bool create_image(x11_ctx_t *ctx, Visual *visual, int depth)
+{
+    ctx->img = XCreateImage(ctx->dpy, visual, (unsigned int)depth, ZPixmap, 0, NULL, (unsigned int)ctx->width,
+                            (unsigned int)ctx->height, 32, 0);
+    if (ctx->img == NULL) {
+        return false;
+    }
+
+    /* Freed by XDestroyImage() */
+    ctx->img->data = malloc((size_t)ctx->img->bytes_per_line * (size_t)ctx->height);
+
+    return ctx->img->data != NULL;
+}
+
+/**
+ * Push an area of the image to the window
+ *
+ * @param ctx the context
+ * @param x the left edge of the area
+ * @param y the top edge of the area
+ * @param w the width of the area
+ * @param h the height of the area
+ */
+static void put_image(x11_ctx_t *ctx, int32_t x, int32_t y, int32_t w, int32_t h)
+{
+    if (ctx->use_shm) {
+        XShmPutImage(ctx->dpy, ctx->win, ctx->gc, ctx->img, x, y, x, y, (unsigned int)w, (unsigned int)h, False);
+    } else {
+        XPutImage(ctx->dpy, ctx->win, ctx->gc, ctx->img, x, y, x, y, (unsigned int)w, (unsigned int)h);
+    }
+}
+
+/**
+ * Push the areas drawn in the image to the window
+ *
+ * @param disp the display
+ * @param area the area rendered
+ * @param px_map the image, unused in direct mode
+ */
+static void flush_cb(lv_display_t *disp, const lv_area_t *area, uint8_t *px_map)
+{
+    x11_ctx_t *ctx = lv_display_get_driver_data(disp);
+
+    LV_UNUSED(px_map);
+
+    if (ctx->blit_rects == 0) {
+        ctx->blit_start_ns = perf_time_ns();
+    }
+
+    put_image(ctx, area->x1, area->y1, lv_area_get_width(area), lv_area_get_height(area));
+    ctx->blit_rects++;
+    ctx->blit_bytes += (uint64_t)lv_area_get_size(area) * (uint64_t)(ctx->img->bits_per_pixel / 8);
+
+    if (lv_display_flush_is_last(disp)) {
+        /* The server has read the image once XSync() returns */
+        XSync(ctx->dpy, False);
+
+        perf_hist_add(&ctx->blit_hist, (uint32_t)((perf_time_ns() - ctx->blit_start_ns) / 1000));
+        perf_hist_add(&ctx->rects_hist, ctx->blit_rects);
+        perf_hist_add(&ctx->bytes_hist, (uint32_t)ctx->blit_bytes);
+        ctx->frames++;
+        ctx->blit_rects = 0;
+        ctx->blit_bytes = 0;
+    }
+
+    lv_display_flush_ready(disp);
+}
+
+/**
+ * Convert an X key to an LVGL key
+ *
+ * @param sym the keysym
+ * @param text the text of the key
+ * @param len the length of the text
+ * @return the LVGL key, 0 if the key is ignored
+ */
+static uint32_t translate_key(KeySym sym, const char *text, int len)
+{
+    switch (sym) {
+    case XK_Return:
+    case XK_KP_Enter:
+        return LV_KEY_ENTER;
+    case XK_Escape:
+        return LV_KEY_ESC;
+    case XK_BackSpace:
+        return LV_KEY_BACKSPACE;
+    case XK_Delete:
+        return LV_KEY_DEL;
+    case XK_Tab:
+        return LV_KEY_NEXT;
+    case XK_ISO_Left_Tab:
+        return LV_KEY_PREV;
+    case XK_Left:
+        return LV_KEY_LEFT;
+    case XK_Right:
+        return LV_KEY_RIGHT;
+    case XK_Up:
+        return LV_KEY_UP;
+    case XK_Down:
+        return LV_KEY_DOWN;
+    case XK_Home:
+        return LV_KEY_HOME;
+    case XK_End:
+        return LV_KEY_END;
+    default:
+        return len == 1 ? (uint8_t)text[0] : 0;
+    }
+}
+
+/**
+ * Handle the events queued by Xlib
+ *
+ * @param ctx the context
+ */
+static void process_events(x11_ctx_t *ctx)
+{
+    XEvent ev;
+    KeySym sym;
+    char text[8];
+    int len;
+    uint32_t key;
+
+    while (XPending(ctx->dpy) > 0) {
+        XNextEvent(ctx->dpy, &ev);
+
+        switch (ev.type) {
+        case Expose:
+            /* The image holds the last frame */
+            if (ev.xexpose.count == 0) {
+                put_image(ctx, 0, 0, ctx->width, ctx->height);
+                XFlush(ctx->dpy);
+            }
+            break;
+        case MotionNotify:
+            ctx->pointer_pos.x = ev.xmotion.x;
+            ctx->pointer_pos.y = ev.xmotion.y;
+            break;
+        case ButtonPress:
+        case ButtonRelease:
+            if (ev.xbutton.button == Button1) {
+                ctx->pointer_pos.x = ev.xbutton.x;
+                ctx->pointer_pos.y = ev.xbutton.y;
+                ctx->pointer_state = ev.type == ButtonPress ? LV_INDEV_STATE_PRESSED : LV_INDEV_STATE_RELEASED;
+            }
+            break;
+        case LeaveNotify:
+            ctx->pointer_state = LV_INDEV_STATE_RELEASED;
+            break;
+        case KeyPress:
+        case KeyRelease:
+            len = XLookupString(&ev.xkey, text, sizeof(text), &sym, NULL);
+            key = translate_key(sym, text, len);
+            if (key != 0) {
+                ctx->key = key;
+                ctx->key_state = ev.type == KeyPress ? LV_INDEV_STATE_PRESSED : LV_INDEV_STATE_RELEASED;
+            }
+            break;
+        case ClientMessage:
+            if ((Atom)ev.xclient.data.l[0] == ctx->wm_delete) {
+                ctx->closed = true;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+/**
+ * Report the state of the mouse
+ *
+ * @param indev the input device
+ * @param data the state to fill
+ */
+static void pointer_read_cb(lv_indev_t *indev, lv_indev_data_t *data)
+{
+    x11_ctx_t *ctx = lv_indev_get_driver_data(indev);
+
+    data->point = ctx->pointer_pos;
+    data->state = ctx->pointer_state;
+}
+
+/**
+ * Report the last key
+ *
+ * @param indev the input device
+ * @param data the state to fill
+ */
+static void keypad_read_cb(lv_indev_t *indev, lv_indev_data_t *data)
+{
+    x11_ctx_t *ctx = lv_indev_get_driver_data(indev);
+
+    data->key = ctx->key;
+    data->state = ctx->key_state;
+}
+
+/**
+ * Handle the events of the X connection
+ *
+ * @param fd the connection fd
+ * @param revents the events of the fd, 0 if it was not readable
+ * @param user_data the context
+ */
+static void display_fd_cb(int fd, short revents, void *user_data)
+{
+    LV_UNUSED(fd);
+
+    if (revents != 0) {
+        process_events(user_data);
+    }
+}
+
+/**
+ * Print and reset the blit statistics
+ *
+ * @param timer the report timer
+ */
+static void blit_report_cb(lv_timer_t *timer)
+{
+    x11_ctx_t *ctx = lv_timer_get_user_data(timer);
+
+    fprintf(stdout, "x11: %u frames pushed with %s, %dx%d %d bpp\n", ctx->frames,
+            ctx->use_shm ? "XShmPutImage" : "XPutImage", ctx->width, ctx->height, ctx->img->bits_per_pixel);
+    perf_hist_print(&ctx->blit_hist, "blit per frame", "us");
+    perf_hist_print(&ctx->rects_hist, "rects per frame", "");
+    perf_hist_print(&ctx->bytes_hist, "pushed per frame", "B");
+
+    ctx->frames = 0;
+    perf_hist_reset(&ctx->blit_hist);
+    perf_hist_reset(&ctx->rects_hist);
+    perf_hist_reset(&ctx->bytes_hist);
 }
 
 /**
  * The run loop of the X11 driver
  */
-void run_loop_x11(void)
+static void run_loop_x11(void)
 {
+    x11_ctx_t *ctx = &x11_ctx;
     uint32_t idle_time;
 
-    /* Handle LVGL tasks */
-    while (true) {
+    /* Run until the window closes */
+    while (!ctx->closed) {
         /* Returns the time to the next timer execution */
         idle_time = lv_timer_handler();
-        usleep(idle_time * 1000);
+
+        /* XSync() may have read events that left nothing to read on the socket */
+        process_events(ctx);
+        XFlush(ctx->dpy);
+
+        event_loop_wait(idle_time);
     }
 }
 
@@ -18,12 +18,23 @@
 #include <stdbool.h>
 #include <string.h>
 #include <ctype.h>
+#include <limits.h>
+
+#if BACKEND_MODULES
+#include <dlfcn.h>
+#endif
 
 #include "lvgl/lvgl.h"
+/* The flush callback and the flushing flags of a display are only reachable through the private header */
+#include "lvgl/src/display/lv_display_private.h"
 
 #include "simulator_util.h"
 #include "simulator_settings.h"
 #include "driver_backends.h"
+#include "event_loop.h"
+#include "perf_stats.h"
+#include "frame_trace.h"
+#include "rt_profile.h"
 
 #include "backends.h"
 
@@ -42,14 +53,82 @@
 #error Unsupported configuration - Please select at least one graphics backend in lv_conf.h
 #endif
 
+#if BACKEND_MODULES
+/* Directory of the modules relative to the one of the executable */
+#define BACKEND_MODULE_DIR "../lib/lvgl_backends"
+#endif
+
+/* Areas of a frame copied for the flush thread, more are flushed before the frame ends */
+#define FLUSH_MAX_AREAS 64
+
 /**********************
  *      TYPEDEFS
  **********************/
 
+#if BACKEND_MODULES
+/* A display backend built as the module lvgl_backend_<module>.so */
+typedef struct {
+    char *name;                     /* Name of the backend */
+    char *module;                   /* Suffix of the module and of its backend_init_ function */
+} backend_module_t;
+#endif
+
+/* A display and the thread running its flush */
+typedef struct {
+    backend_t *backend;
+    lv_display_t *display;
+    int index;
+
+    /* Flush thread, the flush callback of the backend runs in it */
+    bool threaded;
+    lv_display_flush_cb_t flush_cb;
+    lv_display_t flush_display;     /* Copy of the display handed to flush_cb, see hand_off() */
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint8_t *staging;               /* Copy of the areas rendered, flushed by the thread */
+    size_t staging_size;
+    size_t staging_used;
+    lv_area_t areas[FLUSH_MAX_AREAS];
+    size_t offsets[FLUSH_MAX_AREAS];    /* Of the pixels of each area in staging */
+    uint32_t area_count;
+    bool queued;                    /* The areas copied are handed to the thread */
+    bool frame_queued;              /* They end a frame */
+    bool frame_flushed;             /* The thread flushed a frame, resume the refresh */
+    uint32_t period_ms;
+    uint32_t delay_ms;              /* Added to the flush of every area to simulate a slow panel */
+
+    /* Statistics */
+    uint64_t refr_start_ns;
+    uint64_t prev_refr_start_ns;
+    uint64_t flush_start_ns;
+    uint32_t frames;
+    perf_hist_t refr_hist;
+    perf_hist_t interval_hist;
+    perf_hist_t flush_hist;         /* Protected by lock */
+    perf_hist_t handoff_hist;       /* Time of the UI thread in threaded_flush_cb() */
+    uint32_t stalls;                /* The UI thread waited for the flush thread */
+} display_slot_t;
+
 /**********************
  *  STATIC PROTOTYPES
  **********************/
 
+static backend_t *find_backend(const char *name);
+#if BACKEND_MODULES
+static const backend_module_t *find_backend_module(const char *name);
+static backend_t *load_backend_module(const backend_module_t *m);
+#endif
+static int init_display_entry(char *entry);
+static int start_flush_thread(display_slot_t *slot);
+static void *flush_thread(void *arg);
+static void threaded_flush_cb(lv_display_t *disp, const lv_area_t *area, uint8_t *px_map);
+static void hand_off(display_slot_t *slot, bool frame_end);
+static void wait_flushed(display_slot_t *slot);
+static void flush_done_cb(void *user_data);
+static void display_event_cb(lv_event_t *e);
+static void display_report_cb(lv_timer_t *timer);
+
 /**********************
  *  STATIC VARIABLES
  **********************/
@@ -60,27 +139,27 @@
  */
 backend_init_t available_backends[] = {
 
-#if LV_USE_LINUX_FBDEV
+#if LV_USE_LINUX_FBDEV && !BACKEND_MODULES
     backend_init_fbdev,
 #endif
 
-#if LV_USE_LINUX_DRM
+#if LV_USE_LINUX_DRM && !BACKEND_MODULES
     backend_init_drm,
 #endif
 
-#if LV_USE_SDL
+#if LV_USE_SDL && !BACKEND_MODULES
     backend_init_sdl,
 #endif
 
-#if LV_USE_WAYLAND
+#if LV_USE_WAYLAND && !BACKEND_MODULES
     backend_init_wayland,
 #endif
 
-#if LV_USE_X11
+#if LV_USE_X11 && !BACKEND_MODULES
     backend_init_x11,
 #endif
 
-#if LV_USE_GLFW
+#if LV_USE_GLFW && !BACKEND_MODULES
     backend_init_glfw3,
 #endif
 
@@ -90,12 +169,58 @@ backend_init_t available_backends[] = {
     NULL    /* Sentinel */
 };
 
-/* Contains the backend descriptors */
-static backend_t *backends[sizeof(available_backends) / sizeof(available_backends[0])];
+#if BACKEND_MODULES
+/* The display backends loaded on demand, in the order of available_backends
+ * The first one is the default backend
+ */
+static const backend_module_t backend_modules[] = {
+
+#if LV_USE_LINUX_FBDEV
+    { "FBDEV", "fbdev" },
+#endif
+
+#if LV_USE_LINUX_DRM
+    { "DRM", "drm" },
+#endif
+
+#if LV_USE_SDL
+    { "SDL", "sdl" },
+#endif
+
+#if LV_USE_WAYLAND
+    { "WAYLAND", "wayland" },
+#endif
+
+#if LV_USE_X11
+    { "X11", "x11" },
+#endif
+
+#if LV_USE_GLFW
+    { "GLFW", "glfw3" },
+#endif
+    { NULL, NULL }  /* Sentinel */
+};
+
+#define BACKEND_MODULE_SLOTS (sizeof(backend_modules) / sizeof(backend_modules[0]))
+#else
+#define BACKEND_MODULE_SLOTS 0
+#endif
+
+/* Contains the backend descriptors, the loaded modules are appended */
+static backend_t *backends[sizeof(available_backends) / sizeof(available_backends[0]) + BACKEND_MODULE_SLOTS];
+static int backend_count;
+static bool backends_registered;
+
+/* Time spent loading the modules of the display backends */
+static uint64_t module_load_ns;
 
 /* Set once the user selects a backend - or it is set to the default backend */
 static backend_t *sel_display_backend = NULL;
 
+/* The displays initialized, the first one is sel_display_backend */
+static display_slot_t display_slots[DRIVER_BACKENDS_MAX_DISPLAYS];
+static int display_count;
+
 /**********************
  *  GLOBAL VARIABLES
  **********************/
@@ -117,7 +242,7 @@ void driver_backends_register(void)
     backend_t *b;
 
     i = 0;
-    if (backends[i] != NULL) {
+    if (backends_registered) {
         /* backends are already registered - leave */
         return;
     }
@@ -136,6 +261,9 @@ void driver_backends_register(void)
         backends[i] = b;
         i++;
     }
+
+    backend_count = i;
+    backends_registered = true;
 }
 
 int driver_backends_init_backend(char *backend_name)
@@ -145,13 +273,17 @@ int driver_backends_init_backend(char *backend_name)
     display_backend_t *dispb;
     indev_backend_t *indevb;
 
-    if (backends[0] == NULL) {
+    if (!backends_registered) {
         LV_LOG_ERROR("Please call driver_backends_register first");
         return -1;
     }
 
     if (backend_name == NULL) {
 
+#if BACKEND_MODULES
+        /* Set default display backend - which is the first module */
+        backend_name = backend_modules[0].name;
+#else
         /*
          * Set default display backend - which is the first defined
          * item in available_backends array
@@ -165,8 +297,14 @@ int driver_backends_init_backend(char *backend_name)
         }
 
         backend_name = backends[0]->name;
+#endif
     }
 
+#if BACKEND_MODULES
+    /* Load the module of the backend the first time it is named */
+    find_backend(backend_name);
+#endif
+
     i = 0;
     while ((b = backends[i]) != NULL) {
 
@@ -178,6 +316,20 @@ int driver_backends_init_backend(char *backend_name)
 
                 dispb = b->handle->display;
                 LV_ASSERT_NULL(dispb->init_display);
+
+                /* The backends keep their state in static variables */
+                for (int j = 0; j < display_count; j++) {
+                    if (display_slots[j].backend == b) {
+                        LV_LOG_ERROR("The %s display backend is already initialized", b->name);
+                        return -1;
+                    }
+                }
+
+                if (display_count == DRIVER_BACKENDS_MAX_DISPLAYS) {
+                    LV_LOG_ERROR("Too many displays, the maximum is %d", DRIVER_BACKENDS_MAX_DISPLAYS);
+                    return -1;
+                }
+
                 dispb->display = dispb->init_display();
 
                 if (dispb->display == NULL) {
@@ -185,7 +337,17 @@ int driver_backends_init_backend(char *backend_name)
                     return -1;
                 }
 
-                sel_display_backend = b;
+                display_slots[display_count].backend = b;
+                display_slots[display_count].display = dispb->display;
+                display_slots[display_count].index = display_count;
+                display_slots[display_count].period_ms = LV_DEF_REFR_PERIOD;
+                pthread_mutex_init(&display_slots[display_count].lock, NULL);
+                pthread_cond_init(&display_slots[display_count].cond, NULL);
+                display_count++;
+
+                if (sel_display_backend == NULL) {
+                    sel_display_backend = b;
+                }
                 LV_LOG_INFO("Initialized %s display backend", b->name);
                 break;
 
@@ -218,17 +380,104 @@ int driver_backends_init_backend(char *backend_name)
     return 0;
 }
 
+int driver_backends_init_displays(void)
+{
+    const char *list = getenv_default("LV_DISPLAYS", "");
+    display_slot_t *slot;
+    char *entries;
+    char *entry;
+    char *save;
+    int report_sec;
+    int cache_kb;
+    int i;
+
+    if (list[0] == '\0') {
+        if (driver_backends_init_backend(NULL) != 0) {
+            return -1;
+        }
+    } else {
+        entries = strdup(list);
+        LV_ASSERT_MALLOC(entries);
+
+        for (entry = strtok_r(entries, ",", &save); entry != NULL; entry = strtok_r(NULL, ",", &save)) {
+            if (init_display_entry(entry) != 0) {
+                free(entries);
+                return -1;
+            }
+        }
+
+        free(entries);
+    }
+
+    if (display_count == 0) {
+        LV_LOG_ERROR("LV_DISPLAYS does not name a display backend");
+        return -1;
+    }
+
+    /* The decoded images are cached once for all the displays */
+    cache_kb = atoi(getenv_default("LV_IMAGE_CACHE_KB", "0"));
+    if (cache_kb > 0) {
+        lv_image_cache_resize((uint32_t)cache_kb * 1024, false);
+    }
+
+    report_sec = atoi(getenv_default("LV_DISPLAYS_REPORT", "0"));
+
+    for (i = 0; i < display_count; i++) {
+        slot = &display_slots[i];
+        lv_display_add_event_cb(slot->display, display_event_cb, LV_EVENT_REFR_START, slot);
+        lv_display_add_event_cb(slot->display, display_event_cb, LV_EVENT_REFR_READY, slot);
+        lv_display_add_event_cb(slot->display, display_event_cb, LV_EVENT_FLUSH_START, slot);
+        lv_display_add_event_cb(slot->display, display_event_cb, LV_EVENT_FLUSH_FINISH, slot);
+    }
+
+    if (report_sec > 0) {
+        lv_timer_create(display_report_cb, (uint32_t)report_sec * 1000, NULL);
+    }
+
+    return display_count;
+}
+
+int driver_backends_get_display_count(void)
+{
+    return display_count;
+}
+
+lv_display_t *driver_backends_get_display(int index)
+{
+    if (index < 0 || index >= display_count) {
+        return NULL;
+    }
+
+    return display_slots[index].display;
+}
+
 int driver_backends_print_supported(void)
 {
     int i;
     backend_t *b;
 
     i = 0;
-    if (backends[i] == NULL) {
+    if (!backends_registered) {
         LV_LOG_ERROR("Please call driver_backends_register first");
         return -1;
     }
 
+#if BACKEND_MODULES
+    fprintf(stdout, "Default backend: %s\n", backend_modules[0].name);
+    fprintf(stdout, "Supported backends: ");
+
+    for (i = 0; backend_modules[i].name != NULL; i++) {
+        fprintf(stdout, "%s ", backend_modules[i].name);
+    }
+
+    /* Input device backends stay linked in */
+    i = 0;
+    while ((b = backends[i++]) != NULL) {
+        if (b->type != BACKEND_DISPLAY) {
+            fprintf(stdout, "%s ", b->name);
+        }
+    }
+#else
     b = backends[i];
 
     fprintf(stdout, "Default backend: %s\n", b->name);
@@ -237,6 +486,7 @@ int driver_backends_print_supported(void)
     while ((b = backends[i++]) != NULL) {
         fprintf(stdout, "%s ", b->name);
     }
+#endif
 
     fprintf(stdout, "\n");
     return 0;
@@ -261,9 +511,20 @@ int driver_backends_is_supported(char *backend_name)
         }
     }
 
+#if BACKEND_MODULES
+    if (find_backend_module(name) != NULL) {
+        return 1;
+    }
+#endif
+
     return 0;
 }
 
+uint64_t driver_backends_get_module_load_ns(void)
+{
+    return module_load_ns;
+}
+
 void driver_backends_run_loop(void)
 {
     display_backend_t *dispb;
@@ -282,3 +543,567 @@ void driver_backends_run_loop(void)
  *   STATIC FUNCTIONS
  **********************/
 
+/**
+ * Find a registered backend, the module of a display backend is loaded
+ * the first time it is looked for
+ *
+ * @param name the name of the backend in upper case
+ * @return the backend, NULL if there is none
+ */
+static backend_t *find_backend(const char *name)
+{
+    backend_t *b;
+    int i = 0;
+#if BACKEND_MODULES
+    const backend_module_t *m;
+#endif
+
+    while ((b = backends[i++]) != NULL) {
+        if (strcmp(b->name, name) == 0) {
+            return b;
+        }
+    }
+
+#if BACKEND_MODULES
+    m = find_backend_module(name);
+    if (m != NULL) {
+        return load_backend_module(m);
+    }
+#endif
+
+    return NULL;
+}
+
+#if BACKEND_MODULES
+/**
+ * Find a display backend built as a module
+ *
+ * @param name the name of the backend in upper case
+ * @return the module, NULL if there is none
+ */
+static const backend_module_t *find_backend_module(const char *name)
+{
+    const backend_module_t *m;
+
+    for (m = backend_modules; m->name != NULL; m++) {
+        if (strcmp(m->name, name) == 0) {
+            return m;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Load the module of a display backend and register it
+ *
+ * The module is searched in LV_BACKEND_DIR, by default in ../lib/lvgl_backends
+ * next to the executable. Its symbols are bound at load time so that the
+ * relocation cost is counted in the load time.
+ *
+ * @param m the module
+ * @return the backend, NULL if the module could not be loaded
+ */
+static backend_t *load_backend_module(const backend_module_t *m)
+{
+    char exe[PATH_MAX];
+    char path[PATH_MAX + 64];
+    char symbol[64];
+    const char *dir = getenv_default("LV_BACKEND_DIR", "");
+    backend_init_t init_backend;
+    backend_t *b;
+    uint64_t start_ns;
+    ssize_t len;
+    char *slash;
+    void *lib;
+
+    if (dir[0] != '\0') {
+        snprintf(path, sizeof(path), "%s/lvgl_backend_%s.so", dir, m->module);
+    } else {
+        len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+        exe[len > 0 ? len : 0] = '\0';
+        slash = strrchr(exe, '/');
+        if (slash != NULL) {
+            *slash = '\0';
+        }
+        snprintf(path, sizeof(path), "%s/" BACKEND_MODULE_DIR "/lvgl_backend_%s.so",
+                 slash != NULL ? exe : ".", m->module);
+    }
+
+    start_ns = perf_time_ns();
+
+    lib = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (lib == NULL) {
+        LV_LOG_ERROR("Unable to load the %s backend: %s", m->name, dlerror());
+        return NULL;
+    }
+
+    /* POSIX allows converting the object pointer to a function pointer this way */
+    snprintf(symbol, sizeof(symbol), "backend_init_%s", m->module);
+    *(void **)&init_backend = dlsym(lib, symbol);
+    if (init_backend == NULL) {
+        LV_LOG_ERROR("%s does not define %s", path, symbol);
+        dlclose(lib);
+        return NULL;
+    }
+
+    b = malloc(sizeof(backend_t));
+    LV_ASSERT_NULL(b);
+
+    b->handle = malloc(sizeof(backend_handle_t));
+    LV_ASSERT_NULL(b->handle);
+
+    init_backend(b);
+    backends[backend_count++] = b;
+
+    module_load_ns += perf_time_ns() - start_ns;
+    LV_LOG_INFO("Loaded the %s backend from %s", b->name, path);
+
+    return b;
+}
+#endif
+
+/**
+ * Initialize a display of LV_DISPLAYS
+ *
+ * @param entry "NAME[:period_ms][:thread][:delay=ms]", modified
+ * @return 0 on success, -1 on error
+ */
+static int init_display_entry(char *entry)
+{
+    display_slot_t *slot;
+    backend_t *b;
+    char *name;
+    char *opt;
+    char *save;
+    uint32_t period = 0;
+    bool threaded = false;
+    uint32_t delay = 0;
+
+    name = strtok_r(entry, ":", &save);
+    if (name == NULL || !driver_backends_is_supported(name)) {
+        LV_LOG_ERROR("Unsupported display backend in LV_DISPLAYS: %s", entry);
+        return -1;
+    }
+
+    b = find_backend(name);
+    if (b == NULL) {
+        return -1;
+    }
+
+    if (b->type != BACKEND_DISPLAY) {
+        LV_LOG_ERROR("%s is not a display backend", name);
+        return -1;
+    }
+
+    while ((opt = strtok_r(NULL, ":", &save)) != NULL) {
+        if (strcmp(opt, "thread") == 0) {
+            threaded = true;
+        } else if (strncmp(opt, "delay=", 6) == 0) {
+            delay = (uint32_t)atoi(opt + 6);
+        } else if (isdigit((unsigned char)opt[0])) {
+            period = (uint32_t)atoi(opt);
+        } else {
+            LV_LOG_ERROR("Unknown display option %s", opt);
+            return -1;
+        }
+    }
+
+    /* Only the run loop of the first display runs */
+    if (display_count > 0 && !b->handle->display->shared_loop) {
+        LV_LOG_ERROR("The %s backend has its own run loop, it can only be the first display", name);
+        return -1;
+    }
+
+    if (threaded && !b->handle->display->thread_flush) {
+        LV_LOG_ERROR("The %s backend flushes on the UI thread, it can not have a flush thread", name);
+        return -1;
+    }
+
+    if (driver_backends_init_backend(name) != 0) {
+        return -1;
+    }
+
+    slot = &display_slots[display_count - 1];
+    slot->delay_ms = delay;
+
+    if (period != 0) {
+        slot->period_ms = period;
+        lv_timer_set_period(lv_display_get_refr_timer(slot->display), period);
+    }
+
+    if (threaded && start_flush_thread(slot) != 0) {
+        return -1;
+    }
+
+    LV_LOG_USER("Display %d: %s, refreshed every %u ms, flushed %s with %u ms of delay per area", slot->index,
+                name, (unsigned)slot->period_ms,
+                threaded ? "in its own thread" : "on the UI thread", (unsigned)delay);
+
+    return 0;
+}
+
+/**
+ * Run the flush of a display in a thread of its own
+ *
+ * Each area rendered is copied into a staging buffer and LVGL gets its
+ * draw buffer back at once, so the UI thread never waits for the panel.
+ * Once the refresh ends, the thread flushes the copy area by area while
+ * the refresh timer of the display is paused: a slow panel only lowers the
+ * frame rate of its own display. LVGL renders the next frame into its
+ * buffers while the previous one is flushed from the copy.
+ *
+ * @param slot the display
+ * @return 0 on success, -1 on error
+ */
+static int start_flush_thread(display_slot_t *slot)
+{
+    static bool wake_cb_added;
+    lv_color_format_t cf = lv_display_get_color_format(slot->display);
+    size_t frame_size;
+
+    if (!wake_cb_added) {
+        if (event_loop_add_wake_cb(flush_done_cb, NULL) != 0) {
+            return -1;
+        }
+        wake_cb_added = true;
+    }
+
+    /* A frame in partial mode is made of areas which may overlap */
+    frame_size = (size_t)lv_draw_buf_width_to_stride((uint32_t)lv_display_get_horizontal_resolution(slot->display), cf) *
+                 (size_t)lv_display_get_vertical_resolution(slot->display);
+    slot->staging_size = slot->display->render_mode == LV_DISPLAY_RENDER_MODE_PARTIAL ? 2 * frame_size : frame_size;
+    slot->staging = calloc(1, slot->staging_size);
+    if (slot->staging == NULL) {
+        LV_LOG_ERROR("No memory for the staging buffer of display %d", slot->index);
+        return -1;
+    }
+
+    slot->flush_cb = slot->display->flush_cb;
+    slot->threaded = true;
+
+    if (pthread_create(&slot->thread, NULL, flush_thread, slot) != 0) {
+        LV_LOG_ERROR("Failed to start the flush thread of display %d", slot->index);
+        slot->threaded = false;
+        return -1;
+    }
+
+    lv_display_set_flush_cb(slot->display, threaded_flush_cb);
+    return 0;
+}
+
+/**
+ * Flush the areas handed off by threaded_flush_cb()
+ *
+ * @param arg the display
+ * @return never returns
+ */
+static void *flush_thread(void *arg)
+{
+    display_slot_t *slot = arg;
+    uint64_t start;
+    uint32_t count;
+    uint32_t i;
+    bool frame_end;
+
+    rt_profile_thread("FLUSH");
+
+    pthread_mutex_lock(&slot->lock);
+
+    while (true) {
+        while (!slot->queued) {
+            pthread_cond_wait(&slot->cond, &slot->lock);
+        }
+
+        count = slot->area_count;
+        frame_end = slot->frame_queued;
+        pthread_mutex_unlock(&slot->lock);
+
+        /* The backend gets the copy of the display, with the flags LVGL would set
+         * for each area, the display itself is only written by the UI thread */
+        for (i = 0; i < count; i++) {
+            start = perf_time_ns();
+            FRAME_TRACE_BEGIN("flush_thread");
+            slot->flush_display.flushing = 1;
+            slot->flush_display.flushing_last = frame_end && i == count - 1;
+            slot->flush_cb(&slot->flush_display, &slot->areas[i], slot->staging + slot->offsets[i]);
+            if (slot->delay_ms != 0) {
+                usleep(slot->delay_ms * 1000);
+            }
+            FRAME_TRACE_END("flush_thread");
+
+            pthread_mutex_lock(&slot->lock);
+            perf_hist_add(&slot->flush_hist, (uint32_t)((perf_time_ns() - start) / 1000));
+            pthread_mutex_unlock(&slot->lock);
+        }
+
+        pthread_mutex_lock(&slot->lock);
+        slot->area_count = 0;
+        slot->staging_used = 0;
+        slot->queued = false;
+        slot->frame_flushed = frame_end;
+        pthread_cond_broadcast(&slot->cond);
+
+        if (frame_end) {
+            event_loop_wake();
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Copy an area for the flush thread of the display and release the draw buffer
+ *
+ * In partial mode the areas are packed one after the other, otherwise the
+ * staging buffer is a copy of the frame buffer kept up to date area by area.
+ *
+ * @param disp the display
+ * @param area the area rendered
+ * @param px_map the whole frame in direct and full mode, the area in partial mode
+ */
+static void threaded_flush_cb(lv_display_t *disp, const lv_area_t *area, uint8_t *px_map)
+{
+    display_slot_t *slot = NULL;
+    uint32_t px_size = lv_color_format_get_size(lv_display_get_color_format(disp));
+    int32_t w = lv_area_get_width(area);
+    int32_t h = lv_area_get_height(area);
+    uint64_t start = perf_time_ns();
+    uint32_t stride;
+    size_t offset;
+    size_t size;
+    uint8_t *dst;
+    int32_t y;
+    int i;
+
+    for (i = 0; i < display_count; i++) {
+        if (display_slots[i].display == disp) {
+            slot = &display_slots[i];
+        }
+    }
+
+    LV_ASSERT_NULL(slot);
+
+    if (disp->render_mode == LV_DISPLAY_RENDER_MODE_PARTIAL) {
+        stride = lv_draw_buf_width_to_stride((uint32_t)w, lv_display_get_color_format(disp));
+        size = (size_t)stride * (size_t)h;
+        offset = slot->staging_used;
+    } else {
+        stride = lv_display_get_buf_active(disp)->header.stride;
+        size = (size_t)stride * (size_t)lv_display_get_vertical_resolution(disp);
+        offset = 0;
+        px_map += (size_t)area->y1 * stride + (size_t)area->x1 * px_size;
+    }
+
+    /* More areas than a frame, or a larger frame: flush what was copied first */
+    if (slot->area_count == FLUSH_MAX_AREAS || offset + size > slot->staging_size) {
+        if (slot->area_count > 0) {
+            hand_off(slot, false);
+            wait_flushed(slot);
+        }
+
+        if (offset + size > slot->staging_size && disp->render_mode != LV_DISPLAY_RENDER_MODE_PARTIAL) {
+            free(slot->staging);
+            slot->staging_size = size;
+            slot->staging = calloc(1, size);
+            LV_ASSERT_MALLOC(slot->staging);
+        }
+
+        offset = disp->render_mode == LV_DISPLAY_RENDER_MODE_PARTIAL ? 0 : offset;
+        LV_ASSERT(offset + size <= slot->staging_size);
+    }
+
+    if (disp->render_mode == LV_DISPLAY_RENDER_MODE_PARTIAL) {
+        dst = slot->staging + offset;
+        slot->staging_used = offset + size;
+    } else {
+        dst = slot->staging + (size_t)area->y1 * stride + (size_t)area->x1 * px_size;
+    }
+
+    for (y = 0; y < h; y++) {
+        memcpy(dst, px_map, (size_t)w * px_size);
+        dst += stride;
+        px_map += stride;
+    }
+
+    slot->areas[slot->area_count] = *area;
+    slot->offsets[slot->area_count] = offset;
+    slot->area_count++;
+
+    lv_display_flush_ready(disp);
+    perf_hist_add(&slot->handoff_hist, (uint32_t)((perf_time_ns() - start) / 1000));
+}
+
+/**
+ * Hand the areas copied to the flush thread
+ *
+ * The thread is idle, it flushed the previous areas. It gets a copy of the
+ * display taken now, so the flushing flags and lv_display_flush_ready()
+ * called by the backend do not race with LVGL on the UI thread.
+ *
+ * @param slot the display
+ * @param frame_end true if the areas end a frame, the refresh resumes once they are flushed
+ */
+static void hand_off(display_slot_t *slot, bool frame_end)
+{
+    pthread_mutex_lock(&slot->lock);
+    slot->flush_display = *slot->display;
+    slot->frame_queued = frame_end;
+    slot->queued = true;
+    pthread_cond_broadcast(&slot->cond);
+    pthread_mutex_unlock(&slot->lock);
+}
+
+/**
+ * Wait until the flush thread flushed the areas handed off
+ *
+ * @param slot the display
+ */
+static void wait_flushed(display_slot_t *slot)
+{
+    pthread_mutex_lock(&slot->lock);
+    if (slot->queued) {
+        slot->stalls++;
+    }
+    while (slot->queued) {
+        pthread_cond_wait(&slot->cond, &slot->lock);
+    }
+    pthread_mutex_unlock(&slot->lock);
+}
+
+/**
+ * Resume the refresh of the displays whose flush thread flushed a frame
+ *
+ * @param user_data unused
+ */
+static void flush_done_cb(void *user_data)
+{
+    display_slot_t *slot;
+    bool resume;
+    int i;
+
+    LV_UNUSED(user_data);
+
+    for (i = 0; i < display_count; i++) {
+        slot = &display_slots[i];
+        if (!slot->threaded) {
+            continue;
+        }
+
+        pthread_mutex_lock(&slot->lock);
+        resume = slot->frame_flushed && !slot->queued;
+        if (resume) {
+            slot->frame_flushed = false;
+        }
+        pthread_mutex_unlock(&slot->lock);
+
+        if (resume) {
+            lv_timer_resume(lv_display_get_refr_timer(slot->display));
+        }
+    }
+}
+
+/**
+ * Measure the refreshes and the flushes of a display
+ *
+ * @param e the event
+ */
+static void display_event_cb(lv_event_t *e)
+{
+    display_slot_t *slot = lv_event_get_user_data(e);
+    uint64_t now = perf_time_ns();
+
+    switch (lv_event_get_code(e)) {
+    case LV_EVENT_REFR_START:
+        /* A refresh forced while a frame is flushed, e.g. by lv_refr_now(), waits for it */
+        if (slot->threaded) {
+            wait_flushed(slot);
+            now = perf_time_ns();
+        }
+        if (slot->prev_refr_start_ns != 0) {
+            perf_hist_add(&slot->interval_hist, (uint32_t)((now - slot->prev_refr_start_ns) / 1000));
+        }
+        slot->prev_refr_start_ns = now;
+        slot->refr_start_ns = now;
+        break;
+    case LV_EVENT_REFR_READY:
+        /* LVGL is done with the display, the thread flushes the frame copied */
+        if (slot->threaded && slot->area_count > 0) {
+            hand_off(slot, true);
+            lv_timer_pause(lv_display_get_refr_timer(slot->display));
+        }
+        perf_hist_add(&slot->refr_hist, (uint32_t)((now - slot->refr_start_ns) / 1000));
+        slot->frames++;
+        break;
+    case LV_EVENT_FLUSH_START:
+        slot->flush_start_ns = now;
+        break;
+    case LV_EVENT_FLUSH_FINISH:
+        /* The flush thread measures its own flushes */
+        if (!slot->threaded) {
+            /* The slow panel of a display without a flush thread blocks the UI thread */
+            if (slot->delay_ms != 0) {
+                usleep(slot->delay_ms * 1000);
+                now = perf_time_ns();
+            }
+            pthread_mutex_lock(&slot->lock);
+            perf_hist_add(&slot->flush_hist, (uint32_t)((now - slot->flush_start_ns) / 1000));
+            pthread_mutex_unlock(&slot->lock);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * Print the frame times of every display
+ *
+ * @param timer the report timer
+ */
+static void display_report_cb(lv_timer_t *timer)
+{
+    display_slot_t *slot;
+    char name[64];
+    double interval_ms;
+    uint32_t stalls;
+    int i;
+
+    LV_UNUSED(timer);
+
+    for (i = 0; i < display_count; i++) {
+        slot = &display_slots[i];
+
+        pthread_mutex_lock(&slot->lock);
+        stalls = slot->stalls;
+        slot->stalls = 0;
+        pthread_mutex_unlock(&slot->lock);
+
+        /* A display is unaffected by a slow one when its refreshes follow its period */
+        interval_ms = slot->interval_hist.count > 0 ?
+                      (double)slot->interval_hist.sum / (double)slot->interval_hist.count / 1000.0 : 0.0;
+        fprintf(stdout, "display %d (%s): %u refreshes, %.1f ms between refreshes for a period of %u ms, "
+                "%u waits of the UI thread for the flush\n", i, slot->backend->name, slot->frames, interval_ms,
+                (unsigned)slot->period_ms, stalls);
+
+        snprintf(name, sizeof(name), "display %d refresh", i);
+        perf_hist_print(&slot->refr_hist, name, "us");
+        snprintf(name, sizeof(name), "display %d time between refreshes", i);
+        perf_hist_print(&slot->interval_hist, name, "us");
+        if (slot->threaded) {
+            snprintf(name, sizeof(name), "display %d copy per area", i);
+            perf_hist_print(&slot->handoff_hist, name, "us");
+        }
+
+        pthread_mutex_lock(&slot->lock);
+        snprintf(name, sizeof(name), "display %d flush per area", i);
+        perf_hist_print(&slot->flush_hist, name, "us");
+        perf_hist_reset(&slot->flush_hist);
+        pthread_mutex_unlock(&slot->lock);
+
+        perf_hist_reset(&slot->refr_hist);
+        perf_hist_reset(&slot->interval_hist);
+        perf_hist_reset(&slot->handoff_hist);
+        slot->frames = 0;
+    }
+}
@@ -26,11 +26,15 @@ extern "C" {
 /*********************
  *      INCLUDES
  *********************/
+#include "lvgl/lvgl.h"
 
 /*********************
  *      DEFINES
  *********************/
 
+/* Displays driven by one process, e.g. a cluster and a center display */
+#define DRIVER_BACKENDS_MAX_DISPLAYS 4
+
 /**********************
  *      TYPEDEFS
  **********************/
@@ -57,6 +61,32 @@ void driver_backends_register(void);
  */
 int driver_backends_init_backend(char *backend_name);
 
+/**
+ * @brief Initialize the display backends listed in LV_DISPLAYS
+ * @description the list is "NAME[:period_ms][:thread][:delay=ms],..." e.g. "DRM,FBDEV:50:thread",
+ * the first display is the default one and the input devices are attached to it.
+ * Each display has its own refresh period, ":thread" runs its flush in a thread
+ * of its own, only for the DRM and FBDEV backends whose flush does not need the
+ * UI thread, and ":delay" slows the flush of each area down to test it.
+ * Without LV_DISPLAYS the default backend is initialized.
+ *
+ * @return the number of displays, -1 on error
+ */
+int driver_backends_init_displays(void);
+
+/**
+ * @brief Get the number of displays initialized
+ * @return the number of displays
+ */
+int driver_backends_get_display_count(void);
+
+/**
+ * @brief Get a display
+ * @param index the index of the display, 0 is the default display
+ * @return the display, NULL if there is no such display
+ */
+lv_display_t *driver_backends_get_display(int index);
+
 /**
  * @brief Checks if a backend exists and is supported
  * @param backend_name the backend name to check
@@ -72,9 +102,20 @@ int driver_backends_is_supported(char *backend_name);
  */
 int driver_backends_print_supported(void);
 
+/**
+ * @brief Get the time spent loading backend modules
+ * @description the display backends are loaded with dlopen() the first time they are
+ * named when the simulator is built with BACKEND_MODULES, the time includes the
+ * relocation of the module and of the libraries it pulls in
+ *
+ * @return the time in nanoseconds, 0 when the backends are linked in
+ */
+uint64_t driver_backends_get_module_load_ns(void);
+
 /**
  * @brief Enter the run loop
- * @description enter the run loop of the selected backend
+ * @description enter the run loop of the selected backend, with several displays
+ * the loop of the first one runs the timers of all the displays
  */
 void driver_backends_run_loop(void);
 
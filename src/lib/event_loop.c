@@ -0,0 +1,206 @@
+/**
+ * @file event_loop.c
+ *
+ * Wakeable idle wait shared by the run loops of the backends
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "lvgl/lvgl.h"
+
+#include "event_loop.h"
+#include "frame_trace.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+typedef struct {
+    event_loop_cb_t cb;
+    void *user_data;
+} wake_cb_t;
+
+typedef struct {
+    int fd;
+    event_loop_fd_cb_t cb;
+    void *user_data;
+} watched_fd_t;
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static int get_wake_fd(void);
+static void run_wake_cbs(void);
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+static int wake_fd = -1;
+static wake_cb_t wake_cbs[EVENT_LOOP_MAX_CALLBACKS];
+static int wake_cb_count;
+static watched_fd_t watched_fds[EVENT_LOOP_MAX_FDS];
+static int watched_fd_count;
+static uint32_t wakeups;
+
+/**********************
+ *      MACROS
+ **********************/
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+int event_loop_add_wake_cb(event_loop_cb_t cb, void *user_data)
+{
+    if (wake_cb_count >= EVENT_LOOP_MAX_CALLBACKS || get_wake_fd() < 0) {
+        LV_LOG_ERROR("Unable to register event loop callback");
+        return -1;
+    }
+
+    wake_cbs[wake_cb_count].cb = cb;
+    wake_cbs[wake_cb_count].user_data = user_data;
+    wake_cb_count++;
+
+    return 0;
+}
+
+int event_loop_add_fd(int fd, event_loop_fd_cb_t cb, void *user_data)
+{
+    if (watched_fd_count >= EVENT_LOOP_MAX_FDS || fd < 0) {
+        LV_LOG_ERROR("Unable to watch fd %d", fd);
+        return -1;
+    }
+
+    watched_fds[watched_fd_count].fd = fd;
+    watched_fds[watched_fd_count].cb = cb;
+    watched_fds[watched_fd_count].user_data = user_data;
+    watched_fd_count++;
+
+    return 0;
+}
+
+void event_loop_wake(void)
+{
+    uint64_t one = 1;
+    ssize_t ret;
+
+    if (wake_fd < 0) {
+        /* No wake callbacks were registered - nothing can be waiting */
+        return;
+    }
+
+    ret = write(wake_fd, &one, sizeof(one));
+    LV_UNUSED(ret);
+}
+
+void event_loop_wait(uint32_t timeout_ms)
+{
+    struct pollfd pfds[EVENT_LOOP_MAX_FDS + 1];
+    struct pollfd *wake_pfd = NULL;
+    nfds_t nfds = 0;
+    uint64_t count;
+    int timeout;
+    int ret;
+    int i;
+
+    if (wake_fd < 0 && watched_fd_count == 0) {
+        /* Nothing can interrupt the sleep */
+        FRAME_TRACE_BEGIN("idle");
+        usleep(timeout_ms * 1000);
+        FRAME_TRACE_END("idle");
+        wakeups++;
+        return;
+    }
+
+    timeout = timeout_ms == LV_NO_TIMER_READY ? -1 : (int)timeout_ms;
+
+    for (i = 0; i < watched_fd_count; i++) {
+        pfds[nfds].fd = watched_fds[i].fd;
+        pfds[nfds].events = POLLIN;
+        pfds[nfds].revents = 0;
+        nfds++;
+    }
+
+    if (wake_fd >= 0) {
+        wake_pfd = &pfds[nfds];
+        wake_pfd->fd = wake_fd;
+        wake_pfd->events = POLLIN;
+        wake_pfd->revents = 0;
+        nfds++;
+    }
+
+    FRAME_TRACE_BEGIN("idle");
+    ret = poll(pfds, nfds, timeout);
+    FRAME_TRACE_END("idle");
+    wakeups++;
+
+    if (ret < 0) {
+        if (errno != EINTR) {
+            LV_LOG_WARN("poll failed: %d", errno);
+        }
+        for (i = 0; i < (int)nfds; i++) {
+            pfds[i].revents = 0;
+        }
+    }
+
+    for (i = 0; i < watched_fd_count; i++) {
+        watched_fds[i].cb(watched_fds[i].fd, pfds[i].revents, watched_fds[i].user_data);
+    }
+
+    if (wake_pfd != NULL && (wake_pfd->revents & POLLIN)) {
+        /* Reading resets the counter, several wake ups coalesce into one */
+        if (read(wake_fd, &count, sizeof(count)) == sizeof(count)) {
+            run_wake_cbs();
+        }
+    }
+}
+
+uint32_t event_loop_get_wakeups(void)
+{
+    return wakeups;
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+/**
+ * Create the eventfd on first use
+ *
+ * @return the eventfd or -1 on error
+ */
+static int get_wake_fd(void)
+{
+    if (wake_fd < 0) {
+        wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    }
+
+    return wake_fd;
+}
+
+/**
+ * Execute the registered wake callbacks on the UI thread
+ */
+static void run_wake_cbs(void)
+{
+    int i;
+
+    for (i = 0; i < wake_cb_count; i++) {
+        wake_cbs[i].cb(wake_cbs[i].user_data);
+    }
+}
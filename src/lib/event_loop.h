@@ -0,0 +1,98 @@
+/**
+ * @file event_loop.h
+ *
+ * Wakeable idle wait shared by the run loops of the backends
+ *
+ * The run loops sleep between two calls to lv_timer_handler(),
+ * event_loop_wait() replaces the plain usleep() so that other threads
+ * (e.g the input thread) can interrupt the sleep and get work done
+ * on the UI thread immediately. The file descriptors of the display
+ * servers are watched by the same poll().
+ *
+ */
+
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stdint.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/* Maximum number of wake callbacks */
+#define EVENT_LOOP_MAX_CALLBACKS 8
+
+/* Maximum number of watched file descriptors */
+#define EVENT_LOOP_MAX_FDS 4
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/* Prototype of the callbacks executed on the UI thread after a wake up */
+typedef void (*event_loop_cb_t)(void *user_data);
+
+/* Prototype of the callbacks executed on the UI thread after each wait */
+typedef void (*event_loop_fd_cb_t)(int fd, short revents, void *user_data);
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+/**
+ * @description Register a callback executed on the UI thread
+ * each time the loop is woken up by event_loop_wake()
+ * @param cb the callback
+ * @param user_data passed to the callback
+ * @return 0 on success, -1 on error
+ */
+int event_loop_add_wake_cb(event_loop_cb_t cb, void *user_data);
+
+/**
+ * @description Watch a file descriptor in event_loop_wait()
+ * @param fd the file descriptor, polled for POLLIN
+ * @param cb called after each wait with the events of the fd,
+ *        0 if the fd is not ready, so that a read prepared before
+ *        the wait can always be completed or cancelled
+ * @param user_data passed to the callback
+ * @return 0 on success, -1 on error
+ */
+int event_loop_add_fd(int fd, event_loop_fd_cb_t cb, void *user_data);
+
+/**
+ * @description Wake up the UI thread
+ * @note can be called from any thread and from a signal handler
+ */
+void event_loop_wake(void);
+
+/**
+ * @description Sleep until the timeout expires, event_loop_wake() is called
+ * or a watched file descriptor is readable
+ * @param timeout_ms the value returned by lv_timer_handler(),
+ *        LV_NO_TIMER_READY waits until the next wake up
+ */
+void event_loop_wait(uint32_t timeout_ms);
+
+/**
+ * @description Get the number of times event_loop_wait() returned
+ * @return the count since the start, it wraps around
+ */
+uint32_t event_loop_get_wakeups(void);
+
+/**********************
+ *      MACROS
+ **********************/
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif /*EVENT_LOOP_H*/
@@ -0,0 +1,594 @@
+/**
+ * @file frame_mirror.c
+ *
+ * Mirror of the frames to a remote viewer
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "lvgl/lvgl.h"
+
+#include "simulator_util.h"
+#include "perf_stats.h"
+#include "event_loop.h"
+#include "tickless.h"
+#include "lz_codec.h"
+#include "frame_mirror_proto.h"
+#include "frame_mirror.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+typedef struct {
+    lv_display_t *display;
+    int listen_fd;
+    int client_fd;
+    int32_t hor_res;
+    int32_t ver_res;
+
+    uint16_t *shadow;               /* RGB565 copy of the screen */
+    lv_area_t dirty[FRAME_MIRROR_MAX_RECTS];
+    uint32_t dirty_count;
+    bool dirty_full;
+    bool key_frame;                 /* The viewer has nothing yet */
+
+    uint8_t *rect_buf;              /* Pixels of one rectangle before compression */
+    uint8_t *msg;
+    size_t msg_cap;
+    size_t msg_len;
+    size_t msg_sent;
+    uint32_t frame;
+
+    /* Statistics */
+    uint64_t encode_ns;             /* Copy and compression of the current frame */
+    uint64_t report_start_ns;
+    uint64_t sent_bytes;
+    uint64_t raw_bytes;
+    uint64_t encoded_bytes;
+    uint32_t messages;
+    uint32_t skipped;
+    perf_hist_t encode_hist;
+    perf_hist_t msg_hist;
+} frame_mirror_t;
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static int open_listen_socket(const char *addr);
+static void copy_to_shadow(frame_mirror_t *m, const lv_area_t *area);
+static void add_dirty(frame_mirror_t *m, const lv_area_t *area);
+static void accept_client(frame_mirror_t *m);
+static void close_client(frame_mirror_t *m);
+static bool send_pending(frame_mirror_t *m);
+static void encode_message(frame_mirror_t *m);
+static uint8_t *put16(uint8_t *p, uint32_t v);
+static uint8_t *put32(uint8_t *p, uint32_t v);
+static void flush_start_cb(lv_event_t *e);
+static void refr_ready_cb(lv_event_t *e);
+static void listen_fd_cb(int fd, short revents, void *user_data);
+static void report_timer_cb(lv_timer_t *timer);
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+static frame_mirror_t mirror;
+
+/**********************
+ *      MACROS
+ **********************/
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+void frame_mirror_attach(lv_display_t *display)
+{
+    frame_mirror_t *m = &mirror;
+    const char *addr = getenv_default("LV_MIRROR", "");
+    size_t px_cnt;
+    int report_sec;
+
+    if (addr[0] == '\0' || strcmp(addr, "0") == 0) {
+        return;
+    }
+
+    /* The tap reads the rendered buffer, a rotated frame is in another one */
+    if (lv_display_get_rotation(display) != LV_DISPLAY_ROTATION_0) {
+        LV_LOG_WARN("The frame mirror does not support the software rotation");
+        return;
+    }
+
+    m->display = display;
+    m->client_fd = -1;
+    m->hor_res = lv_display_get_horizontal_resolution(display);
+    m->ver_res = lv_display_get_vertical_resolution(display);
+    px_cnt = (size_t)m->hor_res * (size_t)m->ver_res;
+
+    m->listen_fd = open_listen_socket(strcmp(addr, "1") == 0 ? "unix:" FRAME_MIRROR_DEFAULT_PATH : addr);
+    if (m->listen_fd < 0) {
+        return;
+    }
+
+    /* The rectangles of a message never cover more than the screen, see encode_message() */
+    m->msg_cap = FRAME_MIRROR_FRAME_HEADER_SIZE +
+                 FRAME_MIRROR_MAX_RECTS * (FRAME_MIRROR_RECT_HEADER_SIZE + lz_compress_bound(0)) +
+                 lz_compress_bound(px_cnt * 2);
+    m->shadow = calloc(px_cnt, sizeof(uint16_t));
+    m->rect_buf = malloc(px_cnt * 2);
+    m->msg = malloc(m->msg_cap);
+
+    if (m->shadow == NULL || m->rect_buf == NULL || m->msg == NULL) {
+        LV_LOG_ERROR("Failed to allocate the frame mirror");
+        close(m->listen_fd);
+        m->listen_fd = -1;
+        return;
+    }
+
+    /* Until a viewer connects, the whole screen is sent on connection */
+    lv_display_add_event_cb(display, flush_start_cb, LV_EVENT_FLUSH_START, m);
+    lv_display_add_event_cb(display, refr_ready_cb, LV_EVENT_REFR_READY, m);
+
+    /* The viewer is accepted by the next frame, which an idle display must run */
+    event_loop_add_fd(m->listen_fd, listen_fd_cb, m);
+
+    report_sec = atoi(getenv_default("LV_MIRROR_REPORT", "0"));
+    if (report_sec > 0) {
+        m->report_start_ns = perf_time_ns();
+        lv_timer_create(report_timer_cb, (uint32_t)report_sec * 1000, m);
+    }
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+/**
+ * Listen for the viewer
+ *
+ * @param addr "unix:<path>" or "tcp:<port>", TCP only listens on the loopback
+ * @return the non-blocking listening socket, -1 on error
+ */
+static int open_listen_socket(const char *addr)
+{
+    struct sockaddr_un sun;
+    struct sockaddr_in sin;
+    int one = 1;
+    int fd;
+
+    if (strncmp(addr, "unix:", 5) == 0) {
+        memset(&sun, 0, sizeof(sun));
+        sun.sun_family = AF_UNIX;
+        snprintf(sun.sun_path, sizeof(sun.sun_path), "%s", addr + 5);
+        unlink(sun.sun_path);
+
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd >= 0 && bind(fd, (struct sockaddr *)&sun, sizeof(sun)) == 0 && listen(fd, 1) == 0) {
+            LV_LOG_USER("Mirroring the frames on %s", sun.sun_path);
+            return fd;
+        }
+    } else if (strncmp(addr, "tcp:", 4) == 0) {
+        memset(&sin, 0, sizeof(sin));
+        sin.sin_family = AF_INET;
+        sin.sin_port = htons((uint16_t)atoi(addr + 4));
+        sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd >= 0) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        }
+        if (fd >= 0 && bind(fd, (struct sockaddr *)&sin, sizeof(sin)) == 0 && listen(fd, 1) == 0) {
+            LV_LOG_USER("Mirroring the frames on 127.0.0.1:%s", addr + 4);
+            return fd;
+        }
+    } else {
+        LV_LOG_ERROR("LV_MIRROR must be 1, unix:<path> or tcp:<port>, not %s", addr);
+        return -1;
+    }
+
+    LV_LOG_ERROR("Failed to listen on %s: %s", addr, strerror(errno));
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    return -1;
+}
+
+/**
+ * Copy a flushed area into the RGB565 shadow of the screen
+ *
+ * In direct and full mode the active buffer holds the whole screen, in
+ * partial mode it holds only the area with the stride of its width.
+ *
+ * @param m the mirror
+ * @param area the area about to be flushed
+ */
+static void copy_to_shadow(frame_mirror_t *m, const lv_area_t *area)
+{
+    lv_draw_buf_t *buf = lv_display_get_buf_active(m->display);
+    lv_color_format_t cf = lv_display_get_color_format(m->display);
+    uint32_t px_size = lv_color_format_get_size(cf);
+    int32_t w = lv_area_get_width(area);
+    int32_t h = lv_area_get_height(area);
+    const uint8_t *src;
+    uint32_t stride;
+    uint16_t *dst;
+    int32_t x;
+    int32_t y;
+
+    if (buf->header.w == (uint32_t)m->hor_res && buf->header.h == (uint32_t)m->ver_res) {
+        stride = buf->header.stride;
+        src = buf->data + (size_t)area->y1 * stride + (size_t)area->x1 * px_size;
+    } else {
+        stride = lv_draw_buf_width_to_stride((uint32_t)w, cf);
+        src = buf->data;
+    }
+
+    dst = m->shadow + (size_t)area->y1 * (size_t)m->hor_res + (size_t)area->x1;
+
+    for (y = 0; y < h; y++) {
+        if (cf == LV_COLOR_FORMAT_RGB565) {
+            memcpy(dst, src, (size_t)w * 2);
+        } else if (px_size >= 3) {
+            /* XRGB8888, ARGB8888 and RGB888 start with B, G, R */
+            for (x = 0; x < w; x++) {
+                dst[x] = (uint16_t)(((src[x * px_size + 2] & 0xf8) << 8) | ((src[x * px_size + 1] & 0xfc) << 3) |
+                                    (src[x * px_size] >> 3));
+            }
+        }
+        dst += m->hor_res;
+        src += stride;
+    }
+}
+
+/**
+ * Add an area to send, overlapping areas are merged
+ *
+ * @param m the mirror
+ * @param area the area flushed
+ */
+static void add_dirty(frame_mirror_t *m, const lv_area_t *area)
+{
+    lv_area_t *d;
+    uint32_t i;
+
+    if (m->dirty_full) {
+        return;
+    }
+
+    for (i = 0; i < m->dirty_count; i++) {
+        d = &m->dirty[i];
+        if (area->x1 <= d->x2 && d->x1 <= area->x2 && area->y1 <= d->y2 && d->y1 <= area->y2) {
+            lv_area_set(d, LV_MIN(d->x1, area->x1), LV_MIN(d->y1, area->y1), LV_MAX(d->x2, area->x2),
+                        LV_MAX(d->y2, area->y2));
+            return;
+        }
+    }
+
+    if (m->dirty_count == FRAME_MIRROR_MAX_RECTS) {
+        m->dirty_full = true;
+        return;
+    }
+
+    m->dirty[m->dirty_count++] = *area;
+}
+
+/**
+ * Accept a viewer if none is connected
+ *
+ * @param m the mirror
+ */
+static void accept_client(frame_mirror_t *m)
+{
+    int one = 1;
+    int fd;
+
+    if (m->client_fd >= 0) {
+        return;
+    }
+
+    fd = accept4(m->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    m->client_fd = fd;
+    m->key_frame = true;
+    m->msg_len = 0;
+    m->msg_sent = 0;
+    LV_LOG_USER("Mirror viewer connected");
+}
+
+/**
+ * Drop the viewer
+ *
+ * @param m the mirror
+ */
+static void close_client(frame_mirror_t *m)
+{
+    close(m->client_fd);
+    m->client_fd = -1;
+    m->msg_len = 0;
+    m->msg_sent = 0;
+    LV_LOG_USER("Mirror viewer disconnected");
+}
+
+/**
+ * Send what the socket accepts of the current message
+ *
+ * @param m the mirror
+ * @return true if the whole message was sent
+ */
+static bool send_pending(frame_mirror_t *m)
+{
+    ssize_t ret;
+
+    while (m->msg_sent < m->msg_len) {
+        ret = send(m->client_fd, m->msg + m->msg_sent, m->msg_len - m->msg_sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (ret < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return false;
+            }
+            if (errno != EINTR) {
+                close_client(m);
+                return false;
+            }
+            continue;
+        }
+        m->msg_sent += (size_t)ret;
+        m->sent_bytes += (uint64_t)ret;
+    }
+
+    return true;
+}
+
+/**
+ * Build the message of the areas drawn since the last one
+ *
+ * When the areas cover more pixels than the screen, e.g. after they were
+ * merged, the whole screen is sent instead.
+ *
+ * @param m the mirror
+ */
+static void encode_message(frame_mirror_t *m)
+{
+    lv_area_t full;
+    const lv_area_t *rects = m->dirty;
+    uint32_t count = m->dirty_count;
+    uint64_t px_total = 0;
+    uint8_t *p = m->msg;
+    uint8_t *size_field;
+    const uint16_t *src;
+    size_t raw_len;
+    size_t len;
+    int32_t w;
+    int32_t h;
+    int32_t y;
+    uint32_t i;
+
+    for (i = 0; i < count; i++) {
+        px_total += (uint64_t)lv_area_get_size(&rects[i]);
+    }
+
+    lv_area_set(&full, 0, 0, m->hor_res - 1, m->ver_res - 1);
+    if (m->key_frame || m->dirty_full || px_total > (uint64_t)lv_area_get_size(&full)) {
+        rects = &full;
+        count = 1;
+    }
+
+    p = put32(p, FRAME_MIRROR_MAGIC);
+    p = put32(p, m->frame++);
+    p = put16(p, (uint32_t)m->hor_res);
+    p = put16(p, (uint32_t)m->ver_res);
+    p = put16(p, count);
+    p = put16(p, rects == &full ? FRAME_MIRROR_KEY_FRAME : 0);
+
+    for (i = 0; i < count; i++) {
+        w = lv_area_get_width(&rects[i]);
+        h = lv_area_get_height(&rects[i]);
+        raw_len = (size_t)w * (size_t)h * 2;
+
+        src = m->shadow + (size_t)rects[i].y1 * (size_t)m->hor_res + (size_t)rects[i].x1;
+        for (y = 0; y < h; y++) {
+            memcpy(m->rect_buf + (size_t)y * (size_t)w * 2, src, (size_t)w * 2);
+            src += m->hor_res;
+        }
+
+        p = put16(p, (uint32_t)rects[i].x1);
+        p = put16(p, (uint32_t)rects[i].y1);
+        p = put16(p, (uint32_t)w);
+        p = put16(p, (uint32_t)h);
+        size_field = p;
+        p += 4;
+
+        len = lz_compress(m->rect_buf, raw_len, p, m->msg_cap - (size_t)(p - m->msg));
+        if (len == 0 || len >= raw_len) {
+            memcpy(p, m->rect_buf, raw_len);
+            len = raw_len;
+            put32(size_field, (uint32_t)len | FRAME_MIRROR_RAW);
+        } else {
+            put32(size_field, (uint32_t)len);
+        }
+        p += len;
+
+        m->raw_bytes += raw_len;
+        m->encoded_bytes += len;
+    }
+
+    m->msg_len = (size_t)(p - m->msg);
+    m->msg_sent = 0;
+    m->dirty_count = 0;
+    m->dirty_full = false;
+    m->key_frame = false;
+    m->messages++;
+    perf_hist_add(&m->msg_hist, (uint32_t)m->msg_len);
+}
+
+/**
+ * Write a little endian 16 bit field
+ *
+ * @param p the field
+ * @param v the value
+ * @return the next field
+ */
+static uint8_t *put16(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    return p + 2;
+}
+
+/**
+ * Write a little endian 32 bit field
+ *
+ * @param p the field
+ * @param v the value
+ * @return the next field
+ */
+static uint8_t *put32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+    return p + 4;
+}
+
+/**
+ * Tap the flush of an area
+ *
+ * @param e the flush start event
+ */
+static void flush_start_cb(lv_event_t *e)
+{
+    frame_mirror_t *m = lv_event_get_user_data(e);
+    const lv_area_t *area = lv_event_get_param(e);
+    uint64_t start = perf_time_ns();
+
+    copy_to_shadow(m, area);
+    add_dirty(m, area);
+
+    m->encode_ns += perf_time_ns() - start;
+}
+
+/**
+ * Send the areas of the frame, or keep them for the next message while
+ * the viewer has not read the previous one
+ *
+ * @param e the refresh ready event
+ */
+static void refr_ready_cb(lv_event_t *e)
+{
+    frame_mirror_t *m = lv_event_get_user_data(e);
+    bool drawn = m->dirty_count != 0 || m->dirty_full;
+    uint64_t start;
+
+    accept_client(m);
+
+    if (m->client_fd >= 0 && m->msg_sent < m->msg_len && !send_pending(m)) {
+        /* Backpressure, the areas go with the next message */
+        if (drawn) {
+            m->skipped++;
+        }
+    } else if (m->client_fd >= 0 && (drawn || m->key_frame)) {
+        start = perf_time_ns();
+        encode_message(m);
+        m->encode_ns += perf_time_ns() - start;
+        send_pending(m);
+    } else if (m->client_fd < 0) {
+        m->dirty_count = 0;
+        m->dirty_full = false;
+    }
+
+    if (m->encode_ns != 0) {
+        perf_hist_add(&m->encode_hist, (uint32_t)(m->encode_ns / 1000));
+        m->encode_ns = 0;
+    }
+
+    /* Retry the rest of the message at the next frame even if nothing is drawn */
+    if (m->client_fd >= 0 && m->msg_sent < m->msg_len) {
+        tickless_request_frame(m->display);
+    }
+}
+
+/**
+ * Request a frame to accept a viewer waiting on the listen socket, refuse
+ * a second viewer so that the socket does not stay readable
+ *
+ * @param fd the listen socket
+ * @param revents the events of the socket, 0 if it is not ready
+ * @param user_data the mirror
+ */
+static void listen_fd_cb(int fd, short revents, void *user_data)
+{
+    frame_mirror_t *m = user_data;
+    int extra_fd;
+
+    if (!(revents & POLLIN)) {
+        return;
+    }
+
+    if (m->client_fd < 0) {
+        tickless_request_frame(m->display);
+        return;
+    }
+
+    extra_fd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (extra_fd >= 0) {
+        close(extra_fd);
+        LV_LOG_WARN("Mirror viewer refused, one is already connected");
+    }
+}
+
+/**
+ * Print and reset the cost and the bandwidth of the mirror
+ *
+ * @param timer the report timer
+ */
+static void report_timer_cb(lv_timer_t *timer)
+{
+    frame_mirror_t *m = lv_timer_get_user_data(timer);
+    uint64_t now = perf_time_ns();
+    uint64_t elapsed_ms = (now - m->report_start_ns) / 1000000;
+
+    fprintf(stdout, "mirror: %s, %u messages, %u frames merged into the next message, %llu kB/s, "
+            "compressed to %llu%%\n", m->client_fd >= 0 ? "viewer connected" : "no viewer", m->messages,
+            m->skipped, (unsigned long long)(elapsed_ms ? m->sent_bytes / elapsed_ms : 0),
+            (unsigned long long)(m->raw_bytes ? m->encoded_bytes * 100 / m->raw_bytes : 0));
+    perf_hist_print(&m->encode_hist, "mirror encode per frame", "us");
+    perf_hist_print(&m->msg_hist, "mirror message", "B");
+
+    m->report_start_ns = now;
+    m->messages = 0;
+    m->skipped = 0;
+    m->sent_bytes = 0;
+    m->raw_bytes = 0;
+    m->encoded_bytes = 0;
+    perf_hist_reset(&m->encode_hist);
+    perf_hist_reset(&m->msg_hist);
+}
@@ -0,0 +1,57 @@
+/**
+ * @file frame_mirror.h
+ *
+ * Mirror of the frames to a remote viewer
+ *
+ * The areas flushed by the display are copied in RGB565 into a shadow of
+ * the screen. After each refresh, the areas drawn since the last message
+ * are compressed and sent to the connected viewer (tools/mirror_viewer.c)
+ * over a non-blocking UNIX or loopback TCP socket. While the viewer has
+ * not read the previous message the new areas are not sent, they are
+ * merged into the next message: a slow viewer skips frames, it never
+ * stalls the UI thread.
+ *
+ */
+
+#ifndef FRAME_MIRROR_H
+#define FRAME_MIRROR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include "lvgl/lvgl.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/* Areas kept between two messages, more are merged into the whole screen */
+#define FRAME_MIRROR_MAX_RECTS 32
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+/**
+ * @description Mirror the frames of a display when LV_MIRROR is set
+ * @param display the display, any backend
+ */
+void frame_mirror_attach(lv_display_t *display);
+
+/**********************
+ *      MACROS
+ **********************/
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif /*FRAME_MIRROR_H*/
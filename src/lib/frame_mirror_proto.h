@@ -0,0 +1,63 @@
+/**
+ * @file frame_mirror_proto.h
+ *
+ * Wire format of the frame mirror
+ *
+ * Every message is a frame header followed by its rectangles, all the
+ * fields are little endian:
+ *
+ *   frame:  magic u32, frame u32, width u16, height u16, rect count u16, flags u16
+ *   rect:   x u16, y u16, w u16, h u16, size u32, then size bytes
+ *
+ * The pixels of a rectangle are RGB565 rows of w pixels, compressed with
+ * lz_compress() unless FRAME_MIRROR_RAW is set in its size. The first
+ * frame sent to a viewer covers the whole screen.
+ *
+ */
+
+#ifndef FRAME_MIRROR_PROTO_H
+#define FRAME_MIRROR_PROTO_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define FRAME_MIRROR_MAGIC 0x464d564cu     /* "LVMF" */
+
+#define FRAME_MIRROR_FRAME_HEADER_SIZE 16
+#define FRAME_MIRROR_RECT_HEADER_SIZE 12
+
+/* Flag of the frame header: the rectangles cover the whole screen */
+#define FRAME_MIRROR_KEY_FRAME 0x0001
+
+/* Flag of the rectangle size: the pixels are not compressed */
+#define FRAME_MIRROR_RAW 0x80000000u
+
+/* Default address of the mirror */
+#define FRAME_MIRROR_DEFAULT_PATH "/tmp/lvgl-mirror.sock"
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+/**********************
+ *      MACROS
+ **********************/
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif /*FRAME_MIRROR_PROTO_H*/
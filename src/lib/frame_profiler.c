@@ -0,0 +1,541 @@
+/**
+ * @file frame_profiler.c
+ *
+ * Sampling profiler of the frames running past their deadline
+ *
+ * The folded stack file has one line per distinct stack, outermost frame
+ * first, followed by the number of samples:
+ *
+ *   main;driver_backends_run_loop;lv_timer_handler;...;lv_draw_sw_blend 12
+ *
+ * Functions without a dynamic symbol, e.g. static functions, are written
+ * as <object path>+0x<offset>, tools/folded_symbolize.py resolves them
+ * with addr2line.
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <limits.h>
+#include <link.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "lvgl/lvgl.h"
+
+#include "simulator_util.h"
+#include "perf_stats.h"
+#include "frame_profiler.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/* Frames of the signal handler and of the signal trampoline */
+#define SKIP_FRAMES 2
+
+/* Older C libraries only have the field of the union */
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+typedef struct {
+    uint32_t depth;
+    void *frames[FRAME_PROFILER_DEPTH];     /* Innermost first */
+} stack_sample_t;
+
+/* A distinct symbolized stack of the folded file */
+typedef struct {
+    char *text;
+    uint32_t count;
+} folded_line_t;
+
+typedef struct {
+    lv_display_t *display;
+    const char *path;
+    char exe[PATH_MAX];
+    timer_t timer;
+    struct itimerspec arm;
+    bool armed;
+    uint64_t deadline_ns;
+
+    /* Written by the signal handler, which runs on the UI thread */
+    stack_sample_t *samples;
+    uint32_t capacity;
+    volatile sig_atomic_t sampling;
+    volatile uint32_t sample_count;
+    volatile uint32_t dropped;
+
+    uint32_t frame_first_sample;
+    uint32_t dumped_count;
+    bool dumped;
+    bool full_logged;
+
+    /* Statistics */
+    uint64_t refr_start_ns;
+    uint32_t frames;
+    uint32_t overruns;
+    uint32_t sampled_frames;
+    uint64_t worst_ns;
+    perf_hist_t overrun_hist;
+} frame_profiler_t;
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static void sigprof_handler(int sig, siginfo_t *info, void *context);
+static void disarm(frame_profiler_t *p);
+static void refr_start_cb(lv_event_t *e);
+static void refr_ready_cb(lv_event_t *e);
+static void dump_timer_cb(lv_timer_t *timer);
+static int compare_samples(const void *a, const void *b);
+static int compare_lines(const void *a, const void *b);
+static void symbolize(const frame_profiler_t *p, void *addr, char *buf, size_t size);
+static char *format_stack(const frame_profiler_t *p, const stack_sample_t *s);
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+static frame_profiler_t profiler;
+
+/**********************
+ *      MACROS
+ **********************/
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+void frame_profiler_attach(lv_display_t *display)
+{
+    frame_profiler_t *p = &profiler;
+    const char *path = getenv_default("LV_PROFILE_FOLDED", "");
+    uint32_t deadline_ms;
+    uint32_t interval_us;
+    int dump_sec;
+    struct sigaction sa;
+    struct sigevent sev;
+    void *frames[1];
+    ssize_t len;
+
+    if (path[0] == '\0') {
+        return;
+    }
+
+    if (p->display != NULL) {
+        LV_LOG_WARN("The frame profiler is already attached to a display");
+        return;
+    }
+
+    deadline_ms = (uint32_t)atoi(getenv_default("LV_PROFILE_DEADLINE_MS", "0"));
+    interval_us = (uint32_t)atoi(getenv_default("LV_PROFILE_INTERVAL_US", "0"));
+    p->capacity = (uint32_t)atoi(getenv_default("LV_PROFILE_SAMPLES", "0"));
+    dump_sec = atoi(getenv_default("LV_PROFILE_DUMP_SEC", "10"));
+
+    if (deadline_ms == 0) {
+        deadline_ms = LV_DEF_REFR_PERIOD;
+    }
+    if (interval_us == 0) {
+        interval_us = FRAME_PROFILER_INTERVAL_US;
+    }
+    if (p->capacity == 0) {
+        p->capacity = FRAME_PROFILER_SAMPLES;
+    }
+
+    p->samples = calloc(p->capacity, sizeof(stack_sample_t));
+    if (p->samples == NULL) {
+        LV_LOG_ERROR("Unable to allocate %u profiler samples", p->capacity);
+        return;
+    }
+
+    /* The first call to backtrace() loads libgcc and allocates, it must not happen in the handler */
+    backtrace(frames, 1);
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = sigprof_handler;
+    sa.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGPROF, &sa, NULL);
+
+    /* The signal goes to the UI thread, not to any thread of the process */
+    memset(&sev, 0, sizeof(sev));
+    sev.sigev_notify = SIGEV_THREAD_ID;
+    sev.sigev_signo = SIGPROF;
+    sev.sigev_notify_thread_id = (pid_t)syscall(SYS_gettid);
+
+    if (timer_create(CLOCK_MONOTONIC, &sev, &p->timer) != 0) {
+        LV_LOG_ERROR("Unable to create the profiler timer: %s", strerror(errno));
+        free(p->samples);
+        p->samples = NULL;
+        return;
+    }
+
+    p->display = display;
+    p->path = path;
+    p->deadline_ns = (uint64_t)deadline_ms * 1000000;
+    p->arm.it_value.tv_sec = deadline_ms / 1000;
+    p->arm.it_value.tv_nsec = (long)(deadline_ms % 1000) * 1000000;
+    p->arm.it_interval.tv_sec = interval_us / 1000000;
+    p->arm.it_interval.tv_nsec = (long)(interval_us % 1000000) * 1000;
+    perf_hist_reset(&p->overrun_hist);
+
+    /* Main runs from another directory, relative object paths would be lost */
+    len = readlink("/proc/self/exe", p->exe, sizeof(p->exe) - 1);
+    p->exe[len > 0 ? len : 0] = '\0';
+
+    lv_display_add_event_cb(display, refr_start_cb, LV_EVENT_REFR_START, p);
+    lv_display_add_event_cb(display, refr_ready_cb, LV_EVENT_REFR_READY, p);
+
+    if (dump_sec > 0) {
+        lv_timer_create(dump_timer_cb, (uint32_t)dump_sec * 1000, p);
+    }
+    atexit(frame_profiler_dump);
+
+    LV_LOG_USER("Sampling the frames longer than %u ms every %u us into %s", deadline_ms, interval_us, path);
+}
+
+void frame_profiler_dump(void)
+{
+    frame_profiler_t *p = &profiler;
+    folded_line_t *lines;
+    uint32_t line_count = 0;
+    uint32_t *order;
+    uint32_t count;
+    uint32_t total;
+    uint32_t n;
+    uint32_t i;
+    FILE *f;
+
+    if (p->samples == NULL) {
+        return;
+    }
+
+    /* exit() may be called in the middle of a frame */
+    disarm(p);
+
+    n = p->sample_count;
+    if (p->dumped && n == p->dumped_count) {
+        return;
+    }
+
+    order = malloc((size_t)(n > 0 ? n : 1) * sizeof(uint32_t));
+    lines = malloc((size_t)(n > 0 ? n : 1) * sizeof(folded_line_t));
+    f = fopen(p->path, "w");
+    if (order == NULL || lines == NULL || f == NULL) {
+        LV_LOG_ERROR("Unable to write the folded stacks to %s", p->path);
+        free(order);
+        free(lines);
+        if (f != NULL) {
+            fclose(f);
+        }
+        return;
+    }
+
+    /* Identical stacks become adjacent, each one is symbolized once */
+    for (i = 0; i < n; i++) {
+        order[i] = i;
+    }
+    qsort(order, n, sizeof(uint32_t), compare_samples);
+
+    for (i = 0; i < n; i += count) {
+        for (count = 1; i + count < n && compare_samples(&order[i], &order[i + count]) == 0; count++) {
+        }
+        lines[line_count].text = format_stack(p, &p->samples[order[i]]);
+        lines[line_count].count = count;
+        if (lines[line_count].text != NULL) {
+            line_count++;
+        }
+    }
+
+    /* Different addresses in the same functions give the same text */
+    qsort(lines, line_count, sizeof(folded_line_t), compare_lines);
+
+    for (i = 0; i < line_count; i += count) {
+        total = 0;
+        for (count = 0; i + count < line_count && strcmp(lines[i].text, lines[i + count].text) == 0; count++) {
+            total += lines[i + count].count;
+        }
+        fprintf(f, "%s %u\n", lines[i].text, total);
+    }
+
+    for (i = 0; i < line_count; i++) {
+        free(lines[i].text);
+    }
+
+    fclose(f);
+    free(lines);
+    free(order);
+    p->dumped_count = n;
+    p->dumped = true;
+
+    fprintf(stdout, "profile: %u of %u frames over %.1f ms (worst %.1f ms), %u frames sampled, "
+            "%u samples written to %s\n", p->overruns, p->frames, (double)p->deadline_ns / 1e6,
+            (double)p->worst_ns / 1e6, p->sampled_frames, n, p->path);
+    if (p->dropped > 0) {
+        fprintf(stdout, "profile: %u samples dropped, the buffer of %u samples is full\n", p->dropped, p->capacity);
+    }
+    perf_hist_print(&p->overrun_hist, "past deadline", "us");
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+/**
+ * Record the stack of the UI thread, only async-signal-safe code here
+ *
+ * @param sig the signal
+ * @param info the signal information
+ * @param context the interrupted context
+ */
+static void sigprof_handler(int sig, siginfo_t *info, void *context)
+{
+    frame_profiler_t *p = &profiler;
+    void *frames[FRAME_PROFILER_DEPTH + SKIP_FRAMES];
+    stack_sample_t *s;
+    int saved_errno = errno;
+    int depth;
+
+    LV_UNUSED(sig);
+    LV_UNUSED(info);
+    LV_UNUSED(context);
+
+    if (!p->sampling) {
+        return;
+    }
+
+    if (p->sample_count >= p->capacity) {
+        p->dropped++;
+        return;
+    }
+
+    depth = backtrace(frames, FRAME_PROFILER_DEPTH + SKIP_FRAMES) - SKIP_FRAMES;
+    if (depth > 0) {
+        s = &p->samples[p->sample_count];
+        s->depth = (uint32_t)depth;
+        memcpy(s->frames, frames + SKIP_FRAMES, (size_t)depth * sizeof(void *));
+        p->sample_count++;
+    }
+
+    errno = saved_errno;
+}
+
+/**
+ * Stop the sampling of the current frame
+ *
+ * @param p the profiler
+ */
+static void disarm(frame_profiler_t *p)
+{
+    static const struct itimerspec stop;
+
+    p->sampling = 0;
+    if (p->armed) {
+        timer_settime(p->timer, 0, &stop, NULL);
+        p->armed = false;
+    }
+}
+
+/**
+ * Arm the timer at the deadline of the frame
+ *
+ * @param e the refresh start event
+ */
+static void refr_start_cb(lv_event_t *e)
+{
+    frame_profiler_t *p = lv_event_get_user_data(e);
+
+    p->refr_start_ns = perf_time_ns();
+
+    if (p->sample_count >= p->capacity) {
+        return;
+    }
+
+    p->frame_first_sample = p->sample_count;
+    p->sampling = 1;
+    if (timer_settime(p->timer, 0, &p->arm, NULL) == 0) {
+        p->armed = true;
+    }
+}
+
+/**
+ * Disarm the timer and count the frames over the deadline
+ *
+ * @param e the refresh ready event
+ */
+static void refr_ready_cb(lv_event_t *e)
+{
+    frame_profiler_t *p = lv_event_get_user_data(e);
+    uint64_t elapsed;
+
+    disarm(p);
+    elapsed = perf_time_ns() - p->refr_start_ns;
+    p->frames++;
+
+    if (elapsed > p->deadline_ns) {
+        p->overruns++;
+        perf_hist_add(&p->overrun_hist, (uint32_t)((elapsed - p->deadline_ns) / 1000));
+        if (elapsed > p->worst_ns) {
+            p->worst_ns = elapsed;
+        }
+    }
+
+    if (p->sample_count > p->frame_first_sample) {
+        p->sampled_frames++;
+        p->frame_first_sample = p->sample_count;
+    }
+
+    if (p->sample_count >= p->capacity && !p->full_logged) {
+        LV_LOG_WARN("The profiler buffer is full, the next frames are not sampled");
+        p->full_logged = true;
+    }
+}
+
+/**
+ * Update the folded stack file
+ *
+ * @param timer the dump timer
+ */
+static void dump_timer_cb(lv_timer_t *timer)
+{
+    LV_UNUSED(timer);
+    frame_profiler_dump();
+}
+
+/**
+ * Order two samples by their stack
+ *
+ * @param a the index of the first sample
+ * @param b the index of the second sample
+ * @return <0, 0 or >0
+ */
+static int compare_samples(const void *a, const void *b)
+{
+    const stack_sample_t *sa = &profiler.samples[*(const uint32_t *)a];
+    const stack_sample_t *sb = &profiler.samples[*(const uint32_t *)b];
+
+    if (sa->depth != sb->depth) {
+        return sa->depth < sb->depth ? -1 : 1;
+    }
+
+    return memcmp(sa->frames, sb->frames, sa->depth * sizeof(void *));
+}
+
+/**
+ * Order two folded lines by their text
+ *
+ * @param a the first line
+ * @param b the second line
+ * @return <0, 0 or >0
+ */
+static int compare_lines(const void *a, const void *b)
+{
+    return strcmp(((const folded_line_t *)a)->text, ((const folded_line_t *)b)->text);
+}
+
+/**
+ * Name the function of an address
+ *
+ * dladdr() returns the closest dynamic symbol, which is another function
+ * when the address is in a static one, so the size of the symbol is checked.
+ *
+ * @param p the profiler
+ * @param addr the address
+ * @param buf the name, the symbol or <object path>+0x<offset>
+ * @param size the size of buf
+ */
+static void symbolize(const frame_profiler_t *p, void *addr, char *buf, size_t size)
+{
+    const ElfW(Sym) *sym = NULL;
+    const char *object;
+    Dl_info info;
+
+    if (dladdr1(addr, &info, (void **)&sym, RTLD_DL_SYMENT) == 0) {
+        snprintf(buf, size, "0x%lx", (unsigned long)(uintptr_t)addr);
+        return;
+    }
+
+    if (info.dli_sname != NULL && sym != NULL &&
+        (uintptr_t)addr < (uintptr_t)info.dli_saddr + sym->st_size) {
+        snprintf(buf, size, "%s", info.dli_sname);
+        return;
+    }
+
+    /* The executable is named by argv[0] */
+    object = info.dli_fname;
+    if (object == NULL || strcmp(object, program_invocation_name) == 0) {
+        object = p->exe;
+    } else if (object[0] != '/') {
+        /* No file to resolve the offset with, e.g. the vDSO */
+        snprintf(buf, size, "[%s]", object);
+        return;
+    }
+
+    snprintf(buf, size, "%s+0x%lx", object, (unsigned long)((uintptr_t)addr - (uintptr_t)info.dli_fbase));
+}
+
+/**
+ * Symbolize a stack, outermost frame first
+ *
+ * @param p the profiler
+ * @param s the sample
+ * @return the frames separated by ';', to free, NULL if out of memory
+ */
+static char *format_stack(const frame_profiler_t *p, const stack_sample_t *s)
+{
+    char name[PATH_MAX + 32];
+    size_t name_len;
+    size_t size = 256;
+    size_t len = 0;
+    char *text = malloc(size);
+    char *grown;
+    uint32_t i;
+
+    if (text == NULL) {
+        return NULL;
+    }
+    text[0] = '\0';
+
+    for (i = s->depth; i-- > 0;) {
+        /* Return addresses point after the call, look up the call itself */
+        symbolize(p, (uint8_t *)s->frames[i] - (i > 0 ? 1 : 0), name, sizeof(name));
+        name_len = strlen(name);
+
+        if (len + name_len + 2 > size) {
+            size = (len + name_len + 2) * 2;
+            grown = realloc(text, size);
+            if (grown == NULL) {
+                free(text);
+                return NULL;
+            }
+            text = grown;
+        }
+
+        memcpy(text + len, name, name_len);
+        len += name_len;
+        if (i > 0) {
+            text[len++] = ';';
+        }
+        text[len] = '\0';
+    }
+
+    return text;
+}
@@ -0,0 +1,71 @@
+/**
+ * @file frame_profiler.h
+ *
+ * Sampling profiler of the frames running past their deadline
+ *
+ * At the start of each refresh a POSIX timer is armed to expire at the
+ * deadline of the frame, then periodically. Its SIGPROF signal is
+ * delivered to the UI thread, the handler stores the call stack into a
+ * preallocated buffer. The timer is disarmed at the end of the refresh,
+ * so a frame that meets its deadline costs two timer_settime() calls and
+ * is never sampled. The stacks are counted and symbolized outside the
+ * frames and written as a folded stack file for flame graphs.
+ *
+ */
+
+#ifndef FRAME_PROFILER_H
+#define FRAME_PROFILER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include "lvgl/lvgl.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/* Frames kept per sample, the innermost ones */
+#define FRAME_PROFILER_DEPTH 32
+
+/* Default size of the sample buffer, override with LV_PROFILE_SAMPLES */
+#define FRAME_PROFILER_SAMPLES 2048
+
+/* Default sampling interval past the deadline, override with LV_PROFILE_INTERVAL_US */
+#define FRAME_PROFILER_INTERVAL_US 500
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+/**
+ * @description Sample the UI thread during the frames of a display that run past
+ *              their deadline when LV_PROFILE_FOLDED is set
+ * @param display the display, call it from the UI thread
+ */
+void frame_profiler_attach(lv_display_t *display);
+
+/**
+ * @description Count, symbolize and write the recorded stacks to LV_PROFILE_FOLDED,
+ *              also done periodically and at exit
+ * @note call it from the UI thread
+ */
+void frame_profiler_dump(void);
+
+/**********************
+ *      MACROS
+ **********************/
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif /*FRAME_PROFILER_H*/
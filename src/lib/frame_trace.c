@@ -0,0 +1,532 @@
+/**
+ * @file frame_trace.c
+ *
+ * Timeline of the frames, timers, draw tasks and threads
+ *
+ * A thread allocates its event buffer at its first event and pushes it
+ * on a global list with a compare and swap. Only the thread writes into
+ * its buffer, the number of events is published with a release store so
+ * the exporter can read the events of running threads. An event costs a
+ * read of the monotonic clock (vDSO) and three stores.
+ *
+ */
+
+#if FRAME_TRACE
+
+/*********************
+ *      INCLUDES
+ *********************/
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "lvgl/lvgl.h"
+
+#include "simulator_util.h"
+#include "frame_trace.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define PHASE_BEGIN 0
+#define PHASE_END 1
+
+/* Events kept free for the ends of the slices already begun */
+#define END_RESERVE 64
+
+/* Perfetto protobuf field numbers */
+#define PB_TRACE_PACKET 1
+#define PB_PACKET_TIMESTAMP 8
+#define PB_PACKET_SEQUENCE_ID 10
+#define PB_PACKET_TRACK_EVENT 11
+#define PB_PACKET_TRACK_DESCRIPTOR 60
+#define PB_TRACK_UUID 1
+#define PB_TRACK_THREAD 4
+#define PB_THREAD_PID 1
+#define PB_THREAD_TID 2
+#define PB_THREAD_NAME 5
+#define PB_EVENT_TYPE 9
+#define PB_EVENT_TRACK_UUID 11
+#define PB_EVENT_NAME 23
+#define PB_SLICE_BEGIN 1
+#define PB_SLICE_END 2
+
+#define PB_WIRE_VARINT 0
+#define PB_WIRE_BYTES 2
+
+/* Longest name written, the others are truncated */
+#define MAX_NAME_LEN 200
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+typedef struct {
+    uint64_t ts_ns;
+    const char *name;
+    uint32_t phase;
+} trace_event_t;
+
+typedef struct trace_thread_s {
+    struct trace_thread_s *next;
+    pid_t tid;
+    uint32_t capacity;
+    uint32_t count;                 /* Published with a release store */
+    uint32_t dropped;
+    uint32_t dropped_depth;         /* Slices begun while full, their end is dropped too */
+    trace_event_t events[];
+} trace_thread_t;
+
+/* Protobuf message being built */
+typedef struct {
+    uint8_t data[MAX_NAME_LEN + 64];
+    size_t len;
+} pb_buf_t;
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static void trace_init(void) __attribute__((constructor));
+static trace_thread_t *register_thread(void);
+static void record(const char *name, uint32_t phase);
+static void write_trace(void);
+static void write_at_exit(void);
+static void thread_name(pid_t tid, char *buf, size_t size);
+static void write_json(FILE *f);
+static void write_json_string(FILE *f, const char *s);
+static void write_perfetto(FILE *f);
+static void pb_varint(pb_buf_t *b, uint64_t v);
+static void pb_field_varint(pb_buf_t *b, uint32_t field, uint64_t v);
+static void pb_field_bytes(pb_buf_t *b, uint32_t field, const void *data, size_t len);
+static void pb_write_packet(FILE *f, const pb_buf_t *packet);
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+static const char *trace_path;
+static uint32_t thread_capacity;
+static uint64_t start_ns;
+static uint64_t stop_ns;
+static bool enabled;
+static bool written;
+static trace_thread_t *threads;
+
+static __thread trace_thread_t *thread_buf;
+
+/* Given to a thread whose buffer could not be allocated */
+static trace_thread_t no_buffer;
+
+/**********************
+ *      MACROS
+ **********************/
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+void frame_trace_begin(const char *name)
+{
+    if (__atomic_load_n(&enabled, __ATOMIC_RELAXED)) {
+        record(name, PHASE_BEGIN);
+    }
+}
+
+void frame_trace_end(const char *name)
+{
+    if (__atomic_load_n(&enabled, __ATOMIC_RELAXED)) {
+        record(name, PHASE_END);
+    }
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+/**
+ * Start recording before main() when LV_TRACE is set, so that lv_init()
+ * and the backend initialization are included
+ */
+static void trace_init(void)
+{
+    struct timespec ts;
+    int sec;
+
+    trace_path = getenv_default("LV_TRACE", "");
+    if (trace_path[0] == '\0') {
+        return;
+    }
+
+    thread_capacity = (uint32_t)atoi(getenv_default("LV_TRACE_EVENTS", "0"));
+    if (thread_capacity <= END_RESERVE) {
+        thread_capacity = FRAME_TRACE_EVENTS;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    start_ns = (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+
+    sec = atoi(getenv_default("LV_TRACE_SEC", "0"));
+    stop_ns = sec > 0 ? start_ns + (uint64_t)sec * 1000000000 : UINT64_MAX;
+
+    atexit(write_at_exit);
+    __atomic_store_n(&enabled, true, __ATOMIC_RELEASE);
+}
+
+/**
+ * Allocate the buffer of the calling thread and add it to the list
+ *
+ * @return the buffer, no_buffer if it could not be allocated
+ */
+static trace_thread_t *register_thread(void)
+{
+    trace_thread_t *t;
+
+    t = malloc(sizeof(trace_thread_t) + (size_t)thread_capacity * sizeof(trace_event_t));
+    if (t == NULL) {
+        return &no_buffer;
+    }
+
+    t->tid = (pid_t)syscall(SYS_gettid);
+    t->capacity = thread_capacity;
+    t->count = 0;
+    t->dropped = 0;
+    t->dropped_depth = 0;
+
+    t->next = __atomic_load_n(&threads, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&threads, &t->next, t, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+
+    return t;
+}
+
+/**
+ * Append an event to the buffer of the calling thread
+ *
+ * @param name the name of the slice
+ * @param phase PHASE_BEGIN or PHASE_END
+ */
+static void record(const char *name, uint32_t phase)
+{
+    trace_thread_t *t = thread_buf;
+    trace_event_t *ev;
+    struct timespec ts;
+    uint64_t now;
+    uint32_t count;
+
+    if (t == NULL) {
+        t = thread_buf = register_thread();
+    }
+
+    if (t->capacity == 0) {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    now = (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+
+    if (now >= stop_ns) {
+        /* The first thread past the end of the capture writes the trace */
+        if (__atomic_exchange_n(&enabled, false, __ATOMIC_ACQ_REL)) {
+            write_trace();
+        }
+        return;
+    }
+
+    count = t->count;
+    if (phase == PHASE_BEGIN) {
+        if (count >= t->capacity - END_RESERVE) {
+            t->dropped++;
+            t->dropped_depth++;
+            return;
+        }
+    } else if (t->dropped_depth > 0) {
+        /* The begin of this slice was dropped */
+        t->dropped++;
+        t->dropped_depth--;
+        return;
+    } else if (count >= t->capacity) {
+        t->dropped++;
+        return;
+    }
+
+    ev = &t->events[count];
+    ev->ts_ns = now;
+    ev->name = name;
+    ev->phase = phase;
+    __atomic_store_n(&t->count, count + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Write the recorded events, once
+ */
+static void write_trace(void)
+{
+    size_t len = strlen(trace_path);
+    bool json = len >= 5 && strcmp(trace_path + len - 5, ".json") == 0;
+    uint32_t thread_count = 0;
+    uint64_t event_count = 0;
+    uint64_t dropped = 0;
+    struct timespec ts;
+    uint64_t begin_ns;
+    trace_thread_t *t;
+    FILE *f;
+
+    if (__atomic_exchange_n(&written, true, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    begin_ns = (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+
+    f = fopen(trace_path, "wb");
+    if (f == NULL) {
+        LV_LOG_ERROR("Unable to write the trace to %s", trace_path);
+        return;
+    }
+
+    if (json) {
+        write_json(f);
+    } else {
+        write_perfetto(f);
+    }
+    fclose(f);
+
+    for (t = __atomic_load_n(&threads, __ATOMIC_ACQUIRE); t != NULL; t = t->next) {
+        thread_count++;
+        event_count += __atomic_load_n(&t->count, __ATOMIC_ACQUIRE);
+        dropped += t->dropped;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    fprintf(stdout, "trace: %llu events of %u threads written to %s in %.1f ms, %llu dropped\n",
+            (unsigned long long)event_count, thread_count, trace_path,
+            (double)((uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec - begin_ns) / 1e6,
+            (unsigned long long)dropped);
+}
+
+/**
+ * Stop recording and write the trace when the process exits
+ */
+static void write_at_exit(void)
+{
+    __atomic_store_n(&enabled, false, __ATOMIC_RELEASE);
+    write_trace();
+}
+
+/**
+ * Get the name of a thread
+ *
+ * @param tid the thread
+ * @param buf the name
+ * @param size the size of buf
+ */
+static void thread_name(pid_t tid, char *buf, size_t size)
+{
+    char path[64];
+    FILE *f;
+
+    snprintf(path, sizeof(path), "/proc/self/task/%d/comm", (int)tid);
+    f = fopen(path, "r");
+    if (f == NULL || fgets(buf, (int)size, f) == NULL) {
+        /* The thread has exited */
+        snprintf(buf, size, "thread %d", (int)tid);
+    } else {
+        buf[strcspn(buf, "\n")] = '\0';
+    }
+
+    if (f != NULL) {
+        fclose(f);
+    }
+}
+
+/**
+ * Write the Chrome trace event format, timestamps in microseconds
+ *
+ * @param f the trace file
+ */
+static void write_json(FILE *f)
+{
+    const char *sep = "";
+    char name[32];
+    int pid = (int)getpid();
+    trace_thread_t *t;
+    trace_event_t *ev;
+    uint32_t count;
+    uint32_t i;
+
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", f);
+
+    for (t = __atomic_load_n(&threads, __ATOMIC_ACQUIRE); t != NULL; t = t->next) {
+        thread_name(t->tid, name, sizeof(name));
+        fprintf(f, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":", sep, pid,
+                (int)t->tid);
+        write_json_string(f, name);
+        fputs("}}", f);
+        sep = ",\n";
+
+        count = __atomic_load_n(&t->count, __ATOMIC_ACQUIRE);
+        for (i = 0; i < count; i++) {
+            ev = &t->events[i];
+            fprintf(f, ",\n{\"ph\":\"%c\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"name\":", ev->phase == PHASE_BEGIN ? 'B' : 'E',
+                    pid, (int)t->tid, (double)(ev->ts_ns - start_ns) / 1e3);
+            write_json_string(f, ev->name);
+            fputc('}', f);
+        }
+    }
+
+    fputs("\n]}\n", f);
+}
+
+/**
+ * Write a JSON string
+ *
+ * @param f the trace file
+ * @param s the string
+ */
+static void write_json_string(FILE *f, const char *s)
+{
+    size_t i;
+
+    fputc('"', f);
+    for (i = 0; s[i] != '\0' && i < MAX_NAME_LEN; i++) {
+        if (s[i] == '"' || s[i] == '\\') {
+            fputc('\\', f);
+            fputc(s[i], f);
+        } else if ((unsigned char)s[i] < 0x20) {
+            fprintf(f, "\\u%04x", (unsigned)s[i]);
+        } else {
+            fputc(s[i], f);
+        }
+    }
+    fputc('"', f);
+}
+
+/**
+ * Write a Perfetto trace: one track per thread, one packet per event,
+ * each thread is a packet sequence of its own
+ *
+ * @param f the trace file
+ */
+static void write_perfetto(FILE *f)
+{
+    pb_buf_t packet;
+    pb_buf_t inner;
+    pb_buf_t thread;
+    char name[32];
+    int pid = (int)getpid();
+    uint32_t sequence = 0;
+    trace_thread_t *t;
+    trace_event_t *ev;
+    uint64_t uuid;
+    uint32_t count;
+    uint32_t i;
+
+    for (t = __atomic_load_n(&threads, __ATOMIC_ACQUIRE); t != NULL; t = t->next) {
+        sequence++;
+        uuid = ((uint64_t)pid << 32) | (uint32_t)t->tid;
+        thread_name(t->tid, name, sizeof(name));
+
+        thread.len = 0;
+        pb_field_varint(&thread, PB_THREAD_PID, (uint64_t)pid);
+        pb_field_varint(&thread, PB_THREAD_TID, (uint64_t)t->tid);
+        pb_field_bytes(&thread, PB_THREAD_NAME, name, strlen(name));
+
+        inner.len = 0;
+        pb_field_varint(&inner, PB_TRACK_UUID, uuid);
+        pb_field_bytes(&inner, PB_TRACK_THREAD, thread.data, thread.len);
+
+        packet.len = 0;
+        pb_field_varint(&packet, PB_PACKET_SEQUENCE_ID, sequence);
+        pb_field_bytes(&packet, PB_PACKET_TRACK_DESCRIPTOR, inner.data, inner.len);
+        pb_write_packet(f, &packet);
+
+        count = __atomic_load_n(&t->count, __ATOMIC_ACQUIRE);
+        for (i = 0; i < count; i++) {
+            ev = &t->events[i];
+
+            inner.len = 0;
+            pb_field_varint(&inner, PB_EVENT_TYPE, ev->phase == PHASE_BEGIN ? PB_SLICE_BEGIN : PB_SLICE_END);
+            pb_field_varint(&inner, PB_EVENT_TRACK_UUID, uuid);
+            if (ev->phase == PHASE_BEGIN) {
+                pb_field_bytes(&inner, PB_EVENT_NAME, ev->name, strnlen(ev->name, MAX_NAME_LEN));
+            }
+
+            packet.len = 0;
+            pb_field_varint(&packet, PB_PACKET_TIMESTAMP, ev->ts_ns);
+            pb_field_varint(&packet, PB_PACKET_SEQUENCE_ID, sequence);
+            pb_field_bytes(&packet, PB_PACKET_TRACK_EVENT, inner.data, inner.len);
+            pb_write_packet(f, &packet);
+        }
+    }
+}
+
+/**
+ * Append a protobuf varint
+ *
+ * @param b the message
+ * @param v the value
+ */
+static void pb_varint(pb_buf_t *b, uint64_t v)
+{
+    while (v >= 0x80) {
+        b->data[b->len++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    b->data[b->len++] = (uint8_t)v;
+}
+
+/**
+ * Append a varint field
+ *
+ * @param b the message
+ * @param field the field number
+ * @param v the value
+ */
+static void pb_field_varint(pb_buf_t *b, uint32_t field, uint64_t v)
+{
+    pb_varint(b, ((uint64_t)field << 3) | PB_WIRE_VARINT);
+    pb_varint(b, v);
+}
+
+/**
+ * Append a length delimited field, a string or an embedded message
+ *
+ * @param b the message
+ * @param field the field number
+ * @param data the bytes
+ * @param len the number of bytes, the buffers are sized for MAX_NAME_LEN
+ */
+static void pb_field_bytes(pb_buf_t *b, uint32_t field, const void *data, size_t len)
+{
+    pb_varint(b, ((uint64_t)field << 3) | PB_WIRE_BYTES);
+    pb_varint(b, len);
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+}
+
+/**
+ * Write a packet as a field of the Trace message
+ *
+ * @param f the trace file
+ * @param packet the packet
+ */
+static void pb_write_packet(FILE *f, const pb_buf_t *packet)
+{
+    pb_buf_t header;
+
+    header.len = 0;
+    pb_varint(&header, ((uint64_t)PB_TRACE_PACKET << 3) | PB_WIRE_BYTES);
+    pb_varint(&header, packet->len);
+    fwrite(header.data, 1, header.len, f);
+    fwrite(packet->data, 1, packet->len, f);
+}
+
+#endif /*FRAME_TRACE*/
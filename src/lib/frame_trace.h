@@ -0,0 +1,75 @@
+/**
+ * @file frame_trace.h
+ *
+ * Timeline of the frames, timers, draw tasks and threads
+ *
+ * Built with -DFRAME_TRACE=ON, the trace points of LVGL (LV_PROFILER_*,
+ * whose include file is this header) and the FRAME_TRACE_BEGIN/END points
+ * of the simulator record begin and end events. Each thread writes into a
+ * buffer of its own without locks, the events are exported when the
+ * process exits or after LV_TRACE_SEC seconds as Chrome trace event JSON
+ * (path ending with .json) or as a Perfetto protobuf trace (any other
+ * path). Without FRAME_TRACE the trace points compile to nothing.
+ *
+ */
+
+#ifndef FRAME_TRACE_H
+#define FRAME_TRACE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/* Default number of events per thread, override with LV_TRACE_EVENTS */
+#define FRAME_TRACE_EVENTS 65536
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+#if FRAME_TRACE
+
+/**
+ * @description Record the beginning of a slice on the calling thread
+ * @param name the name of the slice, it must stay valid until the trace is written
+ * @note the recording starts before main() when LV_TRACE is set
+ */
+void frame_trace_begin(const char *name);
+
+/**
+ * @description Record the end of the last slice begun on the calling thread
+ * @param name the name of the slice
+ */
+void frame_trace_end(const char *name);
+
+#endif /*FRAME_TRACE*/
+
+/**********************
+ *      MACROS
+ **********************/
+
+#if FRAME_TRACE
+#define FRAME_TRACE_BEGIN(name) frame_trace_begin(name)
+#define FRAME_TRACE_END(name) frame_trace_end(name)
+#else
+#define FRAME_TRACE_BEGIN(name) do {} while (0)
+#define FRAME_TRACE_END(name) do {} while (0)
+#endif
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif /*FRAME_TRACE_H*/
@@ -0,0 +1,706 @@
+/**
+ * @file glyph_cache.c
+ *
+ * Persistent glyph cache for Tiny TTF fonts
+ *
+ * The font returned to the application only serves glyphs from the cache.
+ * A glyph missing from the cache is rasterized by Tiny TTF once, its
+ * bitmap is kept in memory and the writer thread rewrites the cache file
+ * shortly after. The next start maps the file and never calls stb_truetype
+ * for the glyphs it contains.
+ *
+ * File layout, native endianness:
+ * - header: magic, version, hash of the TTF file, font size, bpp, count
+ * - count glyph descriptors with the offset of their bitmap
+ * - the bitmaps, rows packed without padding
+ *
+ * Kerning is disabled as the cache is keyed by code point only.
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "lvgl/lvgl.h"
+
+#if LV_USE_TINY_TTF
+
+#include "simulator_util.h"
+#include "rt_profile.h"
+#include "glyph_cache.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define CACHE_MAGIC "LVGC"
+#define CACHE_VERSION 1
+
+/* Glyphs kept by Tiny TTF, the bitmaps are copied out right away */
+#define TTF_CACHE_SIZE 16
+
+/* Widest glyph written to the file */
+#define GLYPH_CACHE_MAX_ROW 1024
+
+/* Open addressing table, twice the number of glyphs */
+#define INDEX_SIZE (GLYPH_CACHE_MAX_GLYPHS * 2)
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t font_hash;
+    uint32_t font_size;
+    uint32_t bpp;
+    uint32_t count;
+    uint32_t reserved;
+} cache_file_header_t;
+
+typedef struct {
+    uint32_t letter;
+    uint32_t offset;        /* From the start of the file */
+    uint16_t adv_w;         /* Pixels */
+    uint16_t box_w;
+    uint16_t box_h;
+    int16_t ofs_x;
+    int16_t ofs_y;
+    uint16_t reserved;
+} cache_file_glyph_t;
+
+typedef struct {
+    cache_file_glyph_t info;
+    const uint8_t *bitmap;  /* In the mapping or allocated on a miss */
+    uint8_t bpp;
+    lv_draw_buf_t draw_buf; /* Wraps the A8 bitmaps */
+} cache_glyph_t;
+
+typedef struct {
+    lv_font_t font;
+    lv_font_t *ttf;
+    uint8_t *ttf_data;
+    uint64_t font_hash;
+    int32_t font_size;
+    char path[PATH_MAX];
+
+    void *map;
+    size_t map_size;
+
+    /* Entries are never modified once counted */
+    cache_glyph_t *glyphs;
+    uint32_t count;
+    uint16_t index[INDEX_SIZE];
+    glyph_cache_stats_t stats;
+
+    /* Shared with the writer thread */
+    pthread_t writer;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t published;
+    uint32_t saved;
+} glyph_cache_t;
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static bool get_glyph_dsc_cb(const lv_font_t *font, lv_font_glyph_dsc_t *dsc, uint32_t letter,
+                             uint32_t letter_next);
+static const void *get_glyph_bitmap_cb(lv_font_glyph_dsc_t *dsc, lv_draw_buf_t *draw_buf);
+static cache_glyph_t *find_glyph(glyph_cache_t *c, uint32_t letter);
+static cache_glyph_t *rasterize_glyph(glyph_cache_t *c, uint32_t letter);
+static void insert_glyph(glyph_cache_t *c, cache_glyph_t *g);
+static uint8_t *read_file(const char *path, size_t *size);
+static uint64_t hash_data(const uint8_t *data, size_t size);
+static void load_file(glyph_cache_t *c);
+static bool write_file(glyph_cache_t *c, uint32_t count);
+static void *writer_thread(void *arg);
+static size_t bitmap_size(uint32_t w, uint32_t h, uint8_t bpp);
+static void convert_row(uint8_t *dst, uint8_t dst_bpp, const uint8_t *src, uint8_t src_bpp, uint32_t w);
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+/**********************
+ *      MACROS
+ **********************/
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+lv_font_t *glyph_cache_font_create(const char *path, int32_t font_size)
+{
+    const char *dir = getenv_default("LV_GLYPH_CACHE_DIR", "glyph_cache");
+    glyph_cache_t *c;
+    size_t ttf_size;
+
+    c = calloc(1, sizeof(glyph_cache_t));
+    if (c == NULL) {
+        return NULL;
+    }
+
+    c->glyphs = calloc(GLYPH_CACHE_MAX_GLYPHS, sizeof(cache_glyph_t));
+    c->ttf_data = read_file(path, &ttf_size);
+    if (c->glyphs == NULL || c->ttf_data == NULL) {
+        fprintf(stderr, "Failed to load font %s\n", path);
+        goto err;
+    }
+
+    c->ttf = lv_tiny_ttf_create_data_ex(c->ttf_data, ttf_size, font_size,
+                                        LV_FONT_KERNING_NONE, TTF_CACHE_SIZE);
+    if (c->ttf == NULL) {
+        fprintf(stderr, "Failed to parse font %s\n", path);
+        goto err;
+    }
+
+    c->font_hash = hash_data(c->ttf_data, ttf_size);
+    c->font_size = font_size;
+
+    c->font.get_glyph_dsc = get_glyph_dsc_cb;
+    c->font.get_glyph_bitmap = get_glyph_bitmap_cb;
+    c->font.line_height = c->ttf->line_height;
+    c->font.base_line = c->ttf->base_line;
+    c->font.underline_position = c->ttf->underline_position;
+    c->font.underline_thickness = c->ttf->underline_thickness;
+    c->font.user_data = c;
+
+    pthread_mutex_init(&c->lock, NULL);
+    pthread_cond_init(&c->cond, NULL);
+
+    /* An empty directory keeps the glyphs in memory only */
+    if (dir[0] == '\0') {
+        return &c->font;
+    }
+
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Glyph cache disabled, %s: %s\n", dir, strerror(errno));
+        return &c->font;
+    }
+
+    snprintf(c->path, sizeof(c->path), "%s/%016llx-%d-a%d.glc", dir,
+             (unsigned long long)c->font_hash, (int)font_size, GLYPH_CACHE_BPP);
+
+    load_file(c);
+
+    if (pthread_create(&c->writer, NULL, writer_thread, c) != 0) {
+        fprintf(stderr, "Glyph cache write back disabled\n");
+    }
+
+    return &c->font;
+
+err:
+    free(c->ttf_data);
+    free(c->glyphs);
+    free(c);
+    return NULL;
+}
+
+void glyph_cache_get_stats(const lv_font_t *font, glyph_cache_stats_t *stats)
+{
+    glyph_cache_t *c = font->user_data;
+
+    pthread_mutex_lock(&c->lock);
+    *stats = c->stats;
+    pthread_mutex_unlock(&c->lock);
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+/**
+ * Describe a glyph, rasterize it first if it is not cached
+ *
+ * @param font the cached font
+ * @param dsc filled with the glyph descriptor
+ * @param letter the code point
+ * @param letter_next the next code point, unused as kerning is disabled
+ * @return true if the font has the glyph
+ */
+static bool get_glyph_dsc_cb(const lv_font_t *font, lv_font_glyph_dsc_t *dsc, uint32_t letter,
+                             uint32_t letter_next)
+{
+    glyph_cache_t *c = font->user_data;
+    cache_glyph_t *g;
+
+    LV_UNUSED(letter_next);
+
+    g = find_glyph(c, letter);
+    if (g != NULL) {
+        c->stats.hits++;
+    } else {
+        g = rasterize_glyph(c, letter);
+        if (g == NULL) {
+            return false;
+        }
+    }
+
+    dsc->adv_w = g->info.adv_w;
+    dsc->box_w = g->info.box_w;
+    dsc->box_h = g->info.box_h;
+    dsc->ofs_x = g->info.ofs_x;
+    dsc->ofs_y = g->info.ofs_y;
+    dsc->format = LV_FONT_GLYPH_FORMAT_A8;
+    dsc->is_placeholder = 0;
+    dsc->gid.index = (uint32_t)(g - c->glyphs);
+    dsc->entry = NULL;
+
+    return true;
+}
+
+/**
+ * Get the bitmap of a cached glyph
+ *
+ * @param dsc the glyph descriptor
+ * @param draw_buf an A8 buffer of the size of the glyph
+ * @return the A8 bitmap, used in place when stored as A8
+ */
+static const void *get_glyph_bitmap_cb(lv_font_glyph_dsc_t *dsc, lv_draw_buf_t *draw_buf)
+{
+    glyph_cache_t *c = dsc->resolved_font->user_data;
+    cache_glyph_t *g = &c->glyphs[dsc->gid.index];
+    uint32_t row_size;
+    uint32_t y;
+
+    if (g->bitmap == NULL) {
+        return NULL;
+    }
+
+    if (g->bpp == 8) {
+        return &g->draw_buf;
+    }
+
+    if (draw_buf == NULL) {
+        return NULL;
+    }
+
+    row_size = (uint32_t)bitmap_size(g->info.box_w, 1, g->bpp);
+    for (y = 0; y < g->info.box_h; y++) {
+        convert_row(draw_buf->data + y * draw_buf->header.stride, 8,
+                    g->bitmap + y * row_size, g->bpp, g->info.box_w);
+    }
+
+    return draw_buf;
+}
+
+/**
+ * Look up a glyph
+ *
+ * @param c the cache
+ * @param letter the code point
+ * @return the glyph or NULL
+ */
+static cache_glyph_t *find_glyph(glyph_cache_t *c, uint32_t letter)
+{
+    uint32_t i = (letter * 2654435761u) % INDEX_SIZE;
+
+    while (c->index[i] != 0) {
+        if (c->glyphs[c->index[i] - 1].info.letter == letter) {
+            return &c->glyphs[c->index[i] - 1];
+        }
+        i = (i + 1) % INDEX_SIZE;
+    }
+
+    return NULL;
+}
+
+/**
+ * Rasterize a glyph with Tiny TTF and add it to the cache
+ *
+ * @param c the cache
+ * @param letter the code point
+ * @return the glyph or NULL if the font does not have it
+ */
+static cache_glyph_t *rasterize_glyph(glyph_cache_t *c, uint32_t letter)
+{
+    lv_font_glyph_dsc_t dsc;
+    const lv_draw_buf_t *bmp;
+    lv_draw_buf_t *buf;
+    cache_glyph_t *g;
+    uint8_t *bitmap;
+    uint32_t y;
+
+    if (c->count >= GLYPH_CACHE_MAX_GLYPHS) {
+        return NULL;
+    }
+
+    memset(&dsc, 0, sizeof(dsc));
+    if (!c->ttf->get_glyph_dsc(c->ttf, &dsc, letter, 0)) {
+        return NULL;
+    }
+    dsc.resolved_font = c->ttf;
+
+    g = &c->glyphs[c->count];
+    memset(g, 0, sizeof(cache_glyph_t));
+    g->info.letter = letter;
+    g->info.adv_w = dsc.adv_w;
+    g->info.box_w = dsc.box_w;
+    g->info.box_h = dsc.box_h;
+    g->info.ofs_x = dsc.ofs_x;
+    g->info.ofs_y = dsc.ofs_y;
+    g->bpp = 8;
+
+    if (dsc.box_w > 0 && dsc.box_h > 0) {
+        buf = lv_draw_buf_create(dsc.box_w, dsc.box_h, LV_COLOR_FORMAT_A8, 0);
+        bitmap = malloc(bitmap_size(dsc.box_w, dsc.box_h, 8));
+
+        bmp = buf != NULL ? c->ttf->get_glyph_bitmap(&dsc, buf) : NULL;
+        if (bmp != NULL && bitmap != NULL) {
+            for (y = 0; y < dsc.box_h; y++) {
+                memcpy(bitmap + y * dsc.box_w, bmp->data + y * bmp->header.stride, dsc.box_w);
+            }
+            g->bitmap = bitmap;
+        } else {
+            free(bitmap);
+            g->info.box_w = 0;
+            g->info.box_h = 0;
+        }
+
+        if (c->ttf->release_glyph != NULL) {
+            c->ttf->release_glyph(c->ttf, &dsc);
+        }
+        if (buf != NULL) {
+            lv_draw_buf_destroy(buf);
+        }
+    }
+
+    insert_glyph(c, g);
+    c->stats.misses++;
+
+    pthread_mutex_lock(&c->lock);
+    c->published = c->count;
+    pthread_cond_signal(&c->cond);
+    pthread_mutex_unlock(&c->lock);
+
+    return g;
+}
+
+/**
+ * Count the next glyph and add it to the index
+ *
+ * @param c the cache
+ * @param g the glyph, c->glyphs[c->count]
+ */
+static void insert_glyph(glyph_cache_t *c, cache_glyph_t *g)
+{
+    uint32_t i = (g->info.letter * 2654435761u) % INDEX_SIZE;
+
+    if (g->bpp == 8 && g->bitmap != NULL) {
+        lv_draw_buf_init(&g->draw_buf, g->info.box_w, g->info.box_h, LV_COLOR_FORMAT_A8,
+                         g->info.box_w, (void *)g->bitmap,
+                         (uint32_t)bitmap_size(g->info.box_w, g->info.box_h, 8));
+    }
+
+    while (c->index[i] != 0) {
+        i = (i + 1) % INDEX_SIZE;
+    }
+
+    c->index[i] = (uint16_t)(c->count + 1);
+    c->count++;
+}
+
+/**
+ * Read a whole file
+ *
+ * @param path the path of the file
+ * @param size set to the size of the file
+ * @return the content to free or NULL on error
+ */
+static uint8_t *read_file(const char *path, size_t *size)
+{
+    uint8_t *data = NULL;
+    struct stat st;
+    FILE *f;
+
+    f = fopen(path, "rb");
+    if (f == NULL) {
+        return NULL;
+    }
+
+    if (fstat(fileno(f), &st) == 0 && st.st_size > 0) {
+        data = malloc((size_t)st.st_size);
+        if (data != NULL && fread(data, 1, (size_t)st.st_size, f) != (size_t)st.st_size) {
+            free(data);
+            data = NULL;
+        }
+        *size = (size_t)st.st_size;
+    }
+
+    fclose(f);
+
+    return data;
+}
+
+/**
+ * FNV-1a hash of the font file
+ *
+ * @param data the content of the file
+ * @param size the size of the file
+ * @return the hash
+ */
+static uint64_t hash_data(const uint8_t *data, size_t size)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        h ^= data[i];
+        h *= 0x100000001b3ULL;
+    }
+
+    return h;
+}
+
+/**
+ * Map the cache file and index its glyphs
+ *
+ * @param c the cache
+ */
+static void load_file(glyph_cache_t *c)
+{
+    const cache_file_header_t *hdr;
+    const cache_file_glyph_t *info;
+    cache_glyph_t *g;
+    struct stat st;
+    size_t table_end;
+    uint32_t i;
+    int fd;
+
+    fd = open(c->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(cache_file_header_t)) {
+        close(fd);
+        return;
+    }
+
+    /* Fault all the pages in now rather than on the first frame */
+    c->map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+
+    if (c->map == MAP_FAILED) {
+        c->map = NULL;
+        return;
+    }
+
+    c->map_size = (size_t)st.st_size;
+    hdr = c->map;
+    table_end = sizeof(cache_file_header_t) + (size_t)hdr->count * sizeof(cache_file_glyph_t);
+
+    if (memcmp(hdr->magic, CACHE_MAGIC, 4) != 0 || hdr->version != CACHE_VERSION ||
+        hdr->font_hash != c->font_hash || hdr->font_size != (uint32_t)c->font_size ||
+        (hdr->bpp != 4 && hdr->bpp != 8) || hdr->count > GLYPH_CACHE_MAX_GLYPHS ||
+        table_end > c->map_size) {
+        fprintf(stderr, "Ignoring stale glyph cache %s\n", c->path);
+        munmap(c->map, c->map_size);
+        c->map = NULL;
+        return;
+    }
+
+    info = (const cache_file_glyph_t *)(hdr + 1);
+
+    for (i = 0; i < hdr->count; i++) {
+        if ((size_t)info[i].offset + bitmap_size(info[i].box_w, info[i].box_h, (uint8_t)hdr->bpp) > c->map_size ||
+            find_glyph(c, info[i].letter) != NULL) {
+            continue;
+        }
+
+        g = &c->glyphs[c->count];
+        g->info = info[i];
+        g->bpp = (uint8_t)hdr->bpp;
+        g->bitmap = info[i].box_w > 0 && info[i].box_h > 0 ?
+                    (const uint8_t *)c->map + info[i].offset : NULL;
+
+        insert_glyph(c, g);
+    }
+
+    c->stats.loaded = c->count;
+    c->published = c->count;
+    c->saved = c->count;
+}
+
+/**
+ * Write the first glyphs to a temporary file and move it over the cache file
+ *
+ * @param c the cache
+ * @param count the number of glyphs to write
+ * @return true on success
+ */
+static bool write_file(glyph_cache_t *c, uint32_t count)
+{
+    cache_file_header_t hdr;
+    cache_file_glyph_t info;
+    char tmp_path[PATH_MAX + 4];
+    uint8_t row[GLYPH_CACHE_MAX_ROW];
+    const cache_glyph_t *g;
+    uint32_t offset;
+    uint32_t row_size;
+    uint32_t i;
+    uint32_t y;
+    bool ok = true;
+    FILE *f;
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", c->path);
+
+    f = fopen(tmp_path, "wb");
+    if (f == NULL) {
+        return false;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, CACHE_MAGIC, 4);
+    hdr.version = CACHE_VERSION;
+    hdr.font_hash = c->font_hash;
+    hdr.font_size = (uint32_t)c->font_size;
+    hdr.bpp = GLYPH_CACHE_BPP;
+    hdr.count = count;
+    ok &= fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+
+    offset = (uint32_t)(sizeof(hdr) + count * sizeof(cache_file_glyph_t));
+    for (i = 0; i < count; i++) {
+        g = &c->glyphs[i];
+        info = g->info;
+        info.offset = offset;
+        ok &= fwrite(&info, sizeof(info), 1, f) == 1;
+        if (g->bitmap != NULL) {
+            offset += (uint32_t)bitmap_size(info.box_w, info.box_h, GLYPH_CACHE_BPP);
+        }
+    }
+
+    for (i = 0; i < count && ok; i++) {
+        g = &c->glyphs[i];
+        if (g->bitmap == NULL) {
+            continue;
+        }
+
+        row_size = (uint32_t)bitmap_size(g->info.box_w, 1, g->bpp);
+        for (y = 0; y < g->info.box_h && ok; y++) {
+            if (g->info.box_w > GLYPH_CACHE_MAX_ROW) {
+                ok = false;
+                break;
+            }
+            convert_row(row, GLYPH_CACHE_BPP, g->bitmap + y * row_size, g->bpp, g->info.box_w);
+            ok &= fwrite(row, bitmap_size(g->info.box_w, 1, GLYPH_CACHE_BPP), 1, f) == 1;
+        }
+    }
+
+    ok &= fflush(f) == 0 && fsync(fileno(f)) == 0;
+    ok &= fclose(f) == 0;
+
+    if (!ok || rename(tmp_path, c->path) != 0) {
+        fprintf(stderr, "Failed to write glyph cache %s\n", c->path);
+        unlink(tmp_path);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Rewrite the cache file when new glyphs were rasterized
+ *
+ * @param arg the cache
+ * @return NULL
+ */
+static void *writer_thread(void *arg)
+{
+    glyph_cache_t *c = arg;
+    uint32_t count;
+    bool ok;
+
+    rt_profile_thread("GLYPH");
+
+    pthread_mutex_lock(&c->lock);
+
+    while (true) {
+        while (c->published == c->saved) {
+            pthread_cond_wait(&c->cond, &c->lock);
+        }
+
+        /* Let a whole screen of text be rasterized before writing */
+        pthread_mutex_unlock(&c->lock);
+        usleep(GLYPH_CACHE_WRITE_DELAY_MS * 1000);
+        pthread_mutex_lock(&c->lock);
+
+        count = c->published;
+        pthread_mutex_unlock(&c->lock);
+
+        /* On failure wait for new glyphs before retrying */
+        ok = write_file(c, count);
+
+        pthread_mutex_lock(&c->lock);
+        if (ok) {
+            c->stats.written += count - c->saved;
+        }
+        c->saved = count;
+    }
+
+    return NULL;
+}
+
+/**
+ * Size of a packed bitmap
+ *
+ * @param w the width in pixels
+ * @param h the height in pixels
+ * @param bpp 4 or 8
+ * @return the size in bytes
+ */
+static size_t bitmap_size(uint32_t w, uint32_t h, uint8_t bpp)
+{
+    return bpp == 4 ? (size_t)((w + 1) / 2) * h : (size_t)w * h;
+}
+
+/**
+ * Convert a row of pixels between A4 and A8
+ *
+ * @param dst the destination row
+ * @param dst_bpp 4 or 8
+ * @param src the source row
+ * @param src_bpp 4 or 8
+ * @param w the number of pixels
+ */
+static void convert_row(uint8_t *dst, uint8_t dst_bpp, const uint8_t *src, uint8_t src_bpp, uint32_t w)
+{
+    uint32_t x;
+    uint8_t a;
+
+    if (dst_bpp == src_bpp) {
+        memcpy(dst, src, bitmap_size(w, 1, src_bpp));
+        return;
+    }
+
+    if (dst_bpp == 4) {
+        memset(dst, 0, bitmap_size(w, 1, 4));
+    }
+
+    for (x = 0; x < w; x++) {
+        if (src_bpp == 4) {
+            a = (uint8_t)((src[x / 2] >> (x & 1 ? 0 : 4)) & 0x0F);
+            dst[x] = (uint8_t)(a * 17);
+        } else {
+            dst[x / 2] |= (uint8_t)((src[x] >> 4) << (x & 1 ? 0 : 4));
+        }
+    }
+}
+
+#endif /*LV_USE_TINY_TTF*/
@@ -0,0 +1,81 @@
+/**
+ * @file glyph_cache.h
+ *
+ * Persistent glyph cache for Tiny TTF fonts
+ *
+ * The rasterized glyphs of a font are stored in a file named after the
+ * hash of the TTF file and the font size. The file is mapped at startup,
+ * glyphs found in it are never rasterized again, new glyphs are written
+ * back by a background thread.
+ *
+ */
+
+#ifndef GLYPH_CACHE_H
+#define GLYPH_CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stdint.h>
+
+#include "lvgl/lvgl.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/* Maximum number of glyphs per font */
+#define GLYPH_CACHE_MAX_GLYPHS 1024
+
+/* Bits per pixel of the stored bitmaps: 8 is mapped as is, 4 halves the file */
+#ifndef GLYPH_CACHE_BPP
+#define GLYPH_CACHE_BPP 8
+#endif
+
+/* Delay used to batch the glyphs written back to the file */
+#define GLYPH_CACHE_WRITE_DELAY_MS 500
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+typedef struct {
+    uint32_t loaded;    /* Glyphs read from the cache file */
+    uint32_t hits;
+    uint32_t misses;    /* Glyphs rasterized by Tiny TTF */
+    uint32_t written;   /* Glyphs saved to the cache file */
+} glyph_cache_stats_t;
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+/**
+ * @description Load a TTF font backed by a persistent glyph cache
+ * @param path the path of the TTF file
+ * @param font_size the size of the font in pixels
+ * @return the font or NULL on error
+ * @note the cache directory is set with LV_GLYPH_CACHE_DIR
+ */
+lv_font_t *glyph_cache_font_create(const char *path, int32_t font_size);
+
+/**
+ * @description Get the counters of a font created by glyph_cache_font_create
+ * @param font the font
+ * @param stats filled with the counters
+ */
+void glyph_cache_get_stats(const lv_font_t *font, glyph_cache_stats_t *stats);
+
+/**********************
+ *      MACROS
+ **********************/
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif /*GLYPH_CACHE_H*/
@@ -0,0 +1,354 @@
+/**
+ * @file golden_frame.c
+ *
+ * Golden frame log for render regression tests
+ *
+ * The log starts with a header line, then has one line per frame that
+ * flushed something and one line per snapshot:
+ *
+ *   # lvgl-golden 1 <width>x<height> cf <color format> step <ms>
+ *   <frame> <x>,<y>,<w>,<h>:<crc> ...
+ *   <frame> screen:<crc>
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lvgl/lvgl.h"
+
+#include "simulator_util.h"
+#include "perf_stats.h"
+#include "tickless.h"
+#include "golden_frame.h"
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define GOLDEN_LOG_VERSION 1
+
+/* Start of the virtual clock, a zero time means "not set" in some modules */
+#define VIRTUAL_START_NS 1000000000ULL
+
+/* Reflected CRC-32C (Castagnoli) polynomial */
+#define CRC32C_POLY 0x82f63b78u
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+typedef struct {
+    lv_display_t *display;
+    FILE *log;
+    int32_t hor_res;
+    int32_t ver_res;
+    uint32_t px_size;
+    uint8_t *screen;                /* Copy of the screen in the rendered format */
+    uint32_t step_ms;
+    uint32_t frame;
+    uint32_t last_frame;            /* Exit after this frame, 0 to run until stopped */
+    uint32_t snapshots[GOLDEN_FRAME_MAX_SNAPSHOTS];
+    uint32_t snapshot_count;
+    bool line_open;
+} golden_frame_t;
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static void crc32c_init(void);
+static uint32_t crc32c_update(uint32_t crc, const uint8_t *data, size_t len);
+static void parse_snapshots(golden_frame_t *g, const char *list);
+static bool is_snapshot(const golden_frame_t *g, uint32_t frame);
+static uint32_t virtual_tick_cb(void);
+static void flush_start_cb(lv_event_t *e);
+static void refr_ready_cb(lv_event_t *e);
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+static golden_frame_t golden;
+static uint32_t crc32c_table[8][256];
+
+/**********************
+ *      MACROS
+ **********************/
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+void golden_frame_attach(lv_display_t *display)
+{
+    golden_frame_t *g = &golden;
+    const char *path = getenv_default("LV_GOLDEN_LOG", "");
+    lv_timer_t *timer;
+
+    if (path[0] == '\0') {
+        return;
+    }
+
+    /* The flush tap reads the rendered buffer, a rotated frame is in another one */
+    if (lv_display_get_rotation(display) != LV_DISPLAY_ROTATION_0) {
+        LV_LOG_WARN("The golden frame log does not support the software rotation");
+        return;
+    }
+
+    g->display = display;
+    g->hor_res = lv_display_get_horizontal_resolution(display);
+    g->ver_res = lv_display_get_vertical_resolution(display);
+    g->px_size = lv_color_format_get_size(lv_display_get_color_format(display));
+    g->step_ms = (uint32_t)atoi(getenv_default("LV_GOLDEN_STEP_MS", "0"));
+    g->last_frame = (uint32_t)atoi(getenv_default("LV_GOLDEN_FRAMES", "0"));
+    parse_snapshots(g, getenv_default("LV_GOLDEN_SNAPSHOTS", ""));
+
+    if (g->step_ms == 0) {
+        g->step_ms = LV_DEF_REFR_PERIOD;
+    }
+
+    g->screen = calloc((size_t)g->hor_res * (size_t)g->ver_res, g->px_size);
+    g->log = fopen(path, "w");
+    if (g->screen == NULL || g->log == NULL) {
+        LV_LOG_ERROR("Unable to start the golden frame log %s", path);
+        free(g->screen);
+        if (g->log != NULL) {
+            fclose(g->log);
+        }
+        return;
+    }
+
+    crc32c_init();
+
+    fprintf(g->log, "# lvgl-golden %d %dx%d cf 0x%02x step %u\n", GOLDEN_LOG_VERSION, (int)g->hor_res,
+            (int)g->ver_res, (unsigned)lv_display_get_color_format(display), g->step_ms);
+
+    /* Restart the timers of the backends on the virtual clock */
+    perf_time_set_virtual(VIRTUAL_START_NS);
+    lv_tick_set_cb(virtual_tick_cb);
+    for (timer = lv_timer_get_next(NULL); timer != NULL; timer = lv_timer_get_next(timer)) {
+        lv_timer_reset(timer);
+    }
+
+    lv_display_add_event_cb(display, flush_start_cb, LV_EVENT_FLUSH_START, g);
+    lv_display_add_event_cb(display, refr_ready_cb, LV_EVENT_REFR_READY, g);
+
+    LV_LOG_USER("Logging the frame hashes to %s", path);
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+/**
+ * Build the tables of the software CRC-32C, 8 bytes per step
+ */
+static void crc32c_init(void)
+{
+    uint32_t crc;
+    uint32_t i;
+    uint32_t j;
+
+    for (i = 0; i < 256; i++) {
+        crc = i;
+        for (j = 0; j < 8; j++) {
+            crc = (crc >> 1) ^ (CRC32C_POLY & (0u - (crc & 1)));
+        }
+        crc32c_table[0][i] = crc;
+    }
+
+    for (i = 0; i < 256; i++) {
+        for (j = 1; j < 8; j++) {
+            crc32c_table[j][i] = (crc32c_table[j - 1][i] >> 8) ^ crc32c_table[0][crc32c_table[j - 1][i] & 0xff];
+        }
+    }
+}
+
+/**
+ * Continue a CRC-32C, with the CRC instructions when the compiler targets them
+ *
+ * @param crc the CRC of the previous data, inverted, ~0 to start
+ * @param data the data
+ * @param len the size of the data
+ * @return the CRC including the data, inverted
+ */
+static uint32_t crc32c_update(uint32_t crc, const uint8_t *data, size_t len)
+{
+    uint64_t v;
+
+#if defined(__SSE4_2__) && defined(__x86_64__)
+    for (; len >= 8; len -= 8, data += 8) {
+        memcpy(&v, data, 8);
+        crc = (uint32_t)_mm_crc32_u64(crc, v);
+    }
+#elif defined(__ARM_FEATURE_CRC32) && defined(__aarch64__)
+    for (; len >= 8; len -= 8, data += 8) {
+        memcpy(&v, data, 8);
+        crc = __crc32cd(crc, v);
+    }
+#else
+    for (; len >= 8; len -= 8, data += 8) {
+        memcpy(&v, data, 8);
+        v ^= crc;   /* Little endian */
+        crc = crc32c_table[7][v & 0xff] ^ crc32c_table[6][(v >> 8) & 0xff] ^
+              crc32c_table[5][(v >> 16) & 0xff] ^ crc32c_table[4][(v >> 24) & 0xff] ^
+              crc32c_table[3][(v >> 32) & 0xff] ^ crc32c_table[2][(v >> 40) & 0xff] ^
+              crc32c_table[1][(v >> 48) & 0xff] ^ crc32c_table[0][v >> 56];
+    }
+#endif
+
+    for (; len > 0; len--, data++) {
+        crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *data) & 0xff];
+    }
+
+    return crc;
+}
+
+/**
+ * Read the frames to snapshot
+ *
+ * @param g the golden log
+ * @param list frame numbers separated by commas
+ */
+static void parse_snapshots(golden_frame_t *g, const char *list)
+{
+    char *end;
+    unsigned long frame;
+
+    while (*list != '\0' && g->snapshot_count < GOLDEN_FRAME_MAX_SNAPSHOTS) {
+        frame = strtoul(list, &end, 10);
+        if (end == list) {
+            break;
+        }
+        g->snapshots[g->snapshot_count++] = (uint32_t)frame;
+        list = *end == ',' ? end + 1 : end;
+    }
+}
+
+/**
+ * Check if the whole screen is hashed after a frame
+ *
+ * @param g the golden log
+ * @param frame the frame number
+ * @return true for the frames of LV_GOLDEN_SNAPSHOTS and the last frame
+ */
+static bool is_snapshot(const golden_frame_t *g, uint32_t frame)
+{
+    uint32_t i;
+
+    if (g->last_frame != 0 && frame == g->last_frame) {
+        return true;
+    }
+
+    for (i = 0; i < g->snapshot_count; i++) {
+        if (g->snapshots[i] == frame) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Get the time of LVGL from the virtual clock
+ *
+ * @return the virtual time in milliseconds
+ */
+static uint32_t virtual_tick_cb(void)
+{
+    return (uint32_t)(perf_time_ns() / 1000000);
+}
+
+/**
+ * Hash a flushed area and copy it into the screen
+ *
+ * In direct and full mode the active buffer holds the whole screen, in
+ * partial mode it holds only the area with the stride of its width.
+ *
+ * @param e the flush start event
+ */
+static void flush_start_cb(lv_event_t *e)
+{
+    golden_frame_t *g = lv_event_get_user_data(e);
+    const lv_area_t *area = lv_event_get_param(e);
+    lv_draw_buf_t *buf = lv_display_get_buf_active(g->display);
+    size_t row_len = (size_t)lv_area_get_width(area) * g->px_size;
+    size_t screen_stride = (size_t)g->hor_res * g->px_size;
+    int32_t h = lv_area_get_height(area);
+    const uint8_t *src;
+    uint8_t *dst;
+    uint32_t stride;
+    uint32_t crc = 0xffffffffu;
+    int32_t y;
+
+    if (buf->header.w == (uint32_t)g->hor_res && buf->header.h == (uint32_t)g->ver_res) {
+        stride = buf->header.stride;
+        src = buf->data + (size_t)area->y1 * stride + (size_t)area->x1 * g->px_size;
+    } else {
+        stride = lv_draw_buf_width_to_stride((uint32_t)lv_area_get_width(area), lv_display_get_color_format(g->display));
+        src = buf->data;
+    }
+
+    dst = g->screen + (size_t)area->y1 * screen_stride + (size_t)area->x1 * g->px_size;
+
+    for (y = 0; y < h; y++) {
+        crc = crc32c_update(crc, src, row_len);
+        memcpy(dst, src, row_len);
+        src += stride;
+        dst += screen_stride;
+    }
+
+    if (!g->line_open) {
+        fprintf(g->log, "%u", g->frame);
+        g->line_open = true;
+    }
+
+    fprintf(g->log, " %d,%d,%d,%d:%08x", (int)area->x1, (int)area->y1, (int)lv_area_get_width(area), (int)h, ~crc);
+}
+
+/**
+ * End the line of the frame, hash the screen on the snapshot frames and
+ * advance the virtual clock to the next frame
+ *
+ * @param e the refresh ready event
+ */
+static void refr_ready_cb(lv_event_t *e)
+{
+    golden_frame_t *g = lv_event_get_user_data(e);
+    uint32_t crc;
+
+    if (g->line_open) {
+        fputc('\n', g->log);
+        g->line_open = false;
+    }
+
+    if (is_snapshot(g, g->frame)) {
+        crc = crc32c_update(0xffffffffu, g->screen, (size_t)g->hor_res * (size_t)g->ver_res * g->px_size);
+        fprintf(g->log, "%u screen:%08x\n", g->frame, ~crc);
+    }
+
+    if (g->last_frame != 0 && g->frame == g->last_frame) {
+        fclose(g->log);
+        LV_LOG_USER("Logged the hashes of %u frames", g->frame + 1);
+        exit(EXIT_SUCCESS);
+    }
+
+    g->frame++;
+    perf_time_advance((uint64_t)g->step_ms * 1000000);
+
+    /* The virtual clock only moves with the frames, an idle display must keep refreshing */
+    tickless_request_frame(g->display);
+}
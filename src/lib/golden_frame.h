@@ -0,0 +1,60 @@
+/**
+ * @file golden_frame.h
+ *
+ * Golden frame log for render regression tests
+ *
+ * Every area flushed by the display is hashed with CRC-32C and written to
+ * a text log with its frame number and coordinates, together with the hash
+ * of the whole screen at chosen frames. The clocks of LVGL and of the
+ * dashboard are replaced by a virtual clock advanced by a fixed step per
+ * refresh, so that two runs of the same build draw the same frames. The
+ * display is not paused by LV_TICKLESS while it is logged, since the clock
+ * would stop with it.
+ * tools/golden_compare.py reports the first frame and area that differ
+ * between two logs. Nothing is registered unless LV_GOLDEN_LOG is set.
+ *
+ */
+
+#ifndef GOLDEN_FRAME_H
+#define GOLDEN_FRAME_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include "lvgl/lvgl.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/* Frames whose whole screen is hashed, given in LV_GOLDEN_SNAPSHOTS */
+#define GOLDEN_FRAME_MAX_SNAPSHOTS 16
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+/**
+ * @description Log the hashes of the frames of a display when LV_GOLDEN_LOG is set,
+ *              call it before creating the UI so that its timers start on the virtual clock
+ * @param display the display, any backend
+ */
+void golden_frame_attach(lv_display_t *display);
+
+/**********************
+ *      MACROS
+ **********************/
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif /*GOLDEN_FRAME_H*/
@@ -24,7 +24,9 @@
 #include "lvgl/lvgl.h"
 #if LV_USE_EVDEV
 #include "lvgl/src/core/lv_global.h"
+#include "../simulator_util.h"
 #include "../backends.h"
+#include "evdev_reader.h"
 
 /*********************
  *      DEFINES
@@ -148,6 +150,11 @@ static void set_mouse_cursor_icon(lv_indev_t *indev, lv_display_t *display)
  *
  * If LV_LINUX_EVDEV_POINTER_DEVICE is not set, automatic evdev disovery will start
  *
+ * Unless LV_LINUX_EVDEV_THREAD is set to 0, the devices are read by a dedicated
+ * input thread instead of being polled from lv_timer_handler(), in that case
+ * LV_LINUX_EVDEV_POINTER_DEVICE can hold a comma separated list of devices and
+ * the devices present at startup are used instead of the automatic discovery
+ *
  * @param display the LVGL display
  *
  * @return input device
@@ -155,6 +162,18 @@ static void set_mouse_cursor_icon(lv_indev_t *indev, lv_display_t *display)
 static lv_indev_t *init_pointer_evdev(lv_display_t *display)
 {
     const char *input_device = getenv("LV_LINUX_EVDEV_POINTER_DEVICE");
+    lv_indev_t *indev;
+    bool has_rel;
+
+    if (atoi(getenv_default("LV_LINUX_EVDEV_THREAD", "1")) != 0) {
+        indev = evdev_reader_create(display, input_device, &has_rel);
+
+        if (indev != NULL && has_rel) {
+            set_mouse_cursor_icon(indev, display);
+        }
+
+        return indev;
+    }
 
     if (input_device == NULL) {
         LV_LOG_USER("Using evdev automatic discovery.");
@@ -162,7 +181,7 @@ static lv_indev_t *init_pointer_evdev(lv_display_t *display)
         return NULL;
     }
 
-    lv_indev_t *indev = lv_evdev_create(LV_INDEV_TYPE_POINTER, input_device);
+    indev = lv_evdev_create(LV_INDEV_TYPE_POINTER, input_device);
 
     if (indev == NULL) {
         return NULL;
@@ -0,0 +1,598 @@
+/**
+ * @file evdev_reader.c
+ *
+ * Threaded evdev pointer reader
+ *
+ * The LVGL evdev driver reads the device from lv_timer_handler(), so the
+ * age of an event depends on the period of the run loop. Here a dedicated
+ * thread blocks on the evdev file descriptors, keeps the kernel timestamp
+ * of each event and coalesces motion until the UI thread consumes it from
+ * the indev read callback. The input thread wakes up the run loop, which
+ * reads the indev and schedules a refresh right away.
+ *
+ * The time between the kernel timestamp of a sample and the end of the
+ * flush of the first frame rendered after it was consumed is recorded
+ * as the input-to-flush latency.
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/input.h>
+
+#include "lvgl/lvgl.h"
+#if LV_USE_EVDEV
+#include "../simulator_util.h"
+#include "../event_loop.h"
+#include "../perf_stats.h"
+#include "../frame_trace.h"
+#include "../tickless.h"
+#include "../rt_profile.h"
+#include "evdev_reader.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define MAX_EVENTS_PER_READ 64
+
+/* Number of /dev/input/eventX nodes probed when no device is specified */
+#define SCAN_MAX_NODES 32
+
+#define BITS_PER_LONG (sizeof(long) * 8)
+#define NBITS(x) ((((x) - 1) / BITS_PER_LONG) + 1)
+#define TEST_BIT(bit, array) ((array[(bit) / BITS_PER_LONG] >> ((bit) % BITS_PER_LONG)) & 1)
+
+/* Older kernel headers do not provide the accessors */
+#ifndef input_event_sec
+#define input_event_sec time.tv_sec
+#define input_event_usec time.tv_usec
+#endif
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+typedef struct {
+    int32_t x;
+    int32_t y;
+    bool pressed;
+    uint64_t ts_ns;     /* Kernel timestamp of the oldest event merged in the sample */
+} pointer_sample_t;
+
+typedef struct {
+    int fd;
+    bool is_abs;
+    int32_t min_x;
+    int32_t max_x;
+    int32_t min_y;
+    int32_t max_y;
+} reader_device_t;
+
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+
+    reader_device_t devices[EVDEV_READER_MAX_DEVICES];
+    int device_count;
+    int32_t hor_res;
+    int32_t ver_res;
+
+    /* State accumulated by the input thread until the next SYN_REPORT */
+    pointer_sample_t cur;
+    bool cur_dirty;
+
+    /* Queue shared between the threads - protected by lock */
+    pointer_sample_t queue[EVDEV_READER_QUEUE_LEN];
+    uint32_t head;
+    uint32_t count;
+    uint32_t coalesced;
+    uint32_t overflows;
+
+    /* Owned by the UI thread */
+    lv_indev_t *indev;
+    lv_display_t *display;
+    pointer_sample_t last;
+    uint64_t flush_pending_ts_ns;
+    uint32_t delivered;
+    perf_hist_t latency;
+} evdev_reader_t;
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static int open_devices(evdev_reader_t *r, const char *devices);
+static int add_device(evdev_reader_t *r, const char *path, bool require_pointer);
+static void *reader_thread(void *arg);
+static void handle_event(evdev_reader_t *r, reader_device_t *dev, const struct input_event *ev);
+static void commit_sample(evdev_reader_t *r);
+static void read_cb(lv_indev_t *indev, lv_indev_data_t *data);
+static void wake_cb(void *user_data);
+static void flush_finish_cb(lv_event_t *e);
+static void report_timer_cb(lv_timer_t *t);
+static int32_t scale_abs(int32_t value, int32_t min, int32_t max, int32_t res);
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+/**********************
+ *      MACROS
+ **********************/
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+lv_indev_t *evdev_reader_create(lv_display_t *display, const char *devices, bool *has_rel)
+{
+    evdev_reader_t *r;
+    int report_sec;
+    int i;
+
+    r = calloc(1, sizeof(evdev_reader_t));
+    LV_ASSERT_NULL(r);
+
+    pthread_mutex_init(&r->lock, NULL);
+
+    r->display = display;
+    r->hor_res = lv_display_get_horizontal_resolution(display);
+    r->ver_res = lv_display_get_vertical_resolution(display);
+    perf_hist_reset(&r->latency);
+
+    if (open_devices(r, devices) <= 0) {
+        LV_LOG_ERROR("No evdev pointer device found");
+        pthread_mutex_destroy(&r->lock);
+        free(r);
+        return NULL;
+    }
+
+    *has_rel = false;
+    for (i = 0; i < r->device_count; i++) {
+        if (!r->devices[i].is_abs) {
+            *has_rel = true;
+        }
+    }
+
+    /* Start in the middle of the screen for mice */
+    r->cur.x = r->hor_res / 2;
+    r->cur.y = r->ver_res / 2;
+    r->last = r->cur;
+
+    r->indev = lv_indev_create();
+    lv_indev_set_type(r->indev, LV_INDEV_TYPE_POINTER);
+    lv_indev_set_read_cb(r->indev, read_cb);
+    lv_indev_set_driver_data(r->indev, r);
+    lv_indev_set_display(r->indev, display);
+
+    lv_display_add_event_cb(display, flush_finish_cb, LV_EVENT_FLUSH_FINISH, r);
+
+    if (event_loop_add_wake_cb(wake_cb, r) < 0) {
+        LV_LOG_WARN("Input events will be read on the indev timer period");
+    } else if (tickless_is_enabled()) {
+        /* Only read when the input thread wakes up the run loop */
+        lv_indev_set_mode(r->indev, LV_INDEV_MODE_EVENT);
+    }
+
+    report_sec = atoi(getenv_default("LV_LINUX_EVDEV_LATENCY_REPORT", "0"));
+    if (report_sec > 0) {
+        lv_timer_create(report_timer_cb, (uint32_t)report_sec * 1000, r);
+    }
+
+    if (pthread_create(&r->thread, NULL, reader_thread, r) != 0) {
+        die("Failed to start the evdev input thread\n");
+    }
+
+    LV_LOG_USER("evdev input thread started with %d device(s)", r->device_count);
+    return r->indev;
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+/**
+ * Open the requested devices or scan for pointer devices
+ *
+ * @param r the reader
+ * @param devices comma separated list of device nodes or NULL
+ * @return the number of opened devices
+ */
+static int open_devices(evdev_reader_t *r, const char *devices)
+{
+    char path[64];
+    char *list;
+    char *tok;
+    char *save;
+    int i;
+
+    if (devices != NULL) {
+        list = strdup(devices);
+        LV_ASSERT_NULL(list);
+
+        for (tok = strtok_r(list, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+            add_device(r, tok, false);
+        }
+
+        free(list);
+        return r->device_count;
+    }
+
+    for (i = 0; i < SCAN_MAX_NODES; i++) {
+        snprintf(path, sizeof(path), "/dev/input/event%d", i);
+        add_device(r, path, true);
+    }
+
+    return r->device_count;
+}
+
+/**
+ * Open a device and query its axes
+ *
+ * @param r the reader
+ * @param path the device node
+ * @param require_pointer skip devices without pointer axes
+ * @return 0 if the device was added, -1 otherwise
+ */
+static int add_device(evdev_reader_t *r, const char *path, bool require_pointer)
+{
+    unsigned long ev_bits[NBITS(EV_MAX)];
+    unsigned long abs_bits[NBITS(ABS_MAX)];
+    unsigned long rel_bits[NBITS(REL_MAX)];
+    struct input_absinfo absinfo;
+    reader_device_t *dev;
+    int clk = CLOCK_MONOTONIC;
+    int fd;
+
+    if (r->device_count >= EVDEV_READER_MAX_DEVICES) {
+        return -1;
+    }
+
+    fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        if (!require_pointer) {
+            LV_LOG_ERROR("Unable to open %s: %s", path, strerror(errno));
+        }
+        return -1;
+    }
+
+    memset(ev_bits, 0, sizeof(ev_bits));
+    memset(abs_bits, 0, sizeof(abs_bits));
+    memset(rel_bits, 0, sizeof(rel_bits));
+    ioctl(fd, EVIOCGBIT(0, sizeof(ev_bits)), ev_bits);
+    ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(abs_bits)), abs_bits);
+    ioctl(fd, EVIOCGBIT(EV_REL, sizeof(rel_bits)), rel_bits);
+
+    dev = &r->devices[r->device_count];
+    dev->fd = fd;
+    dev->is_abs = TEST_BIT(EV_ABS, ev_bits) && TEST_BIT(ABS_X, abs_bits);
+
+    if (require_pointer && !dev->is_abs &&
+        !(TEST_BIT(EV_REL, ev_bits) && TEST_BIT(REL_X, rel_bits))) {
+        close(fd);
+        return -1;
+    }
+
+    if (dev->is_abs) {
+        dev->min_x = 0;
+        dev->max_x = r->hor_res - 1;
+        dev->min_y = 0;
+        dev->max_y = r->ver_res - 1;
+
+        if (ioctl(fd, EVIOCGABS(ABS_X), &absinfo) == 0) {
+            dev->min_x = absinfo.minimum;
+            dev->max_x = absinfo.maximum;
+        }
+
+        if (ioctl(fd, EVIOCGABS(ABS_Y), &absinfo) == 0) {
+            dev->min_y = absinfo.minimum;
+            dev->max_y = absinfo.maximum;
+        }
+    }
+
+    /* Event timestamps are CLOCK_REALTIME by default */
+    if (ioctl(fd, EVIOCSCLOCKID, &clk) != 0) {
+        LV_LOG_WARN("%s: unable to select the monotonic clock, latency will be wrong", path);
+    }
+
+    r->device_count++;
+    LV_LOG_USER("evdev input thread: using %s (%s)", path, dev->is_abs ? "ABS" : "REL");
+    return 0;
+}
+
+/**
+ * Body of the input thread
+ *
+ * @param arg the reader
+ */
+static void *reader_thread(void *arg)
+{
+    evdev_reader_t *r = arg;
+    struct pollfd pfds[EVDEV_READER_MAX_DEVICES];
+    struct input_event events[MAX_EVENTS_PER_READ];
+    ssize_t len;
+    int open_count;
+    int ret;
+    int i;
+    int j;
+
+    rt_profile_thread("INPUT");
+
+    for (i = 0; i < r->device_count; i++) {
+        pfds[i].fd = r->devices[i].fd;
+        pfds[i].events = POLLIN;
+    }
+
+    open_count = r->device_count;
+
+    while (open_count > 0) {
+
+        ret = poll(pfds, (nfds_t)r->device_count, -1);
+
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LV_LOG_ERROR("evdev input thread: poll failed: %s", strerror(errno));
+            break;
+        }
+
+        for (i = 0; i < r->device_count; i++) {
+
+            if (pfds[i].revents == 0) {
+                continue;
+            }
+
+            len = read(pfds[i].fd, events, sizeof(events));
+
+            if (len < 0 && (errno == EAGAIN || errno == EINTR)) {
+                continue;
+            }
+
+            if (len <= 0 || (pfds[i].revents & (POLLERR | POLLHUP))) {
+                /* The device was unplugged, a negative fd is ignored by poll */
+                LV_LOG_WARN("evdev input thread: device removed");
+                close(pfds[i].fd);
+                pfds[i].fd = -1;
+                open_count--;
+                continue;
+            }
+
+            FRAME_TRACE_BEGIN("evdev_read");
+            for (j = 0; j < (int)(len / (ssize_t)sizeof(struct input_event)); j++) {
+                handle_event(r, &r->devices[i], &events[j]);
+            }
+            FRAME_TRACE_END("evdev_read");
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Accumulate an event in the pending sample
+ *
+ * @param r the reader
+ * @param dev the device the event comes from
+ * @param ev the event
+ */
+static void handle_event(evdev_reader_t *r, reader_device_t *dev, const struct input_event *ev)
+{
+    bool touched = false;
+
+    switch (ev->type) {
+    case EV_REL:
+        if (ev->code == REL_X) {
+            r->cur.x = LV_MAX(0, LV_MIN(r->hor_res - 1, r->cur.x + ev->value));
+            touched = true;
+        } else if (ev->code == REL_Y) {
+            r->cur.y = LV_MAX(0, LV_MIN(r->ver_res - 1, r->cur.y + ev->value));
+            touched = true;
+        }
+        break;
+    case EV_ABS:
+        if (ev->code == ABS_X || ev->code == ABS_MT_POSITION_X) {
+            r->cur.x = scale_abs(ev->value, dev->min_x, dev->max_x, r->hor_res);
+            touched = true;
+        } else if (ev->code == ABS_Y || ev->code == ABS_MT_POSITION_Y) {
+            r->cur.y = scale_abs(ev->value, dev->min_y, dev->max_y, r->ver_res);
+            touched = true;
+        }
+        break;
+    case EV_KEY:
+        if (ev->code == BTN_LEFT || ev->code == BTN_TOUCH) {
+            r->cur.pressed = ev->value != 0;
+            touched = true;
+        }
+        break;
+    case EV_SYN:
+        if (ev->code == SYN_REPORT && r->cur_dirty) {
+            commit_sample(r);
+            r->cur_dirty = false;
+        }
+        break;
+    default:
+        break;
+    }
+
+    if (touched && !r->cur_dirty) {
+        r->cur.ts_ns = (uint64_t)ev->input_event_sec * 1000000000ULL +
+                       (uint64_t)ev->input_event_usec * 1000ULL;
+        r->cur_dirty = true;
+    }
+}
+
+/**
+ * Hand the pending sample to the UI thread
+ *
+ * @description Motion is merged into the last queued sample as long as
+ * the button state is the same, so a frame only sees the latest position
+ * but never misses a press or a release.
+ * @param r the reader
+ */
+static void commit_sample(evdev_reader_t *r)
+{
+    pointer_sample_t *tail;
+    bool wake;
+
+    pthread_mutex_lock(&r->lock);
+
+    tail = r->count > 0 ? &r->queue[(r->head + r->count - 1) % EVDEV_READER_QUEUE_LEN] : NULL;
+
+    if (tail != NULL && (tail->pressed == r->cur.pressed || r->count == EVDEV_READER_QUEUE_LEN)) {
+        /* Keep the timestamp of the oldest event to measure the full latency */
+        if (tail->pressed != r->cur.pressed) {
+            r->overflows++;
+        }
+        tail->x = r->cur.x;
+        tail->y = r->cur.y;
+        tail->pressed = r->cur.pressed;
+        r->coalesced++;
+        wake = false;
+    } else {
+        r->queue[(r->head + r->count) % EVDEV_READER_QUEUE_LEN] = r->cur;
+        r->count++;
+        wake = true;
+    }
+
+    pthread_mutex_unlock(&r->lock);
+
+    /* A merged sample is already waiting for the UI thread */
+    if (wake) {
+        event_loop_wake();
+    }
+}
+
+/**
+ * The indev read callback
+ *
+ * @param indev the input device
+ * @param data the data to fill
+ */
+static void read_cb(lv_indev_t *indev, lv_indev_data_t *data)
+{
+    evdev_reader_t *r = lv_indev_get_driver_data(indev);
+
+    pthread_mutex_lock(&r->lock);
+
+    if (r->count > 0) {
+        r->last = r->queue[r->head];
+        r->head = (r->head + 1) % EVDEV_READER_QUEUE_LEN;
+        r->count--;
+        data->continue_reading = r->count > 0;
+        r->delivered++;
+
+        if (r->flush_pending_ts_ns == 0) {
+            r->flush_pending_ts_ns = r->last.ts_ns;
+        }
+    }
+
+    pthread_mutex_unlock(&r->lock);
+
+    data->point.x = r->last.x;
+    data->point.y = r->last.y;
+    data->state = r->last.pressed ? LV_INDEV_STATE_PRESSED : LV_INDEV_STATE_RELEASED;
+}
+
+/**
+ * Read the new samples as soon as the input thread wakes up the run loop
+ *
+ * @param user_data the reader
+ */
+static void wake_cb(void *user_data)
+{
+    evdev_reader_t *r = user_data;
+    uint32_t delivered = r->delivered;
+
+    lv_indev_read(r->indev);
+
+    /* Render the result now instead of waiting for the refresh period */
+    if (r->delivered != delivered) {
+        lv_timer_ready(lv_display_get_refr_timer(r->display));
+    }
+}
+
+/**
+ * Record the input-to-flush latency
+ *
+ * @param e the flush finish event of the display
+ */
+static void flush_finish_cb(lv_event_t *e)
+{
+    evdev_reader_t *r = lv_event_get_user_data(e);
+    uint64_t now;
+
+    if (r->flush_pending_ts_ns == 0 || !lv_display_flush_is_last(r->display)) {
+        return;
+    }
+
+    now = perf_time_ns();
+    if (now > r->flush_pending_ts_ns) {
+        perf_hist_add(&r->latency, (uint32_t)((now - r->flush_pending_ts_ns) / 1000));
+    }
+
+    r->flush_pending_ts_ns = 0;
+}
+
+/**
+ * Periodically print the latency histogram
+ *
+ * @param t the report timer
+ */
+static void report_timer_cb(lv_timer_t *t)
+{
+    evdev_reader_t *r = lv_timer_get_user_data(t);
+    uint32_t coalesced;
+    uint32_t overflows;
+
+    pthread_mutex_lock(&r->lock);
+    coalesced = r->coalesced;
+    overflows = r->overflows;
+    r->coalesced = 0;
+    r->overflows = 0;
+    pthread_mutex_unlock(&r->lock);
+
+    fprintf(stdout, "evdev: delivered=%u coalesced=%u overflows=%u\n",
+            r->delivered, coalesced, overflows);
+    perf_hist_print(&r->latency, "evdev input-to-flush latency", "us");
+
+    r->delivered = 0;
+    perf_hist_reset(&r->latency);
+}
+
+/**
+ * Map an absolute axis value to the display resolution
+ *
+ * @param value the raw value
+ * @param min the minimum of the axis
+ * @param max the maximum of the axis
+ * @param res the display resolution
+ * @return the coordinate
+ */
+static int32_t scale_abs(int32_t value, int32_t min, int32_t max, int32_t res)
+{
+    int64_t pos;
+
+    if (max <= min) {
+        return value;
+    }
+
+    pos = ((int64_t)(value - min) * res) / ((int64_t)max - min + 1);
+    return (int32_t)LV_MAX(0, LV_MIN(res - 1, pos));
+}
+
+#endif /*LV_USE_EVDEV*/
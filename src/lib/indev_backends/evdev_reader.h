@@ -0,0 +1,56 @@
+/**
+ * @file evdev_reader.h
+ *
+ * Threaded evdev pointer reader
+ *
+ */
+
+#ifndef EVDEV_READER_H
+#define EVDEV_READER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stdbool.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/* Maximum number of evdev devices handled by the input thread */
+#define EVDEV_READER_MAX_DEVICES 8
+
+/* Number of pointer samples buffered between the input and the UI thread */
+#define EVDEV_READER_QUEUE_LEN 16
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+/**
+ * @description Create a pointer input device fed by the input thread
+ * @param display the display the pointer belongs to
+ * @param devices comma separated list of device nodes,
+ *        NULL to scan /dev/input for pointer devices
+ * @param has_rel set to true if one of the devices is a mouse
+ * @return the input device or NULL on error
+ */
+lv_indev_t *evdev_reader_create(lv_display_t *display, const char *devices, bool *has_rel);
+
+/**********************
+ *      MACROS
+ **********************/
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif /*EVDEV_READER_H*/
@@ -0,0 +1,262 @@
+/**
+ * @file lz_codec.c
+ *
+ * Fast LZ codec for pixel data
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lz_codec.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define MIN_MATCH 4
+
+/* The last 5 bytes are literals, the last match starts 12 bytes before the end */
+#define LAST_LITERALS 5
+#define MF_LIMIT 12
+
+#define MAX_OFFSET 65535
+
+#define HASH_LOG 12
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static uint32_t read32(const uint8_t *p);
+static uint32_t hash4(uint32_t v);
+static uint8_t *put_length(uint8_t *op, size_t len);
+static uint8_t *put_sequence(uint8_t *op, const uint8_t *lit, size_t lit_len, uint32_t offset, size_t match_len);
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+/**********************
+ *      MACROS
+ **********************/
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+size_t lz_compress_bound(size_t len)
+{
+    return len + len / 255 + 16;
+}
+
+size_t lz_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap)
+{
+    /* Positions + 1, 0 is an empty slot */
+    uint32_t table[1 << HASH_LOG];
+    uint8_t *op = dst;
+    size_t anchor = 0;
+    size_t ip = 0;
+    size_t ref;
+    size_t match_len;
+    uint32_t seq;
+    uint32_t h;
+
+    if (cap < lz_compress_bound(len)) {
+        return 0;
+    }
+
+    memset(table, 0, sizeof(table));
+
+    if (len > MF_LIMIT) {
+        while (ip < len - MF_LIMIT) {
+            seq = read32(src + ip);
+            h = hash4(seq);
+            ref = table[h];
+            table[h] = (uint32_t)ip + 1;
+
+            if (ref == 0 || ip - (ref - 1) > MAX_OFFSET || read32(src + ref - 1) != seq) {
+                ip++;
+                continue;
+            }
+
+            ref--;
+            match_len = MIN_MATCH;
+            while (ip + match_len < len - LAST_LITERALS && src[ref + match_len] == src[ip + match_len]) {
+                match_len++;
+            }
+
+            op = put_sequence(op, src + anchor, ip - anchor, (uint32_t)(ip - ref), match_len);
+            ip += match_len;
+            anchor = ip;
+        }
+    }
+
+    /* The last sequence only has literals */
+    op = put_sequence(op, src + anchor, len - anchor, 0, 0);
+
+    return (size_t)(op - dst);
+}
+
+int32_t lz_decompress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap)
+{
+    const uint8_t *ip = src;
+    const uint8_t *end = src + len;
+    uint8_t *op = dst;
+    uint8_t *op_end = dst + cap;
+    const uint8_t *ref;
+    size_t lit_len;
+    size_t match_len;
+    uint32_t offset;
+    uint8_t token;
+    uint8_t b;
+
+    while (ip < end) {
+        token = *ip++;
+
+        lit_len = token >> 4;
+        if (lit_len == 15) {
+            do {
+                if (ip >= end) {
+                    return -1;
+                }
+                b = *ip++;
+                lit_len += b;
+            } while (b == 255);
+        }
+
+        if (lit_len > (size_t)(end - ip) || lit_len > (size_t)(op_end - op)) {
+            return -1;
+        }
+        memcpy(op, ip, lit_len);
+        ip += lit_len;
+        op += lit_len;
+
+        /* The last sequence ends after its literals */
+        if (ip == end) {
+            break;
+        }
+
+        if (end - ip < 2) {
+            return -1;
+        }
+        offset = (uint32_t)ip[0] | ((uint32_t)ip[1] << 8);
+        ip += 2;
+
+        match_len = (token & 0x0f) + MIN_MATCH;
+        if ((token & 0x0f) == 15) {
+            do {
+                if (ip >= end) {
+                    return -1;
+                }
+                b = *ip++;
+                match_len += b;
+            } while (b == 255);
+        }
+
+        if (offset == 0 || offset > (size_t)(op - dst) || match_len > (size_t)(op_end - op)) {
+            return -1;
+        }
+
+        /* The match may overlap the bytes it produces */
+        ref = op - offset;
+        while (match_len--) {
+            *op++ = *ref++;
+        }
+    }
+
+    return (int32_t)(op - dst);
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+/**
+ * Read 4 unaligned bytes
+ *
+ * @param p the first byte
+ * @return the bytes in native order
+ */
+static uint32_t read32(const uint8_t *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/**
+ * Hash 4 bytes into the match table
+ *
+ * @param v the bytes
+ * @return the index in the table
+ */
+static uint32_t hash4(uint32_t v)
+{
+    return (v * 2654435761u) >> (32 - HASH_LOG);
+}
+
+/**
+ * Write the bytes extending a length that does not fit in its nibble
+ *
+ * @param op the output
+ * @param len the length minus 15
+ * @return the next output byte
+ */
+static uint8_t *put_length(uint8_t *op, size_t len)
+{
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (uint8_t)len;
+
+    return op;
+}
+
+/**
+ * Write a sequence
+ *
+ * @param op the output
+ * @param lit the literals
+ * @param lit_len the number of literals
+ * @param offset the distance of the match, 0 for the last sequence
+ * @param match_len the length of the match, 0 for the last sequence
+ * @return the next output byte
+ */
+static uint8_t *put_sequence(uint8_t *op, const uint8_t *lit, size_t lit_len, uint32_t offset, size_t match_len)
+{
+    uint8_t *token = op++;
+    size_t ml = match_len != 0 ? match_len - MIN_MATCH : 0;
+
+    *token = (uint8_t)((lit_len >= 15 ? 15 : lit_len) << 4);
+    if (lit_len >= 15) {
+        op = put_length(op, lit_len - 15);
+    }
+
+    memcpy(op, lit, lit_len);
+    op += lit_len;
+
+    if (match_len == 0) {
+        return op;
+    }
+
+    *op++ = (uint8_t)offset;
+    *op++ = (uint8_t)(offset >> 8);
+
+    *token |= (uint8_t)(ml >= 15 ? 15 : ml);
+    if (ml >= 15) {
+        op = put_length(op, ml - 15);
+    }
+
+    return op;
+}
@@ -0,0 +1,74 @@
+/**
+ * @file lz_codec.h
+ *
+ * Fast LZ codec for pixel data
+ *
+ * The compressed data is an LZ4 block: sequences of literals followed
+ * by a match of 4 bytes or more up to 64 KiB back. The compressor is a
+ * greedy single pass with a hash of the next 4 bytes, fast enough to run
+ * on the UI thread. The codec does not depend on LVGL so that the tools
+ * can link it.
+ *
+ */
+
+#ifndef LZ_CODEC_H
+#define LZ_CODEC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stddef.h>
+#include <stdint.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+/**
+ * @description Get the largest compressed size of some data
+ * @param len the size of the data
+ * @return the size of the buffer to pass to lz_compress()
+ */
+size_t lz_compress_bound(size_t len);
+
+/**
+ * @description Compress a block
+ * @param src the data
+ * @param len the size of the data
+ * @param dst the compressed data
+ * @param cap the size of dst, lz_compress_bound(len) always fits
+ * @return the compressed size, 0 if dst is too small
+ */
+size_t lz_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap);
+
+/**
+ * @description Decompress a block
+ * @param src the compressed data
+ * @param len the compressed size
+ * @param dst the decompressed data
+ * @param cap the size of dst
+ * @return the decompressed size, -1 if the data is corrupted or does not fit
+ */
+int32_t lz_decompress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap);
+
+/**********************
+ *      MACROS
+ **********************/
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif /*LZ_CODEC_H*/
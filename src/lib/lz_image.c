@@ -0,0 +1,298 @@
+/**
+ * @file lz_image.c
+ *
+ * Image decoder of the LZ compressed native images (.lzi)
+ *
+ * The compressed planes are read in one go and decompressed straight
+ * into the draw buffer, which is created with the stride of the file.
+ * Like the decoders of LVGL the decoded image is added to the image cache
+ * when it is enabled.
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lvgl/lvgl.h"
+#include "lvgl/src/draw/lv_image_decoder_private.h"
+
+#include "lz_codec.h"
+#include "lz_image.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define DECODER_NAME "LZI"
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+typedef struct {
+    lv_color_format_t cf;
+    uint32_t w;
+    uint32_t h;
+    uint32_t stride;
+    uint32_t raw_size;
+    uint32_t comp_size;
+} lzi_header_t;
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static bool read_header(lv_fs_file_t *file, lzi_header_t *header);
+static uint64_t planes_size(const lzi_header_t *header);
+static lv_result_t decoder_info(lv_image_decoder_t *decoder, lv_image_decoder_dsc_t *dsc,
+                                lv_image_header_t *header);
+static lv_result_t decoder_open(lv_image_decoder_t *decoder, lv_image_decoder_dsc_t *dsc);
+static void decoder_close(lv_image_decoder_t *decoder, lv_image_decoder_dsc_t *dsc);
+static lv_draw_buf_t *decode(lv_fs_file_t *file, const lzi_header_t *header);
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+/**********************
+ *      MACROS
+ **********************/
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+void lz_image_decoder_init(void)
+{
+    lv_image_decoder_t *dec = lv_image_decoder_create();
+
+    lv_image_decoder_set_info_cb(dec, decoder_info);
+    lv_image_decoder_set_open_cb(dec, decoder_open);
+    lv_image_decoder_set_close_cb(dec, decoder_close);
+    dec->name = DECODER_NAME;
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+/**
+ * Read and check the header of a .lzi file
+ *
+ * @param file the file, read from the start
+ * @param header the fields of the header
+ * @return true if the header is valid
+ */
+static bool read_header(lv_fs_file_t *file, lzi_header_t *header)
+{
+    uint8_t buf[LZ_IMAGE_HEADER_SIZE];
+    uint32_t rn;
+
+    if (lv_fs_seek(file, 0, LV_FS_SEEK_SET) != LV_FS_RES_OK ||
+        lv_fs_read(file, buf, sizeof(buf), &rn) != LV_FS_RES_OK || rn != sizeof(buf) ||
+        memcmp(buf, LZ_IMAGE_MAGIC, 4) != 0) {
+        return false;
+    }
+
+    header->cf = (lv_color_format_t)buf[4];
+    header->w = (uint32_t)buf[8] | ((uint32_t)buf[9] << 8);
+    header->h = (uint32_t)buf[10] | ((uint32_t)buf[11] << 8);
+    header->stride = (uint32_t)buf[12] | ((uint32_t)buf[13] << 8) | ((uint32_t)buf[14] << 16) |
+                     ((uint32_t)buf[15] << 24);
+    header->raw_size = (uint32_t)buf[16] | ((uint32_t)buf[17] << 8) | ((uint32_t)buf[18] << 16) |
+                       ((uint32_t)buf[19] << 24);
+    header->comp_size = (uint32_t)buf[20] | ((uint32_t)buf[21] << 8) | ((uint32_t)buf[22] << 16) |
+                        ((uint32_t)buf[23] << 24);
+
+    /* Only the formats written by convert_lzi.py */
+    switch (header->cf) {
+    case LV_COLOR_FORMAT_RGB565:
+    case LV_COLOR_FORMAT_RGB565A8:
+    case LV_COLOR_FORMAT_ARGB8888:
+    case LV_COLOR_FORMAT_A8:
+        break;
+    default:
+        return false;
+    }
+
+    /* The stride is stored in 16 bits by LVGL */
+    if (header->w == 0 || header->h == 0 || header->stride > UINT16_MAX || header->comp_size == 0 ||
+        header->stride < (header->w * lv_color_format_get_bpp(header->cf) + 7) / 8) {
+        return false;
+    }
+
+    /* The planes fill the whole draw buffer */
+    return header->raw_size == planes_size(header);
+}
+
+/**
+ * Get the size of the planes of an image, as allocated by lv_draw_buf_create
+ *
+ * @param header the header of the file
+ * @return the size in bytes
+ */
+static uint64_t planes_size(const lzi_header_t *header)
+{
+    uint64_t size = (uint64_t)header->stride * header->h;
+
+    /* The A8 plane of RGB565A8 has half the stride of the RGB565 plane */
+    if (header->cf == LV_COLOR_FORMAT_RGB565A8) {
+        size += (uint64_t)(header->stride / 2) * header->h;
+    }
+
+    return size;
+}
+
+/**
+ * Get the size and the color format of a .lzi file
+ *
+ * @param decoder the decoder
+ * @param dsc the image, its file is open
+ * @param header the header to fill
+ * @return LV_RESULT_OK if the image is a .lzi file
+ */
+static lv_result_t decoder_info(lv_image_decoder_t *decoder, lv_image_decoder_dsc_t *dsc,
+                                lv_image_header_t *header)
+{
+    lzi_header_t h;
+
+    LV_UNUSED(decoder);
+
+    if (dsc->src_type != LV_IMAGE_SRC_FILE || strcmp(lv_fs_get_ext(dsc->src), "lzi") != 0) {
+        return LV_RESULT_INVALID;
+    }
+
+    if (!read_header(&dsc->file, &h)) {
+        LV_LOG_WARN("%s: invalid header", (const char *)dsc->src);
+        return LV_RESULT_INVALID;
+    }
+
+    header->cf = h.cf;
+    header->w = h.w;
+    header->h = h.h;
+    header->stride = h.stride;
+
+    return LV_RESULT_OK;
+}
+
+/**
+ * Decode a .lzi file and add it to the image cache
+ *
+ * @param decoder the decoder
+ * @param dsc the image, its file is open
+ * @return LV_RESULT_OK on success
+ */
+static lv_result_t decoder_open(lv_image_decoder_t *decoder, lv_image_decoder_dsc_t *dsc)
+{
+    lv_image_cache_data_t search_key;
+    lv_cache_entry_t *entry;
+    lv_draw_buf_t *decoded;
+    lv_draw_buf_t *adjusted;
+    lzi_header_t h;
+
+    if (!read_header(&dsc->file, &h)) {
+        return LV_RESULT_INVALID;
+    }
+
+    decoded = decode(&dsc->file, &h);
+    if (decoded == NULL) {
+        LV_LOG_WARN("%s: unable to decode", (const char *)dsc->src);
+        return LV_RESULT_INVALID;
+    }
+
+    /* Apply the stride and premultiplication requested by the caller */
+    adjusted = lv_image_decoder_post_process(dsc, decoded);
+    if (adjusted == NULL) {
+        lv_draw_buf_destroy(decoded);
+        return LV_RESULT_INVALID;
+    }
+
+    if (adjusted != decoded) {
+        lv_draw_buf_destroy(decoded);
+        decoded = adjusted;
+    }
+
+    dsc->decoded = decoded;
+
+    if (dsc->args.no_cache || !lv_image_cache_is_enabled()) {
+        return LV_RESULT_OK;
+    }
+
+    search_key.src_type = dsc->src_type;
+    search_key.src = dsc->src;
+    search_key.slot.size = decoded->data_size;
+
+    entry = lv_image_decoder_add_to_cache(decoder, &search_key, decoded, NULL);
+    if (entry == NULL) {
+        lv_draw_buf_destroy(decoded);
+        return LV_RESULT_INVALID;
+    }
+    dsc->cache_entry = entry;
+
+    return LV_RESULT_OK;
+}
+
+/**
+ * Release an image not owned by the cache
+ *
+ * @param decoder the decoder
+ * @param dsc the image
+ */
+static void decoder_close(lv_image_decoder_t *decoder, lv_image_decoder_dsc_t *dsc)
+{
+    LV_UNUSED(decoder);
+
+    if (dsc->args.no_cache || !lv_image_cache_is_enabled()) {
+        lv_draw_buf_destroy((lv_draw_buf_t *)dsc->decoded);
+    }
+}
+
+/**
+ * Read the compressed planes and decompress them into a draw buffer
+ *
+ * @param file the file, positioned after the header
+ * @param header the header of the file
+ * @return the draw buffer, NULL on error
+ */
+static lv_draw_buf_t *decode(lv_fs_file_t *file, const lzi_header_t *header)
+{
+    lv_draw_buf_t *decoded;
+    uint8_t *comp;
+    uint32_t rn;
+    int32_t len;
+
+    decoded = lv_draw_buf_create(header->w, header->h, header->cf, header->stride);
+    if (decoded == NULL) {
+        return NULL;
+    }
+
+    if (header->raw_size != decoded->data_size) {
+        lv_draw_buf_destroy(decoded);
+        return NULL;
+    }
+
+    comp = lv_malloc(header->comp_size);
+    if (comp == NULL) {
+        lv_draw_buf_destroy(decoded);
+        return NULL;
+    }
+
+    if (lv_fs_read(file, comp, header->comp_size, &rn) != LV_FS_RES_OK || rn != header->comp_size) {
+        len = -1;
+    } else {
+        len = lz_decompress(comp, header->comp_size, decoded->data, header->raw_size);
+    }
+
+    lv_free(comp);
+
+    if (len != (int32_t)header->raw_size) {
+        lv_draw_buf_destroy(decoded);
+        return NULL;
+    }
+
+    return decoded;
+}
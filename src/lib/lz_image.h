@@ -0,0 +1,63 @@
+/**
+ * @file lz_image.h
+ *
+ * Image decoder of the LZ compressed native images (.lzi)
+ *
+ * The pixels are stored in the color format LVGL draws from (RGB565,
+ * RGB565A8, ARGB8888...) and compressed with src/lib/lz_codec, so opening
+ * an image is a file read and an LZ4 block decompression, without the
+ * inflate, filtering and color conversion of PNG. The files are written
+ * by assets/convert_lzi.py.
+ *
+ * File layout, little endian:
+ *  - "LZI1"
+ *  - color format (uint8_t, lv_color_format_t): RGB565, RGB565A8, ARGB8888
+ *    or A8, 3 reserved bytes
+ *  - width, height (uint16_t)
+ *  - stride of the first plane (uint32_t)
+ *  - decompressed size, the size of all the planes, compressed size (uint32_t)
+ *  - the LZ4 block of the planes, e.g. the RGB565 plane then the A8 plane
+ *
+ */
+
+#ifndef LZ_IMAGE_H
+#define LZ_IMAGE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define LZ_IMAGE_MAGIC "LZI1"
+#define LZ_IMAGE_HEADER_SIZE 24
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+/**
+ * @description Register the decoder of the .lzi files next to the decoders of LVGL
+ * @note call it after lv_init()
+ */
+void lz_image_decoder_init(void);
+
+/**********************
+ *      MACROS
+ **********************/
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif /*LZ_IMAGE_H*/
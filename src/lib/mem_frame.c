@@ -0,0 +1,644 @@
+/**
+ * @file mem_frame.c
+ *
+ * LVGL memory allocator for the steady-state frame loop
+ *
+ * Every block starts with a small header recording where it comes from:
+ * - ARENA: bump allocated from the frame arena while a refresh is running,
+ *   free only decrements the number of live blocks of the arena. The arena
+ *   is rewound when the refresh is over, if a block outlives the refresh
+ *   the arena is retired and released once its last block is freed.
+ * - POOL: fixed size classes of up to 1 KiB recycled through free lists,
+ *   used for the recurring objects allocated outside of the refresh
+ *   (label text, timers, styles ...)
+ * - HEAP: forwarded to malloc
+ *
+ * The arena is only enabled after a warm-up period, so that the image and
+ * glyph caches filled by the first frames do not pin it.
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lvgl/lvgl.h"
+#if LV_USE_STDLIB_MALLOC == LV_STDLIB_CUSTOM
+#if LV_USE_OS != LV_OS_NONE
+#include <pthread.h>
+#endif
+#include "simulator_util.h"
+#include "mem_verify.h"
+#include "mem_frame.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define HDR_SIZE 16
+
+/* Pool classes hold 16, 32, ... 1024 bytes */
+#define POOL_MIN_SHIFT 4
+#define POOL_CLASS_COUNT 7
+#define POOL_MAX_SIZE (1U << (POOL_MIN_SHIFT + POOL_CLASS_COUNT - 1))
+
+/* Number of blocks allocated at once when a pool class is empty */
+#define POOL_SLAB_BLOCKS 32
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+typedef enum {
+    BLOCK_HEAP,
+    BLOCK_POOL,
+    BLOCK_ARENA
+} block_kind_t;
+
+typedef union {
+    struct {
+        void *owner;        /* The pool class or the arena */
+        uint32_t size;      /* Requested size */
+        uint32_t kind;
+    } h;
+    uint8_t align[HDR_SIZE];
+} block_hdr_t;
+
+typedef struct free_block {
+    struct free_block *next;
+} free_block_t;
+
+typedef struct {
+    uint32_t block_size;
+    free_block_t *free_list;
+    uint32_t total;
+    uint32_t used;
+} pool_class_t;
+
+typedef struct {
+    uint8_t *base;
+    size_t size;
+    size_t used;
+    size_t peak;
+    uint32_t live;
+    bool retired;
+} arena_t;
+
+typedef struct {
+    uint32_t calls;     /* lv_malloc and lv_realloc calls which allocated */
+    uint32_t arena;
+    uint32_t pool;
+    uint32_t heap;
+    uint32_t sys;       /* Calls to malloc including pool and arena growth */
+} alloc_counters_t;
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static void *alloc_block(size_t size);
+static void free_block(void *p);
+static size_t block_capacity(const block_hdr_t *hdr);
+static void *arena_alloc(size_t size);
+static arena_t *arena_create(size_t size);
+static void arena_frame_end(void);
+static void *pool_alloc(size_t size);
+static bool pool_grow(pool_class_t *pc);
+static void *heap_alloc(size_t size);
+static void refr_event_cb(lv_event_t *e);
+static void report_timer_cb(lv_timer_t *t);
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+static pool_class_t pools[POOL_CLASS_COUNT];
+static arena_t *arena;
+static size_t arena_size;
+static uint32_t retired_count;
+static bool arena_disabled;
+static uint32_t refr_depth;
+static uint32_t frame_count;
+static uint32_t warmup_frames;
+
+/* Bytes of the pool blocks and of the arena in use, and their high-water mark */
+static size_t used_size;
+static size_t max_used_size;
+
+static alloc_counters_t counters;
+static uint32_t report_frames;
+static uint32_t verify_allocs;
+
+#if LV_USE_OS != LV_OS_NONE
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/**********************
+ *      MACROS
+ **********************/
+
+#if LV_USE_OS != LV_OS_NONE
+#define MEM_LOCK() pthread_mutex_lock(&lock)
+#define MEM_UNLOCK() pthread_mutex_unlock(&lock)
+#else
+#define MEM_LOCK()
+#define MEM_UNLOCK()
+#endif
+
+#define ALIGN_UP(x) (((x) + HDR_SIZE - 1) & ~((size_t)HDR_SIZE - 1))
+#define HDR_OF(p) ((block_hdr_t *)((uint8_t *)(p) - HDR_SIZE))
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+void lv_mem_init(void)
+{
+    uint32_t i;
+
+    for (i = 0; i < POOL_CLASS_COUNT; i++) {
+        pools[i].block_size = 1U << (POOL_MIN_SHIFT + i);
+    }
+
+    arena_size = (size_t)atoi(getenv_default("LV_MEM_FRAME_ARENA_KB", "0")) * 1024;
+    if (arena_size == 0) {
+        arena_size = MEM_FRAME_ARENA_SIZE_KB * 1024;
+    }
+
+    warmup_frames = (uint32_t)atoi(getenv_default("LV_MEM_FRAME_WARMUP", "0"));
+    if (warmup_frames == 0) {
+        warmup_frames = MEM_FRAME_WARMUP_FRAMES;
+    }
+}
+
+void lv_mem_deinit(void)
+{
+    /* The pools and the arena are released with the process */
+}
+
+lv_mem_pool_t lv_mem_add_pool(void *mem, size_t bytes)
+{
+    LV_UNUSED(mem);
+    LV_UNUSED(bytes);
+    return NULL;
+}
+
+void lv_mem_remove_pool(lv_mem_pool_t pool)
+{
+    LV_UNUSED(pool);
+}
+
+void *lv_malloc_core(size_t size)
+{
+    void *p;
+
+    MEM_LOCK();
+    p = alloc_block(size);
+    MEM_UNLOCK();
+
+    return p;
+}
+
+void *lv_realloc_core(void *p, size_t new_size)
+{
+    block_hdr_t *hdr;
+    void *new_p;
+
+    if (p == NULL) {
+        return lv_malloc_core(new_size);
+    }
+
+    MEM_LOCK();
+
+    hdr = HDR_OF(p);
+
+    if (new_size <= block_capacity(hdr)) {
+        /* Fits in the existing block */
+        hdr->h.size = (uint32_t)new_size;
+        MEM_UNLOCK();
+        return p;
+    }
+
+    new_p = alloc_block(new_size);
+    if (new_p != NULL) {
+        memcpy(new_p, p, hdr->h.size);
+        free_block(p);
+    }
+
+    MEM_UNLOCK();
+    return new_p;
+}
+
+void lv_free_core(void *p)
+{
+    if (p == NULL) {
+        return;
+    }
+
+    MEM_LOCK();
+    free_block(p);
+    MEM_UNLOCK();
+}
+
+void lv_mem_monitor_core(lv_mem_monitor_t *mon_p)
+{
+    uint32_t i;
+    size_t total = 0;
+    size_t used = 0;
+
+    memset(mon_p, 0, sizeof(lv_mem_monitor_t));
+
+    MEM_LOCK();
+
+    for (i = 0; i < POOL_CLASS_COUNT; i++) {
+        total += (size_t)pools[i].total * pools[i].block_size;
+        used += (size_t)pools[i].used * pools[i].block_size;
+        mon_p->used_cnt += pools[i].used;
+        mon_p->free_cnt += pools[i].total - pools[i].used;
+    }
+
+    if (arena != NULL) {
+        total += arena->size;
+        used += arena->used;
+    }
+
+    MEM_UNLOCK();
+
+    mon_p->total_size = total;
+    mon_p->free_size = total - used;
+    mon_p->max_used = (uint32_t)max_used_size;
+    mon_p->used_pct = total > 0 ? (uint8_t)((used * 100) / total) : 0;
+}
+
+lv_result_t lv_mem_test_core(void)
+{
+    return LV_RESULT_OK;
+}
+
+void mem_frame_attach(lv_display_t *display)
+{
+    int report_sec;
+
+    lv_display_add_event_cb(display, refr_event_cb, LV_EVENT_REFR_START, NULL);
+    lv_display_add_event_cb(display, refr_event_cb, LV_EVENT_REFR_READY, NULL);
+
+    report_sec = atoi(getenv_default("LV_MEM_FRAME_REPORT", "0"));
+    if (report_sec > 0) {
+        lv_timer_create(report_timer_cb, (uint32_t)report_sec * 1000, NULL);
+    }
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+/**
+ * Allocate a block from the arena, a pool or the heap
+ *
+ * @param size the size to allocate
+ * @return the block or NULL
+ */
+static void *alloc_block(size_t size)
+{
+    void *p = NULL;
+
+    counters.calls++;
+
+    if (refr_depth > 0 && arena != NULL) {
+        p = arena_alloc(size);
+        if (p != NULL) {
+            counters.arena++;
+            return p;
+        }
+    }
+
+    if (size <= POOL_MAX_SIZE) {
+        p = pool_alloc(size);
+        if (p != NULL) {
+            counters.pool++;
+            return p;
+        }
+    }
+
+    counters.heap++;
+    return heap_alloc(size);
+}
+
+/**
+ * Return a block to where it comes from
+ *
+ * @param p the block
+ */
+static void free_block(void *p)
+{
+    block_hdr_t *hdr = HDR_OF(p);
+    pool_class_t *pc;
+    arena_t *a;
+    free_block_t *fb;
+
+    switch (hdr->h.kind) {
+    case BLOCK_POOL:
+        pc = hdr->h.owner;
+        fb = (free_block_t *)hdr;
+        fb->next = pc->free_list;
+        pc->free_list = fb;
+        pc->used--;
+        used_size -= pc->block_size;
+        break;
+    case BLOCK_ARENA:
+        a = hdr->h.owner;
+        a->live--;
+        if (a->retired && a->live == 0) {
+            free(a->base);
+            free(a);
+            retired_count--;
+        }
+        break;
+    default:
+        free(hdr);
+        break;
+    }
+}
+
+/**
+ * Get the number of bytes a block can hold
+ *
+ * @param hdr the header of the block
+ * @return the capacity
+ */
+static size_t block_capacity(const block_hdr_t *hdr)
+{
+    switch (hdr->h.kind) {
+    case BLOCK_POOL:
+        return ((const pool_class_t *)hdr->h.owner)->block_size;
+    case BLOCK_ARENA:
+        return ALIGN_UP(hdr->h.size);
+    default:
+        return hdr->h.size;
+    }
+}
+
+/**
+ * Bump allocate from the frame arena
+ *
+ * @param size the size to allocate
+ * @return the block or NULL if the arena is full
+ */
+static void *arena_alloc(size_t size)
+{
+    block_hdr_t *hdr;
+    size_t need = HDR_SIZE + ALIGN_UP(size);
+
+    if (arena->used + need > arena->size) {
+        return NULL;
+    }
+
+    hdr = (block_hdr_t *)(arena->base + arena->used);
+    hdr->h.owner = arena;
+    hdr->h.size = (uint32_t)size;
+    hdr->h.kind = BLOCK_ARENA;
+
+    arena->used += need;
+    arena->live++;
+    used_size += need;
+    if (used_size > max_used_size) {
+        max_used_size = used_size;
+    }
+
+    if (arena->used > arena->peak) {
+        arena->peak = arena->used;
+    }
+
+    return (uint8_t *)hdr + HDR_SIZE;
+}
+
+/**
+ * Create an arena
+ *
+ * @param size the size of the arena
+ * @return the arena or NULL
+ */
+static arena_t *arena_create(size_t size)
+{
+    arena_t *a;
+
+    a = calloc(1, sizeof(arena_t));
+    if (a == NULL) {
+        return NULL;
+    }
+
+    /* The headers keep the blocks aligned on HDR_SIZE */
+    if (posix_memalign((void **)&a->base, HDR_SIZE, ALIGN_UP(size)) != 0) {
+        free(a);
+        return NULL;
+    }
+
+    a->size = ALIGN_UP(size);
+    counters.sys += 2;
+    return a;
+}
+
+/**
+ * Rewind the arena at the end of a refresh
+ */
+static void arena_frame_end(void)
+{
+    if (arena == NULL) {
+        return;
+    }
+
+    /* A retired arena is not reported, like a rewound one */
+    used_size -= arena->used;
+
+    if (arena->live == 0) {
+        arena->used = 0;
+        return;
+    }
+
+    /* Some blocks outlive the frame - wait for them before releasing the arena */
+    arena->retired = true;
+    retired_count++;
+    arena = NULL;
+
+    if (retired_count > MEM_FRAME_MAX_RETIRED) {
+        LV_LOG_WARN("Too many long lived allocations in the frame arena - disabling it");
+        arena_disabled = true;
+        return;
+    }
+
+    arena = arena_create(arena_size);
+}
+
+/**
+ * Allocate from the smallest fitting pool class
+ *
+ * @param size the size to allocate
+ * @return the block or NULL
+ */
+static void *pool_alloc(size_t size)
+{
+    pool_class_t *pc;
+    block_hdr_t *hdr;
+    uint32_t i = 0;
+
+    while ((1U << (POOL_MIN_SHIFT + i)) < size) {
+        i++;
+    }
+
+    pc = &pools[i];
+
+    if (pc->free_list == NULL && !pool_grow(pc)) {
+        return NULL;
+    }
+
+    hdr = (block_hdr_t *)pc->free_list;
+    pc->free_list = pc->free_list->next;
+    pc->used++;
+    used_size += pc->block_size;
+    if (used_size > max_used_size) {
+        max_used_size = used_size;
+    }
+
+    hdr->h.owner = pc;
+    hdr->h.size = (uint32_t)size;
+    hdr->h.kind = BLOCK_POOL;
+
+    return (uint8_t *)hdr + HDR_SIZE;
+}
+
+/**
+ * Add a slab of blocks to a pool class
+ *
+ * @param pc the pool class
+ * @return true on success
+ */
+static bool pool_grow(pool_class_t *pc)
+{
+    size_t stride = HDR_SIZE + pc->block_size;
+    uint8_t *slab;
+    free_block_t *fb;
+    uint32_t i;
+
+    if (posix_memalign((void **)&slab, HDR_SIZE, stride * POOL_SLAB_BLOCKS) != 0) {
+        return false;
+    }
+
+    counters.sys++;
+
+    for (i = 0; i < POOL_SLAB_BLOCKS; i++) {
+        fb = (free_block_t *)(slab + i * stride);
+        fb->next = pc->free_list;
+        pc->free_list = fb;
+    }
+
+    pc->total += POOL_SLAB_BLOCKS;
+    return true;
+}
+
+/**
+ * Allocate a block with malloc
+ *
+ * @param size the size to allocate
+ * @return the block or NULL
+ */
+static void *heap_alloc(size_t size)
+{
+    block_hdr_t *hdr;
+
+    hdr = malloc(HDR_SIZE + size);
+    if (hdr == NULL) {
+        return NULL;
+    }
+
+    counters.sys++;
+
+    hdr->h.owner = NULL;
+    hdr->h.size = (uint32_t)size;
+    hdr->h.kind = BLOCK_HEAP;
+
+    return (uint8_t *)hdr + HDR_SIZE;
+}
+
+/**
+ * Track the refreshes of the display
+ *
+ * @param e the REFR_START or REFR_READY event
+ */
+static void refr_event_cb(lv_event_t *e)
+{
+    if (lv_event_get_code(e) == LV_EVENT_REFR_START) {
+        MEM_LOCK();
+        refr_depth++;
+        MEM_UNLOCK();
+        return;
+    }
+
+    MEM_LOCK();
+
+    if (refr_depth > 0) {
+        refr_depth--;
+    }
+
+    if (refr_depth == 0) {
+        arena_frame_end();
+    }
+
+    frame_count++;
+    report_frames++;
+
+    if (frame_count == warmup_frames && !arena_disabled) {
+        /* Start of the steady state */
+        arena = arena_create(arena_size);
+#if MEM_VERIFY
+        mem_verify_arm();
+#endif
+    }
+
+    MEM_UNLOCK();
+
+#if MEM_VERIFY
+    verify_allocs += mem_verify_take();
+#endif
+}
+
+/**
+ * Print the allocations per frame
+ *
+ * @param t the report timer
+ */
+static void report_timer_cb(lv_timer_t *t)
+{
+    alloc_counters_t c;
+    uint32_t frames;
+    size_t peak;
+
+    LV_UNUSED(t);
+
+    MEM_LOCK();
+    c = counters;
+    frames = report_frames > 0 ? report_frames : 1;
+    peak = arena != NULL ? arena->peak : 0;
+    memset(&counters, 0, sizeof(counters));
+    report_frames = 0;
+    MEM_UNLOCK();
+
+    /* With LV_STDLIB_CLIB every lv_malloc call is a call to malloc */
+    fprintf(stdout, "mem: %s frames=%u lv_malloc/frame=%.2f (arena=%.2f pool=%.2f heap=%.2f) "
+            "malloc/frame=%.2f (%.2f with clib) arena_peak=%zu retired=%u\n",
+            frame_count < warmup_frames ? "warm-up" : "steady", frames,
+            (double)c.calls / frames, (double)c.arena / frames,
+            (double)c.pool / frames, (double)c.heap / frames,
+            (double)c.sys / frames, (double)c.calls / frames, peak, retired_count);
+
+#if MEM_VERIFY
+    fprintf(stdout, "mem: intercepted malloc/frame=%.2f\n", (double)verify_allocs / frames);
+#endif
+    verify_allocs = 0;
+}
+
+#endif /*LV_USE_STDLIB_MALLOC == LV_STDLIB_CUSTOM*/
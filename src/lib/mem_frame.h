@@ -0,0 +1,60 @@
+/**
+ * @file mem_frame.h
+ *
+ * LVGL memory allocator for the steady-state frame loop
+ *
+ * Implements the LV_STDLIB_CUSTOM allocator interface:
+ * - allocations made while a display refreshes are served from a bump
+ *   arena which is rewound once the refresh is over
+ * - other small allocations come from fixed size pools
+ * - everything else is forwarded to malloc
+ *
+ */
+
+#ifndef MEM_FRAME_H
+#define MEM_FRAME_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/* Default size of the per-frame arena, override with LV_MEM_FRAME_ARENA_KB */
+#define MEM_FRAME_ARENA_SIZE_KB 256
+
+/* Frames rendered before the arena is used, override with LV_MEM_FRAME_WARMUP */
+#define MEM_FRAME_WARMUP_FRAMES 300
+
+/* Arenas kept alive by long lived allocations before the arena is disabled */
+#define MEM_FRAME_MAX_RETIRED 4
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+/**
+ * @description Follow the refreshes of a display to rewind the frame arena
+ * @param display the display
+ */
+void mem_frame_attach(lv_display_t *display);
+
+/**********************
+ *      MACROS
+ **********************/
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif /*MEM_FRAME_H*/
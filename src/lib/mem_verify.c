@@ -0,0 +1,159 @@
+/**
+ * @file mem_verify.c
+ *
+ * Detection of allocations in the steady-state frame loop
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <execinfo.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mem_verify.h"
+
+#if MEM_VERIFY
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define BACKTRACE_DEPTH 32
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *p, size_t size);
+void __real_free(void *p);
+int __real_posix_memalign(void **p, size_t alignment, size_t size);
+void *__real_aligned_alloc(size_t alignment, size_t size);
+
+static void check_alloc(const char *fn, size_t size);
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+static volatile bool armed;
+static bool abort_on_alloc;
+static pthread_t ui_thread;
+static volatile uint32_t alloc_count;
+static __thread bool in_check;
+
+/**********************
+ *      MACROS
+ **********************/
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+void mem_verify_arm(void)
+{
+    void *frames[1];
+    const char *mode = getenv("LV_MEM_VERIFY");
+
+    /* The first call to backtrace() loads libgcc and allocates */
+    backtrace(frames, 1);
+
+    abort_on_alloc = mode != NULL && strcmp(mode, "abort") == 0;
+
+    fprintf(stdout, "mem: steady state reached, checking allocations%s\n",
+            abort_on_alloc ? " (abort on first allocation)" : "");
+    fflush(stdout);
+
+    ui_thread = pthread_self();
+    alloc_count = 0;
+    armed = true;
+}
+
+uint32_t mem_verify_take(void)
+{
+    uint32_t count = alloc_count;
+
+    alloc_count = 0;
+    return count;
+}
+
+void *__wrap_malloc(size_t size)
+{
+    check_alloc("malloc", size);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+    check_alloc("calloc", nmemb * size);
+    return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *p, size_t size)
+{
+    check_alloc("realloc", size);
+    return __real_realloc(p, size);
+}
+
+int __wrap_posix_memalign(void **p, size_t alignment, size_t size)
+{
+    check_alloc("posix_memalign", size);
+    return __real_posix_memalign(p, alignment, size);
+}
+
+void *__wrap_aligned_alloc(size_t alignment, size_t size)
+{
+    check_alloc("aligned_alloc", size);
+    return __real_aligned_alloc(alignment, size);
+}
+
+void __wrap_free(void *p)
+{
+    __real_free(p);
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+/**
+ * Count an allocation made by the UI thread in the steady state
+ *
+ * @param fn the name of the allocation function
+ * @param size the requested size
+ */
+static void check_alloc(const char *fn, size_t size)
+{
+    void *frames[BACKTRACE_DEPTH];
+    int depth;
+
+    if (!armed || in_check || !pthread_equal(pthread_self(), ui_thread)) {
+        return;
+    }
+
+    alloc_count++;
+
+    if (!abort_on_alloc) {
+        return;
+    }
+
+    in_check = true;
+    fprintf(stderr, "mem: %s(%zu) in the steady-state frame loop\n", fn, size);
+    depth = backtrace(frames, BACKTRACE_DEPTH);
+    backtrace_symbols_fd(frames, depth, STDERR_FILENO);
+    abort();
+}
+
+#endif /*MEM_VERIFY*/
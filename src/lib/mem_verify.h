@@ -0,0 +1,63 @@
+/**
+ * @file mem_verify.h
+ *
+ * Detection of allocations in the steady-state frame loop
+ *
+ * When built with -DMEM_VERIFY=ON, the program is linked with
+ * --wrap=malloc,calloc,realloc,posix_memalign,aligned_alloc,free so that
+ * every allocation made by the application and LVGL, including the slabs
+ * and arenas of the custom allocator, goes through this module. Once
+ * armed, allocations made from the UI thread are counted, or abort the
+ * program when LV_MEM_VERIFY is set to "abort".
+ *
+ */
+
+#ifndef MEM_VERIFY_H
+#define MEM_VERIFY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stdint.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+#if MEM_VERIFY
+
+/**
+ * @description Start checking the allocations of the calling thread
+ * @note the calling thread is considered as the UI thread
+ */
+void mem_verify_arm(void);
+
+/**
+ * @description Get the number of intercepted allocations
+ * @return the allocations made since the previous call
+ */
+uint32_t mem_verify_take(void);
+
+#endif /*MEM_VERIFY*/
+
+/**********************
+ *      MACROS
+ **********************/
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif /*MEM_VERIFY_H*/
@@ -0,0 +1,200 @@
+/**
+ * @file perf_stats.c
+ *
+ * Lightweight timing helpers and log2 histograms
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "perf_stats.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/* Width of the widest bar printed by perf_hist_print */
+#define BAR_WIDTH 40
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static uint32_t bucket_index(uint32_t value);
+static uint32_t bucket_upper(uint32_t index);
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+static bool virtual_clock;
+static uint64_t virtual_ns;
+
+/**********************
+ *      MACROS
+ **********************/
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+uint64_t perf_time_ns(void)
+{
+    struct timespec ts;
+
+    if (virtual_clock) {
+        return virtual_ns;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void perf_time_set_virtual(uint64_t start_ns)
+{
+    virtual_clock = true;
+    virtual_ns = start_ns;
+}
+
+void perf_time_advance(uint64_t ns)
+{
+    virtual_ns += ns;
+}
+
+void perf_hist_reset(perf_hist_t *hist)
+{
+    memset(hist, 0, sizeof(*hist));
+    hist->min = UINT32_MAX;
+}
+
+void perf_hist_add(perf_hist_t *hist, uint32_t value)
+{
+    hist->bucket[bucket_index(value)]++;
+    hist->count++;
+    hist->sum += value;
+
+    if (value < hist->min) {
+        hist->min = value;
+    }
+
+    if (value > hist->max) {
+        hist->max = value;
+    }
+}
+
+uint32_t perf_hist_percentile(const perf_hist_t *hist, uint32_t pct)
+{
+    uint64_t target;
+    uint64_t seen;
+    uint32_t i;
+    uint32_t upper;
+
+    if (hist->count == 0) {
+        return 0;
+    }
+
+    target = (hist->count * pct + 99) / 100;
+    seen = 0;
+
+    for (i = 0; i < PERF_HIST_BUCKETS; i++) {
+        seen += hist->bucket[i];
+        if (seen >= target && seen > 0) {
+            break;
+        }
+    }
+
+    upper = bucket_upper(i < PERF_HIST_BUCKETS ? i : PERF_HIST_BUCKETS - 1);
+    return upper < hist->max ? upper : hist->max;
+}
+
+void perf_hist_print(const perf_hist_t *hist, const char *name, const char *unit)
+{
+    uint32_t i;
+    uint32_t peak;
+    uint32_t len;
+    char bar[BAR_WIDTH + 1];
+
+    if (hist->count == 0) {
+        fprintf(stdout, "%s (%s): no samples\n", name, unit);
+        return;
+    }
+
+    fprintf(stdout, "%s (%s): n=%llu min=%u avg=%llu p50<=%u p90<=%u p99<=%u max=%u\n",
+            name, unit, (unsigned long long)hist->count, hist->min,
+            (unsigned long long)(hist->sum / hist->count),
+            perf_hist_percentile(hist, 50), perf_hist_percentile(hist, 90),
+            perf_hist_percentile(hist, 99), hist->max);
+
+    peak = 0;
+    for (i = 0; i < PERF_HIST_BUCKETS; i++) {
+        if (hist->bucket[i] > peak) {
+            peak = hist->bucket[i];
+        }
+    }
+
+    for (i = 0; i < PERF_HIST_BUCKETS; i++) {
+        if (hist->bucket[i] == 0) {
+            continue;
+        }
+
+        len = (uint32_t)(((uint64_t)hist->bucket[i] * BAR_WIDTH + peak - 1) / peak);
+        memset(bar, '#', len);
+        bar[len] = '\0';
+
+        fprintf(stdout, "  [%10u, %10u] %-*s %u\n",
+                i == 0 ? 0 : bucket_upper(i - 1) + 1, bucket_upper(i),
+                BAR_WIDTH, bar, hist->bucket[i]);
+    }
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+/**
+ * Find the bucket of a value
+ *
+ * @param value the sample
+ * @return the index of the bucket
+ */
+static uint32_t bucket_index(uint32_t value)
+{
+    uint32_t index;
+
+    if (value == 0) {
+        return 0;
+    }
+
+    index = 32 - (uint32_t)__builtin_clz(value);
+    return index < PERF_HIST_BUCKETS ? index : PERF_HIST_BUCKETS - 1;
+}
+
+/**
+ * Get the largest value that falls into a bucket
+ *
+ * @param index the index of the bucket
+ * @return the inclusive upper bound
+ */
+static uint32_t bucket_upper(uint32_t index)
+{
+    if (index == 0) {
+        return 0;
+    }
+
+    /* The last bucket also collects everything above its range */
+    if (index >= PERF_HIST_BUCKETS - 1) {
+        return UINT32_MAX;
+    }
+
+    return (1U << index) - 1;
+}
@@ -0,0 +1,100 @@
+/**
+ * @file perf_stats.h
+ *
+ * Lightweight timing helpers and log2 histograms used to report
+ * latencies and per-frame costs of the backends
+ *
+ */
+
+#ifndef PERF_STATS_H
+#define PERF_STATS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stdint.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/* Bucket 0 counts zero values, bucket i counts values in [2^(i-1), 2^i) */
+#define PERF_HIST_BUCKETS 32
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+typedef struct {
+    uint32_t bucket[PERF_HIST_BUCKETS];
+    uint64_t count;
+    uint64_t sum;
+    uint32_t min;
+    uint32_t max;
+} perf_hist_t;
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+/**
+ * @description Read the monotonic clock
+ * @return the current CLOCK_MONOTONIC time in nanoseconds, or the virtual time
+ */
+uint64_t perf_time_ns(void);
+
+/**
+ * @description Replace the monotonic clock by a virtual clock, only advanced by
+ *              perf_time_advance(), to make the animations of a run reproducible
+ * @param start_ns the initial time of the virtual clock
+ */
+void perf_time_set_virtual(uint64_t start_ns);
+
+/**
+ * @description Advance the virtual clock
+ * @param ns the time to add in nanoseconds
+ */
+void perf_time_advance(uint64_t ns);
+
+/**
+ * @description Clear all the samples of a histogram
+ * @param hist the histogram to reset
+ */
+void perf_hist_reset(perf_hist_t *hist);
+
+/**
+ * @description Add a sample to a histogram
+ * @param hist the histogram
+ * @param value the sample, the unit is chosen by the caller
+ */
+void perf_hist_add(perf_hist_t *hist, uint32_t value);
+
+/**
+ * @description Estimate a percentile of the recorded samples
+ * @param hist the histogram
+ * @param pct the percentile to compute, 0 - 100
+ * @return upper bound of the bucket containing the percentile
+ */
+uint32_t perf_hist_percentile(const perf_hist_t *hist, uint32_t pct);
+
+/**
+ * @description Print a summary line and the non empty buckets on stdout
+ * @param hist the histogram
+ * @param name the name of the measured quantity
+ * @param unit the unit of the samples e.g "us"
+ */
+void perf_hist_print(const perf_hist_t *hist, const char *name, const char *unit);
+
+/**********************
+ *      MACROS
+ **********************/
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif /*PERF_STATS_H*/
@@ -0,0 +1,310 @@
+/**
+ * @file px_convert.c
+ *
+ * Pixel format of the scanout buffers and row converters
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stdint.h>
+
+#include "lvgl/lvgl.h"
+
+#include "px_convert.h"
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static void rgb565_swap(uint8_t *dst, const uint8_t *src, uint32_t px_cnt);
+static void rgb565_to_bgr565(uint8_t *dst, const uint8_t *src, uint32_t px_cnt);
+static void xrgb8888_to_xbgr8888(uint8_t *dst, const uint8_t *src, uint32_t px_cnt);
+static void rgb565_to_xrgb8888(uint8_t *dst, const uint8_t *src, uint32_t px_cnt);
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+static const char *const format_names[] = {
+    [PX_FORMAT_UNKNOWN] = "unknown",
+    [PX_FORMAT_RGB565] = "RGB565",
+    [PX_FORMAT_RGB565_SWAPPED] = "RGB565 swapped",
+    [PX_FORMAT_BGR565] = "BGR565",
+    [PX_FORMAT_RGB888] = "RGB888",
+    [PX_FORMAT_XRGB8888] = "XRGB8888",
+    [PX_FORMAT_XBGR8888] = "XBGR8888",
+};
+
+/**********************
+ *      MACROS
+ **********************/
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+const char *px_format_name(px_format_t format)
+{
+    return format_names[format];
+}
+
+uint32_t px_format_get_size(px_format_t format)
+{
+    switch (format) {
+    case PX_FORMAT_RGB565:
+    case PX_FORMAT_RGB565_SWAPPED:
+    case PX_FORMAT_BGR565:
+        return 2;
+    case PX_FORMAT_RGB888:
+        return 3;
+    case PX_FORMAT_XRGB8888:
+    case PX_FORMAT_XBGR8888:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+lv_color_format_t px_format_to_color_format(px_format_t format)
+{
+    switch (format) {
+    case PX_FORMAT_RGB565:
+        return LV_COLOR_FORMAT_RGB565;
+    case PX_FORMAT_RGB888:
+        return LV_COLOR_FORMAT_RGB888;
+    case PX_FORMAT_XRGB8888:
+        return LV_COLOR_FORMAT_XRGB8888;
+    default:
+        return LV_COLOR_FORMAT_UNKNOWN;
+    }
+}
+
+lv_color_format_t px_format_get_render_format(px_format_t format)
+{
+    switch (format) {
+    case PX_FORMAT_RGB565:
+    case PX_FORMAT_RGB565_SWAPPED:
+    case PX_FORMAT_BGR565:
+        return LV_COLOR_FORMAT_RGB565;
+    case PX_FORMAT_XRGB8888:
+    case PX_FORMAT_XBGR8888:
+        return LV_COLOR_FORMAT_XRGB8888;
+    default:
+        return LV_COLOR_FORMAT_UNKNOWN;
+    }
+}
+
+px_convert_fn_t px_convert_find(lv_color_format_t cf, px_format_t format)
+{
+    if (cf == LV_COLOR_FORMAT_RGB565) {
+        switch (format) {
+        case PX_FORMAT_RGB565_SWAPPED:
+            return rgb565_swap;
+        case PX_FORMAT_BGR565:
+            return rgb565_to_bgr565;
+        case PX_FORMAT_XRGB8888:
+            return rgb565_to_xrgb8888;
+        default:
+            return NULL;
+        }
+    }
+
+    if (cf == LV_COLOR_FORMAT_XRGB8888 && format == PX_FORMAT_XBGR8888) {
+        return xrgb8888_to_xbgr8888;
+    }
+
+    return NULL;
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+/**
+ * Swap the bytes of RGB565 pixels
+ *
+ * @param dst the destination row
+ * @param src the source row
+ * @param px_cnt the number of pixels
+ */
+static void rgb565_swap(uint8_t *dst, const uint8_t *src, uint32_t px_cnt)
+{
+    const uint16_t *s = (const uint16_t *)src;
+    uint16_t *d = (uint16_t *)dst;
+    uint32_t i = 0;
+
+#if defined(__ARM_NEON)
+    for (; i + 8 <= px_cnt; i += 8) {
+        vst1q_u8((uint8_t *)&d[i], vrev16q_u8(vld1q_u8((const uint8_t *)&s[i])));
+    }
+#elif defined(__SSE2__)
+    for (; i + 8 <= px_cnt; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)&s[i]);
+        _mm_storeu_si128((__m128i *)&d[i], _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+    }
+#endif
+
+    for (; i < px_cnt; i++) {
+        d[i] = (uint16_t)((s[i] << 8) | (s[i] >> 8));
+    }
+}
+
+/**
+ * Exchange the red and blue channels of RGB565 pixels
+ *
+ * @param dst the destination row
+ * @param src the source row
+ * @param px_cnt the number of pixels
+ */
+static void rgb565_to_bgr565(uint8_t *dst, const uint8_t *src, uint32_t px_cnt)
+{
+    const uint16_t *s = (const uint16_t *)src;
+    uint16_t *d = (uint16_t *)dst;
+    uint32_t i = 0;
+
+#if defined(__ARM_NEON)
+    const uint16x8_t g_mask = vdupq_n_u16(0x07e0);
+
+    for (; i + 8 <= px_cnt; i += 8) {
+        uint16x8_t v = vld1q_u16(&s[i]);
+        vst1q_u16(&d[i], vorrq_u16(vorrq_u16(vshlq_n_u16(v, 11), vshrq_n_u16(v, 11)), vandq_u16(v, g_mask)));
+    }
+#elif defined(__SSE2__)
+    const __m128i g_mask = _mm_set1_epi16(0x07e0);
+
+    for (; i + 8 <= px_cnt; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)&s[i]);
+        __m128i rb = _mm_or_si128(_mm_slli_epi16(v, 11), _mm_srli_epi16(v, 11));
+        _mm_storeu_si128((__m128i *)&d[i], _mm_or_si128(rb, _mm_and_si128(v, g_mask)));
+    }
+#endif
+
+    for (; i < px_cnt; i++) {
+        d[i] = (uint16_t)((s[i] << 11) | (s[i] >> 11) | (s[i] & 0x07e0));
+    }
+}
+
+/**
+ * Exchange the red and blue channels of XRGB8888 pixels
+ *
+ * @param dst the destination row
+ * @param src the source row
+ * @param px_cnt the number of pixels
+ */
+static void xrgb8888_to_xbgr8888(uint8_t *dst, const uint8_t *src, uint32_t px_cnt)
+{
+    const uint32_t *s = (const uint32_t *)src;
+    uint32_t *d = (uint32_t *)dst;
+    uint32_t i = 0;
+    uint32_t rb;
+
+#if defined(__ARM_NEON)
+    for (; i + 16 <= px_cnt; i += 16) {
+        uint8x16x4_t v = vld4q_u8((const uint8_t *)&s[i]);
+        uint8x16_t b = v.val[0];
+        v.val[0] = v.val[2];
+        v.val[2] = b;
+        vst4q_u8((uint8_t *)&d[i], v);
+    }
+#elif defined(__SSE2__)
+    const __m128i rb_mask = _mm_set1_epi32(0x00ff00ff);
+
+    for (; i + 4 <= px_cnt; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)&s[i]);
+        __m128i rb_v = _mm_and_si128(v, rb_mask);
+        __m128i ga_v = _mm_andnot_si128(rb_mask, v);
+        rb_v = _mm_or_si128(_mm_slli_epi32(rb_v, 16), _mm_srli_epi32(rb_v, 16));
+        _mm_storeu_si128((__m128i *)&d[i], _mm_or_si128(rb_v, ga_v));
+    }
+#endif
+
+    for (; i < px_cnt; i++) {
+        rb = s[i] & 0x00ff00ff;
+        d[i] = (s[i] & 0xff00ff00) | (rb << 16) | (rb >> 16);
+    }
+}
+
+/**
+ * Expand RGB565 pixels to XRGB8888, the high bits are replicated in the
+ * low bits so that white stays white
+ *
+ * @param dst the destination row
+ * @param src the source row
+ * @param px_cnt the number of pixels
+ */
+static void rgb565_to_xrgb8888(uint8_t *dst, const uint8_t *src, uint32_t px_cnt)
+{
+    const uint16_t *s = (const uint16_t *)src;
+    uint32_t *d = (uint32_t *)dst;
+    uint32_t i = 0;
+    uint32_t r;
+    uint32_t g;
+    uint32_t b;
+
+#if defined(__ARM_NEON)
+    for (; i + 8 <= px_cnt; i += 8) {
+        uint16x8_t v = vld1q_u16(&s[i]);
+        uint8x8_t r8 = vand_u8(vshrn_n_u16(v, 8), vdup_n_u8(0xf8));
+        uint8x8_t g8 = vand_u8(vshrn_n_u16(v, 3), vdup_n_u8(0xfc));
+        uint8x8_t b8 = vmovn_u16(vshlq_n_u16(v, 3));
+        uint8x8x4_t out;
+
+        out.val[0] = vorr_u8(b8, vshr_n_u8(b8, 5));
+        out.val[1] = vorr_u8(g8, vshr_n_u8(g8, 6));
+        out.val[2] = vorr_u8(r8, vshr_n_u8(r8, 5));
+        out.val[3] = vdup_n_u8(0xff);
+        vst4_u8((uint8_t *)&d[i], out);
+    }
+#elif defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha = _mm_set1_epi32((int)0xff000000);
+    const __m128i r_hi = _mm_set1_epi32(0xf8);
+    const __m128i r_lo = _mm_set1_epi32(0x07);
+    const __m128i g_hi = _mm_set1_epi32(0xfc);
+    const __m128i g_lo = _mm_set1_epi32(0x03);
+    __m128i v16;
+    __m128i v;
+    __m128i r_v;
+    __m128i g_v;
+    __m128i b_v;
+    int half;
+
+    for (; i + 8 <= px_cnt; i += 8) {
+        v16 = _mm_loadu_si128((const __m128i *)&s[i]);
+
+        for (half = 0; half < 2; half++) {
+            v = half == 0 ? _mm_unpacklo_epi16(v16, zero) : _mm_unpackhi_epi16(v16, zero);
+
+            r_v = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(v, 8), r_hi), _mm_and_si128(_mm_srli_epi32(v, 13), r_lo));
+            g_v = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(v, 3), g_hi), _mm_and_si128(_mm_srli_epi32(v, 9), g_lo));
+            b_v = _mm_or_si128(_mm_and_si128(_mm_slli_epi32(v, 3), r_hi), _mm_and_si128(_mm_srli_epi32(v, 2), r_lo));
+
+            v = _mm_or_si128(_mm_or_si128(alpha, _mm_slli_epi32(r_v, 16)), _mm_or_si128(_mm_slli_epi32(g_v, 8), b_v));
+            _mm_storeu_si128((__m128i *)&d[i + half * 4], v);
+        }
+    }
+#endif
+
+    for (; i < px_cnt; i++) {
+        r = ((s[i] >> 8) & 0xf8) | ((s[i] >> 13) & 0x07);
+        g = ((s[i] >> 3) & 0xfc) | ((s[i] >> 9) & 0x03);
+        b = ((s[i] << 3) & 0xf8) | ((s[i] >> 2) & 0x07);
+        d[i] = 0xff000000 | (r << 16) | (g << 8) | b;
+    }
+}
@@ -0,0 +1,100 @@
+/**
+ * @file px_convert.h
+ *
+ * Pixel format of the scanout buffers and row converters
+ *
+ * The converters write a row of pixels rendered by LVGL in the format of
+ * the scanout buffer. They are vectorized with NEON or SSE2 when the
+ * compiler targets them, with a scalar loop for the remaining pixels.
+ *
+ */
+
+#ifndef PX_CONVERT_H
+#define PX_CONVERT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stdint.h>
+
+#include "lvgl/lvgl.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+typedef enum {
+    PX_FORMAT_UNKNOWN,
+    PX_FORMAT_RGB565,
+    PX_FORMAT_RGB565_SWAPPED,   /* Big endian RGB565, e.g. sent as is to an SPI panel */
+    PX_FORMAT_BGR565,
+    PX_FORMAT_RGB888,
+    PX_FORMAT_XRGB8888,
+    PX_FORMAT_XBGR8888,
+} px_format_t;
+
+/**
+ * Convert a row of pixels
+ * @param dst the first pixel in the scanout buffer
+ * @param src the first pixel rendered by LVGL
+ * @param px_cnt the number of pixels
+ */
+typedef void (*px_convert_fn_t)(uint8_t *dst, const uint8_t *src, uint32_t px_cnt);
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+/**
+ * @description Get the name of a format
+ * @param format the format
+ * @return the name e.g "XRGB8888"
+ */
+const char *px_format_name(px_format_t format);
+
+/**
+ * @description Get the size of a pixel
+ * @param format the format
+ * @return the number of bytes per pixel, 0 for PX_FORMAT_UNKNOWN
+ */
+uint32_t px_format_get_size(px_format_t format);
+
+/**
+ * @description Get the LVGL color format rendering directly in a format
+ * @param format the format of the scanout buffer
+ * @return the color format, LV_COLOR_FORMAT_UNKNOWN if LVGL cannot render it
+ */
+lv_color_format_t px_format_to_color_format(px_format_t format);
+
+/**
+ * @description Get the LVGL color format to render in before converting to a format
+ * @param format the format of the scanout buffer
+ * @return the color format with the same depth, LV_COLOR_FORMAT_UNKNOWN if there is no converter
+ */
+lv_color_format_t px_format_get_render_format(px_format_t format);
+
+/**
+ * @description Find the converter between a rendered and a scanout format
+ * @param cf the color format rendered by LVGL
+ * @param format the format of the scanout buffer
+ * @return the converter, NULL if there is none
+ */
+px_convert_fn_t px_convert_find(lv_color_format_t cf, px_format_t format);
+
+/**********************
+ *      MACROS
+ **********************/
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif /*PX_CONVERT_H*/
@@ -0,0 +1,371 @@
+/**
+ * @file rt_profile.c
+ *
+ * Real-time runtime profile
+ *
+ * The malloc trimming and mmap thresholds are disabled before the memory
+ * is locked, so the heap faulted in at startup is reused instead of being
+ * returned to the kernel and mapped again. mlockall(MCL_FUTURE) also
+ * locks what is mapped later, e.g. the images decoded into the cache
+ * during the first frames. The draw buffers are written page by page
+ * since device memory mapped by the display driver is not populated by
+ * mlockall().
+ *
+ * The page faults and involuntary context switches of the process are
+ * read at the start of each frame, the difference is the cost of the
+ * previous frame interval. The preemptions of the UI thread are counted
+ * separately.
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#define _GNU_SOURCE
+#include <errno.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include "lvgl/lvgl.h"
+#include "lvgl/src/display/lv_display_private.h"
+
+#include "simulator_util.h"
+#include "perf_stats.h"
+#include "driver_backends.h"
+#include "rt_profile.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+typedef struct {
+    long minflt;
+    long majflt;
+    long nivcsw;
+    long ui_nivcsw;
+} rt_counters_t;
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static bool set_affinity(const char *cpus);
+static size_t touch_pages(uint8_t *data, size_t size);
+static size_t prefault_heap(size_t size);
+static size_t prefault_draw_buf(lv_draw_buf_t *buf);
+static void prefault_stack(size_t size) __attribute__((noinline));
+static void read_counters(rt_counters_t *counters);
+static void refr_start_cb(lv_event_t *e);
+static void report_timer_cb(lv_timer_t *timer);
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+static int enabled = -1;
+static rt_counters_t last;
+static perf_hist_t minor_faults;
+static perf_hist_t major_faults;
+static perf_hist_t switches;
+static perf_hist_t ui_switches;
+static uint32_t faulting_frames;
+static uint32_t preempted_frames;
+
+/**********************
+ *      MACROS
+ **********************/
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+bool rt_profile_is_enabled(void)
+{
+    if (enabled < 0) {
+        enabled = atoi(getenv_default("LV_RT_PROFILE", "0")) != 0;
+    }
+
+    return enabled;
+}
+
+void rt_profile_thread(const char *role)
+{
+    struct sched_param param;
+    const char *cpus;
+    char name[32];
+    int prio;
+    int ret;
+
+    if (!rt_profile_is_enabled()) {
+        return;
+    }
+
+    snprintf(name, sizeof(name), "LV_RT_%s_CPU", role);
+    cpus = getenv(name);
+    if (cpus != NULL && !set_affinity(cpus)) {
+        fprintf(stderr, "rt: unable to pin the %s thread to CPU %s\n", role, cpus);
+    }
+
+    snprintf(name, sizeof(name), "LV_RT_%s_PRIO", role);
+    prio = atoi(getenv_default(name, "0"));
+    if (prio > 0) {
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = prio;
+        ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (ret != 0) {
+            fprintf(stderr, "rt: unable to set SCHED_FIFO %d on the %s thread: %s\n", prio, role, strerror(ret));
+            prio = 0;
+        }
+    }
+
+    fprintf(stdout, "rt: %s thread on CPU %s, %s %d\n", role, cpus != NULL ? cpus : "any",
+            prio > 0 ? "SCHED_FIFO" : "SCHED_OTHER", prio);
+}
+
+void rt_profile_apply(void)
+{
+    lv_display_t *display;
+    size_t heap_size;
+    size_t stack_size;
+    size_t buf_size = 0;
+    int report_sec;
+    int i;
+
+    if (!rt_profile_is_enabled()) {
+        return;
+    }
+
+    rt_profile_thread("UI");
+
+    /* Keep the freed memory in the heap, it stays locked and faulted in */
+    mallopt(M_MMAP_MAX, 0);
+    mallopt(M_TRIM_THRESHOLD, -1);
+
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        fprintf(stderr, "rt: mlockall failed: %s, check RLIMIT_MEMLOCK\n", strerror(errno));
+    }
+
+    heap_size = prefault_heap((size_t)atoi(getenv_default("LV_RT_HEAP_KB", "0")) * 1024);
+
+    for (i = 0; i < driver_backends_get_display_count(); i++) {
+        display = driver_backends_get_display(i);
+        buf_size += prefault_draw_buf(display->buf_1);
+        buf_size += prefault_draw_buf(display->buf_2);
+    }
+
+    stack_size = (size_t)atoi(getenv_default("LV_RT_STACK_KB", "0")) * 1024;
+    if (stack_size == 0) {
+        stack_size = RT_PROFILE_STACK_KB * 1024;
+    }
+    prefault_stack(stack_size);
+
+    fprintf(stdout, "rt: memory locked, %zu KB of heap, %zu KB of draw buffers and %zu KB of stack faulted in\n",
+            heap_size / 1024, buf_size / 1024, stack_size / 1024);
+
+    perf_hist_reset(&minor_faults);
+    perf_hist_reset(&major_faults);
+    perf_hist_reset(&switches);
+    perf_hist_reset(&ui_switches);
+    read_counters(&last);
+
+    lv_display_add_event_cb(lv_display_get_default(), refr_start_cb, LV_EVENT_REFR_START, NULL);
+
+    report_sec = atoi(getenv_default("LV_RT_REPORT", "10"));
+    if (report_sec > 0) {
+        lv_timer_create(report_timer_cb, (uint32_t)report_sec * 1000, NULL);
+    }
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+/**
+ * Pin the calling thread
+ *
+ * @param cpus comma separated list of CPU numbers
+ * @return true on success
+ */
+static bool set_affinity(const char *cpus)
+{
+    cpu_set_t set;
+    const char *p = cpus;
+    char *end;
+    long cpu;
+
+    CPU_ZERO(&set);
+
+    while (*p != '\0') {
+        cpu = strtol(p, &end, 10);
+        if (end == p || cpu < 0 || cpu >= CPU_SETSIZE) {
+            return false;
+        }
+        CPU_SET((int)cpu, &set);
+        p = *end == ',' ? end + 1 : end;
+    }
+
+    return CPU_COUNT(&set) > 0 && pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+/**
+ * Fault in a memory range by writing back the first byte of each page
+ *
+ * @param data start of the range
+ * @param size size of the range in bytes
+ * @return the size
+ */
+static size_t touch_pages(uint8_t *data, size_t size)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    volatile uint8_t *p;
+    size_t off;
+
+    for (off = 0; off < size; off += page) {
+        p = data + off;
+        *p = *p;
+    }
+
+    return size;
+}
+
+/**
+ * Grow the heap and fault it in, the trimming is disabled so it is kept
+ *
+ * @param size the size to reserve, 0 for RT_PROFILE_HEAP_KB
+ * @return the size faulted in
+ */
+static size_t prefault_heap(size_t size)
+{
+    uint8_t *block;
+
+    if (size == 0) {
+        size = RT_PROFILE_HEAP_KB * 1024;
+    }
+
+    block = malloc(size);
+    if (block == NULL) {
+        fprintf(stderr, "rt: unable to reserve %zu KB of heap\n", size / 1024);
+        return 0;
+    }
+
+    touch_pages(block, size);
+    free(block);
+
+    return size;
+}
+
+/**
+ * Fault in a draw buffer
+ *
+ * @param buf the draw buffer, can be NULL
+ * @return the size faulted in
+ */
+static size_t prefault_draw_buf(lv_draw_buf_t *buf)
+{
+    if (buf == NULL || buf->data == NULL) {
+        return 0;
+    }
+
+    return touch_pages(buf->data, buf->data_size);
+}
+
+/**
+ * Fault in the stack of the calling thread below the current frame
+ *
+ * @param size the size of the stack to fault in
+ */
+static void prefault_stack(size_t size)
+{
+    volatile uint8_t stack[size];
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t off;
+
+    for (off = 0; off < size; off += page) {
+        stack[off] = 0;
+    }
+
+    LV_UNUSED(stack);
+}
+
+/**
+ * Read the page faults and context switches
+ *
+ * @param counters the counters of the process and of the UI thread
+ */
+static void read_counters(rt_counters_t *counters)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    counters->minflt = ru.ru_minflt;
+    counters->majflt = ru.ru_majflt;
+    counters->nivcsw = ru.ru_nivcsw;
+
+    getrusage(RUSAGE_THREAD, &ru);
+    counters->ui_nivcsw = ru.ru_nivcsw;
+}
+
+/**
+ * Record the faults and preemptions of the last frame interval
+ *
+ * @param e the refresh start event
+ */
+static void refr_start_cb(lv_event_t *e)
+{
+    rt_counters_t now;
+
+    LV_UNUSED(e);
+
+    read_counters(&now);
+
+    perf_hist_add(&minor_faults, (uint32_t)(now.minflt - last.minflt));
+    perf_hist_add(&major_faults, (uint32_t)(now.majflt - last.majflt));
+    perf_hist_add(&switches, (uint32_t)(now.nivcsw - last.nivcsw));
+    perf_hist_add(&ui_switches, (uint32_t)(now.ui_nivcsw - last.ui_nivcsw));
+
+    if (now.minflt != last.minflt || now.majflt != last.majflt) {
+        faulting_frames++;
+    }
+    if (now.ui_nivcsw != last.ui_nivcsw) {
+        preempted_frames++;
+    }
+
+    last = now;
+}
+
+/**
+ * Print and reset the counters per frame
+ *
+ * @param timer the report timer
+ */
+static void report_timer_cb(lv_timer_t *timer)
+{
+    LV_UNUSED(timer);
+
+    fprintf(stdout, "rt: %llu frames, %u with page faults, %u with the UI thread preempted\n",
+            (unsigned long long)minor_faults.count, faulting_frames, preempted_frames);
+    perf_hist_print(&minor_faults, "minor faults/frame", "");
+    perf_hist_print(&major_faults, "major faults/frame", "");
+    perf_hist_print(&switches, "involuntary switches/frame", "");
+    perf_hist_print(&ui_switches, "UI thread preemptions/frame", "");
+
+    perf_hist_reset(&minor_faults);
+    perf_hist_reset(&major_faults);
+    perf_hist_reset(&switches);
+    perf_hist_reset(&ui_switches);
+    faulting_frames = 0;
+    preempted_frames = 0;
+}
@@ -0,0 +1,75 @@
+/**
+ * @file rt_profile.h
+ *
+ * Real-time runtime profile
+ *
+ * With LV_RT_PROFILE=1 the threads are pinned to the cores and given the
+ * SCHED_FIFO priorities of their role (LV_RT_<ROLE>_CPU and
+ * LV_RT_<ROLE>_PRIO), the memory of the process is locked, the heap, the
+ * draw buffers and the stack of the UI thread are faulted in before the
+ * first frame, and the page faults and involuntary context switches of
+ * each frame are reported.
+ *
+ */
+
+#ifndef RT_PROFILE_H
+#define RT_PROFILE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stdbool.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/* Default stack of the UI thread faulted in, override with LV_RT_STACK_KB */
+#define RT_PROFILE_STACK_KB 256
+
+/* Default heap faulted in and kept, override with LV_RT_HEAP_KB */
+#define RT_PROFILE_HEAP_KB 8192
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+/**
+ * @description Check if LV_RT_PROFILE is set
+ * @return true if the real-time profile is applied
+ */
+bool rt_profile_is_enabled(void);
+
+/**
+ * @description Pin the calling thread and set its priority from LV_RT_<role>_CPU
+ *              and LV_RT_<role>_PRIO when LV_RT_PROFILE is set
+ * @param role the role of the thread in upper case, e.g "FLUSH"
+ * @note call it at the start of the thread
+ */
+void rt_profile_thread(const char *role);
+
+/**
+ * @description Apply the profile to the UI thread and the process when LV_RT_PROFILE
+ *              is set: role UI, locked memory, heap, draw buffers and stack faulted in,
+ *              per frame report every LV_RT_REPORT seconds
+ * @note call it from the UI thread once the displays are created, before the run loop
+ */
+void rt_profile_apply(void);
+
+/**********************
+ *      MACROS
+ **********************/
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif /*RT_PROFILE_H*/
@@ -0,0 +1,339 @@
+/**
+ * @file startup_stats.c
+ *
+ * Startup cost report
+ *
+ * The counters are opened from a constructor so that the loading of the
+ * binary, lv_init() and the backend initialisation are all included. The
+ * major page faults and the block I/O delay show how much of the startup
+ * is spent paging in the binary and its assets. The shared objects mapped
+ * and the resident memory compare the builds with linked in and loadable
+ * backends.
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#define _GNU_SOURCE
+#include <link.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "lvgl/lvgl.h"
+
+#include "simulator_util.h"
+#include "perf_stats.h"
+#include "driver_backends.h"
+#include "startup_stats.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define COUNTER_ICACHE_MISSES 0
+#define COUNTER_INSTRUCTIONS 1
+#define COUNTER_COUNT 2
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static void open_counters(void) __attribute__((constructor));
+static int open_counter(uint32_t type, uint64_t config);
+static uint64_t read_counter(int index);
+static void read_proc_stat(double *since_exec_ms, unsigned long long *blkio_ticks);
+static long read_status_kb(const char *key);
+static int count_object_cb(struct dl_phdr_info *info, size_t size, void *data);
+static void print_memory(void);
+static void refr_event_cb(lv_event_t *e);
+static void print_first_frame(void);
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+static int counter_fds[COUNTER_COUNT] = { -1, -1 };
+static uint64_t start_ns;
+static uint64_t frame_start[COUNTER_COUNT];
+static uint32_t frames;
+static perf_hist_t icache_misses;
+static perf_hist_t instructions;
+
+/**********************
+ *      MACROS
+ **********************/
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+void startup_stats_attach(lv_display_t *display)
+{
+    if (start_ns == 0) {
+        return;
+    }
+
+    perf_hist_reset(&icache_misses);
+    perf_hist_reset(&instructions);
+
+    lv_display_add_event_cb(display, refr_event_cb, LV_EVENT_REFR_START, NULL);
+    lv_display_add_event_cb(display, refr_event_cb, LV_EVENT_REFR_READY, NULL);
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+/**
+ * Start counting before main() when the report is enabled
+ */
+static void open_counters(void)
+{
+    if (atoi(getenv_default("LV_STARTUP_REPORT", "0")) == 0) {
+        return;
+    }
+
+    start_ns = perf_time_ns();
+
+    counter_fds[COUNTER_ICACHE_MISSES] = open_counter(PERF_TYPE_HW_CACHE,
+                                                      PERF_COUNT_HW_CACHE_L1I |
+                                                      (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                                      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    counter_fds[COUNTER_INSTRUCTIONS] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+
+    if (counter_fds[COUNTER_ICACHE_MISSES] < 0) {
+        fprintf(stderr, "startup: L1 instruction cache misses not available, "
+                "check /proc/sys/kernel/perf_event_paranoid\n");
+    }
+}
+
+/**
+ * Count a user space event of the calling thread
+ *
+ * @param type the perf event type
+ * @param config the perf event config
+ * @return the counter fd or -1
+ */
+static int open_counter(uint32_t type, uint64_t config)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+/**
+ * Read a counter
+ *
+ * @param index the counter
+ * @return the count, 0 if the counter is not available
+ */
+static uint64_t read_counter(int index)
+{
+    uint64_t value = 0;
+
+    if (counter_fds[index] < 0 || read(counter_fds[index], &value, sizeof(value)) != sizeof(value)) {
+        return 0;
+    }
+
+    return value;
+}
+
+/**
+ * Read the start time and the block I/O delay of the process
+ *
+ * @param since_exec_ms set to the time elapsed since exec, 10 ms resolution
+ * @param blkio_ticks set to the clock ticks spent waiting for block I/O
+ */
+static void read_proc_stat(double *since_exec_ms, unsigned long long *blkio_ticks)
+{
+    unsigned long long start_ticks = 0;
+    struct timespec now;
+    char buf[1024];
+    char *p;
+    size_t len;
+    int field;
+    FILE *f;
+
+    *since_exec_ms = 0;
+    *blkio_ticks = 0;
+
+    f = fopen("/proc/self/stat", "r");
+    if (f == NULL) {
+        return;
+    }
+
+    len = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[len] = '\0';
+
+    /* The command name may contain spaces, fields are counted after it */
+    p = strrchr(buf, ')');
+    if (p == NULL) {
+        return;
+    }
+
+    for (field = 2; p != NULL && *p != '\0'; field++) {
+        p = strchr(p + 1, ' ');
+        if (p == NULL) {
+            break;
+        }
+        if (field + 1 == 22) {
+            start_ticks = strtoull(p + 1, NULL, 10);
+        } else if (field + 1 == 42) {
+            *blkio_ticks = strtoull(p + 1, NULL, 10);
+        }
+    }
+
+    clock_gettime(CLOCK_BOOTTIME, &now);
+    *since_exec_ms = ((double)now.tv_sec + (double)now.tv_nsec / 1e9 -
+                      (double)start_ticks / (double)sysconf(_SC_CLK_TCK)) * 1000.0;
+}
+
+/**
+ * Read a size from /proc/self/status
+ *
+ * @param key the field, e.g. "VmRSS:"
+ * @return the size in kB, -1 if the field is missing
+ */
+static long read_status_kb(const char *key)
+{
+    size_t key_len = strlen(key);
+    char line[256];
+    long kb = -1;
+    FILE *f;
+
+    f = fopen("/proc/self/status", "r");
+    if (f == NULL) {
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (strncmp(line, key, key_len) == 0) {
+            kb = strtol(line + key_len, NULL, 10);
+            break;
+        }
+    }
+
+    fclose(f);
+    return kb;
+}
+
+/**
+ * Count a shared object of the link map
+ *
+ * @param info the object
+ * @param size the size of info
+ * @param data the counter
+ * @return 0 to continue
+ */
+static int count_object_cb(struct dl_phdr_info *info, size_t size, void *data)
+{
+    LV_UNUSED(size);
+
+    /* The executable itself has an empty name */
+    if (info->dlpi_name != NULL && info->dlpi_name[0] != '\0') {
+        (*(int *)data)++;
+    }
+
+    return 0;
+}
+
+/**
+ * Print the resident memory and the shared objects mapped
+ */
+static void print_memory(void)
+{
+    int objects = 0;
+
+    dl_iterate_phdr(count_object_cb, &objects);
+
+    fprintf(stdout, "startup: RSS %ld kB, peak %ld kB, %d shared objects, backend modules loaded in %.2f ms\n",
+            read_status_kb("VmRSS:"), read_status_kb("VmHWM:"), objects,
+            (double)driver_backends_get_module_load_ns() / 1e6);
+}
+
+/**
+ * Report the first frame then measure the following ones
+ *
+ * @param e the refresh event
+ */
+static void refr_event_cb(lv_event_t *e)
+{
+    lv_display_t *display = lv_event_get_target(e);
+    int i;
+
+    if (lv_event_get_code(e) == LV_EVENT_REFR_START) {
+        for (i = 0; i < COUNTER_COUNT; i++) {
+            frame_start[i] = read_counter(i);
+        }
+        return;
+    }
+
+    if (frames == 0) {
+        print_first_frame();
+    } else {
+        perf_hist_add(&icache_misses,
+                      (uint32_t)(read_counter(COUNTER_ICACHE_MISSES) - frame_start[COUNTER_ICACHE_MISSES]));
+        perf_hist_add(&instructions,
+                      (uint32_t)((read_counter(COUNTER_INSTRUCTIONS) - frame_start[COUNTER_INSTRUCTIONS]) / 1000));
+    }
+
+    frames++;
+
+    if (frames > STARTUP_STATS_FRAMES) {
+        fprintf(stdout, "startup: next %u frames\n", STARTUP_STATS_FRAMES);
+        perf_hist_print(&icache_misses, "L1i misses/frame", "");
+        perf_hist_print(&instructions, "instructions/frame", "k");
+        print_memory();
+
+        lv_display_remove_event_cb_with_user_data(display, refr_event_cb, NULL);
+        for (i = 0; i < COUNTER_COUNT; i++) {
+            if (counter_fds[i] >= 0) {
+                close(counter_fds[i]);
+                counter_fds[i] = -1;
+            }
+        }
+    }
+}
+
+/**
+ * Print the cost of everything up to the first frame
+ */
+static void print_first_frame(void)
+{
+    unsigned long long blkio_ticks;
+    double since_exec_ms;
+    struct rusage ru;
+
+    read_proc_stat(&since_exec_ms, &blkio_ticks);
+    getrusage(RUSAGE_SELF, &ru);
+
+    fprintf(stdout, "startup: first frame %.1f ms after exec, %.1f ms after load\n",
+            since_exec_ms, (double)(perf_time_ns() - start_ns) / 1e6);
+    fprintf(stdout, "startup: page faults minor=%ld major=%ld, block I/O wait %.1f ms\n",
+            ru.ru_minflt, ru.ru_majflt, (double)blkio_ticks * 1000.0 / (double)sysconf(_SC_CLK_TCK));
+    fprintf(stdout, "startup: L1i misses=%llu instructions=%llu\n",
+            (unsigned long long)read_counter(COUNTER_ICACHE_MISSES),
+            (unsigned long long)read_counter(COUNTER_INSTRUCTIONS));
+    print_memory();
+}
@@ -0,0 +1,54 @@
+/**
+ * @file startup_stats.h
+ *
+ * Startup cost report
+ *
+ * Measures the time from the start of the process to the first flushed
+ * frame, the page faults taken on the way and the L1 instruction cache
+ * misses of the startup and of the following frames.
+ *
+ */
+
+#ifndef STARTUP_STATS_H
+#define STARTUP_STATS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include "lvgl/lvgl.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/* Frames measured after the first one */
+#define STARTUP_STATS_FRAMES 300
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+/**
+ * @description Report the startup cost when LV_STARTUP_REPORT is set
+ * @param display the display whose first frame ends the startup
+ * @note the counters are started before main(), call it once the display exists
+ */
+void startup_stats_attach(lv_display_t *display);
+
+/**********************
+ *      MACROS
+ **********************/
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif /*STARTUP_STATS_H*/
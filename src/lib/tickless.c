@@ -0,0 +1,326 @@
+/**
+ * @file tickless.c
+ *
+ * Demand driven refresh of the idle displays
+ *
+ * A frame drew something when its flush started. At LV_EVENT_REFR_READY
+ * of a frame that drew nothing and that nobody requested, the refresh
+ * timer is paused. LV_EVENT_INVALIDATE_AREA and tickless_request_frame()
+ * resume it, the timer then runs at once since its period has elapsed.
+ * The other timers are left alone: the run loop sleeps until the next of
+ * them is due or until event_loop_wake() is called by the input thread.
+ *
+ * The idle report compares the wake ups of the run loop, the frames and
+ * the CPU time of the process with and without LV_TICKLESS.
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+
+#include "lvgl/lvgl.h"
+
+#include "simulator_util.h"
+#include "perf_stats.h"
+#include "event_loop.h"
+#include "tickless.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+typedef struct {
+    lv_display_t *display;
+    lv_timer_t *refr_timer;
+
+    bool paused;        /* The refresh timer is paused by the idle detection */
+    bool resumed;       /* Resumed since the last frame */
+    bool after_idle;    /* The current frame follows an idle period */
+    bool drawn;         /* The current frame flushed something */
+    bool requested;     /* A frame after the current one was requested */
+
+    uint64_t paused_at_ns;
+    uint64_t paused_ns;
+    uint32_t frames;
+    uint32_t drawn_frames;
+} tickless_t;
+
+typedef struct {
+    uint64_t time_ns;
+    uint64_t cpu_us;
+    uint64_t switches;
+    uint32_t wakeups;
+} idle_sample_t;
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static tickless_t *find_display(const lv_display_t *display);
+static void resume(tickless_t *s);
+static void refr_start_cb(lv_event_t *e);
+static void refr_ready_cb(lv_event_t *e);
+static void flush_start_cb(lv_event_t *e);
+static void invalidate_cb(lv_event_t *e);
+static void take_sample(idle_sample_t *sample);
+static void report_timer_cb(lv_timer_t *timer);
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+static tickless_t displays[TICKLESS_MAX_DISPLAYS];
+static uint32_t display_count;
+static int enabled = -1;
+static lv_timer_t *report_timer;
+static idle_sample_t last_sample;
+
+/**********************
+ *      MACROS
+ **********************/
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+bool tickless_is_enabled(void)
+{
+    if (enabled < 0) {
+        enabled = atoi(getenv_default("LV_TICKLESS", "0")) != 0;
+    }
+
+    return enabled;
+}
+
+void tickless_attach(lv_display_t *display)
+{
+    tickless_t *s;
+    int report_sec;
+
+    if (display == NULL || find_display(display) != NULL) {
+        return;
+    }
+
+    if (display_count == TICKLESS_MAX_DISPLAYS) {
+        LV_LOG_WARN("Too many displays, the display keeps refreshing when idle");
+        return;
+    }
+
+    s = &displays[display_count++];
+    s->display = display;
+    s->refr_timer = lv_display_get_refr_timer(display);
+
+    /* The frames are counted for the report in both modes */
+    lv_display_add_event_cb(display, refr_start_cb, LV_EVENT_REFR_START, s);
+    lv_display_add_event_cb(display, flush_start_cb, LV_EVENT_FLUSH_START, s);
+
+    if (tickless_is_enabled()) {
+        lv_display_add_event_cb(display, refr_ready_cb, LV_EVENT_REFR_READY, s);
+        lv_display_add_event_cb(display, invalidate_cb, LV_EVENT_INVALIDATE_AREA, s);
+    }
+
+    report_sec = atoi(getenv_default("LV_IDLE_REPORT", "0"));
+    if (report_sec > 0 && report_timer == NULL) {
+        take_sample(&last_sample);
+        report_timer = lv_timer_create(report_timer_cb, (uint32_t)report_sec * 1000, NULL);
+    }
+}
+
+void tickless_request_frame(lv_display_t *display)
+{
+    tickless_t *s = find_display(display);
+
+    if (s == NULL) {
+        return;
+    }
+
+    s->requested = true;
+    resume(s);
+}
+
+bool tickless_frame_after_idle(const lv_display_t *display)
+{
+    tickless_t *s = find_display(display);
+
+    return s != NULL && s->after_idle;
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+/**
+ * Find the state of a display
+ *
+ * @param display the display
+ * @return the state, NULL if the display is not attached
+ */
+static tickless_t *find_display(const lv_display_t *display)
+{
+    uint32_t i;
+
+    for (i = 0; i < display_count; i++) {
+        if (displays[i].display == display) {
+            return &displays[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Resume the refresh timer if the idle detection paused it
+ *
+ * @param s the display state
+ */
+static void resume(tickless_t *s)
+{
+    if (!s->paused) {
+        return;
+    }
+
+    s->paused = false;
+    s->resumed = true;
+    s->paused_ns += perf_time_ns() - s->paused_at_ns;
+    lv_timer_resume(s->refr_timer);
+}
+
+/**
+ * Start a frame, its callbacks can request the next one
+ *
+ * @param e the refresh start event
+ */
+static void refr_start_cb(lv_event_t *e)
+{
+    tickless_t *s = lv_event_get_user_data(e);
+
+    /* Resumed by someone else, e.g. the flush thread */
+    if (s->paused) {
+        resume(s);
+    }
+
+    s->after_idle = s->resumed;
+    s->resumed = false;
+    s->drawn = false;
+    s->requested = false;
+    s->frames++;
+}
+
+/**
+ * Pause the refresh timer after a frame which drew nothing
+ *
+ * @param e the refresh ready event
+ */
+static void refr_ready_cb(lv_event_t *e)
+{
+    tickless_t *s = lv_event_get_user_data(e);
+
+    if (s->drawn || s->requested || s->paused || lv_timer_get_paused(s->refr_timer)) {
+        return;
+    }
+
+    s->paused = true;
+    s->paused_at_ns = perf_time_ns();
+    lv_timer_pause(s->refr_timer);
+}
+
+/**
+ * Mark the frame as drawn
+ *
+ * @param e the flush start event
+ */
+static void flush_start_cb(lv_event_t *e)
+{
+    tickless_t *s = lv_event_get_user_data(e);
+
+    if (!s->drawn) {
+        s->drawn = true;
+        s->drawn_frames++;
+    }
+}
+
+/**
+ * Refresh the display when an area is invalidated
+ *
+ * @param e the invalidate area event
+ */
+static void invalidate_cb(lv_event_t *e)
+{
+    tickless_t *s = lv_event_get_user_data(e);
+
+    if (s->paused) {
+        resume(s);
+    } else if (s->drawn) {
+        /* Invalidated after the rendering, it is drawn by the next frame */
+        s->requested = true;
+    }
+}
+
+/**
+ * Read the counters of the process
+ *
+ * @param sample the counters
+ */
+static void take_sample(idle_sample_t *sample)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+
+    sample->time_ns = perf_time_ns();
+    sample->cpu_us = (uint64_t)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000 +
+                     (uint64_t)(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec);
+    sample->switches = (uint64_t)(ru.ru_nvcsw + ru.ru_nivcsw);
+    sample->wakeups = event_loop_get_wakeups();
+}
+
+/**
+ * Print the wake ups, frames and CPU time per second since the last report
+ *
+ * @param timer the report timer
+ */
+static void report_timer_cb(lv_timer_t *timer)
+{
+    idle_sample_t now;
+    tickless_t *s;
+    uint64_t paused_ns;
+    double sec;
+    uint32_t i;
+
+    LV_UNUSED(timer);
+
+    take_sample(&now);
+    sec = (double)(now.time_ns - last_sample.time_ns) / 1e9;
+
+    fprintf(stdout, "idle: tickless %s, %.1f run loop wake ups/s, %.1f context switches/s, %.2f ms CPU/s\n",
+            tickless_is_enabled() ? "on" : "off", (double)(now.wakeups - last_sample.wakeups) / sec,
+            (double)(now.switches - last_sample.switches) / sec,
+            (double)(now.cpu_us - last_sample.cpu_us) / 1000.0 / sec);
+
+    for (i = 0; i < display_count; i++) {
+        s = &displays[i];
+        paused_ns = s->paused_ns + (s->paused ? now.time_ns - s->paused_at_ns : 0);
+        if (s->paused) {
+            s->paused_at_ns = now.time_ns;
+        }
+
+        fprintf(stdout, "idle: display %u, %.1f frames/s, %.1f drawn/s, paused %.0f%% of the time\n", i,
+                (double)s->frames / sec, (double)s->drawn_frames / sec, (double)paused_ns / 1e7 / sec);
+
+        s->frames = 0;
+        s->drawn_frames = 0;
+        s->paused_ns = 0;
+    }
+
+    last_sample = now;
+}
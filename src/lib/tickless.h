@@ -0,0 +1,85 @@
+/**
+ * @file tickless.h
+ *
+ * Demand driven refresh of the idle displays
+ *
+ * LVGL runs the refresh timer of a display every refresh period even when
+ * nothing changed. With LV_TICKLESS=1 the refresh timer of a display is
+ * paused after a frame that drew nothing, and resumed when an area is
+ * invalidated or when a frame is requested, so the run loop sleeps until
+ * a value changes, an input event arrives or a timer (blink, animation)
+ * is due. The elements applied at LV_EVENT_REFR_START request the frames
+ * they need with tickless_request_frame().
+ *
+ */
+
+#ifndef TICKLESS_H
+#define TICKLESS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stdbool.h>
+
+#include "lvgl/lvgl.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/* Maximum number of displays attached */
+#define TICKLESS_MAX_DISPLAYS 4
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+/**
+ * @description Check if LV_TICKLESS is set
+ * @return true if the idle displays stop refreshing
+ */
+bool tickless_is_enabled(void);
+
+/**
+ * @description Stop refreshing a display while it is idle when LV_TICKLESS is set,
+ *              print the wake ups and the CPU time when LV_IDLE_REPORT is set
+ * @param display the display
+ * @note attach before adding other LV_EVENT_REFR_START callbacks to the display,
+ *       they can then request the next frame from theirs
+ */
+void tickless_attach(lv_display_t *display);
+
+/**
+ * @description Make sure the display refreshes at the next refresh period even
+ *              if nothing is invalidated
+ * @param display the display
+ * @note call it from the UI thread, from a LV_EVENT_REFR_START callback to keep the
+ *       frames coming, ready the refresh timer as well to refresh immediately
+ */
+void tickless_request_frame(lv_display_t *display);
+
+/**
+ * @description Check if the current frame is the first one after an idle period
+ * @param display the display
+ * @return true from LV_EVENT_REFR_START of that frame until the next frame,
+ *         the interval since the previous frame is not a frame time
+ */
+bool tickless_frame_after_idle(const lv_display_t *display);
+
+/**********************
+ *      MACROS
+ **********************/
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif /*TICKLESS_H*/
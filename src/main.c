@@ -1,10 +1,32 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "lvgl/lvgl.h"
 #include "src/lib/driver_backends.h"
 #include "src/lib/simulator_settings.h"
+#include "src/lib/simulator_util.h"
+#include "src/lib/mem_frame.h"
+#include "src/lib/startup_stats.h"
+#include "src/lib/frame_mirror.h"
+#include "src/lib/golden_frame.h"
+#include "src/lib/frame_profiler.h"
+#include "src/lib/tickless.h"
+#include "src/lib/rt_profile.h"
+#include "src/lib/lz_image.h"
+#include "src/dash_bench.h"
+#include "src/dash_telltales.h"
+#include "src/dash_timeline.h"
+#include "src/dash_sched.h"
+
+/* The layout pre-rotated by tools/rotate_assets.py when built with DASH_ROTATION */
+#if DASH_ROTATION
+#include "dash_layout_rotated.h"
+#else
+#include "src/dash_layout.h"
+#endif
 
 extern simulator_settings_t settings;
 
@@ -15,141 +37,175 @@ extern simulator_settings_t settings;
 #define TEMP_LED_COUNT        8
 #define FUEL_LED_COUNT       20
 #define ICON_COUNT           10
-
-#define TIMER_PERIOD_MS      15
+#define ICON_ALL_MASK        ((1u << ICON_COUNT) - 1)
+#define ICON_LEFT_TURN        3  /* Index in icon_sprites */
+#define ICON_RIGHT_TURN       8
+#define ICON_TURN_MASK       ((1u << ICON_LEFT_TURN) | (1u << ICON_RIGHT_TURN))
 
 #define RPM_REDLINE_INDEX    89
 #define RPM_BOUNCE_FLOOR     82
-#define RPM_MAX_BOUNCES       3
-
-/* Icon timing (ONE-SHOT, NOT BLINKING) */
-#define ICON_ON_DELAY_TICKS  10   /* delay before icons appear */
-#define ICON_HOLD_TICKS      15   /* how long icons stay visible */
 
-/* ============================================================
- * MODE
- * ============================================================ */
-typedef enum {
-    MODE_STARTUP,
-    MODE_DAQ_IDLE
-} dash_mode_t;
+/* Startup sweep, one LED every 15 ms then 3 bounces below the redline */
+#define SWEEP_STEP_MS        15
+#define SWEEP_UP_MS          (RPM_REDLINE_INDEX * SWEEP_STEP_MS)
+#define SWEEP_BOUNCE_MS      ((RPM_REDLINE_INDEX - RPM_BOUNCE_FLOOR) * SWEEP_STEP_MS)
+#define SWEEP_END_MS         (SWEEP_UP_MS + 5 * SWEEP_BOUNCE_MS)
 
-static dash_mode_t dash_mode = MODE_STARTUP;
+/* Icon timing (ONE-SHOT, NOT BLINKING) */
+#define ICON_ON_MS           150  /* delay before icons appear */
+#define ICON_OFF_MS          375  /* when icons are hidden again */
 
 /* ============================================================
- * POSITION STRUCT
+ * OBJECTS
  * ============================================================ */
-typedef struct { int x; int y; } pos_t;
+static lv_obj_t *rpm_img[RPM_LED_COUNT];
+static lv_obj_t *temp_img[TEMP_LED_COUNT];
+static lv_obj_t *fuel_img[FUEL_LED_COUNT];
+static lv_obj_t *telltales;
+
+/* Color of the telltale masks, printed by assets/convert_lzi.py --format a8 */
+static const uint32_t icon_colors[ICON_COUNT] = {
+    0xff3b22, /* door_open */
+    0x013979, /* hi_beam */
+    0x66d36b, /* immo */
+    0x65c867, /* left_turn */
+    0xff3f25, /* low_bat */
+    0xff4326, /* low_brake_fluid */
+    0xff3a23, /* low_oil */
+    0xff6c18, /* mil_on */
+    0x5dbc60, /* right_turn */
+    0xff321c, /* trunk_open */
+};
 
 /* ============================================================
- * POSITIONS (VERIFIED)
+ * STARTUP SEQUENCE
  * ============================================================ */
-static const pos_t rpm_pos[RPM_LED_COUNT] = {
-    {122,211},{128,206},{131,204},{134,202},{138,200},{142,197},{146,196},{150,194},{153,192},
-    {157,190},{161,188},{165,186},{169,184},{173,182},{177,180},{181,179},{185,177},{190,175},
-    {194,173},{198,172},{202,170},{207,168},{211,166},{216,165},{221,164},{226,162},{230,160},
-    {235,159},{240,157},{244,156},{250,155},{254,153},{259,152},{265,151},{269,150},{275,149},
-    {280,148},{285,147},{290,146},{295,144},{301,144},{306,143},{311,142},{316,142},{322,141},
-    {328,141},{333,140},{338,139},{344,139},{350,138},{356,138},{361,138},{368,137},{373,137},
-    {380,137},{386,136},{392,136},{398,136},{404,136},{409,137},{416,137},{422,137},{429,137},
-    {434,138},{442,139},{448,139},{456,140},{461,141},{468,142},{474,143},{481,144},{488,146},
-    {496,147},{504,149},{511,151},{519,153},{527,155},{534,157},{541,160},{549,162},{557,165},
-    {565,168},{573,171},{581,175},{590,178},{597,182},{605,186},{613,189},{621,194},{621,199}
+static void rpm_level_cb(int32_t value, void *user_data);
+static void gauges_visible_cb(int32_t value, void *user_data);
+static void icons_visible_cb(int32_t value, void *user_data);
+
+static const dash_keyframe_t rpm_keys[] = {
+    {0, 0},
+    {SWEEP_UP_MS, RPM_REDLINE_INDEX},
+    {SWEEP_UP_MS + 1 * SWEEP_BOUNCE_MS, RPM_BOUNCE_FLOOR},
+    {SWEEP_UP_MS + 2 * SWEEP_BOUNCE_MS, RPM_REDLINE_INDEX},
+    {SWEEP_UP_MS + 3 * SWEEP_BOUNCE_MS, RPM_BOUNCE_FLOOR},
+    {SWEEP_UP_MS + 4 * SWEEP_BOUNCE_MS, RPM_REDLINE_INDEX},
+    {SWEEP_END_MS, RPM_BOUNCE_FLOOR},
 };
 
-static const pos_t temp_pos[TEMP_LED_COUNT] = {
-    {107,259},{109,259},{122,259},{136,259},
-    {148,259},{162,259},{176,259},{193,259}
+static const dash_keyframe_t gauges_keys[] = {
+    {0, 1},
+    {SWEEP_END_MS, 0},
 };
 
-static const pos_t fuel_pos[FUEL_LED_COUNT] = {
-    {602,260},{609,260},{613,260},{617,260},{622,260},
-    {627,260},{631,260},{635,260},{640,260},{644,260},
-    {648,260},{653,260},{657,260},{661,260},{666,260},
-    {670,260},{674,260},{679,260},{683,260},{696,261}
+static const dash_keyframe_t icons_keys[] = {
+    {0, 0},
+    {ICON_ON_MS, 1},
+    {ICON_OFF_MS, 0},
 };
 
-static const pos_t icon_pos[ICON_COUNT] = {
-    {611,329},{554,229},{302,332},{282,211},{171,330},
-    {126,329},{210,331},{257,329},{496,211},{563,330}
+/* The visibility of the gauges is evaluated after their level */
+static const dash_track_t startup_tracks[] = {
+    {DASH_TRACK_LEVEL, rpm_keys, sizeof(rpm_keys) / sizeof(rpm_keys[0]), rpm_level_cb, NULL},
+    {DASH_TRACK_VISIBILITY, gauges_keys, sizeof(gauges_keys) / sizeof(gauges_keys[0]), gauges_visible_cb, NULL},
+    {DASH_TRACK_VISIBILITY, icons_keys, sizeof(icons_keys) / sizeof(icons_keys[0]), icons_visible_cb, NULL},
 };
 
 /* ============================================================
- * OBJECTS
+ * GAUGES
  * ============================================================ */
-static lv_obj_t *rpm_img[RPM_LED_COUNT];
-static lv_obj_t *temp_img[TEMP_LED_COUNT];
-static lv_obj_t *fuel_img[FUEL_LED_COUNT];
-static lv_obj_t *icon_img[ICON_COUNT];
+
+/* Show the LEDs up to idx, -1 hides all */
+static void set_leds(lv_obj_t **img, int count, int idx)
+{
+    for(int i=0;i<count;i++)
+        (i <= idx) ? lv_obj_clear_flag(img[i],LV_OBJ_FLAG_HIDDEN)
+                   : lv_obj_add_flag(img[i],LV_OBJ_FLAG_HIDDEN);
+}
+
+/* Show the LEDs up to rpm_idx, the temperature and fuel follow it, -1 hides all */
+static void show_gauges(int rpm_idx)
+{
+    set_leds(rpm_img, RPM_LED_COUNT, rpm_idx);
+    set_leds(temp_img, TEMP_LED_COUNT, rpm_idx < 0 ? -1 : (rpm_idx * TEMP_LED_COUNT) / RPM_LED_COUNT);
+    set_leds(fuel_img, FUEL_LED_COUNT, rpm_idx < 0 ? -1 : (rpm_idx * FUEL_LED_COUNT) / RPM_LED_COUNT);
+}
+
+static void rpm_level_cb(int32_t value, void *user_data)
+{
+    LV_UNUSED(user_data);
+    show_gauges(value);
+}
+
+static void gauges_visible_cb(int32_t value, void *user_data)
+{
+    LV_UNUSED(user_data);
+    if(!value)
+        show_gauges(-1);
+}
+
+static void icons_visible_cb(int32_t value, void *user_data)
+{
+    LV_UNUSED(user_data);
+    dash_telltales_set_mask(telltales, value ? ICON_ALL_MASK : 0, 0);
+}
 
 /* ============================================================
- * STARTUP STATE
+ * DAQ UPDATES
  * ============================================================ */
-static int rpm_idx = 0;
-static int rpm_dir = 1;
-static int rpm_bounces = 0;
-static int tick = 0;
-static int icons_visible = 0;
+
+/* The values are LED indexes, -1 hides all */
+static void rpm_apply_cb(int32_t value, void *user_data)
+{
+    LV_UNUSED(user_data);
+    set_leds(rpm_img, RPM_LED_COUNT, value);
+}
+
+static void temp_apply_cb(int32_t value, void *user_data)
+{
+    LV_UNUSED(user_data);
+    set_leds(temp_img, TEMP_LED_COUNT, value);
+}
+
+static void fuel_apply_cb(int32_t value, void *user_data)
+{
+    LV_UNUSED(user_data);
+    set_leds(fuel_img, FUEL_LED_COUNT, value);
+}
+
+/* The value is the mask of the telltales on, the turn signals blink */
+static void telltales_apply_cb(int32_t value, void *user_data)
+{
+    LV_UNUSED(user_data);
+    dash_telltales_set_mask(telltales, (uint32_t)value, (uint32_t)value & ICON_TURN_MASK);
+}
 
 /* ============================================================
- * TIMER CALLBACK
+ * SECONDARY DISPLAYS
  * ============================================================ */
-static void dash_timer_cb(lv_timer_t *t)
-{
-    LV_UNUSED(t);
-    tick++;
-
-    if(dash_mode != MODE_STARTUP)
-        return;
-
-    /* ---------- RPM ---------- */
-    rpm_idx += rpm_dir;
-    if(rpm_idx >= RPM_REDLINE_INDEX) {
-        rpm_idx = RPM_REDLINE_INDEX;
-        rpm_dir = -1;
-    } else if(rpm_idx <= RPM_BOUNCE_FLOOR && rpm_dir < 0) {
-        rpm_dir = 1;
-        rpm_bounces++;
-    }
 
-    for(int i=0;i<RPM_LED_COUNT;i++)
-        (i <= rpm_idx) ? lv_obj_clear_flag(rpm_img[i],LV_OBJ_FLAG_HIDDEN)
-                       : lv_obj_add_flag(rpm_img[i],LV_OBJ_FLAG_HIDDEN);
-
-    /* ---------- TEMP ---------- */
-    int temp_idx = (rpm_idx * TEMP_LED_COUNT) / RPM_LED_COUNT;
-    for(int i=0;i<TEMP_LED_COUNT;i++)
-        (i <= temp_idx) ? lv_obj_clear_flag(temp_img[i],LV_OBJ_FLAG_HIDDEN)
-                        : lv_obj_add_flag(temp_img[i],LV_OBJ_FLAG_HIDDEN);
-
-    /* ---------- FUEL ---------- */
-    int fuel_idx = (rpm_idx * FUEL_LED_COUNT) / RPM_LED_COUNT;
-    for(int i=0;i<FUEL_LED_COUNT;i++)
-        (i <= fuel_idx) ? lv_obj_clear_flag(fuel_img[i],LV_OBJ_FLAG_HIDDEN)
-                        : lv_obj_add_flag(fuel_img[i],LV_OBJ_FLAG_HIDDEN);
-
-    /* ---------- ICON ONE-SHOT ---------- */
-    if(tick == ICON_ON_DELAY_TICKS) {
-        for(int i=0;i<ICON_COUNT;i++)
-            lv_obj_clear_flag(icon_img[i],LV_OBJ_FLAG_HIDDEN);
-        icons_visible = 1;
-    }
+/* Trip time on the center display, the background is decoded once for both displays */
+static void info_time_cb(lv_timer_t *timer)
+{
+    lv_obj_t *label = lv_timer_get_user_data(timer);
+    uint32_t s = lv_tick_get() / 1000;
+    lv_label_set_text_fmt(label, "%02u:%02u:%02u", (unsigned)(s / 3600), (unsigned)(s / 60 % 60), (unsigned)(s % 60));
+}
 
-    if(icons_visible && tick >= ICON_ON_DELAY_TICKS + ICON_HOLD_TICKS) {
-        for(int i=0;i<ICON_COUNT;i++)
-            lv_obj_add_flag(icon_img[i],LV_OBJ_FLAG_HIDDEN);
-        icons_visible = 0;
-    }
+static void create_info_screen(lv_display_t *disp)
+{
+    lv_obj_t *scr = lv_display_get_screen_active(disp);
 
-    /* ---------- END ---------- */
-    if(rpm_bounces >= RPM_MAX_BOUNCES) {
-        for(int i=0;i<RPM_LED_COUNT;i++) lv_obj_add_flag(rpm_img[i],LV_OBJ_FLAG_HIDDEN);
-        for(int i=0;i<TEMP_LED_COUNT;i++) lv_obj_add_flag(temp_img[i],LV_OBJ_FLAG_HIDDEN);
-        for(int i=0;i<FUEL_LED_COUNT;i++) lv_obj_add_flag(fuel_img[i],LV_OBJ_FLAG_HIDDEN);
-        for(int i=0;i<ICON_COUNT;i++)     lv_obj_add_flag(icon_img[i],LV_OBJ_FLAG_HIDDEN);
+    lv_obj_t *bg = lv_image_create(scr);
+    lv_image_set_src(bg, DASH_BG_SRC);
+    lv_obj_set_pos(bg,0,0);
 
-        dash_mode = MODE_DAQ_IDLE;
-    }
+    lv_obj_t *label = lv_label_create(scr);
+    lv_obj_set_style_text_color(label, lv_color_white(), 0);
+    lv_obj_center(label);
+    lv_label_set_text(label, "00:00:00");
+    lv_timer_create(info_time_cb, 1000, label);
 }
 
 /* ============================================================
@@ -159,56 +215,112 @@ int main(void)
 {
     chdir("/home/honda/lv_port_linux");
 
-    settings.window_width  = 800;
-    settings.window_height = 480;
+    /* The layout is in the orientation of the panel */
+    settings.window_width  = DASH_LAYOUT_WIDTH;
+    settings.window_height = DASH_LAYOUT_HEIGHT;
+
+    /* Rotate the rendered frames in the flush, compare with a DASH_ROTATION build.
+     * At 90 and 270 the panel is portrait, LVGL renders the landscape layout on it */
+    int rotation = atoi(getenv_default("LV_DASH_SW_ROTATION", "0"));
+    if(rotation == 90 || rotation == 270) {
+        settings.window_width  = DASH_LAYOUT_HEIGHT;
+        settings.window_height = DASH_LAYOUT_WIDTH;
+    }
 
     lv_init();
+    lz_image_decoder_init();
     driver_backends_register();
-    driver_backends_init_backend(NULL);
+    driver_backends_init_displays();
+#if LV_USE_EVDEV
+    driver_backends_init_backend("EVDEV");
+#endif
+
+    if(rotation != 0)
+        lv_display_set_rotation(lv_display_get_default(), (lv_display_rotation_t)((rotation / 90) & 3));
+
+    startup_stats_attach(lv_display_get_default());
+    frame_mirror_attach(lv_display_get_default());
+    golden_frame_attach(lv_display_get_default());
+    frame_profiler_attach(lv_display_get_default());
+    for(int i=0;i<driver_backends_get_display_count();i++)
+        tickless_attach(driver_backends_get_display(i));
+#if LV_USE_STDLIB_MALLOC == LV_STDLIB_CUSTOM
+    mem_frame_attach(lv_display_get_default());
+#endif
 
     lv_obj_t *bg = lv_image_create(lv_screen_active());
-    lv_image_set_src(bg, "assets/bg.png");
+    lv_image_set_src(bg, DASH_BG_SRC);
     lv_obj_set_pos(bg,0,0);
 
     for(int i=0;i<RPM_LED_COUNT;i++){
-        char p[64]; sprintf(p,"assets/rpm/rpm%d.png",i+1);
         rpm_img[i]=lv_image_create(lv_screen_active());
-        lv_image_set_src(rpm_img[i],p);
-        lv_obj_set_pos(rpm_img[i],rpm_pos[i].x,rpm_pos[i].y);
+        lv_image_set_src(rpm_img[i],rpm_sprites[i].src);
+        lv_obj_set_pos(rpm_img[i],rpm_sprites[i].x,rpm_sprites[i].y);
         lv_obj_add_flag(rpm_img[i],LV_OBJ_FLAG_HIDDEN);
     }
 
     for(int i=0;i<TEMP_LED_COUNT;i++){
-        char p[64]; sprintf(p,"assets/temp/temp%d.png",91+i);
         temp_img[i]=lv_image_create(lv_screen_active());
-        lv_image_set_src(temp_img[i],p);
-        lv_obj_set_pos(temp_img[i],temp_pos[i].x,temp_pos[i].y);
+        lv_image_set_src(temp_img[i],temp_sprites[i].src);
+        lv_obj_set_pos(temp_img[i],temp_sprites[i].x,temp_sprites[i].y);
         lv_obj_add_flag(temp_img[i],LV_OBJ_FLAG_HIDDEN);
     }
 
     for(int i=0;i<FUEL_LED_COUNT;i++){
-        char p[64]; sprintf(p,"assets/fuel/fuel%d.png",99+i);
         fuel_img[i]=lv_image_create(lv_screen_active());
-        lv_image_set_src(fuel_img[i],p);
-        lv_obj_set_pos(fuel_img[i],fuel_pos[i].x,fuel_pos[i].y);
+        lv_image_set_src(fuel_img[i],fuel_sprites[i].src);
+        lv_obj_set_pos(fuel_img[i],fuel_sprites[i].x,fuel_sprites[i].y);
         lv_obj_add_flag(fuel_img[i],LV_OBJ_FLAG_HIDDEN);
     }
 
-    const char *icons[ICON_COUNT] = {
-        "assets/icons/door_open.png","assets/icons/hi_beam.png","assets/icons/immo.png",
-        "assets/icons/left_turn.png","assets/icons/low_bat.png","assets/icons/low_brake_fluid.png",
-        "assets/icons/low_oil.png","assets/icons/mil_on.png",
-        "assets/icons/right_turn.png","assets/icons/trunk_open.png"
-    };
-
+    /* All the telltales are drawn by one layer from one atlas, from the masks
+     * next to the PNGs when they all decode as A8 and LV_DASH_TELLTALE_A8 is not 0.
+     * A mask converted to ARGB8888 because its error was too large would lose its
+     * color otherwise, so any other format falls back to the PNGs */
+    const char *icons[ICON_COUNT];
+    char icon_masks[ICON_COUNT][128];
+    lv_point_t icon_points[ICON_COUNT];
+    bool use_masks = atoi(getenv_default("LV_DASH_TELLTALE_A8", "1")) != 0;
     for(int i=0;i<ICON_COUNT;i++){
-        icon_img[i]=lv_image_create(lv_screen_active());
-        lv_image_set_src(icon_img[i],icons[i]);
-        lv_obj_set_pos(icon_img[i],icon_pos[i].x,icon_pos[i].y);
-        lv_obj_add_flag(icon_img[i],LV_OBJ_FLAG_HIDDEN);
+        const char *ext = strrchr(icon_sprites[i].src, '.');
+        snprintf(icon_masks[i], sizeof(icon_masks[i]), "%.*s.lzi", (int)(ext - icon_sprites[i].src),
+                 icon_sprites[i].src);
+        lv_image_header_t header;
+        use_masks = use_masks && lv_image_decoder_get_info(icon_masks[i], &header) == LV_RESULT_OK &&
+                    header.cf == LV_COLOR_FORMAT_A8;
+        icon_points[i].x = icon_sprites[i].x;
+        icon_points[i].y = icon_sprites[i].y;
     }
+    for(int i=0;i<ICON_COUNT;i++){
+        icons[i] = use_masks ? icon_masks[i] : icon_sprites[i].src;
+    }
+    telltales = dash_telltales_create(lv_screen_active(), icons, icon_points, ICON_COUNT);
+    for(int i=0;i<ICON_COUNT;i++){
+        dash_telltales_set_color(telltales, i, lv_color_hex(icon_colors[i]));
+    }
+    dash_bench_set_telltales(telltales, 1u << ICON_LEFT_TURN, 1u << ICON_RIGHT_TURN);
+
+    dash_timeline_t *startup = dash_timeline_create("startup", startup_tracks,
+                                                     sizeof(startup_tracks) / sizeof(startup_tracks[0]),
+                                                     NULL);
+    dash_bench_set_startup(startup);
+
+    /* The DAQ posts its values, they are applied at the rate of their class */
+    dash_sched_t *sched = dash_sched_create(lv_display_get_default());
+    dash_sched_add(sched, "telltales", DASH_SCHED_SAFETY, telltales_apply_cb, NULL);
+    dash_sched_add(sched, "rpm", DASH_SCHED_FRAME, rpm_apply_cb, NULL);
+    dash_sched_add(sched, "temp", DASH_SCHED_2HZ, temp_apply_cb, NULL);
+    dash_sched_add(sched, "fuel", DASH_SCHED_2HZ, fuel_apply_cb, NULL);
+    dash_bench_set_sched(sched);
+
+    for(int i=1;i<driver_backends_get_display_count();i++)
+        create_info_screen(driver_backends_get_display(i));
+
+    /* Most benchmarks run on the idle dashboard */
+    if(!dash_bench_start(DASH_BG_SRC))
+        dash_timeline_start(startup, lv_display_get_default());
 
-    lv_timer_create(dash_timer_cb, TIMER_PERIOD_MS, NULL);
+    rt_profile_apply();
     driver_backends_run_loop();
     return 0;
 }
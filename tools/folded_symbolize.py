@@ -0,0 +1,151 @@
+#!/usr/bin/env python3
+"""
+Symbolize a folded stack file written with LV_PROFILE_FOLDED
+
+The profiler names the functions that have a dynamic symbol, the other
+frames are written as <object path>+0x<offset>. They are resolved with
+addr2line, which needs the debug information of the objects, and the
+stacks that become identical are merged. The result is the input of
+flamegraph.pl or of speedscope.
+
+usage: folded_symbolize.py profile.folded > profile.sym.folded
+"""
+
+import argparse
+import re
+import struct
+import subprocess
+import sys
+from collections import OrderedDict, defaultdict
+
+FRAME_RE = re.compile(r"^(/.+)\+0x([0-9a-f]+)$")
+
+PT_LOAD = 1
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description="Symbolize a folded stack file")
+    parser.add_argument("folded", help="folded stack file of the profiler")
+    parser.add_argument("-o", "--output", help="output file, stdout by default")
+    parser.add_argument("--addr2line", default="addr2line", help="addr2line of the target toolchain")
+    return parser.parse_args()
+
+
+# ------------------------------------------------------------
+# ELF
+# ------------------------------------------------------------
+
+def load_base(path):
+    """Lowest page of the PT_LOAD segments, the offsets are relative to it."""
+    try:
+        with open(path, "rb") as f:
+            ident = f.read(64)
+            if ident[:4] != b"\x7fELF":
+                return None
+            endian = "<" if ident[5] == 1 else ">"
+            if ident[4] == 2:
+                phoff, = struct.unpack(endian + "Q", ident[32:40])
+                phentsize, phnum = struct.unpack(endian + "HH", ident[54:58])
+                fmt, vaddr_at = endian + "IIQQQ", 16
+            else:
+                phoff, = struct.unpack(endian + "I", ident[28:32])
+                phentsize, phnum = struct.unpack(endian + "HH", ident[42:46])
+                fmt, vaddr_at = endian + "IIII", 8
+
+            base = None
+            for i in range(phnum):
+                f.seek(phoff + i * phentsize)
+                entry = f.read(struct.calcsize(fmt))
+                p_type = struct.unpack(endian + "I", entry[:4])[0]
+                vaddr, = struct.unpack(endian + ("Q" if ident[4] == 2 else "I"),
+                                       entry[vaddr_at:vaddr_at + (8 if ident[4] == 2 else 4)])
+                if p_type == PT_LOAD and (base is None or vaddr < base):
+                    base = vaddr
+    except OSError:
+        return None
+
+    return base & ~0xfff if base is not None else None
+
+
+def resolve(addr2line, path, offsets):
+    """{offset: function name} of the offsets addr2line knows."""
+    base = load_base(path)
+    if base is None:
+        return {}
+
+    offsets = sorted(offsets)
+    query = "\n".join("0x%x" % (base + off) for off in offsets) + "\n"
+    try:
+        out = subprocess.run([addr2line, "-f", "-C", "-e", path], input=query,
+                             capture_output=True, text=True, check=True).stdout.splitlines()
+    except (OSError, subprocess.CalledProcessError) as e:
+        print("%s: %s" % (path, e), file=sys.stderr)
+        return {}
+
+    # Two lines per address, the function then file:line
+    names = {}
+    for off, name in zip(offsets, out[0::2]):
+        if name and name != "??":
+            names[off] = name.replace(";", ":").replace(" ", "_")
+    return names
+
+
+# ------------------------------------------------------------
+# Main
+# ------------------------------------------------------------
+
+def main():
+    args = parse_args()
+
+    stacks = []
+    wanted = defaultdict(set)
+    try:
+        with open(args.folded) as f:
+            for lineno, line in enumerate(f, 1):
+                line = line.rstrip("\n")
+                if not line:
+                    continue
+                stack, _, count = line.rpartition(" ")
+                if not stack or not count.isdigit():
+                    sys.exit("%s:%d: invalid line" % (args.folded, lineno))
+                frames = stack.split(";")
+                stacks.append((frames, int(count)))
+                for frame in frames:
+                    m = FRAME_RE.match(frame)
+                    if m:
+                        wanted[m.group(1)].add(int(m.group(2), 16))
+    except OSError as e:
+        sys.exit("Unable to read %s: %s" % (args.folded, e))
+
+    names = {path: resolve(args.addr2line, path, offsets) for path, offsets in wanted.items()}
+
+    merged = OrderedDict()
+    resolved = 0
+    unresolved = 0
+    for frames, count in stacks:
+        out = []
+        for frame in frames:
+            m = FRAME_RE.match(frame)
+            if m:
+                name = names[m.group(1)].get(int(m.group(2), 16))
+                if name is not None:
+                    resolved += 1
+                    frame = name
+                else:
+                    unresolved += 1
+            out.append(frame)
+        key = ";".join(out)
+        merged[key] = merged.get(key, 0) + count
+
+    output = open(args.output, "w") if args.output else sys.stdout
+    with output:
+        for stack in sorted(merged):
+            output.write("%s %d\n" % (stack, merged[stack]))
+
+    print("%d frames resolved, %d left as offsets, %d stacks" % (resolved, unresolved, len(merged)),
+          file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,138 @@
+#!/usr/bin/env python3
+"""
+Report the footprint of the fonts linked in a binary
+
+Sums the size of the data symbols defined by every font translation unit
+(lv_font_*.c, font_*.c) and prints the section sizes of the binary. With
+a second binary, e.g. built with -DFONT_SUBSET=ON, prints the difference.
+
+usage: font_report.py build/bin/lvglsim [build_subset/bin/lvglsim]
+
+The binaries must not be stripped.
+"""
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+
+
+# ------------------------------------------------------------
+# CONFIG (editable)
+# ------------------------------------------------------------
+
+FONT_FILE_RE = re.compile(r"(^|/)(lv_)?font_[\w]+\.c$")
+FONT_GLOBAL_RE = re.compile(r"^(lv_)?font_\w+$")
+SECTIONS = (".text", ".rodata", ".data", ".bss")
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description="Report the font footprint of binaries")
+    parser.add_argument("binary", help="binary to measure")
+    parser.add_argument("compare", nargs="?", help="binary to compare with")
+    return parser.parse_args()
+
+
+# ------------------------------------------------------------
+# ELF parsing
+# ------------------------------------------------------------
+
+def run(cmd):
+    try:
+        return subprocess.run(cmd, check=True, capture_output=True, text=True).stdout
+    except (OSError, subprocess.CalledProcessError) as e:
+        sys.exit("%s failed: %s" % (cmd[0], e))
+
+
+def font_symbols(binary):
+    """Size of the objects of each font, keyed by font source file."""
+    fonts = {}
+    current = None
+
+    # Local symbols follow the FILE symbol of their translation unit
+    for line in run(["readelf", "-sW", binary]).splitlines():
+        cols = line.split()
+        if len(cols) < 8 or not cols[0].rstrip(":").isdigit():
+            continue
+
+        size, sym_type, bind, name = cols[2], cols[3], cols[4], cols[7]
+
+        if sym_type == "FILE":
+            current = os.path.basename(name) if FONT_FILE_RE.search(name) else None
+            continue
+
+        if sym_type != "OBJECT":
+            continue
+
+        size = int(size, 0)
+
+        if bind == "LOCAL" and current is not None:
+            fonts[current] = fonts.get(current, 0) + size
+        elif bind == "GLOBAL" and FONT_GLOBAL_RE.match(name):
+            key = name + ".c"
+            fonts[key] = fonts.get(key, 0) + size
+
+    return fonts
+
+
+def section_sizes(binary):
+    sizes = {}
+    for line in run(["size", "-A", binary]).splitlines():
+        cols = line.split()
+        if len(cols) >= 2 and cols[0] in SECTIONS:
+            sizes[cols[0]] = int(cols[1])
+    return sizes
+
+
+def measure(binary):
+    return {
+        "fonts": font_symbols(binary),
+        "sections": section_sizes(binary),
+        "file": os.path.getsize(binary),
+    }
+
+
+# ------------------------------------------------------------
+# Report
+# ------------------------------------------------------------
+
+def print_report(name, m):
+    print("%s: %d bytes" % (name, m["file"]))
+    for font in sorted(m["fonts"]):
+        print("  %-32s %8d" % (font, m["fonts"][font]))
+    print("  %-32s %8d" % ("fonts total", sum(m["fonts"].values())))
+    for sec in SECTIONS:
+        print("  %-32s %8d" % (sec, m["sections"].get(sec, 0)))
+
+
+def print_diff(a, b):
+    fa = sum(a["fonts"].values())
+    fb = sum(b["fonts"].values())
+    ra = a["sections"].get(".rodata", 0)
+    rb = b["sections"].get(".rodata", 0)
+
+    print("difference:")
+    print("  %-32s %+8d" % ("fonts", fb - fa))
+    print("  %-32s %+8d" % (".rodata", rb - ra))
+    print("  %-32s %+8d" % ("file", b["file"] - a["file"]))
+
+
+# ------------------------------------------------------------
+# MAIN
+# ------------------------------------------------------------
+
+def main():
+    args = parse_args()
+
+    a = measure(args.binary)
+    print_report(args.binary, a)
+
+    if args.compare:
+        b = measure(args.compare)
+        print_report(args.compare, b)
+        print_diff(a, b)
+
+
+if __name__ == "__main__":
+    main()
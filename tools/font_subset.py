@@ -0,0 +1,251 @@
+#!/usr/bin/env python3
+"""
+Generate subsets of the fonts drawn by the application
+
+The fonts and their charsets are declared in assets/fonts/subset.json.
+A font with "scan" keeps the characters of the string literals passed to
+the lv_*_set_text*() / lv_*_add_text*() calls of the application and the
+LV_SYMBOL_* it uses, e.g. LV_FONT_DEFAULT which draws the labels. The
+"chars" of a font are added for the text built at run time.
+
+A font without "font" is generated from the Montserrat of LVGL under the
+name of the LVGL built-in font (lv_font_montserrat_<size>), which is
+disabled by the FONT_SUBSET CMake option. A font with "font" is generated
+from that file, or copied from its "fallback" source when the file is
+not there.
+
+Requires lv_font_conv (npm i -g lv_font_conv).
+"""
+
+import argparse
+import json
+import os
+import re
+import shutil
+import subprocess
+import sys
+
+
+# ------------------------------------------------------------
+# CONFIG (editable)
+# ------------------------------------------------------------
+
+# Same options as lvgl/scripts/built_in_font/built_in_font_gen.py
+FONT_BPP = 4
+FULL_RANGE = "32-127,176,8226"
+
+SOURCE_EXTENSIONS = (".c", ".h")
+
+# Generated sources hold no UI strings
+SKIP_DIRS = ("assets",)
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description="Generate subsets of the fonts drawn")
+    parser.add_argument("--fonts", required=True, nargs="+",
+                        help="fonts to generate, declared in the config, e.g. lv_font_montserrat_14")
+    parser.add_argument("--lvgl", default="lvgl",
+                        help="path of the LVGL sources")
+    parser.add_argument("--config", default="assets/fonts/subset.json",
+                        help="declared charsets per font")
+    parser.add_argument("--scan", nargs="*", default=["src"],
+                        help="directories scanned for the text set on widgets")
+    parser.add_argument("--output", required=True,
+                        help="directory of the generated sources")
+    return parser.parse_args()
+
+
+# ------------------------------------------------------------
+# Character collection
+# ------------------------------------------------------------
+
+TEXT_CALL_RE = re.compile(r"\blv_\w*_(?:set|add|ins)_\w*text\w*\s*\(([^;]*)\)\s*;", re.DOTALL)
+STRING_RE = re.compile(r'"((?:[^"\\\n]|\\.)*)"')
+SYMBOL_USE_RE = re.compile(r"\b(LV_SYMBOL_[A-Z0-9_]+)\b")
+SYMBOL_DEF_RE = re.compile(r'#define\s+(LV_SYMBOL_[A-Z0-9_]+)\s+"((?:\\x[0-9A-Fa-f]{2})+)"')
+INCLUDE_RE = re.compile(r"^\s*#\s*include\b.*$", re.MULTILINE)
+
+
+def unescape_c(literal):
+    """Decode a C string literal body to text, UTF-8 escapes included."""
+    out = bytearray()
+    i = 0
+    simple = {"n": 10, "t": 9, "r": 13, "0": 0, "\\": 92, '"': 34, "'": 39}
+
+    while i < len(literal):
+        c = literal[i]
+        if c != "\\":
+            out += c.encode("utf-8")
+            i += 1
+            continue
+
+        nxt = literal[i + 1] if i + 1 < len(literal) else ""
+        if nxt == "x":
+            m = re.match(r"[0-9A-Fa-f]{1,2}", literal[i + 2:])
+            out.append(int(m.group(0), 16) if m else 0)
+            i += 2 + (len(m.group(0)) if m else 0)
+        elif nxt in simple:
+            out.append(simple[nxt])
+            i += 2
+        else:
+            i += 2
+
+    return out.decode("utf-8", errors="ignore")
+
+
+def scan_sources(dirs):
+    """Characters of the text set on widgets and LV_SYMBOL_* names used by the sources."""
+    chars = set()
+    symbols = set()
+
+    for d in dirs:
+        for root, subdirs, files in os.walk(d):
+            subdirs[:] = [s for s in subdirs if s not in SKIP_DIRS]
+            for name in files:
+                if not name.endswith(SOURCE_EXTENSIONS):
+                    continue
+                with open(os.path.join(root, name), encoding="utf-8", errors="ignore") as f:
+                    text = INCLUDE_RE.sub("", f.read())
+
+                for call_args in TEXT_CALL_RE.findall(text):
+                    for literal in STRING_RE.findall(call_args):
+                        # Format strings may print any digit or sign
+                        if "%" in literal:
+                            chars.update("0123456789-+.")
+                            literal = re.sub(r"%[-+ #0-9.]*[a-zA-Z]+", "", literal)
+                        chars.update(ch for ch in unescape_c(literal) if ch.isprintable())
+
+                symbols.update(SYMBOL_USE_RE.findall(text))
+
+    return chars, symbols
+
+
+def symbol_code_points(lvgl_dir, names):
+    """Code points of the LV_SYMBOL_* macros, parsed from lv_symbol_def.h."""
+    path = os.path.join(lvgl_dir, "src", "font", "lv_symbol_def.h")
+    defs = {}
+
+    with open(path, encoding="utf-8") as f:
+        for name, value in SYMBOL_DEF_RE.findall(f.read()):
+            defs[name] = ord(unescape_c(value))
+
+    return sorted(defs[n] for n in names if n in defs)
+
+
+def load_config(path):
+    if not os.path.exists(path):
+        return {}
+    with open(path, encoding="utf-8") as f:
+        return json.load(f)
+
+
+# ------------------------------------------------------------
+# Generation
+# ------------------------------------------------------------
+
+def find_font_conv():
+    exe = shutil.which("lv_font_conv")
+    if exe:
+        return [exe]
+    if shutil.which("npx"):
+        return ["npx", "--yes", "lv_font_conv"]
+    sys.exit("lv_font_conv not found, install it with: npm i -g lv_font_conv")
+
+
+def generate_font(conv, lvgl_dir, name, decl, chars, symbols, out_path):
+    builtin = os.path.join(lvgl_dir, "scripts", "built_in_font")
+    font = decl.get("font", os.path.join(builtin, "Montserrat-Medium.ttf"))
+
+    cmd = conv + [
+        "--bpp", str(decl.get("bpp", FONT_BPP)), "--size", str(decl["size"]), "--no-compress",
+        "--font", font, "--range", ",".join(str(ord(c)) for c in sorted(chars)),
+    ]
+
+    if symbols:
+        cmd += ["--font", os.path.join(builtin, "FontAwesome5-Solid+Brands+Regular.woff"),
+                "--range", ",".join(str(s) for s in symbols)]
+
+    cmd += decl.get("options", [])
+    cmd += ["--format", "lvgl", "--force-fast-kern-format",
+            "--lv-include", "lvgl/lvgl.h", "--lv-font-name", name, "-o", out_path]
+
+    subprocess.run(cmd, check=True, stdout=subprocess.DEVNULL)
+
+
+def write_header(path, names):
+    lines = [
+        "/* Generated by tools/font_subset.py, do not edit */",
+        "",
+        "#ifndef FONT_SUBSET_H",
+        "#define FONT_SUBSET_H",
+        "",
+        '#include "lvgl/lvgl.h"',
+        "",
+    ]
+    lines += ["LV_FONT_DECLARE(%s);" % n for n in names]
+    lines += ["", "#endif /*FONT_SUBSET_H*/", ""]
+
+    with open(path, "w", encoding="utf-8") as f:
+        f.write("\n".join(lines))
+
+
+def full_glyph_count():
+    count = 0
+    for part in FULL_RANGE.split(","):
+        lo, _, hi = part.partition("-")
+        count += int(hi or lo) - int(lo) + 1
+    return count
+
+
+# ------------------------------------------------------------
+# MAIN
+# ------------------------------------------------------------
+
+def main():
+    args = parse_args()
+    config = load_config(args.config)
+    conv = None
+
+    scanned, symbol_names = scan_sources(args.scan)
+    symbols = symbol_code_points(args.lvgl, symbol_names)
+
+    os.makedirs(args.output, exist_ok=True)
+
+    for name in args.fonts:
+        decl = config.get("fonts", {}).get(name)
+        if decl is None:
+            sys.exit("%s is not declared in %s" % (name, args.config))
+
+        out_path = os.path.join(args.output, name + ".c")
+
+        if "font" in decl and not os.path.exists(decl["font"]):
+            if "fallback" not in decl:
+                sys.exit("%s: %s not found" % (name, decl["font"]))
+            shutil.copyfile(decl["fallback"], out_path)
+            print("%s: %s not found, using %s" % (name, decl["font"], decl["fallback"]))
+            continue
+
+        chars = set(config.get("common", "")) | set(decl.get("chars", ""))
+        font_symbols = []
+        if decl.get("scan", False):
+            chars |= scanned
+            font_symbols = symbols
+
+            # Keep the space so that the line height and word wrapping still work
+            chars.add(" ")
+
+        if conv is None:
+            conv = find_font_conv()
+        generate_font(conv, args.lvgl, name, decl, chars, font_symbols, out_path)
+
+        if "font" in decl:
+            print("%s: %d glyphs" % (name, len(chars)))
+        else:
+            print("%s: %d glyphs + %d symbols (built-in: %d glyphs + 60 symbols)"
+                  % (name, len(chars), len(font_symbols), full_glyph_count()))
+
+    write_header(os.path.join(args.output, "font_subset.h"), args.fonts)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+"""
+Compare two golden frame logs written with LV_GOLDEN_LOG
+
+Reports the first frame whose flushed areas or screen hash differ, with
+the first differing area, and the number of differing frames. Exits with
+1 when the logs differ, 0 when they match.
+
+usage: golden_compare.py reference.log candidate.log
+"""
+
+import argparse
+import sys
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description="Compare two golden frame logs")
+    parser.add_argument("reference", help="log of the reference build")
+    parser.add_argument("candidate", help="log of the build to check")
+    parser.add_argument("-a", "--all", action="store_true", help="list every differing frame")
+    return parser.parse_args()
+
+
+# ------------------------------------------------------------
+# Log parsing
+# ------------------------------------------------------------
+
+def read_log(path):
+    """Header and {(frame, kind): [entries]}, kind is "areas" or "screen"."""
+    header = None
+    frames = {}
+
+    try:
+        f = open(path)
+    except OSError as e:
+        sys.exit("Unable to read %s: %s" % (path, e))
+
+    with f:
+        for lineno, line in enumerate(f, 1):
+            line = line.strip()
+            if not line:
+                continue
+            if line.startswith("#"):
+                header = header or line[1:].strip()
+                continue
+
+            cols = line.split()
+            try:
+                frame = int(cols[0])
+            except ValueError:
+                sys.exit("%s:%d: invalid line" % (path, lineno))
+
+            if cols[1].startswith("screen:"):
+                frames[(frame, "screen")] = [cols[1]]
+            else:
+                frames[(frame, "areas")] = cols[1:]
+
+    if header is None or not header.startswith("lvgl-golden "):
+        sys.exit("%s is not a golden frame log" % path)
+
+    return header, frames
+
+
+def describe(entry):
+    if entry is None:
+        return "nothing"
+    if entry.startswith("screen:"):
+        return "screen hash %s" % entry[7:]
+    area, crc = entry.split(":")
+    x, y, w, h = area.split(",")
+    return "area %sx%s at %s,%s hash %s" % (w, h, x, y, crc)
+
+
+def first_difference(ref, cand):
+    """Index and description of the first differing entry of a frame."""
+    for i in range(max(len(ref), len(cand))):
+        r = ref[i] if i < len(ref) else None
+        c = cand[i] if i < len(cand) else None
+        if r != c:
+            return i, "%s, expected %s" % (describe(c), describe(r))
+    return None
+
+
+# ------------------------------------------------------------
+# Main
+# ------------------------------------------------------------
+
+def main():
+    args = parse_args()
+    ref_header, ref = read_log(args.reference)
+    cand_header, cand = read_log(args.candidate)
+
+    if ref_header != cand_header:
+        print("Headers differ, the runs are not comparable:")
+        print("  reference: %s" % ref_header)
+        print("  candidate: %s" % cand_header)
+        return 1
+
+    # A frame that flushed nothing has no line
+    keys = sorted(set(ref) | set(cand), key=lambda k: (k[0], k[1] == "screen"))
+    diffs = []
+    for key in keys:
+        d = first_difference(ref.get(key, []), cand.get(key, []))
+        if d is not None:
+            diffs.append((key, d))
+
+    last_ref = max((k[0] for k in ref), default=-1)
+    last_cand = max((k[0] for k in cand), default=-1)
+    print("%d frames in the reference, %d in the candidate" % (last_ref + 1, last_cand + 1))
+
+    if not diffs:
+        print("All the frames match")
+        return 0
+
+    for (frame, kind), (index, text) in diffs if args.all else diffs[:1]:
+        if kind == "screen":
+            print("Frame %d: %s" % (frame, text))
+        else:
+            print("Frame %d, area %d: %s" % (frame, index, text))
+
+    screens = sum(1 for (_, kind), _ in diffs if kind == "screen")
+    print("%d frames with differing areas, %d differing screen hashes" % (len(diffs) - screens, screens))
+    return 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,486 @@
+/**
+ * @file mirror_viewer.c
+ *
+ * Viewer of the frames mirrored by the simulator
+ *
+ * Connects to a simulator started with LV_MIRROR, applies the rectangles
+ * of every message to a copy of the screen and shows it in an SDL window.
+ * Once per second it prints the messages received, the bandwidth and the
+ * decoding time. Built without SDL, or with -n, it only decodes and
+ * prints, -o writes the last frame as a PPM file on exit.
+ *
+ * usage: mirror_viewer [-n] [-d duration_s] [-o frame.ppm] [unix:<path>|tcp:<port>]
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#ifndef MIRROR_VIEWER_SDL
+#define MIRROR_VIEWER_SDL 0
+#endif
+
+#if MIRROR_VIEWER_SDL
+#include <SDL2/SDL.h>
+#endif
+
+#include "lz_codec.h"
+#include "frame_mirror_proto.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define MAX_RES 4096
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+typedef struct {
+    uint16_t *screen;
+    uint8_t *data;
+    size_t data_cap;
+    uint32_t width;
+    uint32_t height;
+    uint32_t last_frame;
+    bool started;
+
+    /* Statistics of the current second */
+    uint32_t messages;
+    uint32_t key_frames;
+    uint32_t lost;                  /* Gaps in the frame numbers, the deltas merged by the simulator */
+    uint64_t bytes;
+    uint64_t decode_ns;
+} viewer_t;
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static int connect_mirror(const char *addr);
+static bool read_full(int fd, void *buf, size_t len);
+static bool read_message(int fd, viewer_t *v);
+static bool apply_rect(viewer_t *v, const uint8_t *hdr, const uint8_t *data);
+static void write_ppm(const viewer_t *v, const char *path);
+static uint16_t get16(const uint8_t *p);
+static uint32_t get32(const uint8_t *p);
+static uint64_t time_ns(void);
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+int main(int argc, char **argv)
+{
+    const char *addr = "unix:" FRAME_MIRROR_DEFAULT_PATH;
+    const char *ppm_path = NULL;
+    viewer_t v;
+    bool headless = !MIRROR_VIEWER_SDL;
+    long duration = 0;
+    uint64_t start;
+    uint64_t report;
+    uint64_t now;
+    int opt;
+    int fd;
+#if MIRROR_VIEWER_SDL
+    SDL_Window *window = NULL;
+    SDL_Renderer *renderer = NULL;
+    SDL_Texture *texture = NULL;
+    SDL_Event event;
+    bool quit = false;
+#endif
+
+    while ((opt = getopt(argc, argv, "nd:o:")) != -1) {
+        switch (opt) {
+        case 'n':
+            headless = true;
+            break;
+        case 'd':
+            duration = strtol(optarg, NULL, 10);
+            break;
+        case 'o':
+            ppm_path = optarg;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n] [-d duration_s] [-o frame.ppm] [unix:<path>|tcp:<port>]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (optind < argc) {
+        addr = argv[optind];
+    }
+
+    fd = connect_mirror(addr);
+    if (fd < 0) {
+        return EXIT_FAILURE;
+    }
+
+    if (headless) {
+        fprintf(stdout, "Decoding %s without a window\n", addr);
+    }
+
+    memset(&v, 0, sizeof(v));
+    start = time_ns();
+    report = start;
+
+    while (read_message(fd, &v)) {
+#if MIRROR_VIEWER_SDL
+        if (!headless) {
+            if (window == NULL) {
+                SDL_Init(SDL_INIT_VIDEO);
+                window = SDL_CreateWindow("LVGL mirror", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+                                          (int)v.width, (int)v.height, 0);
+                renderer = SDL_CreateRenderer(window, -1, 0);
+                texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGB565, SDL_TEXTUREACCESS_STREAMING,
+                                            (int)v.width, (int)v.height);
+            }
+
+            while (SDL_PollEvent(&event)) {
+                quit |= event.type == SDL_QUIT;
+            }
+            if (quit) {
+                break;
+            }
+
+            SDL_UpdateTexture(texture, NULL, v.screen, (int)v.width * 2);
+            SDL_RenderCopy(renderer, texture, NULL, NULL);
+            SDL_RenderPresent(renderer);
+        }
+#endif
+
+        now = time_ns();
+        if (now - report >= 1000000000ULL) {
+            fprintf(stdout, "%ux%u, %u messages, %u key frames, %u frames merged, %llu kB/s, decode %llu us/message\n",
+                    v.width, v.height, v.messages, v.key_frames, v.lost,
+                    (unsigned long long)(v.bytes * 1000000ULL / (now - report)),
+                    (unsigned long long)(v.messages ? v.decode_ns / v.messages / 1000 : 0));
+            v.messages = 0;
+            v.key_frames = 0;
+            v.lost = 0;
+            v.bytes = 0;
+            v.decode_ns = 0;
+            report = now;
+        }
+
+        if (duration > 0 && now - start >= (uint64_t)duration * 1000000000ULL) {
+            break;
+        }
+    }
+
+#if MIRROR_VIEWER_SDL
+    if (window != NULL) {
+        SDL_DestroyTexture(texture);
+        SDL_DestroyRenderer(renderer);
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+    }
+#endif
+
+    if (ppm_path != NULL && v.screen != NULL) {
+        write_ppm(&v, ppm_path);
+    }
+
+    close(fd);
+    free(v.screen);
+    free(v.data);
+    return EXIT_SUCCESS;
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+/**
+ * Connect to the simulator
+ *
+ * @param addr "unix:<path>" or "tcp:<port>" on the loopback
+ * @return the socket or -1 on error
+ */
+static int connect_mirror(const char *addr)
+{
+    struct sockaddr_un sun;
+    struct sockaddr_in sin;
+    int fd = -1;
+    int ret = -1;
+
+    if (strncmp(addr, "unix:", 5) == 0) {
+        memset(&sun, 0, sizeof(sun));
+        sun.sun_family = AF_UNIX;
+        snprintf(sun.sun_path, sizeof(sun.sun_path), "%s", addr + 5);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0) {
+            ret = connect(fd, (struct sockaddr *)&sun, sizeof(sun));
+        }
+    } else if (strncmp(addr, "tcp:", 4) == 0) {
+        memset(&sin, 0, sizeof(sin));
+        sin.sin_family = AF_INET;
+        sin.sin_port = htons((uint16_t)atoi(addr + 4));
+        sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd >= 0) {
+            ret = connect(fd, (struct sockaddr *)&sin, sizeof(sin));
+        }
+    } else {
+        fprintf(stderr, "The address must be unix:<path> or tcp:<port>\n");
+        return -1;
+    }
+
+    if (ret < 0) {
+        fprintf(stderr, "Unable to connect to %s: %s\n", addr, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+
+    return fd;
+}
+
+/**
+ * Read exactly a number of bytes
+ *
+ * @param fd the socket
+ * @param buf the destination
+ * @param len the number of bytes
+ * @return false on error or when the simulator closed the connection
+ */
+static bool read_full(int fd, void *buf, size_t len)
+{
+    uint8_t *p = buf;
+    ssize_t ret;
+
+    while (len > 0) {
+        ret = read(fd, p, len);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            return false;
+        }
+        p += ret;
+        len -= (size_t)ret;
+    }
+
+    return true;
+}
+
+/**
+ * Read a message and apply its rectangles to the screen
+ *
+ * @param fd the socket
+ * @param v the viewer
+ * @return false on error or when the simulator closed the connection
+ */
+static bool read_message(int fd, viewer_t *v)
+{
+    uint8_t hdr[FRAME_MIRROR_FRAME_HEADER_SIZE];
+    uint8_t rect_hdr[FRAME_MIRROR_RECT_HEADER_SIZE];
+    uint32_t width;
+    uint32_t height;
+    uint32_t frame;
+    uint32_t count;
+    uint32_t size;
+    uint64_t start;
+    uint32_t i;
+
+    if (!read_full(fd, hdr, sizeof(hdr))) {
+        return false;
+    }
+
+    if (get32(hdr) != FRAME_MIRROR_MAGIC) {
+        fprintf(stderr, "Not a frame mirror message\n");
+        return false;
+    }
+
+    frame = get32(hdr + 4);
+    width = get16(hdr + 8);
+    height = get16(hdr + 10);
+    count = get16(hdr + 12);
+
+    if (width == 0 || height == 0 || width > MAX_RES || height > MAX_RES) {
+        fprintf(stderr, "Invalid resolution %ux%u\n", width, height);
+        return false;
+    }
+
+    if (width != v->width || height != v->height) {
+        free(v->screen);
+        free(v->data);
+        v->width = width;
+        v->height = height;
+        v->screen = calloc((size_t)width * height, sizeof(uint16_t));
+        v->data_cap = lz_compress_bound((size_t)width * height * 2);
+        v->data = malloc(v->data_cap);
+        if (v->screen == NULL || v->data == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            return false;
+        }
+    }
+
+    if (v->started && frame != v->last_frame + 1) {
+        v->lost += frame - v->last_frame - 1;
+    }
+    v->started = true;
+    v->last_frame = frame;
+    v->messages++;
+    v->key_frames += (get16(hdr + 14) & FRAME_MIRROR_KEY_FRAME) != 0;
+    v->bytes += sizeof(hdr);
+
+    for (i = 0; i < count; i++) {
+        if (!read_full(fd, rect_hdr, sizeof(rect_hdr))) {
+            return false;
+        }
+
+        size = get32(rect_hdr + 8) & ~FRAME_MIRROR_RAW;
+        if (size > v->data_cap) {
+            fprintf(stderr, "Invalid rectangle size %u\n", size);
+            return false;
+        }
+
+        if (!read_full(fd, v->data, size)) {
+            return false;
+        }
+
+        start = time_ns();
+        if (!apply_rect(v, rect_hdr, v->data)) {
+            return false;
+        }
+        v->decode_ns += time_ns() - start;
+        v->bytes += sizeof(rect_hdr) + size;
+    }
+
+    return true;
+}
+
+/**
+ * Decompress a rectangle into the screen
+ *
+ * @param v the viewer
+ * @param hdr the header of the rectangle
+ * @param data the data of the rectangle
+ * @return false if the rectangle is invalid
+ */
+static bool apply_rect(viewer_t *v, const uint8_t *hdr, const uint8_t *data)
+{
+    static uint8_t *pixels;
+    static size_t pixels_cap;
+    uint32_t x = get16(hdr);
+    uint32_t y = get16(hdr + 2);
+    uint32_t w = get16(hdr + 4);
+    uint32_t h = get16(hdr + 6);
+    uint32_t size = get32(hdr + 8);
+    size_t raw_len = (size_t)w * h * 2;
+    const uint8_t *src = data;
+    uint32_t row;
+
+    if (x + w > v->width || y + h > v->height) {
+        fprintf(stderr, "Rectangle %u,%u %ux%u out of the screen\n", x, y, w, h);
+        return false;
+    }
+
+    if (size & FRAME_MIRROR_RAW) {
+        if ((size & ~FRAME_MIRROR_RAW) != raw_len) {
+            fprintf(stderr, "Invalid raw rectangle\n");
+            return false;
+        }
+    } else {
+        if (pixels_cap < raw_len) {
+            free(pixels);
+            pixels = malloc(raw_len);
+            pixels_cap = pixels == NULL ? 0 : raw_len;
+            if (pixels == NULL) {
+                return false;
+            }
+        }
+        if (lz_decompress(data, size, pixels, raw_len) != (int32_t)raw_len) {
+            fprintf(stderr, "Corrupted rectangle\n");
+            return false;
+        }
+        src = pixels;
+    }
+
+    for (row = 0; row < h; row++) {
+        memcpy(v->screen + (size_t)(y + row) * v->width + x, src + (size_t)row * w * 2, (size_t)w * 2);
+    }
+
+    return true;
+}
+
+/**
+ * Write the screen as a binary PPM file
+ *
+ * @param v the viewer
+ * @param path the file to write
+ */
+static void write_ppm(const viewer_t *v, const char *path)
+{
+    FILE *f = fopen(path, "wb");
+    uint16_t px;
+    uint8_t rgb[3];
+    size_t i;
+
+    if (f == NULL) {
+        fprintf(stderr, "Unable to write %s: %s\n", path, strerror(errno));
+        return;
+    }
+
+    fprintf(f, "P6\n%u %u\n255\n", v->width, v->height);
+    for (i = 0; i < (size_t)v->width * v->height; i++) {
+        px = v->screen[i];
+        rgb[0] = (uint8_t)(((px >> 8) & 0xf8) | (px >> 13));
+        rgb[1] = (uint8_t)(((px >> 3) & 0xfc) | ((px >> 9) & 0x03));
+        rgb[2] = (uint8_t)(((px << 3) & 0xf8) | ((px >> 2) & 0x07));
+        fwrite(rgb, 1, sizeof(rgb), f);
+    }
+
+    fclose(f);
+}
+
+/**
+ * Read a little endian 16 bit field
+ *
+ * @param p the field
+ * @return the value
+ */
+static uint16_t get16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+/**
+ * Read a little endian 32 bit field
+ *
+ * @param p the field
+ * @return the value
+ */
+static uint32_t get32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/**
+ * Get the monotonic time
+ *
+ * @return the time in nanoseconds
+ */
+static uint64_t time_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+"""
+Generate the dashboard layout and sprites of a rotated panel
+
+The sprites listed in src/dash_layout.h are rotated and written under
+<output>/assets, their positions are mapped to the rotated screen and the
+layout is written to <output>/dash_layout_rotated.h. LVGL then renders in
+the orientation of the panel and the flush does not rotate anything.
+
+The rotation goes in the same direction as LV_DISPLAY_ROTATION_*, a build
+with DASH_ROTATION=90 shows the same image as LV_DASH_SW_ROTATION=90.
+
+Usage:
+    rotate_assets.py --rotation 90 --layout src/dash_layout.h --root . --output build/rot90
+"""
+
+import argparse
+import os
+import re
+import sys
+
+from PIL import Image
+
+SPRITE_RE = re.compile(r'\{"([^"]+)",\s*(-?\d+),\s*(-?\d+)\}')
+DEFINE_RE = r'(#define {}[ \t]+)(\S+)'
+
+# PIL rotates counter-clockwise like LV_DISPLAY_ROTATION_*
+TRANSPOSE = {
+    90: Image.Transpose.ROTATE_90,
+    180: Image.Transpose.ROTATE_180,
+    270: Image.Transpose.ROTATE_270,
+}
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description="Pre-rotate the dashboard sprites and layout")
+    parser.add_argument("--rotation", type=int, required=True, choices=sorted(TRANSPOSE))
+    parser.add_argument("--layout", required=True, help="landscape layout header")
+    parser.add_argument("--root", default=".", help="directory the sprite paths are relative to")
+    parser.add_argument("--output", required=True, help="output directory")
+    return parser.parse_args()
+
+
+def get_define(text, name):
+    m = re.search(DEFINE_RE.format(name), text)
+    if m is None:
+        sys.exit(f"{name} not found in the layout")
+    return m.group(2)
+
+
+def set_define(text, name, value):
+    return re.sub(DEFINE_RE.format(name), lambda m: m.group(1) + value, text, count=1)
+
+
+def rotate_rect(rotation, scr_w, scr_h, x, y, w, h):
+    """Top left corner of a w x h rectangle at x, y once the screen is rotated"""
+    if rotation == 90:
+        return y, scr_w - x - w
+    if rotation == 180:
+        return scr_w - x - w, scr_h - y - h
+    return scr_h - y - h, x
+
+
+def rotate_image(args, src, out_root):
+    """Rotate a sprite, return its new path and its size before the rotation"""
+    dst = os.path.join(out_root, src)
+    img = Image.open(os.path.join(args.root, src))
+    size = img.size
+
+    os.makedirs(os.path.dirname(dst), exist_ok=True)
+    img.transpose(TRANSPOSE[args.rotation]).save(dst)
+
+    return dst, size
+
+
+def main():
+    args = parse_args()
+    out_root = os.path.abspath(args.output)
+
+    with open(args.layout, encoding="utf-8") as f:
+        text = f.read()
+
+    scr_w = int(get_define(text, "DASH_LAYOUT_WIDTH"))
+    scr_h = int(get_define(text, "DASH_LAYOUT_HEIGHT"))
+    bg = get_define(text, "DASH_BG_SRC").strip('"')
+
+    def sprite(m):
+        src, x, y = m.group(1), int(m.group(2)), int(m.group(3))
+        dst, (w, h) = rotate_image(args, src, out_root)
+        x, y = rotate_rect(args.rotation, scr_w, scr_h, x, y, w, h)
+        return '{"%s", %d, %d}' % (dst, x, y)
+
+    text, count = SPRITE_RE.subn(sprite, text)
+
+    bg_dst, _ = rotate_image(args, bg, out_root)
+    text = set_define(text, "DASH_BG_SRC", '"%s"' % bg_dst)
+
+    if args.rotation != 180:
+        scr_w, scr_h = scr_h, scr_w
+    text = set_define(text, "DASH_LAYOUT_WIDTH", str(scr_w))
+    text = set_define(text, "DASH_LAYOUT_HEIGHT", str(scr_h))
+    text = set_define(text, "DASH_LAYOUT_ROTATION", str(args.rotation))
+    text = text.replace("@file dash_layout.h", "@file dash_layout_rotated.h\n *\n"
+                        " * Generated by tools/rotate_assets.py, do not edit", 1)
+
+    header = os.path.join(out_root, "dash_layout_rotated.h")
+    with open(header, "w", encoding="utf-8") as f:
+        f.write(text)
+
+    print(f"{count + 1} sprites rotated by {args.rotation} degrees, layout {scr_w}x{scr_h} in {header}")
+
+
+if __name__ == "__main__":
+    main()
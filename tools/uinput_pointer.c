@@ -0,0 +1,236 @@
+/**
+ * @file uinput_pointer.c
+ *
+ * Virtual mouse used to measure the input-to-flush latency
+ *
+ * Creates a relative pointer device through /dev/uinput and moves it
+ * around a circle at a fixed rate, with a click every second. Run the
+ * simulator with LV_LINUX_EVDEV_LATENCY_REPORT set to get the latency
+ * histogram, the device node to pass in LV_LINUX_EVDEV_POINTER_DEVICE
+ * is printed on startup.
+ *
+ * usage: uinput_pointer [-r rate_hz] [-d duration_s] [-w wait_s]
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/uinput.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define CIRCLE_STEPS 64
+#define CIRCLE_RADIUS 120
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static int setup_device(void);
+static void print_event_node(int fd);
+static void emit(int fd, int type, int code, int value);
+static void sleep_until(struct timespec *deadline, long period_ns);
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+int main(int argc, char **argv)
+{
+    struct timespec deadline;
+    long rate = 125;
+    long duration = 10;
+    long wait = 3;
+    long period_ns;
+    long frames;
+    long i;
+    double a0;
+    double a1;
+    int opt;
+    int fd;
+
+    while ((opt = getopt(argc, argv, "r:d:w:")) != -1) {
+        switch (opt) {
+        case 'r':
+            rate = strtol(optarg, NULL, 10);
+            break;
+        case 'd':
+            duration = strtol(optarg, NULL, 10);
+            break;
+        case 'w':
+            wait = strtol(optarg, NULL, 10);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-r rate_hz] [-d duration_s] [-w wait_s]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (rate <= 0 || rate > 1000 || duration <= 0) {
+        fprintf(stderr, "Invalid rate or duration\n");
+        return EXIT_FAILURE;
+    }
+
+    fd = setup_device();
+    if (fd < 0) {
+        return EXIT_FAILURE;
+    }
+
+    print_event_node(fd);
+
+    /* Leave time to start the application on the new device */
+    fprintf(stdout, "Starting in %ld s\n", wait);
+    sleep((unsigned int)wait);
+
+    period_ns = 1000000000L / rate;
+    frames = rate * duration;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+    for (i = 0; i < frames; i++) {
+        a0 = 2.0 * M_PI * (double)(i % CIRCLE_STEPS) / CIRCLE_STEPS;
+        a1 = 2.0 * M_PI * (double)((i + 1) % CIRCLE_STEPS) / CIRCLE_STEPS;
+
+        emit(fd, EV_REL, REL_X, (int)lround(CIRCLE_RADIUS * (cos(a1) - cos(a0))));
+        emit(fd, EV_REL, REL_Y, (int)lround(CIRCLE_RADIUS * (sin(a1) - sin(a0))));
+
+        if (i % rate == 0) {
+            emit(fd, EV_KEY, BTN_LEFT, 1);
+        } else if (i % rate == 1) {
+            emit(fd, EV_KEY, BTN_LEFT, 0);
+        }
+
+        emit(fd, EV_SYN, SYN_REPORT, 0);
+        sleep_until(&deadline, period_ns);
+    }
+
+    fprintf(stdout, "Sent %ld reports at %ld Hz\n", frames, rate);
+
+    ioctl(fd, UI_DEV_DESTROY);
+    close(fd);
+    return EXIT_SUCCESS;
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+/**
+ * Create the virtual mouse
+ *
+ * @return the uinput file descriptor or -1 on error
+ */
+static int setup_device(void)
+{
+    struct uinput_setup setup;
+    int fd;
+
+    fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
+    if (fd < 0) {
+        fprintf(stderr, "Unable to open /dev/uinput: %s\n", strerror(errno));
+        return -1;
+    }
+
+    ioctl(fd, UI_SET_EVBIT, EV_KEY);
+    ioctl(fd, UI_SET_KEYBIT, BTN_LEFT);
+    ioctl(fd, UI_SET_EVBIT, EV_REL);
+    ioctl(fd, UI_SET_RELBIT, REL_X);
+    ioctl(fd, UI_SET_RELBIT, REL_Y);
+
+    memset(&setup, 0, sizeof(setup));
+    setup.id.bustype = BUS_VIRTUAL;
+    setup.id.vendor = 0x1209;
+    setup.id.product = 0x4c56;
+    strncpy(setup.name, "LVGL latency pointer", UINPUT_MAX_NAME_SIZE - 1);
+
+    if (ioctl(fd, UI_DEV_SETUP, &setup) < 0 || ioctl(fd, UI_DEV_CREATE) < 0) {
+        fprintf(stderr, "Unable to create the uinput device: %s\n", strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/**
+ * Print the /dev/input node of the virtual mouse
+ *
+ * @param fd the uinput file descriptor
+ */
+static void print_event_node(int fd)
+{
+    char sysname[64];
+    char path[128];
+    struct dirent *entry;
+    DIR *dir;
+
+    if (ioctl(fd, UI_GET_SYSNAME(sizeof(sysname)), sysname) < 0) {
+        return;
+    }
+
+    snprintf(path, sizeof(path), "/sys/devices/virtual/input/%s", sysname);
+    dir = opendir(path);
+    if (dir == NULL) {
+        return;
+    }
+
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "event", 5) == 0) {
+            fprintf(stdout, "LV_LINUX_EVDEV_POINTER_DEVICE=/dev/input/%s\n", entry->d_name);
+        }
+    }
+
+    closedir(dir);
+}
+
+/**
+ * Write an input event
+ *
+ * @param fd the uinput file descriptor
+ * @param type the event type
+ * @param code the event code
+ * @param value the event value
+ */
+static void emit(int fd, int type, int code, int value)
+{
+    struct input_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.type = type;
+    ev.code = code;
+    ev.value = value;
+
+    if (write(fd, &ev, sizeof(ev)) != sizeof(ev)) {
+        fprintf(stderr, "Failed to write event: %s\n", strerror(errno));
+    }
+}
+
+/**
+ * Sleep until the next period without accumulating drift
+ *
+ * @param deadline the previous deadline, updated in place
+ * @param period_ns the period in nanoseconds
+ */
+static void sleep_until(struct timespec *deadline, long period_ns)
+{
+    deadline->tv_nsec += period_ns;
+    while (deadline->tv_nsec >= 1000000000L) {
+        deadline->tv_nsec -= 1000000000L;
+        deadline->tv_sec++;
+    }
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, deadline, NULL) == EINTR) {
+    }
+}